@@ -0,0 +1,138 @@
+/*
+ * Compare the file and SQLite note backends through the notes.h API at
+ * 1k/10k/100k notes. Each run gets a fresh tmpdir that is removed afterwards.
+ *
+ *   make bench-backends
+ */
+#include "notes.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+
+#define SAMPLE_OPS 1000
+
+static const gint SIZES[] = {1000, 10000, 100000};
+
+static const gchar *const WORDS[] = {
+    "note",  "todo",   "meeting", "idea",  "- item", "**bold**", "`code`",
+    "link",  "draft",  "review",  "later", "# Title", "and",     "the",
+    "fix",   "build",  "release", "queue", "notes",  "markdown", "tray"};
+
+/* Mostly short notes with a long tail, roughly like a real collection. */
+static gchar *make_content(GRand *rand) {
+  gint target = g_rand_int_range(rand, 0, 100) < 90
+                    ? g_rand_int_range(rand, 64, 2048)
+                    : g_rand_int_range(rand, 2048, 65536);
+  GString *out = g_string_sized_new((gsize)target + 16);
+
+  while ((gint)out->len < target) {
+    const gchar *word = WORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(WORDS))];
+    g_string_append(out, word);
+    g_string_append_c(out, g_rand_int_range(rand, 0, 12) == 0 ? '\n' : ' ');
+  }
+
+  return g_string_free(out, FALSE);
+}
+
+static void remove_tree(const gchar *path) {
+  GDir *dir = g_dir_open(path, 0, NULL);
+
+  if (dir) {
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+      gchar *child = g_build_filename(path, name, NULL);
+      remove_tree(child);
+      g_free(child);
+    }
+    g_dir_close(dir);
+  }
+  g_remove(path);
+}
+
+static gdouble elapsed_ms(gint64 start) {
+  return (gdouble)(g_get_monotonic_time() - start) / 1000.0;
+}
+
+static void bench_backend(MarkydNotesBackend backend, gint n) {
+  gchar *root = g_dir_make_tmp("traymd-bench-XXXXXX", NULL);
+  gchar *dir;
+  GRand *rand;
+  GPtrArray *paths;
+  GPtrArray *listed;
+  gint64 start;
+  gdouble populate_ms, list_ms, count_ms, load_ms, save_ms;
+  gint count;
+
+  if (!root) {
+    g_printerr("Failed to create benchmark directory\n");
+    return;
+  }
+
+  dir = g_build_filename(root, "notes", NULL);
+  notes_set_backend(backend);
+  if (!notes_init_at(dir)) {
+    g_free(dir);
+    g_free(root);
+    return;
+  }
+
+  rand = g_rand_new_with_seed(42);
+  paths = g_ptr_array_new_with_free_func(g_free);
+
+  start = g_get_monotonic_time();
+  for (gint i = 0; i < n; i++) {
+    gchar *filename = g_strdup_printf("bench_%06d.md", i);
+    gchar *path = g_build_filename(dir, filename, NULL);
+    gchar *content = make_content(rand);
+    notes_save(path, content);
+    g_ptr_array_add(paths, path);
+    g_free(content);
+    g_free(filename);
+  }
+  populate_ms = elapsed_ms(start);
+
+  start = g_get_monotonic_time();
+  listed = notes_list();
+  list_ms = elapsed_ms(start);
+  g_ptr_array_free(listed, TRUE);
+
+  start = g_get_monotonic_time();
+  count = notes_count();
+  count_ms = elapsed_ms(start);
+
+  start = g_get_monotonic_time();
+  for (gint i = 0; i < SAMPLE_OPS; i++) {
+    g_free(notes_load(g_ptr_array_index(paths, g_rand_int_range(rand, 0, n))));
+  }
+  load_ms = elapsed_ms(start);
+
+  start = g_get_monotonic_time();
+  for (gint i = 0; i < SAMPLE_OPS; i++) {
+    gchar *content = make_content(rand);
+    notes_save(g_ptr_array_index(paths, g_rand_int_range(rand, 0, n)),
+               content);
+    g_free(content);
+  }
+  save_ms = elapsed_ms(start);
+
+  g_print("%-6s %7d  populate %9.1f ms  list %8.2f ms  count %8.2f ms  "
+          "load %7.1f us/op  save %7.1f us/op%s\n",
+          backend == MARKYD_NOTES_BACKEND_SQLITE ? "sqlite" : "files", n,
+          populate_ms, list_ms, count_ms, load_ms * 1000.0 / SAMPLE_OPS,
+          save_ms * 1000.0 / SAMPLE_OPS, count == n ? "" : "  (count mismatch)");
+
+  notes_cleanup();
+  g_ptr_array_free(paths, TRUE);
+  g_rand_free(rand);
+  remove_tree(root);
+  g_free(dir);
+  g_free(root);
+}
+
+int main(void) {
+  for (guint i = 0; i < G_N_ELEMENTS(SIZES); i++) {
+    bench_backend(MARKYD_NOTES_BACKEND_FILES, SIZES[i]);
+    bench_backend(MARKYD_NOTES_BACKEND_SQLITE, SIZES[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Storage scaling baseline for notes.c: p50/p99 latency and syscalls per
+ * operation for list, count, load, save and create+refresh, on synthetic
+ * notebooks of 1k/10k/100k notes in a tmpdir (removed afterwards).
+ *
+ *   make bench-storage                 # plain-file backend
+ *   obj/bench_storage sqlite           # SQLite backend
+ *
+ * Syscalls are counted by running one more call of each operation in a
+ * forked child under ptrace (threads included), so tracing never slows the
+ * timed runs. Where ptrace is not permitted the column shows "-". Timings
+ * are with a warm page cache.
+ */
+#include "notes.h"
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SAMPLE_OPS 1000
+
+static const gint SIZES[] = {1000, 10000, 100000};
+
+static const gchar *const WORDS[] = {
+    "note",  "todo",   "meeting", "idea",  "- item", "**bold**", "`code`",
+    "link",  "draft",  "review",  "later", "# Title", "and",     "the",
+    "fix",   "build",  "release", "queue", "notes",  "markdown", "tray"};
+
+typedef struct _Bench {
+  GPtrArray *paths; /* Every note, in creation order */
+  GRand *rand;
+  gchar *content; /* Payload for the next save */
+} Bench;
+
+typedef void (*BenchOp)(Bench *bench);
+
+/* Sizes follow a rough log-normal: most notes are a few hundred bytes to a
+ * few KiB, a long tail reaches into hundreds of KiB. */
+static gchar *make_content(GRand *rand) {
+  gdouble u1 = g_rand_double_range(rand, 1e-9, 1.0);
+  gdouble u2 = g_rand_double(rand);
+  gdouble normal = sqrt(-2.0 * log(u1)) * cos(2.0 * G_PI * u2);
+  gint target = (gint)CLAMP(exp(7.0 + 1.3 * normal), 16.0, 512.0 * 1024.0);
+  GString *out = g_string_sized_new((gsize)target + 16);
+
+  while ((gint)out->len < target) {
+    const gchar *word = WORDS[g_rand_int_range(rand, 0, G_N_ELEMENTS(WORDS))];
+    g_string_append(out, word);
+    g_string_append_c(out, g_rand_int_range(rand, 0, 12) == 0 ? '\n' : ' ');
+  }
+
+  return g_string_free(out, FALSE);
+}
+
+static void remove_tree(const gchar *path) {
+  GDir *dir = g_dir_open(path, 0, NULL);
+
+  if (dir) {
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+      gchar *child = g_build_filename(path, name, NULL);
+      remove_tree(child);
+      g_free(child);
+    }
+    g_dir_close(dir);
+  }
+  g_remove(path);
+}
+
+static gint64 now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static const gchar *random_path(Bench *bench) {
+  return g_ptr_array_index(bench->paths,
+                           g_rand_int_range(bench->rand, 0,
+                                            (gint)bench->paths->len));
+}
+
+static void op_list(Bench *bench) {
+  (void)bench;
+  g_ptr_array_free(notes_list(), TRUE);
+}
+
+static void op_count(Bench *bench) {
+  (void)bench;
+  notes_count();
+}
+
+static void op_load(Bench *bench) { g_free(notes_load(random_path(bench))); }
+
+static void op_save(Bench *bench) {
+  notes_save(random_path(bench), bench->content);
+}
+
+/* What the app does for "New note" on a cold start: create, then re-list */
+static void op_create_refresh(Bench *bench) {
+  gchar *path = notes_create();
+
+  if (path) {
+    g_ptr_array_add(bench->paths, path);
+  }
+  g_ptr_array_free(notes_list(), TRUE);
+}
+
+static void op_nothing(Bench *bench) { (void)bench; }
+
+/*
+ * Syscalls made by one call of op, counted in a forked child that stops
+ * itself and is then single-stepped from syscall to syscall. Every thread
+ * it spawns is followed. Returns -1 if the child can't be traced.
+ */
+static glong count_syscalls(BenchOp op, Bench *bench) {
+  GHashTable *in_syscall;
+  pid_t child;
+  gint status;
+  glong count = 0;
+
+  fflush(NULL);
+  child = fork();
+  if (child < 0) {
+    return -1;
+  }
+  if (child == 0) {
+    if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) {
+      _exit(2);
+    }
+    raise(SIGSTOP);
+    op(bench);
+    _exit(0);
+  }
+
+  if (waitpid(child, &status, 0) != child || !WIFSTOPPED(status)) {
+    return -1;
+  }
+  ptrace(PTRACE_SETOPTIONS, child, NULL,
+         (void *)(glong)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE |
+                         PTRACE_O_EXITKILL));
+  ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+
+  /* Syscall stops alternate entry/exit per thread; count the entries */
+  in_syscall = g_hash_table_new(g_direct_hash, g_direct_equal);
+  for (;;) {
+    pid_t pid = waitpid(-1, &status, __WALL);
+    gint sig = 0;
+
+    if (pid < 0) {
+      break; /* All traced threads are gone */
+    }
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+      if (pid == child && WIFEXITED(status) && WEXITSTATUS(status) == 2) {
+        count = -1;
+      }
+      continue;
+    }
+
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+      gpointer key = GINT_TO_POINTER(pid);
+      if (g_hash_table_contains(in_syscall, key)) {
+        g_hash_table_remove(in_syscall, key);
+      } else {
+        g_hash_table_add(in_syscall, key);
+        if (count >= 0) {
+          count++;
+        }
+      }
+    } else if (WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP) {
+      sig = WSTOPSIG(status); /* A real signal: pass it on */
+    }
+    ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(glong)sig);
+  }
+  g_hash_table_destroy(in_syscall);
+
+  return count;
+}
+
+static gint compare_i64(gconstpointer a, gconstpointer b) {
+  gint64 x = *(const gint64 *)a;
+  gint64 y = *(const gint64 *)b;
+  return (x > y) - (x < y);
+}
+
+static void format_ns(gchar *out, gsize size, gint64 ns) {
+  if (ns >= 10000000) {
+    g_snprintf(out, size, "%.1f ms", (gdouble)ns / 1e6);
+  } else if (ns >= 10000) {
+    g_snprintf(out, size, "%.1f us", (gdouble)ns / 1e3);
+  } else {
+    g_snprintf(out, size, "%" G_GINT64_FORMAT " ns", ns);
+  }
+}
+
+/* Time reps calls of op and print a row; baseline is the syscall overhead
+ * of the tracing harness itself */
+static void run_op(const gchar *name, BenchOp op, Bench *bench, gint reps,
+                   glong baseline) {
+  GArray *samples = g_array_sized_new(FALSE, FALSE, sizeof(gint64), reps);
+  gchar p50[32];
+  gchar p99[32];
+  gchar calls[32];
+  glong syscalls;
+
+  for (gint i = 0; i < reps; i++) {
+    gint64 start;
+    gint64 ns;
+
+    if (op == op_save) {
+      g_free(bench->content);
+      bench->content = make_content(bench->rand);
+    }
+    start = now_ns();
+    op(bench);
+    ns = now_ns() - start;
+    g_array_append_val(samples, ns);
+  }
+  g_array_sort(samples, compare_i64);
+  format_ns(p50, sizeof(p50), g_array_index(samples, gint64, reps / 2));
+  format_ns(p99, sizeof(p99),
+            g_array_index(samples, gint64, MIN(reps - 1, reps * 99 / 100)));
+
+  syscalls = baseline >= 0 ? count_syscalls(op, bench) : -1;
+  if (syscalls >= 0) {
+    g_snprintf(calls, sizeof(calls), "%ld", MAX(syscalls - baseline, 0));
+  } else {
+    g_strlcpy(calls, "-", sizeof(calls));
+  }
+
+  g_print("  %-16s %6d %12s %12s %12s\n", name, reps, p50, p99, calls);
+  g_array_free(samples, TRUE);
+}
+
+/* Create n notes; notes_create_named skips the save bookkeeping (history,
+ * signatures) so setup stays quick at 100k */
+static guint64 populate(gint n, Bench *bench) {
+  guint64 bytes = 0;
+
+  for (gint i = 0; i < n; i++) {
+    gchar *content = make_content(bench->rand);
+    gchar *stem = g_strdup_printf("bench_%06d", i);
+    gchar *path = notes_create_named("", stem, content, 0);
+
+    if (path) {
+      g_ptr_array_add(bench->paths, path);
+    }
+    bytes += strlen(content);
+    g_free(stem);
+    g_free(content);
+  }
+  return bytes;
+}
+
+static void bench_size(MarkydNotesBackend backend, gint n) {
+  gchar *root = g_dir_make_tmp("traymd-bench-XXXXXX", NULL);
+  gchar *dir;
+  gchar *size;
+  Bench bench;
+  gint reps;
+  glong baseline;
+
+  if (!root) {
+    g_printerr("Failed to create benchmark directory\n");
+    return;
+  }
+
+  dir = g_build_filename(root, "notes", NULL);
+  notes_set_backend(backend);
+  if (!notes_init_at(dir)) {
+    g_free(dir);
+    g_free(root);
+    return;
+  }
+
+  bench.paths = g_ptr_array_new_with_free_func(g_free);
+  bench.rand = g_rand_new_with_seed(42);
+  bench.content = NULL;
+  size = g_format_size(populate(n, &bench));
+
+  /* Whole-notebook operations get fewer repetitions as n grows */
+  reps = CLAMP(1000000 / n, 5, 200);
+  baseline = count_syscalls(op_nothing, &bench);
+
+  g_print("%s, %d notes (%s)\n",
+          backend == MARKYD_NOTES_BACKEND_SQLITE ? "sqlite" : "files", n,
+          size);
+  g_print("  %-16s %6s %12s %12s %12s\n", "operation", "runs", "p50", "p99",
+          "syscalls/op");
+  run_op("list", op_list, &bench, reps, baseline);
+  run_op("count", op_count, &bench, reps, baseline);
+  run_op("load", op_load, &bench, SAMPLE_OPS, baseline);
+  run_op("save", op_save, &bench, SAMPLE_OPS, baseline);
+  run_op("create+refresh", op_create_refresh, &bench, reps, baseline);
+  g_print("\n");
+
+  notes_cleanup();
+  g_ptr_array_free(bench.paths, TRUE);
+  g_rand_free(bench.rand);
+  g_free(bench.content);
+  g_free(size);
+  remove_tree(root);
+  g_free(dir);
+  g_free(root);
+}
+
+int main(int argc, char **argv) {
+  MarkydNotesBackend backend = MARKYD_NOTES_BACKEND_FILES;
+
+  if (argc > 1 && g_strcmp0(argv[1], "sqlite") == 0) {
+    backend = MARKYD_NOTES_BACKEND_SQLITE;
+  } else if (argc > 1 && g_strcmp0(argv[1], "files") != 0) {
+    g_printerr("usage: %s [files|sqlite]\n", argv[0]);
+    return 2;
+  }
+
+  for (guint i = 0; i < G_N_ELEMENTS(SIZES); i++) {
+    bench_size(backend, SIZES[i]);
+  }
+  return 0;
+}
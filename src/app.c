@@ -1,7 +1,10 @@
 #include "app.h"
 #include "config.h"
 #include "editor.h"
+#include "latency.h"
 #include "notes.h"
+#include "notes_dupes.h"
+#include "notes_folds.h"
 #include "tray.h"
 #include "window.h"
 
@@ -13,6 +16,36 @@ MarkydApp *app = NULL;
 
 static void on_activate(GtkApplication *gtk_app, gpointer user_data);
 static gboolean on_autosave_timeout(gpointer user_data);
+static void on_cold_archived(GObject *source_object, GAsyncResult *result,
+                             gpointer user_data);
+static void schedule_dupes_scan(MarkydApp *self);
+static void refresh_notes_then(MarkydApp *self, void (*done)(MarkydApp *));
+static void open_first_note(MarkydApp *self);
+static void cancel_note_load(MarkydApp *self);
+
+void markyd_app_set_notebook(MarkydApp *self, const gchar *notebook) {
+  if (!notebook || g_strcmp0(self->notebook, notebook) == 0) {
+    return;
+  }
+
+  /* Save current note first */
+  markyd_app_save_current(self);
+
+  cancel_note_load(self);
+  g_free(self->notebook);
+  self->notebook = g_strdup(notebook);
+
+  /* The old notebook's notes are gone from the list, and its open note is
+   * read-only, until the new listing arrives */
+  g_ptr_array_set_size(self->note_paths, 0);
+  self->current_index = -1;
+  self->modified = FALSE;
+  markyd_window_set_loading(self->window, TRUE);
+  markyd_window_update_counter(self->window);
+  markyd_window_update_nav_sensitivity(self->window);
+
+  refresh_notes_then(self, open_first_note);
+}
 
 MarkydApp *markyd_app_new(void) {
   MarkydApp *self = g_new0(MarkydApp, 1);
@@ -31,6 +64,7 @@ MarkydApp *markyd_app_new(void) {
   self->gtk_app = gtk_application_new("org.traymd.app", flags);
   self->note_paths = g_ptr_array_new_with_free_func(g_free);
   self->current_index = -1;
+  self->notebook = g_strdup("");
   self->save_timeout_id = 0;
   self->modified = FALSE;
   self->tray_backend = MARKYD_TRAY_BACKEND_STATUSICON;
@@ -55,6 +89,35 @@ void markyd_app_free(MarkydApp *self) {
     markyd_app_save_current(self);
   }
 
+  if (self->dupes_cancellable) {
+    g_cancellable_cancel(self->dupes_cancellable);
+    g_clear_object(&self->dupes_cancellable);
+  }
+  if (self->archive_cancellable) {
+    g_cancellable_cancel(self->archive_cancellable);
+    g_clear_object(&self->archive_cancellable);
+  }
+
+  if (self->stats_dump) {
+    GtkTextBuffer *buffer = self->editor ? self->editor->buffer : NULL;
+    gchar *report = markyd_latency_format(
+        buffer ? gtk_text_buffer_get_char_count(buffer) : 0,
+        buffer ? gtk_text_buffer_get_line_count(buffer) : 0);
+
+    g_print("%s", report);
+    g_free(report);
+  }
+
+  /* Their callbacks see the cancellation and leave self alone */
+  if (self->list_cancellable) {
+    g_cancellable_cancel(self->list_cancellable);
+    g_clear_object(&self->list_cancellable);
+  }
+  if (self->load_cancellable) {
+    g_cancellable_cancel(self->load_cancellable);
+    g_clear_object(&self->load_cancellable);
+  }
+
   tray_cleanup();
 
   if (self->window) {
@@ -65,6 +128,10 @@ void markyd_app_free(MarkydApp *self) {
     g_ptr_array_free(self->note_paths, TRUE);
   }
 
+  g_free(self->notebook);
+  /* Waits for the workers cancelled above */
+  notes_cleanup();
+
   g_object_unref(self->gtk_app);
 
   /* Save and free config */
@@ -98,6 +165,13 @@ static void on_activate(GtkApplication *gtk_app, gpointer user_data) {
   }
 
   /* Initialize notes storage */
+  notes_set_backend(g_strcmp0(config->storage_backend, "sqlite") == 0
+                        ? MARKYD_NOTES_BACKEND_SQLITE
+                        : MARKYD_NOTES_BACKEND_FILES);
+  notes_set_history_enabled(config->history);
+  notes_set_chunk_threshold(config->chunk_notes_over_kb > 0
+                                ? (gsize)config->chunk_notes_over_kb * 1024
+                                : 0);
   if (!notes_init()) {
     g_printerr("Failed to initialize notes storage\n");
     return;
@@ -112,45 +186,198 @@ static void on_activate(GtkApplication *gtk_app, gpointer user_data) {
     tray_init(self);
   }
 
-  /* Load notes list */
-  markyd_app_refresh_notes(self);
+  /* List notes in the background, then open the most recent one or create
+   * the first; there is nothing to type into until then */
+  markyd_window_set_loading(self->window, TRUE);
+  refresh_notes_then(self, open_first_note);
+
+  /* Show window on first launch (unless started minimized) */
+  if (!self->start_minimized) {
+    markyd_window_show(self->window);
+  }
+
+  /* Compress long-untouched notes in the background; paths don't change */
+  if (config->cold_after_days > 0) {
+    self->archive_cancellable = g_cancellable_new();
+    notes_archive_cold_async(config->cold_after_days,
+                             self->archive_cancellable, on_cold_archived,
+                             NULL);
+  }
+}
+
+static void on_cold_archived(GObject *source_object, GAsyncResult *result,
+                             gpointer user_data) {
+  GError *error = NULL;
+
+  (void)source_object;
+  (void)user_data;
+
+  if (notes_archive_cold_finish(result, &error) < 0) {
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_printerr("%s\n", error->message);
+    }
+    g_error_free(error);
+  }
+}
+
+/* Bring duplicate signatures of the current notebook up to date on a worker
+ * thread. Saved notes update themselves. */
+static void schedule_dupes_scan(MarkydApp *self) {
+  if (self->dupes_cancellable) {
+    g_cancellable_cancel(self->dupes_cancellable);
+    g_object_unref(self->dupes_cancellable);
+  }
 
-  /* Open most recent note or create first one */
+  self->dupes_cancellable = g_cancellable_new();
+  notes_dupes_refresh_async(self->note_paths, self->dupes_cancellable);
+}
+
+/* After a listing of a fresh notebook: open the newest note or start one */
+static void open_first_note(MarkydApp *self) {
   if (self->note_paths->len > 0) {
     markyd_app_goto_note(self, 0);
   } else {
     markyd_app_new_note(self);
   }
-
-  /* Show window on first launch (unless started minimized) */
-  if (!self->start_minimized) {
-    markyd_window_show(self->window);
-  }
+  schedule_dupes_scan(self);
 }
 
-void markyd_app_refresh_notes(MarkydApp *self) {
+typedef struct _RefreshRequest {
+  MarkydApp *app;
+  void (*done)(MarkydApp *self);
+} RefreshRequest;
+
+static void on_notes_listed(GObject *source, GAsyncResult *result,
+                            gpointer user_data) {
+  RefreshRequest *request = (RefreshRequest *)user_data;
+  MarkydApp *self = request->app;
+  GError *error = NULL;
   GPtrArray *paths;
-  guint i;
+  gchar *current;
 
-  /* Clear existing */
-  g_ptr_array_set_size(self->note_paths, 0);
+  (void)source;
 
-  /* Get fresh list */
-  paths = notes_list();
-  for (i = 0; i < paths->len; i++) {
-    g_ptr_array_add(self->note_paths, g_strdup(g_ptr_array_index(paths, i)));
+  paths = notes_list_in_finish(result, &error);
+  if (!paths) {
+    /* Cancelled by a newer refresh or by shutdown: self may be gone */
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_error_free(error);
+      g_free(request);
+      return;
+    }
+    /* Carry on with the list as it was, so the editor isn't left waiting */
+    g_printerr("Failed to list notes: %s\n", error->message);
+    g_error_free(error);
+    g_clear_object(&self->list_cancellable);
+    if (request->done) {
+      request->done(self);
+    }
+    g_free(request);
+    return;
   }
-  g_ptr_array_free(paths, TRUE);
+  g_clear_object(&self->list_cancellable);
+
+  /* Keep the open note selected by path. If the listing missed it (created
+   * while the list was being read), it is the newest note. After a notebook
+   * switch nothing is open, so nothing from the old one is carried over. */
+  current = g_strdup(markyd_app_get_current_path(self));
+  g_ptr_array_free(self->note_paths, TRUE);
+  self->note_paths = paths;
+  self->current_index = -1;
+  if (current) {
+    for (guint i = 0; i < paths->len; i++) {
+      if (g_strcmp0(g_ptr_array_index(paths, i), current) == 0) {
+        self->current_index = (gint)i;
+        break;
+      }
+    }
+    if (self->current_index < 0) {
+      g_ptr_array_insert(paths, 0, current);
+      current = NULL;
+      self->current_index = 0;
+    }
+  }
+  g_free(current);
+  notes_folds_prune(self->notebook, paths);
 
   /* Update UI */
   if (self->window) {
     markyd_window_update_counter(self->window);
     markyd_window_update_nav_sensitivity(self->window);
   }
+
+  if (request->done) {
+    request->done(self);
+  }
+  g_free(request);
 }
 
-void markyd_app_goto_note(MarkydApp *self, gint index) {
+/* Re-list the current notebook off the main thread and run done once the
+ * new list is in place. A newer refresh supersedes an older one. */
+static void refresh_notes_then(MarkydApp *self, void (*done)(MarkydApp *)) {
+  RefreshRequest *request = g_new0(RefreshRequest, 1);
+
+  if (self->list_cancellable) {
+    g_cancellable_cancel(self->list_cancellable);
+    g_object_unref(self->list_cancellable);
+  }
+  self->list_cancellable = g_cancellable_new();
+
+  request->app = self;
+  request->done = done;
+  notes_list_in_async(self->notebook, self->list_cancellable, on_notes_listed,
+                      request);
+}
+
+void markyd_app_refresh_notes(MarkydApp *self) {
+  refresh_notes_then(self, NULL);
+}
+
+/* Drop a pending load, e.g. before the editor gets other content */
+static void cancel_note_load(MarkydApp *self) {
+  if (!self->load_cancellable) {
+    return;
+  }
+
+  g_cancellable_cancel(self->load_cancellable);
+  g_clear_object(&self->load_cancellable);
+  if (self->window) {
+    markyd_window_set_loading(self->window, FALSE);
+  }
+}
+
+static void on_note_loaded(GObject *source, GAsyncResult *result,
+                           gpointer user_data) {
+  MarkydApp *self = (MarkydApp *)user_data;
+  GError *error = NULL;
   gchar *content;
+
+  (void)source;
+
+  content = notes_load_finish(result, &error);
+  if (!content) {
+    /* Superseded by another note, or shutting down */
+    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_error_free(error);
+      return;
+    }
+    g_printerr("Failed to load note: %s\n", error->message);
+    g_error_free(error);
+  }
+  g_clear_object(&self->load_cancellable);
+
+  markyd_editor_set_content(self->editor, content ? content : "");
+  g_free(content);
+  if (content) {
+    GArray *folds = notes_folds_load(markyd_app_get_current_path(self));
+    markyd_editor_set_folds(self->editor, folds);
+    g_array_free(folds, TRUE);
+  }
+  self->modified = FALSE;
+  markyd_window_set_loading(self->window, FALSE);
+}
+
+void markyd_app_goto_note(MarkydApp *self, gint index) {
   const gchar *path;
 
   if (index < 0 || (guint)index >= self->note_paths->len) {
@@ -159,25 +386,23 @@ void markyd_app_goto_note(MarkydApp *self, gint index) {
 
   /* Save current note first */
   markyd_app_save_current(self);
+  cancel_note_load(self);
 
   self->current_index = index;
   path = g_ptr_array_index(self->note_paths, index);
 
-  content = notes_load(path);
-  if (content) {
-    markyd_editor_set_content(self->editor, content);
-    g_free(content);
-  } else {
-    markyd_editor_set_content(self->editor, "");
-  }
-
+  /* Nothing is saved until the content has arrived */
   self->modified = FALSE;
+  markyd_window_set_loading(self->window, TRUE);
+  self->load_cancellable = g_cancellable_new();
+  notes_load_async(path, self->load_cancellable, on_note_loaded, self);
 
   /* Update UI */
   markyd_window_update_counter(self->window);
   markyd_window_update_nav_sensitivity(self->window);
 }
 
+/* note_paths only holds the current notebook, so prev/next stay inside it */
 void markyd_app_next_note(MarkydApp *self) {
   if (self->current_index < (gint)self->note_paths->len - 1) {
     markyd_app_goto_note(self, self->current_index + 1);
@@ -195,26 +420,20 @@ void markyd_app_new_note(MarkydApp *self) {
 
   /* Save current first */
   markyd_app_save_current(self);
+  cancel_note_load(self);
+  markyd_window_set_loading(self->window, FALSE);
 
   /* Create new note */
-  path = notes_create();
+  path = notes_create_in(self->notebook);
   if (!path) {
     g_printerr("Failed to create new note\n");
     return;
   }
 
-  /* Refresh list and go to the new note (should be first) */
-  markyd_app_refresh_notes(self);
-
-  /* Find the new note in the list */
-  for (guint i = 0; i < self->note_paths->len; i++) {
-    if (g_strcmp0(g_ptr_array_index(self->note_paths, i), path) == 0) {
-      self->current_index = i;
-      break;
-    }
-  }
-
-  g_free(path);
+  /* The list is newest first, so the new note goes to the front; no need
+   * to re-read the notebook */
+  g_ptr_array_insert(self->note_paths, 0, path);
+  self->current_index = 0;
 
   /* Clear editor */
   markyd_editor_set_content(self->editor, "");
@@ -252,16 +471,16 @@ gboolean markyd_app_delete_current_note(MarkydApp *self) {
 
   /* Save current note first */
   markyd_app_save_current(self);
+  cancel_note_load(self);
 
-  path = g_strdup(g_ptr_array_index(self->note_paths, self->current_index));
+  path = g_ptr_array_index(self->note_paths, self->current_index);
   if (!notes_delete(path)) {
-    g_free(path);
     return FALSE;
   }
-  g_free(path);
 
-  /* Refresh list and show an existing note */
-  markyd_app_refresh_notes(self);
+  /* Drop it from the list and show a neighbour */
+  g_ptr_array_remove_index(self->note_paths, (guint)self->current_index);
+  self->current_index = -1;
 
   if (self->note_paths->len == 0) {
     /* Shouldn't happen, but keep the app usable. */
@@ -300,21 +519,38 @@ static gboolean on_autosave_timeout(gpointer user_data) {
 }
 
 void markyd_app_save_current(MarkydApp *self) {
-  gchar *content;
+  const gchar *content;
   const gchar *path;
+  gint64 start;
 
-  if (!self->modified || self->current_index < 0) {
+  /* A note still loading has nothing of its own in the editor yet */
+  if (!self->modified || self->current_index < 0 || self->load_cancellable) {
     return;
   }
 
   path = g_ptr_array_index(self->note_paths, self->current_index);
-  content = markyd_editor_get_content(self->editor);
+  content = markyd_editor_peek_content(self->editor);
 
+  start = g_get_monotonic_time();
   if (notes_save(path, content)) {
     self->modified = FALSE;
   }
+  markyd_latency_record_since(MARKYD_LATENCY_SAVE, start);
 
-  g_free(content);
+  /* Edits above a fold move it to another line */
+  markyd_app_save_folds(self);
+}
+
+void markyd_app_save_folds(MarkydApp *self) {
+  GArray *folds;
+
+  if (self->current_index < 0 || self->load_cancellable) {
+    return;
+  }
+
+  folds = markyd_editor_get_folds(self->editor);
+  notes_folds_save(markyd_app_get_current_path(self), folds);
+  g_array_free(folds, TRUE);
 }
 
 const gchar *markyd_app_get_current_path(MarkydApp *self) {
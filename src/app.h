@@ -19,17 +19,30 @@ typedef struct _MarkydApp {
   MarkydEditor *editor;
 
   /* Note management */
-  GPtrArray *note_paths; /* Array of note file paths */
+  GPtrArray *note_paths; /* Note file paths in the current notebook */
   gint current_index;    /* Current note index (-1 if none) */
+  gchar *notebook;       /* Current notebook, relative to notes dir */
+
+  /* In-flight async listing and note load (NULL when idle) */
+  GCancellable *list_cancellable;
+  GCancellable *load_cancellable;
 
   /* Auto-save */
   guint save_timeout_id; /* Pending save timeout */
   gboolean modified;     /* Current note has unsaved changes */
 
+  /* Background duplicate-signature scan of the current notebook (NULL when
+   * none was started) */
+  GCancellable *dupes_cancellable;
+
+  /* Startup move of idle notes to the cold tier (NULL when not started) */
+  GCancellable *archive_cancellable;
+
   /* Startup options */
   gboolean start_minimized; /* Start minimized to tray */
   MarkydTrayBackend tray_backend;
   gboolean no_tray; /* Disable tray icon/menu integration */
+  gboolean stats_dump; /* Print editor latency percentiles on exit */
 } MarkydApp;
 
 /* Global app instance */
@@ -40,7 +53,8 @@ MarkydApp *markyd_app_new(void);
 void markyd_app_free(MarkydApp *app);
 int markyd_app_run(MarkydApp *app, int argc, char **argv);
 
-/* Note navigation */
+/* Note navigation. Refreshing re-lists the notebook and opening a note
+ * loads it in the background; both return before the I/O is done. */
 void markyd_app_refresh_notes(MarkydApp *app);
 void markyd_app_goto_note(MarkydApp *app, gint index);
 void markyd_app_next_note(MarkydApp *app);
@@ -48,10 +62,16 @@ void markyd_app_prev_note(MarkydApp *app);
 void markyd_app_new_note(MarkydApp *app);
 gboolean markyd_app_delete_current_note(MarkydApp *app);
 
+/* Switch to another notebook ("" is the top level) */
+void markyd_app_set_notebook(MarkydApp *app, const gchar *notebook);
+
 /* Auto-save */
 void markyd_app_schedule_save(MarkydApp *app);
 void markyd_app_save_current(MarkydApp *app);
 
+/* Remember which sections of the current note are folded */
+void markyd_app_save_folds(MarkydApp *app);
+
 /* Utility */
 const gchar *markyd_app_get_current_path(MarkydApp *app);
 gint markyd_app_get_note_count(MarkydApp *app);
@@ -31,6 +31,12 @@ MarkydConfig *config_new(void) {
 
   cfg->line_numbers = FALSE;
   cfg->word_wrap = TRUE;
+  cfg->outline = FALSE;
+
+  cfg->storage_backend = g_strdup("files");
+  cfg->history = TRUE;
+  cfg->cold_after_days = 0;
+  cfg->chunk_notes_over_kb = 0;
 
   return cfg;
 }
@@ -44,6 +50,7 @@ void config_free(MarkydConfig *cfg) {
   g_free(cfg->h2_color);
   g_free(cfg->h3_color);
   g_free(cfg->list_bullet_color);
+  g_free(cfg->storage_backend);
   g_free(cfg);
 }
 
@@ -144,6 +151,23 @@ gboolean config_load(MarkydConfig *cfg) {
   if (g_key_file_has_key(keyfile, "Editor", "word_wrap", NULL))
     cfg->word_wrap =
         g_key_file_get_boolean(keyfile, "Editor", "word_wrap", NULL);
+  if (g_key_file_has_key(keyfile, "Editor", "outline", NULL))
+    cfg->outline = g_key_file_get_boolean(keyfile, "Editor", "outline", NULL);
+
+  /* Storage */
+  if (g_key_file_has_key(keyfile, "Storage", "backend", NULL)) {
+    g_free(cfg->storage_backend);
+    cfg->storage_backend =
+        g_key_file_get_string(keyfile, "Storage", "backend", NULL);
+  }
+  if (g_key_file_has_key(keyfile, "Storage", "history", NULL))
+    cfg->history = g_key_file_get_boolean(keyfile, "Storage", "history", NULL);
+  if (g_key_file_has_key(keyfile, "Storage", "cold_after_days", NULL))
+    cfg->cold_after_days =
+        g_key_file_get_integer(keyfile, "Storage", "cold_after_days", NULL);
+  if (g_key_file_has_key(keyfile, "Storage", "chunk_notes_over_kb", NULL))
+    cfg->chunk_notes_over_kb = g_key_file_get_integer(
+        keyfile, "Storage", "chunk_notes_over_kb", NULL);
 
   g_key_file_free(keyfile);
   return TRUE;
@@ -180,6 +204,15 @@ gboolean config_save(MarkydConfig *cfg) {
 
   /* Editor */
   g_key_file_set_boolean(keyfile, "Editor", "word_wrap", cfg->word_wrap);
+  g_key_file_set_boolean(keyfile, "Editor", "outline", cfg->outline);
+
+  /* Storage */
+  g_key_file_set_string(keyfile, "Storage", "backend", cfg->storage_backend);
+  g_key_file_set_boolean(keyfile, "Storage", "history", cfg->history);
+  g_key_file_set_integer(keyfile, "Storage", "cold_after_days",
+                         cfg->cold_after_days);
+  g_key_file_set_integer(keyfile, "Storage", "chunk_notes_over_kb",
+                         cfg->chunk_notes_over_kb);
 
   data = g_key_file_to_data(keyfile, &length, &error);
   if (error) {
@@ -26,6 +26,13 @@ typedef struct _MarkydConfig {
   /* Editor */
   gboolean line_numbers;
   gboolean word_wrap;
+  gboolean outline; /* Show the headings panel beside the editor */
+
+  /* Storage */
+  gchar *storage_backend;   /* "files", "sqlite" */
+  gboolean history;         /* Keep revision history of saved notes */
+  gint cold_after_days;     /* Compress notes idle this long (0 = never) */
+  gint chunk_notes_over_kb; /* Store bigger notes as chunks (0 = never) */
 } MarkydConfig;
 
 /* Global config instance */
@@ -0,0 +1,138 @@
+#include "doc_stats.h"
+#include <string.h>
+
+/* Silent reading speed of an adult, roughly */
+#define WORDS_PER_MINUTE 200
+
+static gboolean is_word_char(gunichar c) {
+  return c != 0 && !g_unichar_isspace(c);
+}
+
+/* Counts for text alone, and whether it starts and ends inside a word */
+static void count_span(MarkydDocStats *stats, const gchar *text, gssize len,
+                       gboolean *starts_word, gboolean *ends_word) {
+  const gchar *p = text;
+  const gchar *end = text + (len < 0 ? strlen(text) : (gsize)len);
+  gboolean in_word = FALSE;
+
+  memset(stats, 0, sizeof(*stats));
+  *starts_word = FALSE;
+
+  while (p < end) {
+    gunichar c;
+
+    /* ASCII without the table lookup; most markdown is */
+    if ((guchar)*p < 0x80) {
+      c = (guchar)*p;
+      p++;
+      if (c == '\n') {
+        stats->newlines++;
+      }
+      c = (c == ' ' || (c >= '\t' && c <= '\r')) ? 0 : c;
+    } else {
+      c = g_utf8_get_char(p);
+      p = g_utf8_next_char(p);
+    }
+
+    if (is_word_char(c)) {
+      if (!in_word) {
+        stats->words++;
+        *starts_word |= stats->chars == 0;
+      }
+      in_word = TRUE;
+    } else {
+      in_word = FALSE;
+    }
+    stats->chars++;
+  }
+
+  *ends_word = in_word;
+}
+
+void markyd_doc_stats_count(MarkydDocStats *stats, const gchar *text,
+                            gssize len) {
+  gboolean starts_word, ends_word;
+
+  count_span(stats, text, len, &starts_word, &ends_word);
+}
+
+/* Words text adds between before and after: its own, less those it joins
+ * onto a neighbour, plus one if it splits the word they formed */
+static gint64 seam_words(gunichar before, const gchar *text, gssize len,
+                         gunichar after, MarkydDocStats *span) {
+  gboolean left = is_word_char(before);
+  gboolean right = is_word_char(after);
+  gboolean starts_word, ends_word;
+
+  count_span(span, text, len, &starts_word, &ends_word);
+  if (span->chars == 0) {
+    return 0;
+  }
+  return span->words - (left && starts_word) - (right && ends_word) +
+         (left && right);
+}
+
+void markyd_doc_stats_insert(MarkydDocStats *stats, gunichar before,
+                             const gchar *text, gssize len, gunichar after) {
+  MarkydDocStats span;
+
+  stats->words += seam_words(before, text, len, after, &span);
+  stats->chars += span.chars;
+  stats->newlines += span.newlines;
+}
+
+void markyd_doc_stats_delete(MarkydDocStats *stats, gunichar before,
+                             const gchar *text, gssize len, gunichar after) {
+  MarkydDocStats span;
+
+  stats->words -= seam_words(before, text, len, after, &span);
+  stats->chars -= span.chars;
+  stats->newlines -= span.newlines;
+}
+
+void markyd_doc_stats_add(MarkydDocStats *stats, const MarkydDocStats *other) {
+  stats->words += other->words;
+  stats->chars += other->chars;
+  stats->newlines += other->newlines;
+}
+
+gint64 markyd_doc_stats_reading_minutes(const MarkydDocStats *stats) {
+  return (MAX(stats->words, 0) + WORDS_PER_MINUTE - 1) / WORDS_PER_MINUTE;
+}
+
+static void count_thread(GTask *task, gpointer source, gpointer task_data,
+                         GCancellable *cancellable) {
+  MarkydDocStats *stats = g_new(MarkydDocStats, 1);
+
+  (void)source;
+  (void)cancellable;
+
+  markyd_doc_stats_count(stats, task_data, -1);
+  g_task_return_pointer(task, stats, g_free);
+}
+
+void markyd_doc_stats_count_async(gchar *text, GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+
+  g_task_set_source_tag(task, markyd_doc_stats_count_async);
+  g_task_set_task_data(task, text, g_free);
+  g_task_run_in_thread(task, count_thread);
+  g_object_unref(task);
+}
+
+gboolean markyd_doc_stats_count_finish(GAsyncResult *result,
+                                       MarkydDocStats *stats, GError **error) {
+  MarkydDocStats *counted;
+
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+
+  counted = g_task_propagate_pointer(G_TASK(result), error);
+  if (!counted) {
+    return FALSE;
+  }
+  *stats = *counted;
+  g_free(counted);
+  return TRUE;
+}
@@ -0,0 +1,43 @@
+#ifndef MARKYD_DOC_STATS_H
+#define MARKYD_DOC_STATS_H
+
+#include <gio/gio.h>
+
+/*
+ * Word, character and line counts of a note's markdown. A word is a run of
+ * anything but whitespace, as with wc -w. Counts are kept up to date from
+ * each edit: only the edited text is scanned, plus the characters on either
+ * side of it to tell whether a word was split or joined there.
+ */
+
+typedef struct _MarkydDocStats {
+  gint64 words;
+  gint64 chars;
+  gint64 newlines; /* Lines are one more */
+} MarkydDocStats;
+
+/* Count len bytes of text (-1 if NUL-terminated) from scratch */
+void markyd_doc_stats_count(MarkydDocStats *stats, const gchar *text,
+                            gssize len);
+
+/* Account for text inserted between before and after, or deleted from
+ * between them; 0 stands for the start or end of the note */
+void markyd_doc_stats_insert(MarkydDocStats *stats, gunichar before,
+                             const gchar *text, gssize len, gunichar after);
+void markyd_doc_stats_delete(MarkydDocStats *stats, gunichar before,
+                             const gchar *text, gssize len, gunichar after);
+
+/* Add counts taken over part of the note */
+void markyd_doc_stats_add(MarkydDocStats *stats, const MarkydDocStats *other);
+
+/* Minutes to read the words, rounded up */
+gint64 markyd_doc_stats_reading_minutes(const MarkydDocStats *stats);
+
+/* Count text (taken over) on a worker thread */
+void markyd_doc_stats_count_async(gchar *text, GCancellable *cancellable,
+                                  GAsyncReadyCallback callback,
+                                  gpointer user_data);
+gboolean markyd_doc_stats_count_finish(GAsyncResult *result,
+                                       MarkydDocStats *stats, GError **error);
+
+#endif /* MARKYD_DOC_STATS_H */
@@ -1,6 +1,14 @@
 #include "editor.h"
 #include "app.h"
+#include "config.h"
+#include "doc_stats.h"
+#include "find.h"
+#include "heading_index.h"
+#include "latency.h"
+#include "link_index.h"
 #include "markdown.h"
+#include "shadow_text.h"
+#include "undo.h"
 #include "window.h"
 #include <ctype.h>
 #include <string.h>
@@ -19,86 +27,29 @@ static gboolean on_motion_notify(GtkWidget *widget, GdkEventMotion *event,
                                  gpointer user_data);
 static gboolean on_leave_notify(GtkWidget *widget, GdkEventCrossing *event,
                                 gpointer user_data);
+static void on_insert_text_record(GtkTextBuffer *buffer, GtkTextIter *location,
+                                  gchar *text, gint len, gpointer user_data);
+static void on_delete_range_record(GtkTextBuffer *buffer, GtkTextIter *start,
+                                   GtkTextIter *end, gpointer user_data);
+static void on_insert_text_headings(GtkTextBuffer *buffer,
+                                    GtkTextIter *location, gchar *text,
+                                    gint len, gpointer user_data);
+static void on_delete_range_headings(GtkTextBuffer *buffer,
+                                     GtkTextIter *start, GtkTextIter *end,
+                                     gpointer user_data);
+static void on_begin_user_action(GtkTextBuffer *buffer, gpointer user_data);
+static void on_end_user_action(GtkTextBuffer *buffer, gpointer user_data);
 static void on_paste_clipboard(GtkTextView *text_view, gpointer user_data);
-static void on_paste_clipboard_after(GtkTextView *text_view, gpointer user_data);
+static void on_drag_data_received(GtkWidget *widget, GdkDragContext *context,
+                                  gint x, gint y, GtkSelectionData *data,
+                                  guint info, guint time,
+                                  gpointer user_data);
 static void apply_markdown(MarkydEditor *self);
+static gboolean on_text_view_draw(GtkWidget *widget, cairo_t *cr,
+                                  gpointer user_data);
+static gboolean find_restart(MarkydEditor *self, GError **error);
 static void schedule_markdown_apply(MarkydEditor *self);
 
-static const gunichar UNORDERED_LIST_BULLET = 0x2022; /* '•' */
-
-static gint compare_int_desc(gconstpointer a, gconstpointer b) {
-  const gint ia = *(const gint *)a;
-  const gint ib = *(const gint *)b;
-  return (ib - ia);
-}
-
-static gchar *gstring_steal_compat(GString *string) {
-  if (!string) {
-    return NULL;
-  }
-
-  gchar *out = g_strdup(string->str);
-  g_string_free(string, TRUE);
-  return out;
-}
-
-static gchar *markdown_to_display_text(const gchar *content) {
-  if (!content) {
-    return g_strdup("");
-  }
-
-  GString *out = g_string_sized_new(strlen(content));
-  const gchar *p = content;
-  gboolean at_line_start = TRUE;
-
-  while (*p) {
-    if (at_line_start && (p[0] == '-' || p[0] == '*') && p[1] == ' ') {
-      g_string_append_unichar(out, UNORDERED_LIST_BULLET);
-      g_string_append_c(out, ' ');
-      p += 2;
-      at_line_start = FALSE;
-      continue;
-    }
-
-    gunichar c = g_utf8_get_char(p);
-    g_string_append_unichar(out, c);
-    at_line_start = (c == '\n');
-    p = g_utf8_next_char(p);
-  }
-
-  return gstring_steal_compat(out);
-}
-
-static gchar *display_to_markdown_text(const gchar *content) {
-  if (!content) {
-    return g_strdup("");
-  }
-
-  GString *out = g_string_sized_new(strlen(content));
-  const gchar *p = content;
-  gboolean at_line_start = TRUE;
-
-  while (*p) {
-    if (at_line_start) {
-      gunichar c0 = g_utf8_get_char(p);
-      const gchar *p1 = g_utf8_next_char(p);
-      if (c0 == UNORDERED_LIST_BULLET && *p1 == ' ') {
-        g_string_append(out, "- ");
-        p = p1 + 1;
-        at_line_start = FALSE;
-        continue;
-      }
-    }
-
-    gunichar c = g_utf8_get_char(p);
-    g_string_append_unichar(out, c);
-    at_line_start = (c == '\n');
-    p = g_utf8_next_char(p);
-  }
-
-  return gstring_steal_compat(out);
-}
-
 static gboolean hr_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
   (void)user_data;
 
@@ -122,23 +73,101 @@ static gboolean hr_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data) {
 static const gint HR_WIDGET_HEIGHT_PX = 22;
 static const gchar *HR_WIDGET_DATA_KEY = "traymd-hr-widget";
 
-static void clear_last_paste(MarkydEditor *self) {
-  if (!self) {
-    return;
+/* Undo history kept per note before the oldest steps are dropped */
+#define UNDO_MAX_BYTES (8 * 1024 * 1024)
+
+/* Pastes and drops from this size on go in a chunk at a time, across frames */
+#define STREAM_MIN_BYTES (256 * 1024)
+#define STREAM_CHUNK_BYTES (64 * 1024)
+/* Time spent inserting per frame, leaving the rest for layout and input */
+#define STREAM_FRAME_BUDGET_US 6000
+
+/* Notes from this size on are counted off the main thread when opened */
+#define STATS_THREAD_MIN_BYTES (256 * 1024)
+
+/* The note characters either side of iter, past any hrule anchors; 0 at the
+ * start or end */
+static gunichar char_before(const GtkTextIter *iter) {
+  GtkTextIter at = *iter;
+
+  while (gtk_text_iter_backward_char(&at)) {
+    if (!gtk_text_iter_get_child_anchor(&at)) {
+      return gtk_text_iter_get_char(&at);
+    }
   }
+  return 0;
+}
 
-  if (self->paste_inserted_start) {
-    gtk_text_buffer_delete_mark(self->buffer, self->paste_inserted_start);
-    self->paste_inserted_start = NULL;
+static gunichar char_after(const GtkTextIter *iter) {
+  GtkTextIter at = *iter;
+
+  while (gtk_text_iter_get_child_anchor(&at)) {
+    gtk_text_iter_forward_char(&at);
   }
-  if (self->paste_inserted_end) {
-    gtk_text_buffer_delete_mark(self->buffer, self->paste_inserted_end);
-    self->paste_inserted_end = NULL;
+  return gtk_text_iter_get_char(&at);
+}
+
+/*
+ * The renderer adds and removes hrule anchors as the cursor moves, so undo
+ * offsets count only the note's own characters: a buffer offset minus the
+ * live anchors before it.
+ */
+static gint text_offset(MarkydEditor *self, const GtkTextIter *iter) {
+  gint offset = gtk_text_iter_get_offset(iter);
+  gint anchors = 0;
+
+  for (guint i = 0; i < self->hrule_anchors->len; i++) {
+    GtkTextChildAnchor *anchor = g_ptr_array_index(self->hrule_anchors, i);
+    GtkTextIter at;
+
+    if (gtk_text_child_anchor_get_deleted(anchor)) {
+      continue;
+    }
+    gtk_text_buffer_get_iter_at_child_anchor(self->buffer, &at, anchor);
+    if (gtk_text_iter_get_offset(&at) >= offset) {
+      break;
+    }
+    anchors++;
+  }
+
+  return offset - anchors;
+}
+
+static void iter_at_text_offset(MarkydEditor *self, GtkTextIter *iter,
+                                gint offset) {
+  gint buffer_offset = offset;
+
+  for (guint i = 0; i < self->hrule_anchors->len; i++) {
+    GtkTextChildAnchor *anchor = g_ptr_array_index(self->hrule_anchors, i);
+    GtkTextIter at;
+
+    if (gtk_text_child_anchor_get_deleted(anchor)) {
+      continue;
+    }
+    gtk_text_buffer_get_iter_at_child_anchor(self->buffer, &at, anchor);
+    if (gtk_text_iter_get_offset(&at) >= buffer_offset) {
+      break;
+    }
+    buffer_offset++;
   }
 
-  g_clear_pointer(&self->paste_replaced_text, g_free);
-  g_clear_pointer(&self->paste_clipboard_text, g_free);
-  self->paste_valid = FALSE;
+  gtk_text_buffer_get_iter_at_offset(self->buffer, iter, buffer_offset);
+}
+
+/* Replays one step of the undo log on the buffer */
+static void apply_undo_op(MarkydUndoKind kind, gint offset, const gchar *text,
+                          gint n_chars, gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  GtkTextIter start, end;
+
+  iter_at_text_offset(self, &start, offset);
+  if (kind == MARKYD_UNDO_INSERT) {
+    gtk_text_buffer_insert(self->buffer, &start, text, -1);
+  } else {
+    iter_at_text_offset(self, &end, offset + n_chars);
+    gtk_text_buffer_delete(self->buffer, &start, &end);
+  }
+  gtk_text_buffer_place_cursor(self->buffer, &start);
 }
 
 static gboolean is_all_ascii_space(const gchar *s) {
@@ -218,127 +247,19 @@ static gboolean is_iter_inside_code_block(GtkTextBuffer *buffer,
   return in_code_block;
 }
 
-static void normalize_list_markers(MarkydEditor *self) {
-  GtkTextIter line_start, end;
-  GArray *offsets = g_array_new(FALSE, FALSE, sizeof(gint));
-  gboolean in_code_block = FALSE;
-
-  gtk_text_buffer_get_bounds(self->buffer, &line_start, &end);
-  gtk_text_iter_set_line_offset(&line_start, 0);
-
-  while (!gtk_text_iter_is_end(&line_start)) {
-    gint offset = gtk_text_iter_get_offset(&line_start);
-    GtkTextIter line_end = line_start;
-    gchar *line_text;
-
-    gtk_text_iter_forward_to_line_end(&line_end);
-    line_text = gtk_text_buffer_get_text(self->buffer, &line_start, &line_end,
-                                         TRUE);
-    if (is_code_fence_line(line_text, in_code_block)) {
-      in_code_block = !in_code_block;
-    } else if (!in_code_block && line_text[0] != '\0' &&
-               (line_text[0] == '-' || line_text[0] == '*') &&
-               line_text[1] == ' ') {
-      g_array_append_val(offsets, offset);
-    }
-    g_free(line_text);
-
-    if (!gtk_text_iter_forward_line(&line_start)) {
-      break;
-    }
-  }
-
-  if (offsets->len > 0) {
-    g_array_sort(offsets, compare_int_desc);
-    for (guint i = 0; i < offsets->len; i++) {
-      gint offset = g_array_index(offsets, gint, i);
-      GtkTextIter start, finish;
-      gtk_text_buffer_get_iter_at_offset(self->buffer, &start, offset);
-      finish = start;
-      if (gtk_text_iter_forward_chars(&finish, 2)) {
-        gtk_text_buffer_delete(self->buffer, &start, &finish);
-        gtk_text_buffer_insert(self->buffer, &start, "• ", -1);
-      }
-    }
-  }
-
-  g_array_free(offsets, TRUE);
-}
-
-static gboolean get_link_url_at_iter(GtkTextBuffer *buffer, GtkTextIter *at,
-                                     gchar **out_url) {
-  GtkTextTagTable *table;
-  GtkTextTag *tag;
-  GtkTextIter start;
-  GtkTextIter end;
-  GtkTextIter line_end;
-  gchar *tail;
-  gchar *url = NULL;
-
-  if (!buffer || !at || !out_url) {
-    return FALSE;
-  }
-  *out_url = NULL;
-
-  table = gtk_text_buffer_get_tag_table(buffer);
-  tag = gtk_text_tag_table_lookup(table, "link");
-  if (!tag) {
-    return FALSE;
-  }
-  if (!gtk_text_iter_has_tag(at, tag)) {
-    return FALSE;
-  }
-
-  start = *at;
-  end = *at;
-  gtk_text_iter_backward_to_tag_toggle(&start, tag);
-  gtk_text_iter_forward_to_tag_toggle(&end, tag);
-
-  line_end = end;
-  if (!gtk_text_iter_ends_line(&line_end)) {
-    gtk_text_iter_forward_to_line_end(&line_end);
-  }
-
-  /*
-   * Markdown link: the URL is right after the visible link text: ](url)
-   * Auto-link: the visible text itself is the URL.
-   */
-  tail = gtk_text_buffer_get_text(buffer, &end, &line_end, TRUE);
-  if (tail) {
-    GRegex *re = g_regex_new("^\\]\\(([^)]+)\\)", 0, 0, NULL);
-    GMatchInfo *match = NULL;
-    if (re && g_regex_match(re, tail, 0, &match)) {
-      url = g_match_info_fetch(match, 1);
-    }
-    if (match) {
-      g_match_info_free(match);
-    }
-    if (re) {
-      g_regex_unref(re);
-    }
-    g_free(tail);
-  }
-
-  if (!url || url[0] == '\0') {
-    g_free(url);
-    url = gtk_text_buffer_get_text(buffer, &start, &end, TRUE);
-  }
-
-  if (!url || url[0] == '\0') {
-    g_free(url);
-    return FALSE;
-  }
-
-  *out_url = url;
-  return TRUE;
+/* URL of the rendered link at iter (owned by self->links), or NULL */
+static const gchar *get_link_url_at_iter(MarkydEditor *self,
+                                         const GtkTextIter *at) {
+  return markyd_link_index_lookup(self->links, text_offset(self, at));
 }
 
 static void set_link_cursor(MarkydEditor *self, gboolean active) {
   GdkWindow *win = gtk_text_view_get_window(GTK_TEXT_VIEW(self->text_view),
                                             GTK_TEXT_WINDOW_TEXT);
-  if (!win) {
+  if (!win || active == self->link_cursor) {
     return;
   }
+  self->link_cursor = active;
 
   if (active) {
     GdkDisplay *display = gdk_window_get_display(win);
@@ -358,12 +279,14 @@ static void set_link_cursor(MarkydEditor *self, gboolean active) {
 static void render_hrules(MarkydEditor *self) {
   GtkTextIter iter, end;
 
+  g_ptr_array_set_size(self->hrule_anchors, 0);
   gtk_text_buffer_get_bounds(self->buffer, &iter, &end);
   while (!gtk_text_iter_equal(&iter, &end)) {
     GtkTextChildAnchor *anchor = gtk_text_iter_get_child_anchor(&iter);
     if (anchor) {
       if (g_object_get_data(G_OBJECT(anchor), TRAYMD_HRULE_ANCHOR_DATA) !=
           NULL) {
+        g_ptr_array_add(self->hrule_anchors, g_object_ref(anchor));
         GtkWidget *hr = g_object_get_data(G_OBJECT(anchor), HR_WIDGET_DATA_KEY);
         if (!hr) {
           hr = gtk_drawing_area_new();
@@ -385,16 +308,87 @@ static void render_hrules(MarkydEditor *self) {
   on_text_view_size_allocate(self->text_view, &allocation, self);
 }
 
+static gint compare_mark_positions(gconstpointer a, gconstpointer b) {
+  GtkTextMark *x = *(GtkTextMark *const *)a;
+  GtkTextMark *y = *(GtkTextMark *const *)b;
+  GtkTextIter ix, iy;
+
+  gtk_text_buffer_get_iter_at_mark(gtk_text_mark_get_buffer(x), &ix, x);
+  gtk_text_buffer_get_iter_at_mark(gtk_text_mark_get_buffer(y), &iy, y);
+  return gtk_text_iter_compare(&ix, &iy);
+}
+
+/* Line of each fold, ascending; self->folds is sorted to match */
+static GArray *fold_lines(MarkydEditor *self) {
+  GArray *lines = g_array_sized_new(FALSE, FALSE, sizeof(gint),
+                                    self->folds->len);
+
+  g_ptr_array_sort(self->folds, compare_mark_positions);
+  for (guint i = 0; i < self->folds->len; i++) {
+    GtkTextIter iter;
+    gint line;
+
+    gtk_text_buffer_get_iter_at_mark(self->buffer, &iter,
+                                     g_ptr_array_index(self->folds, i));
+    line = gtk_text_iter_get_line(&iter);
+    g_array_append_val(lines, line);
+  }
+  return lines;
+}
+
+static void clear_folds(MarkydEditor *self) {
+  for (guint i = 0; i < self->folds->len; i++) {
+    gtk_text_buffer_delete_mark(self->buffer,
+                                g_ptr_array_index(self->folds, i));
+  }
+  g_ptr_array_set_size(self->folds, 0);
+}
+
 static void apply_markdown(MarkydEditor *self) {
+  GArray *folds;
+  gint64 start;
+
   if (!self) {
     return;
   }
 
+  /* The renderer's own edits (hrule anchors) are not the user's: keep them
+   * out of the undo log */
   self->updating_tags = TRUE;
-  normalize_list_markers(self);
-  markdown_apply_tags(self->buffer);
+  g_signal_handlers_block_matched(self->buffer, G_SIGNAL_MATCH_DATA, 0, 0,
+                                  NULL, NULL, self);
+  start = g_get_monotonic_time();
+  folds = fold_lines(self);
+  markdown_apply_tags(self->buffer, self->links, folds);
+  markyd_latency_record_since(MARKYD_LATENCY_TAGS, start);
+
+  /* Folds whose line stopped being a heading or fence are gone */
+  for (guint i = folds->len; i-- > 0;) {
+    if (g_array_index(folds, gint, i) < 0) {
+      gtk_text_buffer_delete_mark(self->buffer,
+                                  g_ptr_array_index(self->folds, i));
+      g_ptr_array_remove_index(self->folds, i);
+    }
+  }
+  markyd_heading_index_collect(self->heading_index, folds, self->headings);
+  g_array_free(folds, TRUE);
+  start = g_get_monotonic_time();
   render_hrules(self);
+  markyd_latency_record_since(MARKYD_LATENCY_HRULES, start);
+  g_signal_handlers_unblock_matched(self->buffer, G_SIGNAL_MATCH_DATA, 0, 0,
+                                    NULL, NULL, self);
   self->updating_tags = FALSE;
+
+  if (self->app && self->app->window) {
+    markyd_window_update_outline(self->app->window, self->headings);
+    markyd_window_update_stats(self->app->window,
+                               self->stats_counting ? NULL : self->stats);
+  }
+
+  /* Rendering dropped the highlights; the text may have changed too */
+  if (self->find_pattern) {
+    find_restart(self, NULL);
+  }
 }
 
 static gboolean apply_markdown_idle(gpointer user_data) {
@@ -411,6 +405,10 @@ static void schedule_markdown_apply(MarkydEditor *self) {
   if (self->updating_tags) {
     return;
   }
+  /* Rendered once when a streamed insertion completes */
+  if (self->stream_text) {
+    return;
+  }
   if (self->markdown_idle_id != 0) {
     return;
   }
@@ -421,25 +419,145 @@ static void schedule_markdown_apply(MarkydEditor *self) {
 
 void markyd_editor_refresh(MarkydEditor *self) { schedule_markdown_apply(self); }
 
+static void set_insert_progress(MarkydEditor *self, gdouble fraction) {
+  if (self->app && self->app->window) {
+    markyd_window_set_insert_progress(self->app->window, fraction);
+  }
+}
+
+/*
+ * End a streamed insertion, complete or not: close the user action it was
+ * recorded in, unlock the view and render what went in.
+ */
+static void stop_stream(MarkydEditor *self) {
+  GtkTextIter end;
+
+  if (!self->stream_text) {
+    return;
+  }
+
+  if (self->stream_tick_id != 0) {
+    gtk_widget_remove_tick_callback(self->text_view, self->stream_tick_id);
+    self->stream_tick_id = 0;
+  }
+  gtk_text_buffer_get_iter_at_mark(self->buffer, &end, self->stream_mark);
+  gtk_text_buffer_place_cursor(self->buffer, &end);
+  gtk_text_buffer_delete_mark(self->buffer, self->stream_mark);
+  self->stream_mark = NULL;
+  g_clear_pointer(&self->stream_text, g_free);
+
+  gtk_text_buffer_end_user_action(self->buffer);
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(self->text_view), TRUE);
+  set_insert_progress(self, -1);
+  schedule_markdown_apply(self);
+}
+
+static gboolean stream_tick(GtkWidget *widget, GdkFrameClock *clock,
+                            gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  gint64 start = g_get_monotonic_time();
+  (void)clock;
+
+  do {
+    const gchar *chunk = self->stream_text + self->stream_done;
+    gsize left = self->stream_length - self->stream_done;
+    gsize len = MIN(left, STREAM_CHUNK_BYTES);
+    GtkTextIter at;
+
+    /* Cut after the last line break, or at least between characters */
+    if (len < left) {
+      const gchar *newline = g_strrstr_len(chunk, (gssize)len, "\n");
+
+      if (newline) {
+        len = (gsize)(newline - chunk) + 1;
+      } else {
+        while (len > 0 && ((guchar)chunk[len] & 0xC0) == 0x80) {
+          len--;
+        }
+      }
+    }
+
+    gtk_text_buffer_get_iter_at_mark(self->buffer, &at, self->stream_mark);
+    gtk_text_buffer_insert(self->buffer, &at, chunk, (gint)len);
+    self->stream_done += len;
+  } while (self->stream_done < self->stream_length &&
+           g_get_monotonic_time() - start < STREAM_FRAME_BUDGET_US);
+
+  if (self->stream_done < self->stream_length) {
+    set_insert_progress(self, (gdouble)self->stream_done /
+                                  (gdouble)self->stream_length);
+    return G_SOURCE_CONTINUE;
+  }
+
+  self->stream_tick_id = 0; /* Removed by returning */
+  stop_stream(self);
+  gtk_text_view_scroll_mark_onscreen(GTK_TEXT_VIEW(widget),
+                                     gtk_text_buffer_get_insert(self->buffer));
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Insert text (taking ownership) at at, replacing the selection if asked, as
+ * one user action and so one undo step. Small text goes in at once; larger
+ * text a chunk per frame with the view locked and a progress bar shown.
+ */
+static void insert_text_streamed(MarkydEditor *self, GtkTextIter *at,
+                                 gchar *text, gboolean replace_selection) {
+  GtkTextIter sel_start, sel_end;
+  gsize length = strlen(text);
+
+  if (self->stream_text || length == 0) {
+    g_free(text);
+    return;
+  }
+
+  gtk_text_buffer_begin_user_action(self->buffer);
+  if (replace_selection && gtk_text_buffer_get_selection_bounds(
+                               self->buffer, &sel_start, &sel_end)) {
+    gtk_text_buffer_delete(self->buffer, &sel_start, &sel_end);
+    *at = sel_start;
+  }
+
+  if (length < STREAM_MIN_BYTES) {
+    gtk_text_buffer_insert(self->buffer, at, text, (gint)length);
+    gtk_text_buffer_place_cursor(self->buffer, at);
+    gtk_text_buffer_end_user_action(self->buffer);
+    gtk_text_view_scroll_mark_onscreen(GTK_TEXT_VIEW(self->text_view),
+                                       gtk_text_buffer_get_insert(self->buffer));
+    g_free(text);
+    return;
+  }
+
+  /* Right gravity: the mark stays after each inserted chunk */
+  self->stream_mark = gtk_text_buffer_create_mark(self->buffer, NULL, at, FALSE);
+  self->stream_text = text;
+  self->stream_length = length;
+  self->stream_done = 0;
+  if (self->markdown_idle_id != 0) {
+    g_source_remove(self->markdown_idle_id);
+    self->markdown_idle_id = 0;
+  }
+
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(self->text_view), FALSE);
+  set_insert_progress(self, 0.0);
+  self->stream_tick_id =
+      gtk_widget_add_tick_callback(self->text_view, stream_tick, self, NULL);
+}
+
 MarkydEditor *markyd_editor_new(MarkydApp *app) {
   MarkydEditor *self = g_new0(MarkydEditor, 1);
 
   self->app = app;
   self->updating_tags = FALSE;
   self->markdown_idle_id = 0;
-  self->in_paste = FALSE;
-  self->in_undo = FALSE;
-  self->pending_paste_finalize = FALSE;
-  self->paste_start_offset = 0;
-  self->paste_end_offset_before = 0;
-  self->paste_replaced_text = NULL;
-  self->paste_clipboard_text = NULL;
-  self->paste_inserted_start = NULL;
-  self->paste_inserted_end = NULL;
-  self->paste_valid = FALSE;
-  self->paste_had_selection = FALSE;
-  self->paste_sel_start_offset = 0;
-  self->paste_sel_end_offset = 0;
+  self->undo = markyd_undo_new(UNDO_MAX_BYTES);
+  self->shadow = markyd_shadow_text_new();
+  self->stats = g_new0(MarkydDocStats, 1);
+  self->hrule_anchors = g_ptr_array_new_with_free_func(g_object_unref);
+  self->links = markyd_link_index_new();
+  self->folds = g_ptr_array_new();
+  self->headings = markyd_headings_new();
+  self->stream_cancellable = g_cancellable_new();
 
   /* Create text view */
   self->text_view = gtk_text_view_new();
@@ -453,11 +571,28 @@ MarkydEditor *markyd_editor_new(MarkydApp *app) {
   /* Get buffer and init markdown tags */
   self->buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(self->text_view));
   markdown_init_tags(self->buffer);
+  self->heading_index = markyd_heading_index_new(self->buffer);
 
   /* Connect to buffer changes */
   g_signal_connect(self->buffer, "changed", G_CALLBACK(on_buffer_changed),
                    self);
 
+  /* Undo log: record edits before they happen, one step per user action */
+  g_signal_connect(self->buffer, "insert-text",
+                   G_CALLBACK(on_insert_text_record), self);
+  g_signal_connect(self->buffer, "delete-range",
+                   G_CALLBACK(on_delete_range_record), self);
+  g_signal_connect(self->buffer, "begin-user-action",
+                   G_CALLBACK(on_begin_user_action), self);
+  g_signal_connect(self->buffer, "end-user-action",
+                   G_CALLBACK(on_end_user_action), self);
+
+  /* Outline: re-read just the lines each edit leaves behind */
+  g_signal_connect_after(self->buffer, "insert-text",
+                         G_CALLBACK(on_insert_text_headings), self);
+  g_signal_connect_after(self->buffer, "delete-range",
+                         G_CALLBACK(on_delete_range_headings), self);
+
   /* Connect to key press for list continuation */
   g_signal_connect(self->text_view, "key-press-event", G_CALLBACK(on_key_press),
                    self);
@@ -465,8 +600,13 @@ MarkydEditor *markyd_editor_new(MarkydApp *app) {
   g_signal_connect(self->text_view, "size-allocate",
                    G_CALLBACK(on_text_view_size_allocate), self);
 
+  /* List bullets are painted over the text */
+  g_signal_connect_after(self->text_view, "draw",
+                         G_CALLBACK(on_text_view_draw), self);
+
   /* Link hover/click */
   gtk_widget_add_events(self->text_view, GDK_POINTER_MOTION_MASK |
+                                            GDK_POINTER_MOTION_HINT_MASK |
                                             GDK_LEAVE_NOTIFY_MASK |
                                             GDK_BUTTON_PRESS_MASK |
                                             GDK_BUTTON_RELEASE_MASK);
@@ -479,11 +619,13 @@ MarkydEditor *markyd_editor_new(MarkydApp *app) {
   g_signal_connect(self->text_view, "leave-notify-event",
                    G_CALLBACK(on_leave_notify), self);
 
-  /* Track pastes so we can undo the last one with Ctrl+Z */
+  /* Pastes and drops: clipboard read asynchronously, big ones streamed in */
   g_signal_connect(self->text_view, "paste-clipboard",
                    G_CALLBACK(on_paste_clipboard), self);
-  g_signal_connect_after(self->text_view, "paste-clipboard",
-                         G_CALLBACK(on_paste_clipboard_after), self);
+  gtk_target_list_add_uri_targets(
+      gtk_drag_dest_get_target_list(self->text_view), 0);
+  g_signal_connect(self->text_view, "drag-data-received",
+                   G_CALLBACK(on_drag_data_received), self);
 
   return self;
 }
@@ -495,55 +637,387 @@ void markyd_editor_free(MarkydEditor *self) {
     g_source_remove(self->markdown_idle_id);
     self->markdown_idle_id = 0;
   }
-  clear_last_paste(self);
+  g_cancellable_cancel(self->stream_cancellable);
+  g_object_unref(self->stream_cancellable);
+  if (self->stream_tick_id != 0) {
+    gtk_widget_remove_tick_callback(self->text_view, self->stream_tick_id);
+  }
+  g_free(self->stream_text);
+  markyd_undo_free(self->undo);
+  markyd_shadow_text_free(self->shadow);
+  g_free(self->stats);
+  g_ptr_array_free(self->hrule_anchors, TRUE);
+  markyd_link_index_free(self->links);
+  g_ptr_array_free(self->folds, TRUE);
+  markyd_heading_index_free(self->heading_index);
+  g_array_free(self->headings, TRUE);
+  markyd_find_cancel(self->find);
+  g_free(self->find_pattern);
   g_free(self);
 }
 
+static void on_stats_counted(GObject *source_object, GAsyncResult *result,
+                             gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  MarkydDocStats counted;
+
+  (void)source_object;
+
+  /* Cancelled when the editor moved on to another note, or went away */
+  if (!markyd_doc_stats_count_finish(result, &counted, NULL)) {
+    return;
+  }
+
+  /* Edits made meanwhile were counted from zero; add the note they went in */
+  markyd_doc_stats_add(self->stats, &counted);
+  self->stats_counting = FALSE;
+  if (self->app && self->app->window) {
+    markyd_window_update_stats(self->app->window, self->stats);
+  }
+}
+
+/* The one full count, when a note is opened */
+static void count_stats(MarkydEditor *self, const gchar *content) {
+  gsize length = content ? strlen(content) : 0;
+
+  memset(self->stats, 0, sizeof(*self->stats));
+  self->stats_counting = length >= STATS_THREAD_MIN_BYTES;
+  if (self->stats_counting) {
+    markyd_doc_stats_count_async(g_strdup(content), self->stream_cancellable,
+                                 on_stats_counted, self);
+  } else if (length > 0) {
+    markyd_doc_stats_count(self->stats, content, (gssize)length);
+  }
+}
+
 void markyd_editor_set_content(MarkydEditor *self, const gchar *content) {
-  gchar *display = markdown_to_display_text(content);
+  /* A paste or drop still on its way belonged to the previous note */
+  g_cancellable_cancel(self->stream_cancellable);
+  g_object_unref(self->stream_cancellable);
+  self->stream_cancellable = g_cancellable_new();
+  stop_stream(self);
+  clear_folds(self);
+  markyd_find_cancel(self->find);
+  self->find = NULL;
+
   self->updating_tags = TRUE;
-  gtk_text_buffer_set_text(self->buffer, display ? display : "", -1);
+  g_signal_handlers_block_by_func(self->buffer, on_insert_text_record, self);
+  g_signal_handlers_block_by_func(self->buffer, on_delete_range_record, self);
+  g_signal_handlers_block_by_func(self->buffer, on_insert_text_headings, self);
+  g_signal_handlers_block_by_func(self->buffer, on_delete_range_headings,
+                                  self);
+  gtk_text_buffer_set_text(self->buffer, content ? content : "", -1);
+  g_signal_handlers_unblock_by_func(self->buffer, on_delete_range_headings,
+                                    self);
+  g_signal_handlers_unblock_by_func(self->buffer, on_insert_text_headings,
+                                    self);
+  g_signal_handlers_unblock_by_func(self->buffer, on_delete_range_record, self);
+  g_signal_handlers_unblock_by_func(self->buffer, on_insert_text_record, self);
   self->updating_tags = FALSE;
-  g_free(display);
+  markyd_heading_index_rebuild(self->heading_index);
+  markyd_shadow_text_set(self->shadow, content);
+  count_stats(self, content);
+
+  /* History belongs to the note it was typed in */
+  markyd_undo_clear(self->undo);
 
   /* Apply markdown formatting */
   schedule_markdown_apply(self);
 }
 
+const gchar *markyd_editor_peek_content(MarkydEditor *self) {
+  gint64 started = g_get_monotonic_time();
+  const gchar *text;
+
+  /*
+   * The shadow copy holds the raw markdown, hidden syntax included and hrule
+   * anchors left out, so no GtkTextIter walk is needed to save.
+   */
+  text = markyd_shadow_text_peek(self->shadow, NULL);
+  markyd_latency_record_since(MARKYD_LATENCY_GET_CONTENT, started);
+  return text;
+}
+
 gchar *markyd_editor_get_content(MarkydEditor *self) {
+  return g_strdup(markyd_editor_peek_content(self));
+}
+
+void markyd_editor_set_folds(MarkydEditor *self, GArray *lines) {
+  clear_folds(self);
+  for (guint i = 0; i < lines->len; i++) {
+    GtkTextIter iter;
+
+    gtk_text_buffer_get_iter_at_line(self->buffer, &iter,
+                                     g_array_index(lines, gint, i));
+    g_ptr_array_add(self->folds, gtk_text_buffer_create_mark(
+                                     self->buffer, NULL, &iter, TRUE));
+  }
+  schedule_markdown_apply(self);
+}
+
+GArray *markyd_editor_get_folds(MarkydEditor *self) {
+  return fold_lines(self);
+}
+
+/* Fold or unfold the heading section or code block on the cursor's line */
+static void set_fold_at_cursor(MarkydEditor *self, gboolean folded) {
+  GtkTextIter line;
+  gint cursor_line;
+  gint found = -1;
+
+  gtk_text_buffer_get_iter_at_mark(self->buffer, &line,
+                                   gtk_text_buffer_get_insert(self->buffer));
+  cursor_line = gtk_text_iter_get_line(&line);
+  gtk_text_iter_set_line_offset(&line, 0);
+
+  for (guint i = 0; i < self->folds->len && found < 0; i++) {
+    GtkTextIter at;
+
+    gtk_text_buffer_get_iter_at_mark(self->buffer, &at,
+                                     g_ptr_array_index(self->folds, i));
+    if (gtk_text_iter_get_line(&at) == cursor_line) {
+      found = (gint)i;
+    }
+  }
+
+  if (folded == (found >= 0)) {
+    return;
+  }
+  if (folded) {
+    g_ptr_array_add(self->folds, gtk_text_buffer_create_mark(
+                                     self->buffer, NULL, &line, TRUE));
+  } else {
+    gtk_text_buffer_delete_mark(self->buffer,
+                                g_ptr_array_index(self->folds, found));
+    g_ptr_array_remove_index(self->folds, (guint)found);
+  }
+
+  /* Right away, so a line that can't fold is dropped before it is saved */
+  apply_markdown(self);
+  markyd_app_save_folds(self->app);
+}
+
+static void set_find_status(MarkydEditor *self, gboolean done) {
+  if (self->app && self->app->window) {
+    markyd_window_set_find_status(self->app->window, self->find_matches, done);
+  }
+}
+
+static void on_find_matches(const gint *offsets, guint n_matches,
+                            gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+
+  for (guint i = 0; i < n_matches; i++) {
+    GtkTextIter start, end;
+
+    iter_at_text_offset(self, &start, offsets[2 * i]);
+    iter_at_text_offset(self, &end, offsets[2 * i + 1]);
+    gtk_text_buffer_apply_tag_by_name(self->buffer, MARKYD_TAG_FIND_MATCH,
+                                      &start, &end);
+  }
+  self->find_matches += n_matches;
+  set_find_status(self, FALSE);
+
+  /* Large notes are searched on a worker: this may be well after the query
+   * changed, but it is the first moment there is anything to select */
+  if (self->find_select && n_matches > 0) {
+    self->find_select = FALSE;
+    markyd_editor_find_next(self, FALSE);
+  }
+}
+
+static void on_find_done(guint matches, gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+
+  self->find_select = FALSE;
+  self->find_matches = matches;
+  set_find_status(self, TRUE);
+}
+
+/* Search a snapshot of the text again, from the top of the view */
+static gboolean find_restart(MarkydEditor *self, GError **error) {
+  GtkTextView *view = GTK_TEXT_VIEW(self->text_view);
+  GtkTextIter start, end, iter;
+  GdkRectangle visible;
+  const gchar *text;
+  gsize length;
+  gint from, to;
+
+  markyd_find_cancel(self->find);
+  self->find = NULL;
+  self->find_matches = 0;
+  gtk_text_buffer_get_bounds(self->buffer, &start, &end);
+  gtk_text_buffer_remove_tag_by_name(self->buffer, MARKYD_TAG_FIND_MATCH,
+                                     &start, &end);
+  if (!self->find_pattern) {
+    return TRUE;
+  }
+
+  gtk_text_view_get_visible_rect(view, &visible);
+  gtk_text_view_get_iter_at_location(view, &iter, visible.x, visible.y);
+  gtk_text_iter_set_line_offset(&iter, 0);
+  from = text_offset(self, &iter);
+  gtk_text_view_get_iter_at_location(view, &iter, visible.x + visible.width,
+                                     visible.y + visible.height);
+  to = text_offset(self, &iter);
+
+  /* The shadow copy has the hidden markdown syntax and no hrule anchors,
+   * like the buffer text, without walking the buffer for it */
+  text = markyd_shadow_text_peek(self->shadow, &length);
+  self->find = markyd_find_start(g_strndup(text, length), self->find_pattern,
+                                 self->find_regex, self->find_case, from, to,
+                                 on_find_matches, on_find_done, self, error);
+  return self->find != NULL;
+}
+
+gboolean markyd_editor_find(MarkydEditor *self, const gchar *pattern,
+                            gboolean use_regex, gboolean case_sensitive,
+                            GError **error) {
+  g_free(self->find_pattern);
+  self->find_pattern = pattern && pattern[0] ? g_strdup(pattern) : NULL;
+  self->find_regex = use_regex;
+  self->find_case = case_sensitive;
+  self->find_select = self->find_pattern != NULL;
+
+  if (!find_restart(self, error)) {
+    self->find_select = FALSE;
+    g_clear_pointer(&self->find_pattern, g_free);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Bounds of the nearest match starting at or after iter (ending at or
+ * before it if backward) */
+static gboolean find_match_from(GtkTextIter *iter, GtkTextTag *tag,
+                                gboolean backward, GtkTextIter *start,
+                                GtkTextIter *end) {
+  if (!backward) {
+    if (!gtk_text_iter_starts_tag(iter, tag)) {
+      if (gtk_text_iter_has_tag(iter, tag)) {
+        gtk_text_iter_forward_to_tag_toggle(iter, tag);
+      }
+      if (!gtk_text_iter_forward_to_tag_toggle(iter, tag)) {
+        return FALSE;
+      }
+    }
+    *start = *end = *iter;
+    gtk_text_iter_forward_to_tag_toggle(end, tag);
+    return TRUE;
+  }
+
+  if (!gtk_text_iter_ends_tag(iter, tag)) {
+    if (gtk_text_iter_has_tag(iter, tag) &&
+        !gtk_text_iter_starts_tag(iter, tag)) {
+      gtk_text_iter_backward_to_tag_toggle(iter, tag);
+    }
+    if (!gtk_text_iter_backward_to_tag_toggle(iter, tag)) {
+      return FALSE;
+    }
+  }
+  *start = *end = *iter;
+  gtk_text_iter_backward_to_tag_toggle(start, tag);
+  return TRUE;
+}
+
+gboolean markyd_editor_find_next(MarkydEditor *self, gboolean backward) {
+  GtkTextTag *tag = gtk_text_tag_table_lookup(
+      gtk_text_buffer_get_tag_table(self->buffer), MARKYD_TAG_FIND_MATCH);
+  GtkTextIter iter, start, end;
+
+  gtk_text_buffer_get_selection_bounds(self->buffer, &start, &end);
+  iter = backward ? start : end;
+  if (!find_match_from(&iter, tag, backward, &start, &end)) {
+    if (backward) {
+      gtk_text_buffer_get_end_iter(self->buffer, &iter);
+    } else {
+      gtk_text_buffer_get_start_iter(self->buffer, &iter);
+    }
+    if (!find_match_from(&iter, tag, backward, &start, &end)) {
+      return FALSE;
+    }
+  }
+
+  gtk_text_buffer_select_range(self->buffer, &start, &end);
+  gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(self->text_view),
+                               gtk_text_buffer_get_insert(self->buffer), 0.1,
+                               FALSE, 0.0, 0.0);
+  return TRUE;
+}
+
+gint markyd_editor_replace_all(MarkydEditor *self, const gchar *replacement,
+                               GError **error) {
   GtkTextIter start, end;
-  GString *out;
-  GtkTextIter iter;
-  gchar *raw;
-  gchar *converted;
+  gchar *text;
+  gchar *result;
+  gsize old_len, new_len, prefix = 0, suffix = 0;
+  guint replaced = 0;
+
+  if (!self->find_pattern) {
+    return 0;
+  }
 
   gtk_text_buffer_get_bounds(self->buffer, &start, &end);
+  text = gtk_text_buffer_get_text(self->buffer, &start, &end, TRUE);
+  result = markyd_find_replace_all(text, self->find_pattern, self->find_regex,
+                                   self->find_case, replacement, &replaced,
+                                   error);
+  if (!result) {
+    g_free(text);
+    return -1;
+  }
 
   /*
-   * TRUE = include hidden chars (markdown syntax) so they're preserved when
-   * saving, but skip embedded widget anchors (e.g., horizontal rules).
+   * One edit over the span between the first and the last change, rather
+   * than one per match: a single undo step, and a single render once the
+   * buffer settles.
    */
-  out = g_string_new(NULL);
-  iter = start;
-  while (!gtk_text_iter_equal(&iter, &end)) {
-    GtkTextIter next = iter;
-    gtk_text_iter_forward_char(&next);
+  old_len = strlen(text);
+  new_len = strlen(result);
+  while (prefix < old_len && prefix < new_len && text[prefix] == result[prefix]) {
+    prefix++;
+  }
+  while (prefix > 0 && ((text[prefix] & 0xC0) == 0x80 ||
+                        (result[prefix] & 0xC0) == 0x80)) {
+    prefix--;
+  }
+  while (suffix < old_len - prefix && suffix < new_len - prefix &&
+         text[old_len - 1 - suffix] == result[new_len - 1 - suffix]) {
+    suffix++;
+  }
+  while (suffix > 0 && (text[old_len - suffix] & 0xC0) == 0x80) {
+    suffix--;
+  }
 
-    if (gtk_text_iter_get_child_anchor(&iter)) {
-      iter = next;
-      continue;
-    }
+  if (replaced > 0 && (prefix < old_len - suffix || prefix < new_len - suffix)) {
+    gint first = (gint)g_utf8_strlen(text, (gssize)prefix);
 
-    gchar *chunk = gtk_text_buffer_get_text(self->buffer, &iter, &next, TRUE);
-    g_string_append(out, chunk);
-    g_free(chunk);
-    iter = next;
+    iter_at_text_offset(self, &start, first);
+    iter_at_text_offset(
+        self, &end,
+        first + (gint)g_utf8_strlen(text + prefix,
+                                    (gssize)(old_len - suffix - prefix)));
+    gtk_text_buffer_begin_user_action(self->buffer);
+    gtk_text_buffer_delete(self->buffer, &start, &end);
+    gtk_text_buffer_insert(self->buffer, &start, result + prefix,
+                           (gint)(new_len - suffix - prefix));
+    gtk_text_buffer_end_user_action(self->buffer);
   }
 
-  raw = gstring_steal_compat(out);
-  converted = display_to_markdown_text(raw);
-  g_free(raw);
-  return converted;
+  g_free(result);
+  g_free(text);
+  return (gint)replaced;
+}
+
+void markyd_editor_goto_line(MarkydEditor *self, gint line) {
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_iter_at_line(self->buffer, &iter, line);
+  gtk_text_buffer_place_cursor(self->buffer, &iter);
+  gtk_text_view_scroll_to_mark(GTK_TEXT_VIEW(self->text_view),
+                               gtk_text_buffer_get_insert(self->buffer), 0.0,
+                               TRUE, 0.0, 0.0);
+  gtk_widget_grab_focus(self->text_view);
 }
 
 GtkWidget *markyd_editor_get_widget(MarkydEditor *self) {
@@ -570,17 +1044,10 @@ static gboolean is_empty_list_item(const gchar *line) {
   if (!line || !*line)
     return FALSE;
 
-  const gchar *bullet_prefix = "• ";
-  const gsize bullet_prefix_len = strlen(bullet_prefix);
-
   /* Unordered list: "- " or "* " with nothing after */
   if ((line[0] == '-' || line[0] == '*') && line[1] == ' ') {
     return line[2] == '\0';
   }
-  /* Unordered list (display): "• " with nothing after */
-  if (g_str_has_prefix(line, bullet_prefix)) {
-    return strlen(line) == bullet_prefix_len;
-  }
 
   /* Ordered list: "1. ", "2. ", etc. with nothing after */
   if (g_ascii_isdigit(line[0])) {
@@ -600,9 +1067,6 @@ static gchar *get_next_list_prefix(const gchar *line) {
   if (!line || !*line)
     return NULL;
 
-  const gchar *bullet_prefix = "• ";
-  const gsize bullet_prefix_len = strlen(bullet_prefix);
-
   /* Unordered list: "- " or "* " */
   if ((line[0] == '-' || line[0] == '*') && line[1] == ' ') {
     /* Check if line has content after prefix */
@@ -611,13 +1075,6 @@ static gchar *get_next_list_prefix(const gchar *line) {
     }
     return g_strndup(line, 2);
   }
-  /* Unordered list (display): "• " */
-  if (g_str_has_prefix(line, bullet_prefix)) {
-    if (strlen(line) == bullet_prefix_len) {
-      return NULL;
-    }
-    return g_strdup(bullet_prefix);
-  }
 
   /* Ordered list: "1. ", "2. ", etc. */
   if (g_ascii_isdigit(line[0])) {
@@ -651,6 +1108,10 @@ static gboolean on_key_press(GtkWidget *widget, GdkEventKey *event,
 
   (void)widget;
 
+  /* Timed until the buffer reports the change this key makes, if any */
+  self->key_press_time = g_get_monotonic_time();
+  self->key_press_event_time = event ? event->time : 0;
+
   if (event && event->keyval == GDK_KEY_Escape) {
     if (self->app && self->app->window) {
       markyd_window_close_to_tray(self->app->window);
@@ -658,104 +1119,40 @@ static gboolean on_key_press(GtkWidget *widget, GdkEventKey *event,
     }
   }
 
-  /* Ctrl+V: tracked paste so Ctrl+Z can undo it (single level). */
-  if ((event->state & GDK_CONTROL_MASK) &&
-      (event->keyval == GDK_KEY_v || event->keyval == GDK_KEY_V)) {
-    GtkClipboard *cb = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
-    gchar *clip = gtk_clipboard_wait_for_text(cb);
-    GtkTextIter sel_start, sel_end;
-    gboolean had_selection =
-        gtk_text_buffer_get_selection_bounds(buffer, &sel_start, &sel_end);
-
-    if (!clip) {
-      return FALSE;
-    }
-
-    self->in_paste = TRUE;
-    clear_last_paste(self);
+  /* Nothing below may edit while a large paste is streaming in */
+  if (!gtk_text_view_get_editable(GTK_TEXT_VIEW(self->text_view))) {
+    return FALSE;
+  }
 
-    self->paste_had_selection = had_selection;
-    if (had_selection) {
-      self->paste_sel_start_offset = gtk_text_iter_get_offset(&sel_start);
-      self->paste_sel_end_offset = gtk_text_iter_get_offset(&sel_end);
-      self->paste_replaced_text =
-          gtk_text_buffer_get_text(buffer, &sel_start, &sel_end, TRUE);
-    } else {
-      gtk_text_buffer_get_iter_at_mark(buffer, &cursor,
-                                       gtk_text_buffer_get_insert(buffer));
-      self->paste_sel_start_offset = gtk_text_iter_get_offset(&cursor);
-      self->paste_sel_end_offset = self->paste_sel_start_offset;
-      self->paste_replaced_text = g_strdup("");
-      sel_start = cursor;
-      sel_end = cursor;
+  /* Ctrl+Shift+[ folds, Ctrl+Shift+] unfolds the section at the cursor */
+  if (event && (event->state & GDK_CONTROL_MASK) &&
+      (event->state & GDK_SHIFT_MASK)) {
+    if (event->keyval == GDK_KEY_braceleft ||
+        event->keyval == GDK_KEY_bracketleft) {
+      set_fold_at_cursor(self, TRUE);
+      return TRUE;
     }
-
-    /* Mark start of insertion, then delete selection and insert clipboard text. */
-    self->paste_inserted_start =
-        gtk_text_buffer_create_mark(buffer, NULL, &sel_start, TRUE);
-
-    if (had_selection) {
-      gtk_text_buffer_delete(buffer, &sel_start, &sel_end);
-      gtk_text_buffer_get_iter_at_mark(buffer, &sel_start,
-                                       self->paste_inserted_start);
+    if (event->keyval == GDK_KEY_braceright ||
+        event->keyval == GDK_KEY_bracketright) {
+      set_fold_at_cursor(self, FALSE);
+      return TRUE;
     }
-
-    gtk_text_buffer_insert(buffer, &sel_start, clip, -1);
-    self->paste_inserted_end =
-        gtk_text_buffer_create_mark(buffer, NULL, &sel_start, FALSE);
-
-    gtk_text_buffer_place_cursor(buffer, &sel_start);
-
-    self->paste_clipboard_text = clip; /* keep for debug/inspection */
-    self->paste_valid = TRUE;
-    self->in_paste = FALSE;
-
-    schedule_markdown_apply(self);
-    return TRUE;
   }
 
-  /* Ctrl+Z: undo last paste (single level) */
+  /* Ctrl+Z: undo; Ctrl+Shift+Z or Ctrl+Y: redo */
   if ((event->state & GDK_CONTROL_MASK) &&
-      (event->keyval == GDK_KEY_z || event->keyval == GDK_KEY_Z)) {
-    if (self->paste_valid && self->paste_inserted_start &&
-        self->paste_inserted_end) {
-      GtkTextIter start, end;
-      GtkTextIter restore_start;
-
-      self->in_undo = TRUE;
-      self->updating_tags = TRUE;
-
-      gtk_text_buffer_get_iter_at_mark(buffer, &start, self->paste_inserted_start);
-      gtk_text_buffer_get_iter_at_mark(buffer, &end, self->paste_inserted_end);
-      restore_start = start;
-
-      gtk_text_buffer_delete(buffer, &start, &end);
-
-      if (self->paste_replaced_text && self->paste_replaced_text[0] != '\0') {
-        gtk_text_buffer_insert(buffer, &restore_start, self->paste_replaced_text,
-                               -1);
-      }
-
-      /* Restore selection/cursor */
-      if (self->paste_had_selection) {
-        GtkTextIter sel_a, sel_b;
-        gtk_text_buffer_get_iter_at_offset(buffer, &sel_a,
-                                           self->paste_sel_start_offset);
-        gtk_text_buffer_get_iter_at_offset(buffer, &sel_b,
-                                           self->paste_sel_end_offset);
-        gtk_text_buffer_select_range(buffer, &sel_a, &sel_b);
-      } else {
-        gtk_text_buffer_place_cursor(buffer, &restore_start);
-      }
-
-      self->updating_tags = FALSE;
-      self->in_undo = FALSE;
-
-      clear_last_paste(self);
-      schedule_markdown_apply(self);
-      return TRUE;
+      (event->keyval == GDK_KEY_z || event->keyval == GDK_KEY_Z ||
+       event->keyval == GDK_KEY_y || event->keyval == GDK_KEY_Y)) {
+    gboolean redo = event->keyval == GDK_KEY_y || event->keyval == GDK_KEY_Y ||
+                    (event->state & GDK_SHIFT_MASK);
+    gboolean done = redo ? markyd_undo_redo(self->undo, apply_undo_op, self)
+                         : markyd_undo_undo(self->undo, apply_undo_op, self);
+
+    if (done) {
+      gtk_text_view_scroll_mark_onscreen(GTK_TEXT_VIEW(self->text_view),
+                                         gtk_text_buffer_get_insert(buffer));
     }
-    return FALSE;
+    return TRUE;
   }
 
   /* Only handle Return/Enter key */
@@ -871,11 +1268,19 @@ static void on_buffer_changed(GtkTextBuffer *buffer, gpointer user_data) {
     return;
   }
 
-  /* Any edit after a paste invalidates our one-level "undo paste". */
-  if (self->paste_valid && !self->in_paste && !self->in_undo &&
-      !self->pending_paste_finalize) {
-    clear_last_paste(self);
+  if (self->key_press_time != 0 &&
+      gtk_get_current_event_time() == self->key_press_event_time) {
+    markyd_latency_record_since(MARKYD_LATENCY_KEYSTROKE,
+                                self->key_press_time);
   }
+  self->key_press_time = 0;
+
+  /* Link ranges are stale until the next render, and so are find results
+   * still on their way; the render searches again */
+  markyd_link_index_clear(self->links);
+  markyd_find_cancel(self->find);
+  self->find = NULL;
+  self->find_select = FALSE; /* Typing in the note: leave the cursor be */
 
   /* Schedule auto-save */
   markyd_app_schedule_save(self->app);
@@ -884,72 +1289,309 @@ static void on_buffer_changed(GtkTextBuffer *buffer, gpointer user_data) {
   schedule_markdown_apply(self);
 }
 
+static void on_insert_text_record(GtkTextBuffer *buffer, GtkTextIter *location,
+                                  gchar *text, gint len, gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  gint offset = text_offset(self, location);
+  (void)buffer;
+
+  markyd_undo_record(self->undo, MARKYD_UNDO_INSERT, offset, text, len);
+  markyd_shadow_text_insert(self->shadow, offset, text, len);
+  markyd_doc_stats_insert(self->stats, char_before(location), text, len,
+                          char_after(location));
+}
+
+static void on_delete_range_record(GtkTextBuffer *buffer, GtkTextIter *start,
+                                   GtkTextIter *end, gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  gint offset = text_offset(self, start);
+  gchar *text;
+
+  /* Hidden markdown syntax included; hrule anchors are not note text */
+  text = gtk_text_buffer_get_text(buffer, start, end, TRUE);
+  markyd_undo_record(self->undo, MARKYD_UNDO_DELETE, offset, text, -1);
+  markyd_shadow_text_delete(self->shadow, offset, strlen(text));
+  markyd_doc_stats_delete(self->stats, char_before(start), text, -1,
+                          char_after(end));
+  g_free(text);
+}
+
+static void on_insert_text_headings(GtkTextBuffer *buffer,
+                                    GtkTextIter *location, gchar *text,
+                                    gint len, gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  GtkTextIter start = *location; /* Now past the inserted text */
+  (void)buffer;
+
+  gtk_text_iter_backward_chars(&start, (gint)g_utf8_strlen(text, len));
+  markyd_heading_index_update(self->heading_index,
+                              gtk_text_iter_get_line(&start),
+                              gtk_text_iter_get_line(location));
+}
+
+static void on_delete_range_headings(GtkTextBuffer *buffer,
+                                     GtkTextIter *start, GtkTextIter *end,
+                                     gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  gint line = gtk_text_iter_get_line(start);
+  (void)buffer;
+  (void)end;
+
+  markyd_heading_index_update(self->heading_index, line, line);
+}
+
+static void on_begin_user_action(GtkTextBuffer *buffer, gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  (void)buffer;
+
+  markyd_undo_begin_action(self->undo);
+}
+
+static void on_end_user_action(GtkTextBuffer *buffer, gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  (void)buffer;
+
+  markyd_undo_end_action(self->undo);
+}
+
+/* A paste or drop waiting for its text */
+typedef struct _PasteRequest {
+  MarkydEditor *editor;
+  GCancellable *cancellable; /* Cancelled once editor is gone or reloaded */
+  GtkTextMark *at; /* NULL: at the cursor, replacing the selection */
+} PasteRequest;
+
+static PasteRequest *paste_request_new(MarkydEditor *self,
+                                       const GtkTextIter *at) {
+  PasteRequest *request = g_new0(PasteRequest, 1);
+
+  request->editor = self;
+  request->cancellable = g_object_ref(self->stream_cancellable);
+  if (at) {
+    request->at = g_object_ref(
+        gtk_text_buffer_create_mark(self->buffer, NULL, at, TRUE));
+  }
+  return request;
+}
+
+/* Insert text (owned, may be NULL) unless the request was cancelled */
+static void paste_request_finish(PasteRequest *request, gchar *text) {
+  gboolean cancelled = g_cancellable_is_cancelled(request->cancellable);
+
+  if (!cancelled && text) {
+    MarkydEditor *self = request->editor;
+    GtkTextIter at;
+
+    if (request->at) {
+      gtk_text_buffer_get_iter_at_mark(self->buffer, &at, request->at);
+    } else {
+      gtk_text_buffer_get_iter_at_mark(self->buffer, &at,
+                                       gtk_text_buffer_get_insert(self->buffer));
+    }
+    insert_text_streamed(self, &at, text, request->at == NULL);
+    text = NULL;
+  }
+
+  if (request->at) {
+    GtkTextBuffer *buffer = gtk_text_mark_get_buffer(request->at);
+    if (buffer) {
+      gtk_text_buffer_delete_mark(buffer, request->at);
+    }
+    g_object_unref(request->at);
+  }
+  g_object_unref(request->cancellable);
+  g_free(request);
+  g_free(text);
+}
+
+static void on_clipboard_text(GtkClipboard *clipboard, const gchar *text,
+                              gpointer user_data) {
+  (void)clipboard;
+  paste_request_finish(user_data, g_strdup(text));
+}
+
+/* Ctrl+V and the context menu: GTK's paste would wait for the clipboard,
+ * then insert everything in one go */
 static void on_paste_clipboard(GtkTextView *text_view, gpointer user_data) {
   MarkydEditor *self = (MarkydEditor *)user_data;
-  GtkTextBuffer *buffer = self->buffer;
-  GtkTextIter sel_start, sel_end;
-  GtkTextIter insert_iter;
-
-  (void)text_view;
-
-  self->in_paste = TRUE;
-  clear_last_paste(self);
-
-  self->paste_had_selection =
-      gtk_text_buffer_get_selection_bounds(buffer, &sel_start, &sel_end);
-  if (self->paste_had_selection) {
-    self->paste_sel_start_offset = gtk_text_iter_get_offset(&sel_start);
-    self->paste_sel_end_offset = gtk_text_iter_get_offset(&sel_end);
-    self->paste_start_offset = self->paste_sel_start_offset;
-    self->paste_end_offset_before = self->paste_sel_end_offset;
-    self->paste_replaced_text =
-        gtk_text_buffer_get_text(buffer, &sel_start, &sel_end, TRUE);
-  } else {
-    gtk_text_buffer_get_iter_at_mark(buffer, &insert_iter,
-                                     gtk_text_buffer_get_insert(buffer));
-    self->paste_start_offset = gtk_text_iter_get_offset(&insert_iter);
-    self->paste_end_offset_before = self->paste_start_offset;
-    self->paste_replaced_text = g_strdup("");
-    self->paste_sel_start_offset = self->paste_start_offset;
-    self->paste_sel_end_offset = self->paste_start_offset;
+  GtkClipboard *clipboard;
+
+  g_signal_stop_emission_by_name(text_view, "paste-clipboard");
+  if (!gtk_text_view_get_editable(text_view)) {
+    return;
   }
 
-  GtkClipboard *cb = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
-  self->paste_clipboard_text = gtk_clipboard_wait_for_text(cb);
-  self->pending_paste_finalize = TRUE;
+  clipboard = gtk_widget_get_clipboard(GTK_WIDGET(text_view),
+                                       GDK_SELECTION_CLIPBOARD);
+  gtk_clipboard_request_text(clipboard, on_clipboard_text,
+                             paste_request_new(self, NULL));
 }
 
-static void on_paste_clipboard_after(GtkTextView *text_view, gpointer user_data) {
+/* Middle click pastes the PRIMARY selection at the pointer */
+static gboolean on_button_press(GtkWidget *widget, GdkEventButton *event,
+                                gpointer user_data) {
   MarkydEditor *self = (MarkydEditor *)user_data;
-  GtkTextBuffer *buffer = self->buffer;
-  gint inserted_chars;
-  GtkTextIter start_iter, end_iter;
+  GtkTextIter iter;
+  gint bx, by;
 
-  (void)text_view;
+  if (event->type != GDK_BUTTON_PRESS || event->button != 2) {
+    return FALSE;
+  }
+  if (event->state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK | GDK_MOD1_MASK)) {
+    return FALSE;
+  }
+  if (!gtk_text_view_get_editable(GTK_TEXT_VIEW(widget))) {
+    return FALSE;
+  }
+
+  gtk_text_view_window_to_buffer_coords(GTK_TEXT_VIEW(widget),
+                                        GTK_TEXT_WINDOW_TEXT, (gint)event->x,
+                                        (gint)event->y, &bx, &by);
+  gtk_text_view_get_iter_at_location(GTK_TEXT_VIEW(widget), &iter, bx, by);
+  gtk_clipboard_request_text(
+      gtk_widget_get_clipboard(widget, GDK_SELECTION_PRIMARY),
+      on_clipboard_text, paste_request_new(self, &iter));
+  return TRUE;
+}
+
+/* Dropped files that hold UTF-8 text, one after another */
+static void read_dropped_files(GTask *task, gpointer source_object,
+                               gpointer task_data, GCancellable *cancellable) {
+  gchar **uris = task_data;
+  GString *out = g_string_new(NULL);
 
-  if (!self->pending_paste_finalize) {
-    self->in_paste = FALSE;
+  (void)source_object;
+
+  for (guint i = 0; uris[i] && !g_cancellable_is_cancelled(cancellable); i++) {
+    gchar *path = g_filename_from_uri(uris[i], NULL, NULL);
+    gchar *contents = NULL;
+    gsize length = 0;
+    GError *error = NULL;
+
+    if (!path) {
+      continue;
+    }
+    if (!g_file_get_contents(path, &contents, &length, &error)) {
+      g_printerr("Failed to read dropped file '%s': %s\n", path,
+                 error->message);
+      g_clear_error(&error);
+    } else if (!g_utf8_validate(contents, (gssize)length, NULL)) {
+      g_printerr("Not inserting '%s': not a text file\n", path);
+    } else {
+      if (out->len > 0 && out->str[out->len - 1] != '\n') {
+        g_string_append_c(out, '\n');
+      }
+      g_string_append_len(out, contents, (gssize)length);
+    }
+    g_free(contents);
+    g_free(path);
+  }
+
+  g_task_return_pointer(task, g_string_free(out, FALSE), g_free);
+}
+
+static void on_dropped_files_read(GObject *source_object, GAsyncResult *result,
+                                  gpointer user_data) {
+  (void)source_object;
+  paste_request_finish(user_data,
+                       g_task_propagate_pointer(G_TASK(result), NULL));
+}
+
+/* Files and text dropped from other applications take the paste path;
+ * moving a selection within the editor stays with GTK */
+static void on_drag_data_received(GtkWidget *widget, GdkDragContext *context,
+                                  gint x, gint y, GtkSelectionData *data,
+                                  guint info, guint time,
+                                  gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  GtkTextIter at;
+  gchar **uris;
+  gint bx, by;
+
+  (void)info;
+
+  if (!gtk_text_view_get_editable(GTK_TEXT_VIEW(widget))) {
     return;
   }
-  self->pending_paste_finalize = FALSE;
 
-  if (!self->paste_clipboard_text) {
-    self->in_paste = FALSE;
+  gtk_text_view_window_to_buffer_coords(GTK_TEXT_VIEW(widget),
+                                        GTK_TEXT_WINDOW_WIDGET, x, y, &bx, &by);
+  gtk_text_view_get_iter_at_location(GTK_TEXT_VIEW(widget), &at, bx, by);
+
+  uris = gtk_selection_data_get_uris(data);
+  if (uris) {
+    GTask *task = g_task_new(NULL, self->stream_cancellable,
+                             on_dropped_files_read,
+                             paste_request_new(self, &at));
+
+    g_task_set_task_data(task, uris, (GDestroyNotify)g_strfreev);
+    g_task_run_in_thread(task, read_dropped_files);
+    g_object_unref(task);
+  } else if (gtk_drag_get_source_widget(context) != widget &&
+             gtk_selection_data_get_length(data) > 0) {
+    gchar *text = (gchar *)gtk_selection_data_get_text(data);
+
+    if (!text) {
+      return;
+    }
+    paste_request_finish(paste_request_new(self, &at), text);
+  } else {
     return;
   }
 
-  inserted_chars = g_utf8_strlen(self->paste_clipboard_text, -1);
-  gtk_text_buffer_get_iter_at_offset(buffer, &start_iter, self->paste_start_offset);
-  gtk_text_buffer_get_iter_at_offset(buffer, &end_iter,
-                                     self->paste_start_offset + inserted_chars);
+  g_signal_stop_emission_by_name(widget, "drag-data-received");
+  gtk_drag_finish(context, TRUE, FALSE, time);
+}
 
-  self->paste_inserted_start =
-      gtk_text_buffer_create_mark(buffer, NULL, &start_iter, TRUE);
-  self->paste_inserted_end =
-      gtk_text_buffer_create_mark(buffer, NULL, &end_iter, FALSE);
+/*
+ * List markers stay "- " or "* " in the buffer. The renderer makes them
+ * transparent, and a bullet is painted over each one on the visible lines.
+ */
+static gboolean on_text_view_draw(GtkWidget *widget, cairo_t *cr,
+                                  gpointer user_data) {
+  MarkydEditor *self = (MarkydEditor *)user_data;
+  GtkTextView *view = GTK_TEXT_VIEW(widget);
+  GtkTextTag *tag;
+  GdkRectangle visible;
+  GtkTextIter iter, last;
+  PangoLayout *layout;
+  GdkRGBA color;
+  gint width, height;
 
-  self->paste_valid = TRUE;
-  self->in_paste = FALSE;
+  if (!gtk_cairo_should_draw_window(
+          cr, gtk_text_view_get_window(view, GTK_TEXT_WINDOW_TEXT))) {
+    return FALSE;
+  }
+  tag = gtk_text_tag_table_lookup(gtk_text_buffer_get_tag_table(self->buffer),
+                                  MARKYD_TAG_LIST_MARKER);
+  if (!tag || !gdk_rgba_parse(&color, config->list_bullet_color)) {
+    return FALSE;
+  }
+
+  gtk_text_view_get_visible_rect(view, &visible);
+  gtk_text_view_get_line_at_y(view, &iter, visible.y, NULL);
+  gtk_text_view_get_line_at_y(view, &last, visible.y + visible.height, NULL);
+
+  layout = gtk_widget_create_pango_layout(widget, "•");
+  pango_layout_get_pixel_size(layout, &width, &height);
+  gdk_cairo_set_source_rgba(cr, &color);
+  do {
+    if (gtk_text_iter_has_tag(&iter, tag)) {
+      GdkRectangle marker;
+      gint x, y;
+
+      gtk_text_view_get_iter_location(view, &iter, &marker);
+      gtk_text_view_buffer_to_window_coords(view, GTK_TEXT_WINDOW_WIDGET,
+                                            marker.x, marker.y, &x, &y);
+      cairo_move_to(cr, x + (marker.width - width) / 2.0,
+                    y + (marker.height - height) / 2.0);
+      pango_cairo_show_layout(cr, layout);
+    }
+  } while (gtk_text_iter_compare(&iter, &last) < 0 &&
+           gtk_text_iter_forward_line(&iter));
+  g_object_unref(layout);
+
+  return FALSE;
 }
 
 static void on_text_view_size_allocate(GtkWidget *widget,
@@ -983,7 +1625,8 @@ static gboolean on_button_release(GtkWidget *widget, GdkEventButton *event,
   MarkydEditor *self = (MarkydEditor *)user_data;
   GtkTextIter iter;
   gint bx, by;
-  gchar *url = NULL;
+  const gchar *link;
+  gchar *url;
   GError *error = NULL;
 
   if (event->button != 1) {
@@ -1000,14 +1643,15 @@ static gboolean on_button_release(GtkWidget *widget, GdkEventButton *event,
                                         (gint)event->y, &bx, &by);
   gtk_text_view_get_iter_at_location(GTK_TEXT_VIEW(widget), &iter, bx, by);
 
-  if (!get_link_url_at_iter(self->buffer, &iter, &url)) {
+  link = get_link_url_at_iter(self, &iter);
+  if (!link) {
     return FALSE;
   }
 
-  if (g_uri_parse_scheme(url) == NULL) {
-    gchar *with_scheme = g_strdup_printf("https://%s", url);
-    g_free(url);
-    url = with_scheme;
+  if (g_uri_parse_scheme(link) == NULL) {
+    url = g_strdup_printf("https://%s", link);
+  } else {
+    url = g_strdup(link);
   }
 
   GtkWidget *toplevel = gtk_widget_get_toplevel(widget);
@@ -1024,77 +1668,20 @@ static gboolean on_button_release(GtkWidget *widget, GdkEventButton *event,
   return TRUE;
 }
 
-static gboolean on_button_press(GtkWidget *widget, GdkEventButton *event,
-                                gpointer user_data) {
-  MarkydEditor *self = (MarkydEditor *)user_data;
-  GtkTextBuffer *buffer = self->buffer;
-  GtkTextIter iter;
-  gint bx, by;
-
-  /* Middle click paste (PRIMARY selection) with undo-paste support. */
-  if (event->button != 2) {
-    return FALSE;
-  }
-  if (event->state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK | GDK_MOD1_MASK)) {
-    return FALSE;
-  }
-
-  GtkClipboard *cb = gtk_clipboard_get(GDK_SELECTION_PRIMARY);
-  gchar *clip = gtk_clipboard_wait_for_text(cb);
-  if (!clip) {
-    return FALSE; /* fall back to default behavior */
-  }
-
-  gtk_text_view_window_to_buffer_coords(GTK_TEXT_VIEW(widget),
-                                        GTK_TEXT_WINDOW_TEXT, (gint)event->x,
-                                        (gint)event->y, &bx, &by);
-  gtk_text_view_get_iter_at_location(GTK_TEXT_VIEW(widget), &iter, bx, by);
-
-  self->in_paste = TRUE;
-  clear_last_paste(self);
-
-  /* Middle-click paste typically inserts at pointer; don't replace selection. */
-  self->paste_had_selection = FALSE;
-  self->paste_replaced_text = g_strdup("");
-
-  gtk_text_buffer_place_cursor(buffer, &iter);
-  self->paste_sel_start_offset = gtk_text_iter_get_offset(&iter);
-  self->paste_sel_end_offset = self->paste_sel_start_offset;
-
-  self->paste_inserted_start =
-      gtk_text_buffer_create_mark(buffer, NULL, &iter, TRUE);
-
-  gtk_text_buffer_insert(buffer, &iter, clip, -1);
-  self->paste_inserted_end =
-      gtk_text_buffer_create_mark(buffer, NULL, &iter, FALSE);
-
-  gtk_text_buffer_place_cursor(buffer, &iter);
-
-  g_free(self->paste_clipboard_text);
-  self->paste_clipboard_text = clip;
-  self->paste_valid = TRUE;
-  self->in_paste = FALSE;
-
-  schedule_markdown_apply(self);
-  return TRUE;
-}
-
 static gboolean on_motion_notify(GtkWidget *widget, GdkEventMotion *event,
                                  gpointer user_data) {
   MarkydEditor *self = (MarkydEditor *)user_data;
   GtkTextIter iter;
   gint bx, by;
-  gchar *url = NULL;
 
   gtk_text_view_window_to_buffer_coords(GTK_TEXT_VIEW(widget),
                                         GTK_TEXT_WINDOW_TEXT, (gint)event->x,
                                         (gint)event->y, &bx, &by);
   gtk_text_view_get_iter_at_location(GTK_TEXT_VIEW(widget), &iter, bx, by);
+  set_link_cursor(self, get_link_url_at_iter(self, &iter) != NULL);
 
-  gboolean over_link = get_link_url_at_iter(self->buffer, &iter, &url);
-  g_free(url);
-  set_link_cursor(self, over_link);
-
+  /* Motion hints: ask for the next event only once this one is handled */
+  gdk_event_request_motions(event);
   return FALSE;
 }
 
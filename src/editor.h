@@ -4,6 +4,12 @@
 #include <gtk/gtk.h>
 
 typedef struct _MarkydApp MarkydApp;
+typedef struct _MarkydUndo MarkydUndo;
+typedef struct _MarkydLinkIndex MarkydLinkIndex;
+typedef struct _MarkydFind MarkydFind;
+typedef struct _MarkydShadowText MarkydShadowText;
+typedef struct _MarkydDocStats MarkydDocStats;
+typedef struct _MarkydHeadingIndex MarkydHeadingIndex;
 
 typedef struct _MarkydEditor {
   GtkWidget *text_view;
@@ -16,20 +22,52 @@ typedef struct _MarkydEditor {
   /* Coalesce markdown re-rendering to idle to avoid invalidating GTK iterators. */
   guint markdown_idle_id;
 
-  /* "Undo last paste" support (single-level) */
-  gboolean in_paste;
-  gboolean in_undo;
-  gboolean pending_paste_finalize;
-  gint paste_start_offset;
-  gint paste_end_offset_before;
-  gchar *paste_replaced_text;
-  gchar *paste_clipboard_text;
-  GtkTextMark *paste_inserted_start;
-  GtkTextMark *paste_inserted_end;
-  gboolean paste_valid;
-  gboolean paste_had_selection;
-  gint paste_sel_start_offset;
-  gint paste_sel_end_offset;
+  /* Undo/redo history of the open note */
+  MarkydUndo *undo;
+
+  /* Live hrule anchors in buffer order; undo offsets leave them out */
+  GPtrArray *hrule_anchors;
+
+  /* The note's text, updated alongside undo, so saves skip the buffer */
+  MarkydShadowText *shadow;
+
+  /* Word, character and line counts, kept up to date from each edit */
+  MarkydDocStats *stats;
+  gboolean stats_counting; /* A large note is still being counted */
+
+  /* Links found by the last render, for hover and Ctrl+click */
+  MarkydLinkIndex *links;
+  gboolean link_cursor; /* Pointer cursor shown over a link */
+
+  /* Folded headings and code fences: a mark at the start of each line */
+  GPtrArray *folds;
+
+  /* Heading and fence lines, patched from each edit, and the headings the
+   * outline shows (MarkydHeading) as of the last render */
+  MarkydHeadingIndex *heading_index;
+  GArray *headings;
+
+  /* In-note find (Ctrl+F); pattern NULL while nothing is searched for */
+  gchar *find_pattern;
+  gboolean find_regex;
+  gboolean find_case;
+  MarkydFind *find; /* Search of the text as of the last render */
+  guint find_matches; /* Highlighted so far */
+  gboolean find_select; /* A new query: select its first match to arrive */
+
+  /* Last key press, for keystroke latency (time 0 once measured) */
+  gint64 key_press_time;
+  guint32 key_press_event_time;
+
+  /* Large paste or drop going in a chunk per frame (text NULL when idle) */
+  gchar *stream_text;
+  gsize stream_length;
+  gsize stream_done;
+  GtkTextMark *stream_mark;
+  guint stream_tick_id;
+  /* Cancels clipboard requests, file reads and the opening word count when
+   * the note changes */
+  GCancellable *stream_cancellable;
 } MarkydEditor;
 
 /* Lifecycle */
@@ -39,6 +77,32 @@ void markyd_editor_free(MarkydEditor *editor);
 /* Content management */
 void markyd_editor_set_content(MarkydEditor *editor, const gchar *content);
 gchar *markyd_editor_get_content(MarkydEditor *editor);
+/* The text without a copy; valid until the buffer next changes */
+const gchar *markyd_editor_peek_content(MarkydEditor *editor);
+
+/* Folded heading sections and code blocks, by the line they start on
+ * (ascending). get returns a new array. */
+void markyd_editor_set_folds(MarkydEditor *editor, GArray *lines);
+GArray *markyd_editor_get_folds(MarkydEditor *editor);
+
+/* Put the cursor at the start of line and scroll it to the top */
+void markyd_editor_goto_line(MarkydEditor *editor, gint line);
+
+/* Highlight every match of pattern (NULL or "" clears them), searching
+ * again after each edit, and select the first match after the selection as
+ * soon as one is found. FALSE with error for an invalid regex. */
+gboolean markyd_editor_find(MarkydEditor *editor, const gchar *pattern,
+                            gboolean use_regex, gboolean case_sensitive,
+                            GError **error);
+
+/* Select the highlighted match after the selection (before it if backward),
+ * wrapping around; FALSE if there is none */
+gboolean markyd_editor_find_next(MarkydEditor *editor, gboolean backward);
+
+/* Replace every match as one undoable edit. Returns how many, or -1 with
+ * error. */
+gint markyd_editor_replace_all(MarkydEditor *editor, const gchar *replacement,
+                               GError **error);
 
 /* Widget access */
 GtkWidget *markyd_editor_get_widget(MarkydEditor *editor);
@@ -0,0 +1,377 @@
+#define _GNU_SOURCE /* memmem */
+#include "find.h"
+#include <string.h>
+
+/* Texts from this size on are searched off the main thread */
+#define FIND_THREAD_MIN_BYTES (256 * 1024)
+/* Matches collected before they are handed to the main loop */
+#define FIND_BATCH 512
+
+struct _MarkydFind {
+  gint ref_count; /* Atomic: caller + worker + pending idle */
+  gint cancelled; /* Atomic */
+
+  gchar *text;
+  gsize length;
+  GRegex *regex; /* NULL for a plain case-sensitive search */
+  gchar *needle;
+  gsize needle_len;
+  gint from; /* Characters */
+  gint to;
+  gboolean threaded;
+
+  GMutex lock; /* Guards everything below */
+  GArray *pending; /* gint [start, end) pairs, waiting for the main loop */
+  guint idle_id;
+  gboolean finished;
+  guint matches;
+
+  MarkydFindMatchFunc match_func;
+  MarkydFindDoneFunc done_func;
+  gpointer user_data;
+};
+
+/* Scan position, to turn byte offsets into characters as matches come in */
+typedef struct _FindScan {
+  gsize byte;
+  gint chars;
+  gsize visible_end; /* Bytes; hand over what was found once past it */
+  gboolean visible_sent;
+  gsize first_start; /* Bytes; where the first match found starts */
+  gsize stop_end;    /* Bytes; a match ending past it ends the scan */
+  GArray *batch;
+} FindScan;
+
+static MarkydFind *find_ref(MarkydFind *find) {
+  g_atomic_int_inc(&find->ref_count);
+  return find;
+}
+
+static void find_unref(gpointer data) {
+  MarkydFind *find = data;
+
+  if (!g_atomic_int_dec_and_test(&find->ref_count)) {
+    return;
+  }
+
+  g_array_free(find->pending, TRUE);
+  if (find->regex) {
+    g_regex_unref(find->regex);
+  }
+  g_free(find->needle);
+  g_free(find->text);
+  g_mutex_clear(&find->lock);
+  g_free(find);
+}
+
+/* Same rules as notes grep: a regex unless plain and case-sensitive */
+static gboolean compile_pattern(const gchar *pattern, gboolean use_regex,
+                                gboolean case_sensitive, GRegex **regex,
+                                GError **error) {
+  GRegexCompileFlags flags = G_REGEX_OPTIMIZE | G_REGEX_MULTILINE;
+  gchar *source;
+
+  *regex = NULL;
+  if (!use_regex && case_sensitive) {
+    return TRUE;
+  }
+
+  source = use_regex ? g_strdup(pattern) : g_regex_escape_string(pattern, -1);
+  if (!case_sensitive) {
+    flags |= G_REGEX_CASELESS;
+  }
+  *regex = g_regex_new(source, flags, 0, error);
+  g_free(source);
+  return *regex != NULL;
+}
+
+static gboolean flush_matches(gpointer data) {
+  MarkydFind *find = data;
+  GArray *batch;
+  gboolean finished;
+  guint matches;
+
+  g_mutex_lock(&find->lock);
+  batch = find->pending;
+  find->pending = g_array_new(FALSE, FALSE, sizeof(gint));
+  find->idle_id = 0;
+  finished = find->finished;
+  matches = find->matches;
+  g_mutex_unlock(&find->lock);
+
+  if (batch->len > 0 && !g_atomic_int_get(&find->cancelled) &&
+      find->match_func) {
+    find->match_func((const gint *)batch->data, batch->len / 2,
+                     find->user_data);
+  }
+  g_array_free(batch, TRUE);
+
+  if (finished && !g_atomic_int_get(&find->cancelled) && find->done_func) {
+    find->done_func(matches, find->user_data);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Hand the scan's batch over; the main loop picks it up unless the search
+ * runs on it already */
+static void push_batch(MarkydFind *find, FindScan *scan, gboolean finished) {
+  g_mutex_lock(&find->lock);
+  g_array_append_vals(find->pending, scan->batch->data, scan->batch->len);
+  find->matches += scan->batch->len / 2;
+  find->finished = finished;
+  if (find->threaded && find->idle_id == 0 &&
+      (find->pending->len > 0 || finished)) {
+    find->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, flush_matches,
+                                    find_ref(find), find_unref);
+  }
+  g_mutex_unlock(&find->lock);
+  g_array_set_size(scan->batch, 0);
+}
+
+static void add_match(MarkydFind *find, FindScan *scan, gsize start,
+                      gsize end) {
+  gint range[2];
+
+  if (!scan->visible_sent && start >= scan->visible_end) {
+    push_batch(find, scan, FALSE);
+    scan->visible_sent = TRUE;
+  }
+
+  scan->first_start = MIN(scan->first_start, start);
+  scan->chars += (gint)g_utf8_strlen(find->text + scan->byte,
+                                     (gssize)(start - scan->byte));
+  scan->byte = start;
+  range[0] = scan->chars;
+  range[1] = range[0] + (gint)g_utf8_strlen(find->text + start,
+                                            (gssize)(end - start));
+  g_array_append_vals(scan->batch, range, 2);
+
+  if (scan->batch->len / 2 >= FIND_BATCH) {
+    push_batch(find, scan, FALSE);
+  }
+}
+
+/* Matches starting in [start, end), which may run past end */
+static void scan_range(MarkydFind *find, FindScan *scan, gsize start,
+                       gsize end) {
+  if (find->regex) {
+    GMatchInfo *match_info = NULL;
+
+    g_regex_match_full(find->regex, find->text, (gssize)find->length,
+                       (gint)start, 0, &match_info, NULL);
+    while (g_match_info_matches(match_info) &&
+           !g_atomic_int_get(&find->cancelled)) {
+      gint start_pos = 0;
+      gint end_pos = 0;
+
+      g_match_info_fetch_pos(match_info, 0, &start_pos, &end_pos);
+      if ((gsize)start_pos >= end || (gsize)end_pos > scan->stop_end) {
+        break;
+      }
+      if (end_pos > start_pos) {
+        add_match(find, scan, (gsize)start_pos, (gsize)end_pos);
+      }
+      g_match_info_next(match_info, NULL);
+    }
+    g_match_info_free(match_info);
+    return;
+  }
+
+  /* Only as far as a match starting before end can reach */
+  gsize limit = MIN(find->length, end + find->needle_len - 1);
+  gsize at = start;
+
+  while (at + find->needle_len <= limit &&
+         !g_atomic_int_get(&find->cancelled)) {
+    const gchar *hit =
+        memmem(find->text + at, limit - at, find->needle, find->needle_len);
+
+    if (!hit) {
+      break;
+    }
+    at = (gsize)(hit - find->text);
+    if (at + find->needle_len > scan->stop_end) {
+      break;
+    }
+    add_match(find, scan, at, at + find->needle_len);
+    at += find->needle_len;
+  }
+}
+
+/* Byte offset of character chars, or of the end; chars is clamped to match */
+static gsize byte_at_char(const MarkydFind *find, gint *chars) {
+  const gchar *p = find->text;
+  const gchar *end = find->text + find->length;
+  gint n = 0;
+
+  while (n < *chars && p < end) {
+    p = g_utf8_next_char(p);
+    n++;
+  }
+  *chars = n;
+  return (gsize)(p - find->text);
+}
+
+static void scan_all(MarkydFind *find) {
+  FindScan scan = {0};
+  gsize from;
+
+  from = byte_at_char(find, &find->from);
+  find->to = MAX(find->to, find->from);
+  scan.byte = from;
+  scan.chars = find->from;
+  scan.visible_end = byte_at_char(find, &find->to);
+  scan.first_start = G_MAXSIZE;
+  scan.stop_end = G_MAXSIZE;
+  scan.batch = g_array_new(FALSE, FALSE, sizeof(gint));
+
+  /* The visible part first, then the rest, then around from the top. A
+   * match there may run on past from; the last pass ends before one that
+   * would overlap the first match already found. */
+  scan_range(find, &scan, from, find->length);
+  push_batch(find, &scan, FALSE);
+  scan.byte = 0;
+  scan.chars = 0;
+  scan.visible_sent = TRUE;
+  scan.stop_end = scan.first_start;
+  scan_range(find, &scan, 0, from);
+  push_batch(find, &scan, TRUE);
+
+  g_array_free(scan.batch, TRUE);
+}
+
+static gpointer find_worker(gpointer data) {
+  MarkydFind *find = data;
+
+  scan_all(find);
+  find_unref(find);
+  return NULL;
+}
+
+MarkydFind *markyd_find_start(gchar *text, const gchar *pattern,
+                              gboolean use_regex, gboolean case_sensitive,
+                              gint from, gint to,
+                              MarkydFindMatchFunc match_func,
+                              MarkydFindDoneFunc done_func, gpointer user_data,
+                              GError **error) {
+  MarkydFind *find;
+  GRegex *regex;
+
+  g_return_val_if_fail(text != NULL, NULL);
+  g_return_val_if_fail(pattern != NULL && pattern[0] != '\0', NULL);
+
+  if (!compile_pattern(pattern, use_regex, case_sensitive, &regex, error)) {
+    g_free(text);
+    return NULL;
+  }
+
+  find = g_new0(MarkydFind, 1);
+  find->ref_count = 1;
+  find->text = text;
+  find->length = strlen(text);
+  find->regex = regex;
+  find->needle = g_strdup(pattern);
+  find->needle_len = strlen(pattern);
+  find->from = MAX(from, 0);
+  find->to = to;
+  find->threaded = find->length >= FIND_THREAD_MIN_BYTES;
+  g_mutex_init(&find->lock);
+  find->pending = g_array_new(FALSE, FALSE, sizeof(gint));
+  find->match_func = match_func;
+  find->done_func = done_func;
+  find->user_data = user_data;
+
+  if (find->threaded) {
+    g_thread_unref(g_thread_new("traymd-find", find_worker, find_ref(find)));
+  } else {
+    scan_all(find);
+    flush_matches(find);
+  }
+
+  return find;
+}
+
+void markyd_find_cancel(MarkydFind *find) {
+  if (!find) {
+    return;
+  }
+
+  g_atomic_int_set(&find->cancelled, 1);
+  find_unref(find);
+}
+
+typedef struct _ReplaceData {
+  const gchar *replacement;
+  gboolean expand;
+  guint count;
+} ReplaceData;
+
+static gboolean replace_match(const GMatchInfo *match_info, GString *result,
+                              gpointer user_data) {
+  ReplaceData *data = user_data;
+  gint start_pos = 0;
+  gint end_pos = 0;
+
+  /* Empty matches are never highlighted, so they replace nothing either */
+  g_match_info_fetch_pos(match_info, 0, &start_pos, &end_pos);
+  if (end_pos == start_pos) {
+    return FALSE;
+  }
+
+  if (data->expand) {
+    gchar *expanded =
+        g_match_info_expand_references(match_info, data->replacement, NULL);
+    g_string_append(result, expanded ? expanded : "");
+    g_free(expanded);
+  } else {
+    g_string_append(result, data->replacement);
+  }
+  data->count++;
+  return FALSE;
+}
+
+gchar *markyd_find_replace_all(const gchar *text, const gchar *pattern,
+                               gboolean use_regex, gboolean case_sensitive,
+                               const gchar *replacement, guint *n_replaced,
+                               GError **error) {
+  ReplaceData data = {replacement, use_regex, 0};
+  GRegex *regex;
+  gchar *result;
+
+  g_return_val_if_fail(pattern != NULL && pattern[0] != '\0', NULL);
+
+  if (use_regex && !g_regex_check_replacement(replacement, NULL, error)) {
+    return NULL;
+  }
+  if (!compile_pattern(pattern, use_regex, case_sensitive, &regex, error)) {
+    return NULL;
+  }
+
+  if (regex) {
+    result = g_regex_replace_eval(regex, text, -1, 0, 0, replace_match, &data,
+                                  error);
+    g_regex_unref(regex);
+  } else {
+    gsize needle_len = strlen(pattern);
+    GString *out = g_string_new(NULL);
+    const gchar *at = text;
+    const gchar *end = text + strlen(text);
+    const gchar *hit;
+
+    while ((hit = memmem(at, (gsize)(end - at), pattern, needle_len)) !=
+           NULL) {
+      g_string_append_len(out, at, hit - at);
+      g_string_append(out, replacement);
+      data.count++;
+      at = hit + needle_len;
+    }
+    g_string_append_len(out, at, end - at);
+    result = g_string_free(out, FALSE);
+  }
+
+  if (n_replaced) {
+    *n_replaced = result ? data.count : 0;
+  }
+  return result;
+}
@@ -0,0 +1,47 @@
+#ifndef MARKYD_FIND_H
+#define MARKYD_FIND_H
+
+#include <glib.h>
+
+/*
+ * Search within one note. The caller hands over a snapshot of its text;
+ * plain case-sensitive queries go through memmem (two-way, with a vectorised
+ * first-byte scan in glibc), anything else through GRegex. Large snapshots
+ * are searched on a worker thread. Either way the search starts at the
+ * visible part of the note and wraps around, and matches reach the main
+ * loop in batches as character offsets into the snapshot.
+ */
+
+typedef struct _MarkydFind MarkydFind;
+
+/* n_matches [start, end) pairs, flattened into offsets (main thread) */
+typedef void (*MarkydFindMatchFunc)(const gint *offsets, guint n_matches,
+                                    gpointer user_data);
+
+/* Whole text searched (main thread; never called after cancel) */
+typedef void (*MarkydFindDoneFunc)(guint matches, gpointer user_data);
+
+/* Search text (taken over) from character from, visible up to to, then from
+ * the start. Small texts are searched before this returns, with the
+ * callbacks run from inside it. Returns NULL and sets error for an invalid
+ * regex. */
+MarkydFind *markyd_find_start(gchar *text, const gchar *pattern,
+                              gboolean use_regex, gboolean case_sensitive,
+                              gint from, gint to,
+                              MarkydFindMatchFunc match_func,
+                              MarkydFindDoneFunc done_func, gpointer user_data,
+                              GError **error);
+
+/* Stop the search and release it (also once done). No callbacks run after
+ * this returns. */
+void markyd_find_cancel(MarkydFind *find);
+
+/* text with every match replaced, and their count in n_replaced. Regexes
+ * expand back-references (\1) in replacement; plain queries insert it as
+ * is. NULL with error for an invalid regex. */
+gchar *markyd_find_replace_all(const gchar *text, const gchar *pattern,
+                               gboolean use_regex, gboolean case_sensitive,
+                               const gchar *replacement, guint *n_replaced,
+                               GError **error);
+
+#endif /* MARKYD_FIND_H */
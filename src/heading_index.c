@@ -0,0 +1,204 @@
+#include "heading_index.h"
+#include "markdown.h"
+
+typedef struct _IndexEntry {
+  GtkTextMark *mark; /* Start of the line; stays there on inserts */
+  gint level;        /* 1-3 for a heading, 0 for a fence */
+  gboolean opens;    /* A fence that may open a code block */
+  gboolean closes;   /* ...or close one */
+  gchar *title;      /* GRefString, headings only */
+} IndexEntry;
+
+struct _MarkydHeadingIndex {
+  GtkTextBuffer *buffer;
+  GArray *entries; /* IndexEntry, in text order */
+};
+
+static void clear_entry(gpointer data) {
+  IndexEntry *entry = data;
+
+  if (entry->title) {
+    g_ref_string_release(entry->title);
+  }
+}
+
+static void clear_heading(gpointer data) {
+  g_ref_string_release(((MarkydHeading *)data)->title);
+}
+
+GArray *markyd_headings_new(void) {
+  GArray *headings = g_array_new(FALSE, FALSE, sizeof(MarkydHeading));
+
+  g_array_set_clear_func(headings, clear_heading);
+  return headings;
+}
+
+MarkydHeadingIndex *markyd_heading_index_new(GtkTextBuffer *buffer) {
+  MarkydHeadingIndex *index = g_new0(MarkydHeadingIndex, 1);
+
+  index->buffer = buffer;
+  index->entries = g_array_new(FALSE, FALSE, sizeof(IndexEntry));
+  g_array_set_clear_func(index->entries, clear_entry);
+  return index;
+}
+
+/* The marks go with the buffer */
+void markyd_heading_index_free(MarkydHeadingIndex *index) {
+  if (!index) {
+    return;
+  }
+  g_array_free(index->entries, TRUE);
+  g_free(index);
+}
+
+/* First entry at or after iter */
+static guint lower_bound(MarkydHeadingIndex *index, const GtkTextIter *iter) {
+  guint lo = 0;
+  guint hi = index->entries->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+    GtkTextIter at;
+
+    gtk_text_buffer_get_iter_at_mark(
+        index->buffer, &at,
+        g_array_index(index->entries, IndexEntry, mid).mark);
+    if (gtk_text_iter_compare(&at, iter) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* Whether line is a heading or fence; fills entry but for its mark */
+static gboolean read_line(MarkydHeadingIndex *index, const GtkTextIter *start,
+                          IndexEntry *entry) {
+  GtkTextIter end = *start;
+  gchar *text;
+
+  if (!gtk_text_iter_ends_line(&end)) {
+    gtk_text_iter_forward_to_line_end(&end);
+  }
+  text = gtk_text_buffer_get_text(index->buffer, start, &end, TRUE);
+
+  entry->level = markdown_heading_level(text);
+  entry->opens = entry->level == 0 && markdown_is_code_fence(text, FALSE);
+  entry->closes = entry->level == 0 && markdown_is_code_fence(text, TRUE);
+  entry->title = entry->level > 0 ? g_ref_string_new(text + entry->level + 1)
+                                  : NULL;
+  g_free(text);
+  return entry->level > 0 || entry->opens || entry->closes;
+}
+
+void markyd_heading_index_update(MarkydHeadingIndex *index, gint first,
+                                 gint last) {
+  GtkTextIter start, stop;
+  guint lo, hi;
+
+  last = MIN(last, gtk_text_buffer_get_line_count(index->buffer) - 1);
+  if (first > last) {
+    return;
+  }
+
+  /* Entries on those lines, including marks of lines deleted into them */
+  gtk_text_buffer_get_iter_at_line(index->buffer, &start, first);
+  lo = lower_bound(index, &start);
+  gtk_text_buffer_get_iter_at_line(index->buffer, &stop, last);
+  if (gtk_text_iter_forward_line(&stop)) {
+    hi = lower_bound(index, &stop);
+  } else {
+    hi = index->entries->len;
+  }
+  for (guint i = lo; i < hi; i++) {
+    gtk_text_buffer_delete_mark(
+        index->buffer, g_array_index(index->entries, IndexEntry, i).mark);
+  }
+  g_array_remove_range(index->entries, lo, hi - lo);
+
+  for (gint line = first; line <= last; line++) {
+    IndexEntry entry;
+
+    if (line > first) {
+      gtk_text_iter_forward_line(&start);
+    }
+    if (read_line(index, &start, &entry)) {
+      entry.mark =
+          gtk_text_buffer_create_mark(index->buffer, NULL, &start, TRUE);
+      g_array_insert_val(index->entries, lo, entry);
+      lo++;
+    }
+  }
+}
+
+void markyd_heading_index_rebuild(MarkydHeadingIndex *index) {
+  for (guint i = 0; i < index->entries->len; i++) {
+    gtk_text_buffer_delete_mark(
+        index->buffer, g_array_index(index->entries, IndexEntry, i).mark);
+  }
+  g_array_set_size(index->entries, 0);
+  markyd_heading_index_update(index, 0,
+                              gtk_text_buffer_get_line_count(index->buffer) -
+                                  1);
+}
+
+/* The same walk as the renderer's, over the indexed lines only: fences
+ * switch code blocks on and off, and a folded heading hides what follows
+ * up to the next heading of its level or above, a folded fence its block */
+void markyd_heading_index_collect(MarkydHeadingIndex *index, GArray *folds,
+                                  GArray *headings) {
+  gboolean in_code_block = FALSE;
+  gboolean folding = FALSE;
+  gint fold_level = 0;
+  gboolean fold_code = FALSE;
+  guint fold_next = 0;
+
+  g_array_set_size(headings, 0);
+
+  for (guint i = 0; i < index->entries->len; i++) {
+    const IndexEntry *entry = &g_array_index(index->entries, IndexEntry, i);
+    gboolean fence = in_code_block ? entry->closes : entry->opens;
+    gboolean fold_here = FALSE;
+    gint heading_here;
+    GtkTextIter iter;
+    gint line;
+
+    gtk_text_buffer_get_iter_at_mark(index->buffer, &iter, entry->mark);
+    line = gtk_text_iter_get_line(&iter);
+    while (folds && fold_next < folds->len &&
+           g_array_index(folds, gint, fold_next) < line) {
+      fold_next++;
+    }
+    fold_here = folds && fold_next < folds->len &&
+                g_array_index(folds, gint, fold_next) == line;
+
+    if (folding) {
+      if (entry->level > 0 && !in_code_block && entry->level <= fold_level) {
+        folding = FALSE;
+      } else {
+        if (fence) {
+          in_code_block = !in_code_block;
+          folding = !(fold_code && !in_code_block);
+        }
+        continue;
+      }
+    }
+
+    heading_here = in_code_block ? 0 : entry->level;
+    if (heading_here > 0) {
+      MarkydHeading heading = {line, heading_here,
+                               g_ref_string_acquire(entry->title)};
+      g_array_append_val(headings, heading);
+    }
+
+    if (fold_here && (heading_here > 0 || (fence && !in_code_block))) {
+      folding = TRUE;
+      fold_level = heading_here;
+      fold_code = heading_here == 0;
+    }
+    if (fence) {
+      in_code_block = !in_code_block;
+    }
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef MARKYD_HEADING_INDEX_H
+#define MARKYD_HEADING_INDEX_H
+
+#include <gtk/gtk.h>
+
+/*
+ * Heading and code fence lines of the open note, each held by a mark at the
+ * start of its line. Marks move with the text, so an edit only has to read
+ * again the lines it touched, and the outline is taken from the index
+ * without going over the note.
+ */
+
+/* A "#" to "###" heading line */
+typedef struct _MarkydHeading {
+  gint line;
+  gint level;   /* 1-3 */
+  gchar *title; /* A GRefString: shared, not copied */
+} MarkydHeading;
+
+typedef struct _MarkydHeadingIndex MarkydHeadingIndex;
+
+MarkydHeadingIndex *markyd_heading_index_new(GtkTextBuffer *buffer);
+void markyd_heading_index_free(MarkydHeadingIndex *index);
+
+/* Read every line again (e.g. another note was loaded) */
+void markyd_heading_index_rebuild(MarkydHeadingIndex *index);
+
+/* Read lines first to last again, after an edit changed them */
+void markyd_heading_index_update(MarkydHeadingIndex *index, gint first,
+                                 gint last);
+
+/* Refill headings with those outside code blocks and folded sections, in
+ * order. folds holds the line numbers of folded headings and fences,
+ * ascending; negative entries are skipped. */
+void markyd_heading_index_collect(MarkydHeadingIndex *index, GArray *folds,
+                                  GArray *headings);
+
+/* Empty array of MarkydHeading that releases the titles */
+GArray *markyd_headings_new(void);
+
+#endif /* MARKYD_HEADING_INDEX_H */
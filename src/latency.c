@@ -0,0 +1,96 @@
+#include "latency.h"
+
+/* 2^SUB_BITS buckets per power of two; values below that get one each */
+#define SUB_BITS 4
+#define SUB_COUNT (1 << SUB_BITS)
+/* Up to 2^40 us (about 12 days); longer is counted in the last bucket */
+#define MAX_MAGNITUDE 40
+#define N_BUCKETS (SUB_COUNT + (MAX_MAGNITUDE - SUB_BITS + 1) * SUB_COUNT)
+
+typedef struct _Histogram {
+  guint64 buckets[N_BUCKETS];
+  guint64 count;
+  gint64 max; /* us */
+} Histogram;
+
+static Histogram histograms[MARKYD_LATENCY_N_PHASES];
+
+static const gchar *const PHASE_NAMES[MARKYD_LATENCY_N_PHASES] = {
+    "keystroke", "tags", "hrules", "get_content", "save",
+};
+
+static guint bucket_of(guint64 value) {
+  guint magnitude;
+
+  if (value < SUB_COUNT) {
+    return (guint)value;
+  }
+  magnitude = g_bit_storage(value) - 1;
+  if (magnitude > MAX_MAGNITUDE) {
+    return N_BUCKETS - 1;
+  }
+  return SUB_COUNT + (magnitude - SUB_BITS) * SUB_COUNT +
+         (guint)((value >> (magnitude - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+/* Largest value that falls in bucket */
+static guint64 bucket_top(guint bucket) {
+  guint magnitude;
+  guint sub;
+
+  if (bucket < SUB_COUNT) {
+    return bucket;
+  }
+  magnitude = (bucket - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+  sub = (bucket - SUB_COUNT) % SUB_COUNT;
+  return (((guint64)(SUB_COUNT + sub) + 1) << (magnitude - SUB_BITS)) - 1;
+}
+
+void markyd_latency_record_since(MarkydLatencyPhase phase, gint64 start) {
+  Histogram *h = &histograms[phase];
+  gint64 us = MAX(g_get_monotonic_time() - start, 0);
+
+  h->buckets[bucket_of((guint64)us)]++;
+  h->count++;
+  h->max = MAX(h->max, us);
+}
+
+/* In us; never above the largest value recorded */
+static gint64 percentile(const Histogram *h, gdouble p) {
+  guint64 rank = (guint64)(p / 100.0 * (gdouble)h->count + 0.5);
+  guint64 seen = 0;
+
+  rank = CLAMP(rank, 1, h->count);
+  for (guint i = 0; i < N_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= rank) {
+      return MIN((gint64)bucket_top(i), h->max);
+    }
+  }
+  return h->max;
+}
+
+gchar *markyd_latency_format(gint note_chars, gint note_lines) {
+  GString *out = g_string_new(NULL);
+
+  g_string_append_printf(out, "note: %d chars, %d lines\n", note_chars,
+                         note_lines);
+  g_string_append_printf(out, "%-12s %7s %8s %8s %8s %8s\n", "phase (ms)",
+                         "count", "p50", "p95", "p99", "max");
+  for (gint i = 0; i < MARKYD_LATENCY_N_PHASES; i++) {
+    const Histogram *h = &histograms[i];
+
+    if (h->count == 0) {
+      g_string_append_printf(out, "%-12s %7d %8s %8s %8s %8s\n", PHASE_NAMES[i],
+                             0, "-", "-", "-", "-");
+      continue;
+    }
+    g_string_append_printf(
+        out, "%-12s %7" G_GUINT64_FORMAT " %8.2f %8.2f %8.2f %8.2f\n",
+        PHASE_NAMES[i], h->count, percentile(h, 50) / 1000.0,
+        percentile(h, 95) / 1000.0, percentile(h, 99) / 1000.0,
+        h->max / 1000.0);
+  }
+
+  return g_string_free(out, FALSE);
+}
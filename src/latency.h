@@ -0,0 +1,29 @@
+#ifndef MARKYD_LATENCY_H
+#define MARKYD_LATENCY_H
+
+#include <glib.h>
+
+/*
+ * Where editing time goes. Each phase keeps a histogram of its durations in
+ * log-linear buckets (a few percent wide at any magnitude, like an HDR
+ * histogram), so percentiles stay cheap to record and to read. Main thread
+ * only.
+ */
+
+typedef enum {
+  MARKYD_LATENCY_KEYSTROKE,   /* Key press to the buffer's "changed" */
+  MARKYD_LATENCY_TAGS,        /* Render: markdown tags */
+  MARKYD_LATENCY_HRULES,      /* Render: hrule widgets */
+  MARKYD_LATENCY_GET_CONTENT, /* markyd_editor_get_content() */
+  MARKYD_LATENCY_SAVE,        /* notes_save() */
+  MARKYD_LATENCY_N_PHASES
+} MarkydLatencyPhase;
+
+/* Record a phase that began at start (g_get_monotonic_time()) and just ended */
+void markyd_latency_record_since(MarkydLatencyPhase phase, gint64 start);
+
+/* Every phase with its count and p50/p95/p99/max in ms, one per line, after a
+ * line with the open note's size (caller must free) */
+gchar *markyd_latency_format(gint note_chars, gint note_lines);
+
+#endif /* MARKYD_LATENCY_H */
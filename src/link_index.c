@@ -0,0 +1,90 @@
+#include "link_index.h"
+
+typedef struct _LinkSpan {
+  gint start; /* Characters */
+  gint end;
+  gsize url;  /* Byte offset into urls */
+} LinkSpan;
+
+struct _MarkydLinkIndex {
+  GArray *spans; /* LinkSpan, by start */
+  GString *urls; /* NUL-separated */
+};
+
+MarkydLinkIndex *markyd_link_index_new(void) {
+  MarkydLinkIndex *links = g_new0(MarkydLinkIndex, 1);
+
+  links->spans = g_array_new(FALSE, FALSE, sizeof(LinkSpan));
+  links->urls = g_string_new(NULL);
+  return links;
+}
+
+void markyd_link_index_free(MarkydLinkIndex *links) {
+  if (!links) {
+    return;
+  }
+  g_array_free(links->spans, TRUE);
+  g_string_free(links->urls, TRUE);
+  g_free(links);
+}
+
+void markyd_link_index_clear(MarkydLinkIndex *links) {
+  g_array_set_size(links->spans, 0);
+  g_string_truncate(links->urls, 0);
+}
+
+void markyd_link_index_add(MarkydLinkIndex *links, gint start, gint end,
+                           const gchar *url, gssize url_len) {
+  guint at = links->spans->len;
+  LinkSpan span;
+
+  if (start >= end || !url) {
+    return;
+  }
+
+  /* The renderer goes line by line, so this rarely walks back far */
+  while (at > 0 && g_array_index(links->spans, LinkSpan, at - 1).start > start) {
+    at--;
+  }
+  if (at > 0 && g_array_index(links->spans, LinkSpan, at - 1).end > start) {
+    return;
+  }
+  if (at < links->spans->len &&
+      g_array_index(links->spans, LinkSpan, at).start < end) {
+    return;
+  }
+
+  span.start = start;
+  span.end = end;
+  span.url = links->urls->len;
+  if (url_len < 0) {
+    g_string_append(links->urls, url);
+  } else {
+    g_string_append_len(links->urls, url, url_len);
+  }
+  g_string_append_c(links->urls, '\0');
+  g_array_insert_val(links->spans, at, span);
+}
+
+const gchar *markyd_link_index_lookup(MarkydLinkIndex *links, gint offset) {
+  guint lo = 0;
+  guint hi = links->spans->len;
+  const LinkSpan *span;
+
+  /* Last span starting at or before offset */
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index(links->spans, LinkSpan, mid).start <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return NULL;
+  }
+
+  span = &g_array_index(links->spans, LinkSpan, lo - 1);
+  return offset < span->end ? links->urls->str + span->url : NULL;
+}
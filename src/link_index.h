@@ -0,0 +1,30 @@
+#ifndef MARKYD_LINK_INDEX_H
+#define MARKYD_LINK_INDEX_H
+
+#include <glib.h>
+
+/*
+ * Links of the rendered note: the character range of each link's visible
+ * text and the URL it opens. The renderer fills it as it tags links, so the
+ * editor can find the link under the pointer with a binary search instead
+ * of re-parsing the line. Ranges never overlap; of two overlapping links
+ * the one added first is kept.
+ */
+
+typedef struct _MarkydLinkIndex MarkydLinkIndex;
+
+MarkydLinkIndex *markyd_link_index_new(void);
+void markyd_link_index_free(MarkydLinkIndex *links);
+
+/* Forget every link (the text changed or is being rendered again) */
+void markyd_link_index_clear(MarkydLinkIndex *links);
+
+/* Record the link over [start, end) opening url, url_len bytes long (-1 if
+ * NUL-terminated). Links come mostly in text order; that is the cheap case. */
+void markyd_link_index_add(MarkydLinkIndex *links, gint start, gint end,
+                           const gchar *url, gssize url_len);
+
+/* URL of the link covering offset, or NULL. Valid until the next change. */
+const gchar *markyd_link_index_lookup(MarkydLinkIndex *links, gint offset);
+
+#endif /* MARKYD_LINK_INDEX_H */
@@ -1,4 +1,10 @@
 #include "app.h"
+#include "config.h"
+#include "notes.h"
+#include "notes_chunked.h"
+#include "notes_import.h"
+#include "notes_mirror.h"
+#include "notes_sqlite.h"
 #include "tray.h"
 #include "window.h"
 #include <gtk/gtk.h>
@@ -7,6 +13,14 @@
 static gboolean start_minimized = FALSE;
 static MarkydTrayBackend tray_backend = MARKYD_TRAY_BACKEND_STATUSICON;
 static gboolean no_tray = FALSE;
+static gboolean stats_dump = FALSE;
+static gboolean sqlite_import = FALSE;
+static gboolean sqlite_export = FALSE;
+static const gchar *sqlite_export_dir = NULL;
+static const gchar *import_dir = NULL;
+static const gchar *mirror_dir = NULL;
+static const gchar *export_note = NULL;
+static const gchar *export_dest = NULL;
 
 static gboolean parse_tray_backend(const gchar *value,
                                    MarkydTrayBackend *out) {
@@ -31,6 +45,119 @@ static gboolean parse_tray_backend(const gchar *value,
   return FALSE;
 }
 
+/*
+ * One-shot conversions between the plain .md layout and notes.db. They run
+ * without bringing up GTK so they can be scripted.
+ */
+static int run_sqlite_command(void) {
+  gint count;
+
+  notes_set_backend(MARKYD_NOTES_BACKEND_SQLITE);
+  if (!notes_init()) {
+    g_printerr("Failed to initialize notes storage\n");
+    return 1;
+  }
+
+  if (sqlite_import) {
+    count = notes_sqlite_import_dir(notes_get_dir());
+    if (count >= 0) {
+      g_print("Imported %d notes from %s\n", count, notes_get_dir());
+    }
+  } else {
+    const gchar *dir = sqlite_export_dir ? sqlite_export_dir : notes_get_dir();
+    count = notes_sqlite_export_dir(dir);
+    if (count >= 0) {
+      g_print("Exported %d notes to %s\n", count, dir);
+    }
+  }
+
+  notes_cleanup();
+  return count >= 0 ? 0 : 1;
+}
+
+static void print_import_progress(const MarkydImportStats *stats,
+                                  gdouble elapsed_sec, gpointer user_data) {
+  guint processed = stats->imported + stats->duplicates + stats->failed;
+  gdouble secs = elapsed_sec > 0 ? elapsed_sec : 1e-6;
+
+  (void)user_data;
+
+  g_printerr("\r%u/%u files, %u imported, %u duplicates, %u failed "
+             "(%.0f files/s, %.1f MB/s)",
+             processed, stats->total, stats->imported, stats->duplicates,
+             stats->failed, processed / secs,
+             (gdouble)stats->bytes / (1024.0 * 1024.0) / secs);
+}
+
+/* Bulk import into whichever backend the config selects. */
+static int run_import_command(void) {
+  MarkydConfig *cfg = config_new();
+  MarkydImportStats stats = {0};
+  gboolean ok;
+
+  config_load(cfg);
+  notes_set_backend(g_strcmp0(cfg->storage_backend, "sqlite") == 0
+                        ? MARKYD_NOTES_BACKEND_SQLITE
+                        : MARKYD_NOTES_BACKEND_FILES);
+  config_free(cfg);
+
+  if (!notes_init()) {
+    g_printerr("Failed to initialize notes storage\n");
+    return 1;
+  }
+
+  ok = notes_import_dir(import_dir, &stats, print_import_progress, NULL);
+  g_printerr("\n");
+  if (stats.total > 0 || ok) {
+    g_print("Imported %u notes into %s (%u duplicates, %u failed)\n",
+            stats.imported, notes_get_dir(), stats.duplicates, stats.failed);
+  }
+
+  notes_cleanup();
+  return ok ? 0 : 1;
+}
+
+/* Write one note, chunked or not, as a plain .md file other tools can read */
+static int run_export_note_command(void) {
+  if (!notes_chunked_export(export_note, export_dest)) {
+    return 1;
+  }
+  g_print("Exported %s to %s\n", export_note, export_dest);
+  return 0;
+}
+
+/*
+ * Back up the whole data directory (notes, notebooks, cold archives,
+ * history, notes.db) to a second local path, writing only what changed.
+ */
+static int run_mirror_command(void) {
+  MarkydMirrorStats stats = {0};
+  gchar *data_dir;
+  gchar *written;
+  gboolean ok;
+
+  if (!notes_init()) {
+    g_printerr("Failed to initialize notes storage\n");
+    return 1;
+  }
+  data_dir = g_path_get_dirname(notes_get_dir());
+  notes_cleanup();
+
+  ok = notes_mirror_run(data_dir, mirror_dir, &stats);
+  written = g_format_size(stats.bytes_written);
+  g_print("Mirrored %s to %s: %u new, %u updated, %u renamed, %u deleted, "
+          "%u unchanged (%s written)\n",
+          data_dir, mirror_dir, stats.created, stats.updated, stats.renamed,
+          stats.deleted, stats.unchanged, written);
+  if (stats.failed > 0) {
+    g_printerr("%u files could not be mirrored\n", stats.failed);
+  }
+
+  g_free(written);
+  g_free(data_dir);
+  return ok ? 0 : 1;
+}
+
 int main(int argc, char **argv) {
   MarkydApp *application;
   int status;
@@ -70,6 +197,56 @@ int main(int argc, char **argv) {
       continue;
     }
 
+    if (g_strcmp0(argv[i], "--stats-dump") == 0) {
+      stats_dump = TRUE;
+      continue;
+    }
+
+    if (g_strcmp0(argv[i], "--sqlite-import") == 0) {
+      sqlite_import = TRUE;
+      continue;
+    }
+
+    if (g_strcmp0(argv[i], "--sqlite-export") == 0) {
+      sqlite_export = TRUE;
+      continue;
+    }
+
+    if (g_str_has_prefix(argv[i], "--sqlite-export=")) {
+      sqlite_export = TRUE;
+      sqlite_export_dir = argv[i] + strlen("--sqlite-export=");
+      continue;
+    }
+
+    if (g_str_has_prefix(argv[i], "--import=")) {
+      import_dir = argv[i] + strlen("--import=");
+      continue;
+    }
+
+    if (g_strcmp0(argv[i], "--import") == 0 && i + 1 < argc) {
+      import_dir = argv[i + 1];
+      i++;
+      continue;
+    }
+
+    if (g_str_has_prefix(argv[i], "--mirror=")) {
+      mirror_dir = argv[i] + strlen("--mirror=");
+      continue;
+    }
+
+    if (g_strcmp0(argv[i], "--mirror") == 0 && i + 1 < argc) {
+      mirror_dir = argv[i + 1];
+      i++;
+      continue;
+    }
+
+    if (g_strcmp0(argv[i], "--export-note") == 0 && i + 2 < argc) {
+      export_note = argv[i + 1];
+      export_dest = argv[i + 2];
+      i += 2;
+      continue;
+    }
+
     if (g_str_has_prefix(argv[i], "--tray-backend=")) {
       const gchar *value = argv[i] + strlen("--tray-backend=");
       MarkydTrayBackend parsed;
@@ -110,6 +287,26 @@ int main(int argc, char **argv) {
     g_ptr_array_add(filtered, argv[i]);
   }
 
+  if (import_dir) {
+    g_ptr_array_free(filtered, TRUE);
+    return run_import_command();
+  }
+
+  if (mirror_dir) {
+    g_ptr_array_free(filtered, TRUE);
+    return run_mirror_command();
+  }
+
+  if (export_note) {
+    g_ptr_array_free(filtered, TRUE);
+    return run_export_note_command();
+  }
+
+  if (sqlite_import || sqlite_export) {
+    g_ptr_array_free(filtered, TRUE);
+    return run_sqlite_command();
+  }
+
   application = markyd_app_new();
   if (!application) {
     g_printerr("Failed to create application\n");
@@ -120,6 +317,7 @@ int main(int argc, char **argv) {
   application->start_minimized = start_minimized;
   application->tray_backend = tray_backend;
   application->no_tray = no_tray;
+  application->stats_dump = stats_dump;
 
   filtered_argc = (int)filtered->len;
   filtered_argv = g_new0(char *, (gsize)filtered_argc + 1);
@@ -1,6 +1,7 @@
 #include "markdown.h"
 #include "code_highlight.h"
 #include "config.h"
+#include "link_index.h"
 #include <ctype.h>
 #include <string.h>
 
@@ -18,6 +19,8 @@
 #define TAG_LINK "link"
 #define TAG_HRULE "hrule"
 #define TAG_INVISIBLE "invisible"
+#define TAG_FOLDED "folded"
+#define TAG_FOLD_HEADER "fold_header"
 
 static void collect_anchor_offsets(GtkTextBuffer *buffer, const gchar *data_key,
                                    GArray *offsets) {
@@ -59,9 +62,16 @@ static void delete_char_offsets(GtkTextBuffer *buffer, GArray *offsets) {
 }
 
 void markdown_init_tags(GtkTextBuffer *buffer) {
+  const GdkRGBA transparent = {0.0, 0.0, 0.0, 0.0};
+
   /* Invisible tag - hides markdown syntax characters */
   gtk_text_buffer_create_tag(buffer, TAG_INVISIBLE, "invisible", TRUE, NULL);
 
+  /* Body of a folded section or code block, and the line heading it */
+  gtk_text_buffer_create_tag(buffer, TAG_FOLDED, "invisible", TRUE, NULL);
+  gtk_text_buffer_create_tag(buffer, TAG_FOLD_HEADER, "underline",
+                             PANGO_UNDERLINE_DOUBLE, NULL);
+
   /* Header 1 - Large bold */
   gtk_text_buffer_create_tag(buffer, TAG_H1, "weight", PANGO_WEIGHT_BOLD,
                              "scale", 2.0, "foreground", config->h1_color,
@@ -122,6 +132,8 @@ void markdown_init_tags(GtkTextBuffer *buffer) {
   /* List bullet styling */
   gtk_text_buffer_create_tag(buffer, TAG_LIST_BULLET, "foreground",
                              config->list_bullet_color, NULL);
+  gtk_text_buffer_create_tag(buffer, MARKYD_TAG_LIST_MARKER, "foreground-rgba",
+                             &transparent, NULL);
 
   /* Link - Blue underlined */
   gtk_text_buffer_create_tag(buffer, TAG_LINK, "foreground", "#61AFEF",
@@ -132,6 +144,10 @@ void markdown_init_tags(GtkTextBuffer *buffer) {
                              "justification", GTK_JUSTIFY_CENTER,
                              "pixels-above-lines", 6, "pixels-below-lines", 6,
                              NULL);
+
+  /* Find matches - created last so they show over everything else */
+  gtk_text_buffer_create_tag(buffer, MARKYD_TAG_FIND_MATCH, "background",
+                             "#E5C07B", "foreground", "#282C34", NULL);
 }
 
 void markdown_update_accent_tags(GtkTextBuffer *buffer) {
@@ -186,6 +202,17 @@ static gboolean line_starts_with(const gchar *line, const gchar *prefix) {
   return g_str_has_prefix(line, prefix);
 }
 
+/* 1-3 for the headings the renderer styles, else 0 */
+static gint heading_level(const gchar *line) {
+  if (line_starts_with(line, "### ")) {
+    return 3;
+  }
+  if (line_starts_with(line, "## ")) {
+    return 2;
+  }
+  return line_starts_with(line, "# ") ? 1 : 0;
+}
+
 static gboolean is_hrule_line(const gchar *line) {
   gchar *trimmed;
   gsize len;
@@ -386,7 +413,7 @@ static void apply_tag_hide_syntax(GtkTextBuffer *buffer, const gchar *tag_name,
 
 /* Apply inline formatting (bold, italic, code) */
 static void apply_inline_tags(GtkTextBuffer *buffer, GtkTextIter *line_start,
-                              GtkTextIter *line_end) {
+                              GtkTextIter *line_end, MarkydLinkIndex *links) {
   gchar *line_text;
   const gchar *p;
   gint line_offset;
@@ -484,6 +511,15 @@ static void apply_inline_tags(GtkTextBuffer *buffer, GtkTextIter *line_start,
           gtk_text_buffer_get_iter_at_offset(buffer, &end, text_end);
           gtk_text_buffer_apply_tag_by_name(buffer, TAG_LINK, &start, &end);
 
+          /* [text]() opens the text itself */
+          if (links && paren_end > bracket_end + 2) {
+            markyd_link_index_add(links, text_start, text_end,
+                                  bracket_end + 2, paren_end - bracket_end - 2);
+          } else if (links) {
+            markyd_link_index_add(links, text_start, text_end, p + 1,
+                                  bracket_end - p - 1);
+          }
+
           /* Hide [ */
           gtk_text_buffer_get_iter_at_offset(buffer, &start, link_start);
           gtk_text_buffer_get_iter_at_offset(buffer, &end, link_start + 1);
@@ -542,6 +578,11 @@ static void apply_inline_tags(GtkTextBuffer *buffer, GtkTextIter *line_start,
           gtk_text_buffer_get_iter_at_offset(buffer, &s, line_offset + cstart);
           gtk_text_buffer_get_iter_at_offset(buffer, &e, line_offset + cend);
           gtk_text_buffer_apply_tag_by_name(buffer, TAG_LINK, &s, &e);
+          if (links) {
+            markyd_link_index_add(links, line_offset + cstart,
+                                  line_offset + cend, line_text + mstart,
+                                  mend - mstart);
+          }
         }
       }
       if (!g_match_info_next(url_match, NULL)) {
@@ -558,7 +599,14 @@ static void apply_inline_tags(GtkTextBuffer *buffer, GtkTextIter *line_start,
   g_free(line_text);
 }
 
-void markdown_apply_tags(GtkTextBuffer *buffer) {
+gint markdown_heading_level(const gchar *line) { return heading_level(line); }
+
+gboolean markdown_is_code_fence(const gchar *line, gboolean in_code_block) {
+  return is_code_fence_line(line, in_code_block);
+}
+
+void markdown_apply_tags(GtkTextBuffer *buffer, MarkydLinkIndex *links,
+                         GArray *folds) {
   GtkTextIter start, end, line_start, line_end;
   GtkTextIter insert_iter;
   GtkTextMark *insert_mark;
@@ -569,6 +617,13 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
   const MarkydLanguageHighlight *code_language = NULL;
   MarkydCodeScanState code_scan_state = {0};
   gint insert_line = -1;
+  /* Folding: the hidden range starts at fold_start and runs until a heading
+   * of fold_level or above, or past the closing fence if fold_code */
+  guint fold_next = 0;
+  gboolean folding = FALSE;
+  gint fold_level = 0;
+  gboolean fold_code = FALSE;
+  GtkTextIter fold_start;
 
   /*
    * GtkTextIters become invalid if we mutate the buffer (delete/insert anchors)
@@ -582,6 +637,9 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
   /* Remove all existing tags first */
   gtk_text_buffer_get_bounds(buffer, &start, &end);
   gtk_text_buffer_remove_all_tags(buffer, &start, &end);
+  if (links) {
+    markyd_link_index_clear(links);
+  }
 
   /* Process line by line */
   gtk_text_buffer_get_start_iter(buffer, &line_start);
@@ -605,6 +663,57 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
 
     line_text = gtk_text_buffer_get_text(buffer, &line_start, &line_end, FALSE);
 
+    /* Folded lines get no tags of their own; only fences are tracked */
+    if (folding) {
+      gint level = in_code_block ? 0 : heading_level(line_text);
+
+      if (level > 0 && level <= fold_level) {
+        gtk_text_buffer_apply_tag_by_name(buffer, TAG_FOLDED, &fold_start,
+                                          &line_start);
+        folding = FALSE;
+      } else {
+        gboolean closes = FALSE;
+        gboolean more;
+
+        if (is_code_fence_line(line_text, in_code_block)) {
+          in_code_block = !in_code_block;
+          code_language = NULL;
+          markyd_code_scan_state_reset(&code_scan_state);
+          closes = fold_code && !in_code_block;
+        }
+        g_free(line_text);
+
+        more = gtk_text_iter_forward_line(&line_start);
+        if (closes) {
+          gtk_text_buffer_apply_tag_by_name(buffer, TAG_FOLDED, &fold_start,
+                                            &line_start);
+          folding = FALSE;
+        }
+        if (!more) {
+          break;
+        }
+        continue;
+      }
+    }
+
+    /* Is this line folded? Later duplicates of it are stale. */
+    gint fold_entry = -1;
+    while (folds && fold_next < folds->len &&
+           g_array_index(folds, gint, fold_next) <= line_number) {
+      if (g_array_index(folds, gint, fold_next) == line_number) {
+        if (fold_entry >= 0) {
+          g_array_index(folds, gint, fold_next) = -1;
+        } else {
+          fold_entry = (gint)fold_next;
+        }
+      }
+      fold_next++;
+    }
+    gboolean fold_here = fold_entry >= 0;
+    gint heading_here = in_code_block ? 0 : heading_level(line_text);
+    gboolean fold_fence_here =
+        !in_code_block && is_code_fence_line(line_text, FALSE);
+
     if (is_code_fence_line(line_text, in_code_block)) {
       if (!in_code_block) {
         gchar *language = extract_code_fence_language(line_text);
@@ -616,7 +725,8 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
         markyd_code_scan_state_reset(&code_scan_state);
       }
 
-      if (!active_line) {
+      /* A folded block keeps its opening fence in view */
+      if (!active_line && !(fold_here && fold_fence_here)) {
         gtk_text_buffer_apply_tag_by_name(buffer, TAG_INVISIBLE, &line_start,
                                           &line_end);
       }
@@ -655,14 +765,12 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
       gtk_text_buffer_apply_tag_by_name(buffer, TAG_QUOTE, &syntax_end,
                                         &line_end);
     }
-    /* List item - style the bullet, hide and replace with bullet character */
+    /* List item - the marker keeps its width; the editor draws the bullet */
     else if (line_starts_with(line_text, "- ") ||
-             line_starts_with(line_text, "* ") ||
-             line_starts_with(line_text, "• ")) {
-      /* Apply list style to bullet */
+             line_starts_with(line_text, "* ")) {
       gtk_text_buffer_get_iter_at_offset(buffer, &syntax_end, line_offset + 1);
-      gtk_text_buffer_apply_tag_by_name(buffer, TAG_LIST_BULLET, &line_start,
-                                        &syntax_end);
+      gtk_text_buffer_apply_tag_by_name(buffer, MARKYD_TAG_LIST_MARKER,
+                                        &line_start, &syntax_end);
 
       /* Apply list style to whole line */
       gtk_text_buffer_apply_tag_by_name(buffer, TAG_LIST, &line_start,
@@ -671,7 +779,7 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
       GtkTextIter content_start;
       gtk_text_buffer_get_iter_at_offset(buffer, &content_start,
                                          line_offset + 2);
-      apply_inline_tags(buffer, &content_start, &line_end);
+      apply_inline_tags(buffer, &content_start, &line_end, links);
     }
     /* Numbered list - support 1. 2. 3. etc */
     else if (g_ascii_isdigit(line_text[0])) {
@@ -685,9 +793,9 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
         gtk_text_buffer_apply_tag_by_name(buffer, TAG_LIST, &line_start,
                                           &line_end);
         /* Apply inline tags to content */
-        apply_inline_tags(buffer, &syntax_end, &line_end);
+        apply_inline_tags(buffer, &syntax_end, &line_end, links);
       } else {
-        apply_inline_tags(buffer, &line_start, &line_end);
+        apply_inline_tags(buffer, &line_start, &line_end, links);
       }
     }
   /* Horizontal rule */
@@ -702,17 +810,34 @@ void markdown_apply_tags(GtkTextBuffer *buffer) {
     }
     /* Regular line - apply inline formatting */
     else {
-      apply_inline_tags(buffer, &line_start, &line_end);
+      apply_inline_tags(buffer, &line_start, &line_end, links);
     }
 
     g_free(line_text);
 
+    if (fold_here && (heading_here > 0 || fold_fence_here)) {
+      gtk_text_buffer_apply_tag_by_name(buffer, TAG_FOLD_HEADER, &line_start,
+                                        &line_end);
+      folding = TRUE;
+      fold_level = heading_here;
+      fold_code = fold_fence_here;
+      fold_start = line_start;
+      gtk_text_iter_forward_line(&fold_start);
+    } else if (fold_here) {
+      g_array_index(folds, gint, fold_entry) = -1;
+    }
+
     /* Move to next line */
     if (!gtk_text_iter_forward_line(&line_start)) {
       break;
     }
   }
 
+  if (folding) {
+    gtk_text_buffer_get_end_iter(buffer, &end);
+    gtk_text_buffer_apply_tag_by_name(buffer, TAG_FOLDED, &fold_start, &end);
+  }
+
   /* Insert hrule anchors from end to start so offsets stay valid. */
   if (hrule_offsets->len > 0) {
     g_array_sort(hrule_offsets, compare_int_desc);
@@ -3,6 +3,15 @@
 
 #include <gtk/gtk.h>
 
+typedef struct _MarkydLinkIndex MarkydLinkIndex;
+
+/* Covers the "-" or "*" of a list item, drawn transparent; the editor paints
+ * a bullet over it */
+#define MARKYD_TAG_LIST_MARKER "list_marker"
+
+/* Highlights in-note find matches; the renderer never sets it */
+#define MARKYD_TAG_FIND_MATCH "find_match"
+
 /* GObject data key used to mark hrule child anchors inserted into the buffer. */
 #define TRAYMD_HRULE_ANCHOR_DATA "traymd-hr-anchor"
 
@@ -12,7 +21,19 @@ void markdown_init_tags(GtkTextBuffer *buffer);
 /* Update accent colors for existing tags (after config changes). */
 void markdown_update_accent_tags(GtkTextBuffer *buffer);
 
-/* Apply markdown formatting to entire buffer */
-void markdown_apply_tags(GtkTextBuffer *buffer);
+/* Apply markdown formatting to entire buffer. links, if not NULL, is
+ * refilled with the links found, by text offset (hrule anchors excluded).
+ * folds, if not NULL, holds the ascending line numbers of folded headings
+ * and code fences; their sections are hidden and left untagged. Entries on
+ * lines that no longer start either are set to -1. */
+void markdown_apply_tags(GtkTextBuffer *buffer, MarkydLinkIndex *links,
+                         GArray *folds);
+
+/* 1-3 if line is a heading the renderer styles, else 0 */
+gint markdown_heading_level(const gchar *line);
+
+/* Whether line is a fence that opens a code block, or with in_code_block,
+ * closes one */
+gboolean markdown_is_code_fence(const gchar *line, gboolean in_code_block);
 
 #endif /* MARKYD_MARKDOWN_H */
@@ -1,18 +1,81 @@
 #include "notes.h"
+#include "notes_chunked.h"
+#include "notes_cold.h"
+#include "notes_dupes.h"
+#include "notes_folds.h"
+#include "notes_history.h"
+#include "notes_scan.h"
+#include "notes_sqlite.h"
+#include "notes_tree.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <gio/gio.h>
 #include <glib/gstdio.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+#include <utime.h>
 
 static gchar *notes_dir = NULL;
+static MarkydNotesBackend notes_backend = MARKYD_NOTES_BACKEND_FILES;
+static gboolean history_wanted = FALSE;
+static gsize chunk_threshold = 0;
+
+/*
+ * Held wherever shared backend state is used (the SQLite statement cache,
+ * the cold index), so the _async variants can run the same code on GTask
+ * worker threads. Recursive because e.g. notes_search lists. Plain files
+ * need no lock.
+ */
+static GRecMutex storage_lock;
+
+/* Worker threads of the _async calls still running; notes_cleanup waits for
+ * them so none finds the backends gone */
+static GMutex workers_lock;
+static GCond workers_done;
+static guint workers_running = 0;
+
+/* Notes compressed into the cold tier per hold of storage_lock, so a save
+ * waits for one batch at most while archiving runs */
+#define COLD_BATCH_BYTES (1024 * 1024)
+
+void notes_set_backend(MarkydNotesBackend backend) { notes_backend = backend; }
+
+MarkydNotesBackend notes_get_backend(void) { return notes_backend; }
+
+void notes_set_history_enabled(gboolean enabled) { history_wanted = enabled; }
+
+void notes_set_chunk_threshold(gsize bytes) { chunk_threshold = bytes; }
+
+static gboolean use_sqlite(void) {
+  return notes_backend == MARKYD_NOTES_BACKEND_SQLITE;
+}
+
+static const gchar *note_name(const gchar *path) {
+  const gchar *slash = strrchr(path, G_DIR_SEPARATOR);
+  return slash ? slash + 1 : path;
+}
+
+/* A note lives in the cold tier when it is indexed there and has no plain
+ * copy (a plain copy always wins, e.g. after an interrupted freeze). Only
+ * top-level notes are ever frozen. */
+static gboolean is_cold(const gchar *path) {
+  const gchar *name = note_name(path);
+  gsize dir_len = notes_dir ? strlen(notes_dir) : 0;
+
+  return notes_cold_contains(name) && name == path + dir_len + 1 &&
+         strncmp(path, notes_dir, dir_len) == 0 &&
+         !g_file_test(path, G_FILE_TEST_EXISTS);
+}
 
 gboolean notes_init(void) {
   const gchar *data_dir;
   gchar *old_app_dir;
   gchar *new_app_dir;
   gchar *new_notes_dir;
+  gboolean ok;
 
   /* Build path: ~/.local/share/traymd/notes */
   data_dir = g_get_user_data_dir();
@@ -31,105 +94,360 @@ gboolean notes_init(void) {
     }
   }
 
-  notes_dir = g_strdup(new_notes_dir);
+  ok = notes_init_at(new_notes_dir);
   g_free(old_app_dir);
   g_free(new_app_dir);
   g_free(new_notes_dir);
 
+  return ok;
+}
+
+gboolean notes_init_at(const gchar *dir) {
+  gchar *copy = g_strdup(dir);
+
+  g_free(notes_dir);
+  notes_dir = copy;
+
   /* Create directory if it doesn't exist */
   if (g_mkdir_with_parents(notes_dir, 0755) != 0) {
     g_printerr("Failed to create notes directory: %s\n", g_strerror(errno));
     return FALSE;
   }
 
+  notes_tree_init(notes_dir);
+
+  {
+    gchar *parent = g_path_get_dirname(notes_dir);
+    gchar *cache_path = g_build_filename(parent, "dupes.cache", NULL);
+    notes_dupes_init(cache_path);
+    g_free(cache_path);
+    g_free(parent);
+  }
+
+  if (history_wanted) {
+    gchar *parent = g_path_get_dirname(notes_dir);
+    gchar *history_dir = g_build_filename(parent, "history", NULL);
+    notes_history_init(history_dir, notes_dir);
+    g_free(history_dir);
+    g_free(parent);
+  }
+
+  if (use_sqlite()) {
+    gchar *parent = g_path_get_dirname(notes_dir);
+    gchar *db_path = g_build_filename(parent, "notes.db", NULL);
+    gboolean ok = notes_sqlite_open(db_path, notes_dir);
+    g_free(db_path);
+    g_free(parent);
+    return ok;
+  }
+
+  {
+    gchar *parent = g_path_get_dirname(notes_dir);
+    gchar *cold_dir = g_build_filename(parent, "cold", NULL);
+    notes_cold_open(cold_dir);
+    g_free(cold_dir);
+    g_free(parent);
+  }
+
   return TRUE;
 }
 
+void notes_cleanup(void) {
+  g_mutex_lock(&workers_lock);
+  while (workers_running > 0) {
+    g_cond_wait(&workers_done, &workers_lock);
+  }
+  g_mutex_unlock(&workers_lock);
+
+  notes_history_cleanup();
+  notes_dupes_cleanup();
+
+  g_rec_mutex_lock(&storage_lock);
+  notes_folds_cleanup();
+  notes_tree_cleanup();
+  notes_cold_close();
+  notes_sqlite_close();
+  g_clear_pointer(&notes_dir, g_free);
+  g_rec_mutex_unlock(&storage_lock);
+}
+
 const gchar *notes_get_dir(void) { return notes_dir; }
 
+typedef struct _NoteEntry {
+  gchar *path;
+  gint64 mtime; /* Microseconds */
+} NoteEntry;
+
 /* Compare function for sorting by mtime (newest first) */
 static gint compare_by_mtime(gconstpointer a, gconstpointer b) {
-  const gchar *path_a = *(const gchar **)a;
-  const gchar *path_b = *(const gchar **)b;
-  struct stat stat_a, stat_b;
-
-  if (stat(path_a, &stat_a) != 0)
-    return 1;
-  if (stat(path_b, &stat_b) != 0)
-    return -1;
+  const NoteEntry *entry_a = a;
+  const NoteEntry *entry_b = b;
 
   /* Newest first (descending order) */
-  if (stat_b.st_mtime > stat_a.st_mtime)
+  if (entry_b->mtime > entry_a->mtime)
     return 1;
-  if (stat_b.st_mtime < stat_a.st_mtime)
+  if (entry_b->mtime < entry_a->mtime)
     return -1;
   return 0;
 }
 
-GPtrArray *notes_list(void) {
+typedef struct _ColdListing {
+  GArray *entries;
+  GHashTable *hot; /* Names of plain notes, which shadow cold copies */
+} ColdListing;
+
+static void add_cold_entry(const gchar *name, gint64 mtime,
+                           gpointer user_data) {
+  ColdListing *listing = user_data;
+  NoteEntry entry;
+
+  if (g_hash_table_contains(listing->hot, name)) {
+    return;
+  }
+
+  entry.path = g_build_filename(notes_dir, name, NULL);
+  entry.mtime = mtime;
+  g_array_append_val(listing->entries, entry);
+}
+
+GPtrArray *notes_list(void) { return notes_list_in(""); }
+
+GPtrArray *notes_list_in(const gchar *notebook) {
   GPtrArray *paths;
+  GArray *entries;
+  GHashTable *hot;
+  GPtrArray *names;
+  gint64 *mtimes;
+  gchar *dir_path;
   GDir *dir;
   const gchar *filename;
   GError *error = NULL;
+  gboolean top_level = !notebook || !*notebook;
+
+  if (use_sqlite()) {
+    /* The database is flat: everything lives in the top-level notebook */
+    if (!top_level) {
+      return g_ptr_array_new_with_free_func(g_free);
+    }
+    g_rec_mutex_lock(&storage_lock);
+    paths = notes_sqlite_list();
+    g_rec_mutex_unlock(&storage_lock);
+    return paths;
+  }
 
   paths = g_ptr_array_new_with_free_func(g_free);
 
-  dir = g_dir_open(notes_dir, 0, &error);
+  dir_path = g_build_filename(notes_dir, top_level ? "" : notebook, NULL);
+  dir = g_dir_open(dir_path, 0, &error);
   if (!dir) {
     g_printerr("Failed to open notes directory: %s\n", error->message);
     g_error_free(error);
+    g_free(dir_path);
     return paths;
   }
 
+  /* Only include .md files */
+  names = g_ptr_array_new_with_free_func(g_free);
   while ((filename = g_dir_read_name(dir)) != NULL) {
-    /* Only include .md files */
     if (g_str_has_suffix(filename, ".md")) {
-      gchar *path = g_build_filename(notes_dir, filename, NULL);
-      g_ptr_array_add(paths, path);
+      g_ptr_array_add(names, g_strdup(filename));
     }
   }
-
   g_dir_close(dir);
 
+  /* Stat all notes in one batch; cold notes take their mtime from the
+   * index. */
+  mtimes = g_new(gint64, names->len + 1);
+  notes_scan_mtimes(dir_path, names, mtimes);
+
+  entries = g_array_sized_new(FALSE, FALSE, sizeof(NoteEntry), names->len);
+  hot = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (guint i = 0; i < names->len; i++) {
+    const gchar *name = g_ptr_array_index(names, i);
+    NoteEntry entry;
+
+    entry.path = g_build_filename(dir_path, name, NULL);
+    entry.mtime = mtimes[i];
+    g_array_append_val(entries, entry);
+    g_hash_table_add(hot, g_strdup(name));
+  }
+  g_free(mtimes);
+  g_ptr_array_free(names, TRUE);
+  g_free(dir_path);
+
+  if (top_level) {
+    g_rec_mutex_lock(&storage_lock);
+    if (notes_cold_count() > 0) {
+      ColdListing listing = {entries, hot};
+      notes_cold_foreach(add_cold_entry, &listing);
+    }
+    g_rec_mutex_unlock(&storage_lock);
+  }
+  g_hash_table_destroy(hot);
+
   /* Sort by modification time (newest first) */
-  g_ptr_array_sort(paths, compare_by_mtime);
+  g_array_sort(entries, compare_by_mtime);
+
+  for (guint i = 0; i < entries->len; i++) {
+    g_ptr_array_add(paths, g_array_index(entries, NoteEntry, i).path);
+  }
+  g_array_free(entries, TRUE);
 
   return paths;
 }
 
-gchar *notes_create(void) {
-  gchar *filename;
-  gchar *path;
+/*
+ * Create dir/stem.md, or stem_1.md, stem_2.md, ... if taken. O_EXCL makes the
+ * name ours even with other threads or processes creating notes at once.
+ * Returns the open fd and sets path_out, or -1 with errno set.
+ */
+static gint create_exclusive(const gchar *dir, const gchar *stem,
+                             gchar **path_out) {
+  for (gint attempt = 0; attempt < 1000; attempt++) {
+    gchar *filename = attempt == 0
+                          ? g_strdup_printf("%s.md", stem)
+                          : g_strdup_printf("%s_%d.md", stem, attempt);
+    gchar *path = g_build_filename(dir, filename, NULL);
+    gint fd = g_open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+    g_free(filename);
+    if (fd >= 0) {
+      *path_out = path;
+      return fd;
+    }
+    g_free(path);
+    if (errno != EEXIST) {
+      return -1;
+    }
+  }
+
+  errno = EEXIST;
+  return -1;
+}
+
+gchar *notes_create(void) { return notes_create_in(""); }
+
+gchar *notes_create_in(const gchar *notebook) {
+  gchar *dir;
+  gchar *path = NULL;
   time_t now;
   struct tm *tm_info;
   gchar timestamp[32];
-  FILE *fp;
+  gint fd;
+
+  if (use_sqlite()) {
+    g_rec_mutex_lock(&storage_lock);
+    path = notes_sqlite_create();
+    g_rec_mutex_unlock(&storage_lock);
+    return path;
+  }
+
+  notebook = notebook ? notebook : "";
 
   /* Generate filename from timestamp */
   now = time(NULL);
   tm_info = localtime(&now);
   strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", tm_info);
 
-  filename = g_strdup_printf("%s.md", timestamp);
-  path = g_build_filename(notes_dir, filename, NULL);
-  g_free(filename);
-
   /* Create empty file */
-  fp = fopen(path, "w");
-  if (!fp) {
+  dir = g_build_filename(notes_dir, notebook, NULL);
+  fd = create_exclusive(dir, timestamp, &path);
+  g_free(dir);
+  if (fd < 0) {
     g_printerr("Failed to create note: %s\n", g_strerror(errno));
+    return NULL;
+  }
+  close(fd);
+  notes_tree_invalidate(notebook);
+
+  return path;
+}
+
+gchar *notes_create_named(const gchar *notebook, const gchar *stem,
+                          const gchar *content, gint64 mtime) {
+  gchar *dir;
+  gchar *path = NULL;
+  gsize length = content ? strlen(content) : 0;
+  gboolean ok;
+  gint fd;
+  FILE *fp;
+
+  if (use_sqlite()) {
+    g_rec_mutex_lock(&storage_lock);
+    path = notes_sqlite_insert(stem, mtime, content);
+    g_rec_mutex_unlock(&storage_lock);
+    return path;
+  }
+
+  dir = g_build_filename(notes_dir, notebook ? notebook : "", NULL);
+  if (g_mkdir_with_parents(dir, 0755) != 0 ||
+      (fd = create_exclusive(dir, stem, &path)) < 0) {
+    g_printerr("Failed to create note '%s': %s\n", stem, g_strerror(errno));
+    g_free(dir);
+    return NULL;
+  }
+  g_free(dir);
+
+  fp = fdopen(fd, "wb");
+  if (!fp) {
+    close(fd);
+    ok = FALSE;
+  } else {
+    ok = fwrite(content ? content : "", 1, length, fp) == length;
+    if (fclose(fp) != 0) {
+      ok = FALSE;
+    }
+  }
+  if (!ok) {
+    g_printerr("Failed to write note '%s': %s\n", path, g_strerror(errno));
+    g_remove(path);
     g_free(path);
     return NULL;
   }
-  fclose(fp);
+
+  if (mtime > 0) {
+    struct utimbuf times;
+    times.actime = (time_t)(mtime / G_USEC_PER_SEC);
+    times.modtime = times.actime;
+    g_utime(path, &times);
+  }
+  /* The notebook's folders may be new too */
+  notes_tree_invalidate_path(notebook);
 
   return path;
 }
 
-gchar *notes_load(const gchar *path) {
+gchar *notes_notebook_of(const gchar *path) {
+  gchar *dir = g_path_get_dirname(path);
+  gsize root_len = strlen(notes_dir);
+  gchar *notebook;
+
+  if (g_str_has_prefix(dir, notes_dir) && dir[root_len] == G_DIR_SEPARATOR) {
+    notebook = g_strdup(dir + root_len + 1);
+  } else {
+    notebook = g_strdup("");
+  }
+
+  g_free(dir);
+  return notebook;
+}
+
+static gchar *load_note(const gchar *path) {
   gchar *content = NULL;
   GError *error = NULL;
 
+  if (use_sqlite()) {
+    return notes_sqlite_load(path);
+  }
+
+  if (is_cold(path)) {
+    return notes_cold_load(note_name(path));
+  }
+
+  if (notes_chunked_is(path)) {
+    return notes_chunked_load(path, NULL);
+  }
+
   if (!g_file_get_contents(path, &content, NULL, &error)) {
     g_printerr("Failed to load note: %s\n", error->message);
     g_error_free(error);
@@ -139,34 +457,450 @@ gchar *notes_load(const gchar *path) {
   return content;
 }
 
-gboolean notes_save(const gchar *path, const gchar *content) {
+gchar *notes_load(const gchar *path) {
+  gchar *content;
+
+  g_rec_mutex_lock(&storage_lock);
+  content = load_note(path);
+  g_rec_mutex_unlock(&storage_lock);
+  return content;
+}
+
+/* Large notes go to the chunked layout once over the threshold, and stay
+ * there. If chunking isn't possible here the note is saved plain. */
+static gboolean save_file(const gchar *path, const gchar *content) {
   GError *error = NULL;
 
+  if (notes_chunked_is(path)) {
+    return notes_chunked_save(path, content);
+  }
+  if (chunk_threshold > 0 && strlen(content) >= chunk_threshold &&
+      notes_chunked_save(path, content)) {
+    return TRUE;
+  }
+
   if (!g_file_set_contents(path, content, -1, &error)) {
     g_printerr("Failed to save note: %s\n", error->message);
     g_error_free(error);
     return FALSE;
   }
-
   return TRUE;
 }
 
-gboolean notes_delete(const gchar *path) {
-  if (!path) {
+static gboolean save_note(const gchar *path, const gchar *content) {
+  if (use_sqlite()) {
+    if (!notes_sqlite_save(path, content)) {
+      return FALSE;
+    }
+  } else if (!save_file(path, content)) {
     return FALSE;
+  } else if (notes_cold_contains(note_name(path))) {
+    /* Saving thaws a cold note: the plain file is now authoritative */
+    notes_cold_remove(note_name(path));
   }
 
-  if (g_remove(path) != 0) {
+  notes_history_record(path, content);
+  notes_dupes_update(path, content);
+  return TRUE;
+}
+
+gboolean notes_save(const gchar *path, const gchar *content) {
+  gboolean ok;
+
+  g_rec_mutex_lock(&storage_lock);
+  ok = save_note(path, content);
+  g_rec_mutex_unlock(&storage_lock);
+  return ok;
+}
+
+/* The storage half of a delete; safe on a worker thread */
+static gboolean delete_storage(const gchar *path) {
+  gboolean ok = TRUE;
+
+  g_rec_mutex_lock(&storage_lock);
+  if (use_sqlite()) {
+    ok = notes_sqlite_delete(path);
+  } else if (is_cold(path)) {
+    ok = notes_cold_remove(note_name(path));
+  } else if (notes_chunked_is(path)) {
+    ok = notes_chunked_delete(path);
+  } else if (g_remove(path) != 0) {
     g_printerr("Failed to delete note '%s': %s\n", path, g_strerror(errno));
+    ok = FALSE;
+  }
+  g_rec_mutex_unlock(&storage_lock);
+  return ok;
+}
+
+/* Drop what the main thread keeps about a deleted note */
+static void forget_note(const gchar *path) {
+  gchar *notebook = notes_notebook_of(path);
+
+  notes_history_forget(path);
+  notes_dupes_forget(path);
+  notes_folds_save(path, NULL);
+  notes_tree_invalidate(notebook);
+  g_free(notebook);
+}
+
+gboolean notes_delete(const gchar *path) {
+  if (!path || !delete_storage(path)) {
     return FALSE;
   }
 
+  forget_note(path);
   return TRUE;
 }
 
 gint notes_count(void) {
+  if (use_sqlite()) {
+    gint count;
+
+    g_rec_mutex_lock(&storage_lock);
+    count = notes_sqlite_count();
+    g_rec_mutex_unlock(&storage_lock);
+    return count;
+  }
+
   GPtrArray *paths = notes_list();
   gint count = paths->len;
   g_ptr_array_free(paths, TRUE);
   return count;
 }
+
+gint notes_count_in(const gchar *notebook) {
+  gint count = notes_tree_count(notebook);
+
+  /* Only top-level notes are ever frozen */
+  if (!use_sqlite() && (!notebook || !*notebook)) {
+    g_rec_mutex_lock(&storage_lock);
+    count += notes_cold_count();
+    g_rec_mutex_unlock(&storage_lock);
+  }
+  return count;
+}
+
+/* Stops between batches once cancellable is cancelled */
+static gint archive_cold(gint days, GCancellable *cancellable) {
+  gboolean more = !use_sqlite();
+  gint moved = 0;
+
+  while (more && !g_cancellable_is_cancelled(cancellable)) {
+    gint batch;
+
+    g_rec_mutex_lock(&storage_lock);
+    batch = notes_cold_freeze(notes_dir, days, COLD_BATCH_BYTES, &more);
+    g_rec_mutex_unlock(&storage_lock);
+    if (batch < 0) {
+      /* Some plain copies may be gone even so */
+      notes_tree_invalidate("");
+      return -1;
+    }
+    if (batch == 0) {
+      break;
+    }
+    moved += batch;
+  }
+  if (moved > 0) {
+    notes_tree_invalidate("");
+  }
+  return moved;
+}
+
+gint notes_archive_cold(gint days) { return archive_cold(days, NULL); }
+
+static GPtrArray *search_notes(const gchar *query) {
+  GPtrArray *matches;
+  GPtrArray *paths;
+
+  if (use_sqlite()) {
+    return notes_sqlite_search(query);
+  }
+
+  matches = g_ptr_array_new_with_free_func(g_free);
+  if (!query || !*query) {
+    return matches;
+  }
+
+  /* No index for plain files: scan every note, keeping mtime order. */
+  paths = notes_list();
+  for (guint i = 0; i < paths->len; i++) {
+    const gchar *path = g_ptr_array_index(paths, i);
+    gchar *content = NULL;
+
+    if (is_cold(path)) {
+      content = notes_cold_load(note_name(path));
+    } else if (notes_chunked_is(path)) {
+      content = notes_chunked_load(path, NULL);
+    }
+
+    if ((content || g_file_get_contents(path, &content, NULL, NULL)) &&
+        strstr(content, query) != NULL) {
+      g_ptr_array_add(matches, g_strdup(path));
+    }
+    g_free(content);
+  }
+  g_ptr_array_free(paths, TRUE);
+
+  return matches;
+}
+
+GPtrArray *notes_search(const gchar *query) {
+  GPtrArray *matches;
+
+  g_rec_mutex_lock(&storage_lock);
+  matches = search_notes(query);
+  g_rec_mutex_unlock(&storage_lock);
+  return matches;
+}
+
+/*
+ * Async variants. Each runs the synchronous code on a GTask worker thread;
+ * results come back in the caller's thread-default main context. A
+ * cancelled call reports G_IO_ERROR_CANCELLED.
+ */
+
+typedef struct _Worker {
+  GTaskThreadFunc func;
+} Worker;
+
+static void worker_thread(GTask *task, gpointer source, gpointer task_data,
+                          GCancellable *cancellable) {
+  Worker *worker = g_object_get_data(G_OBJECT(task), "notes-worker");
+
+  worker->func(task, source, task_data, cancellable);
+
+  g_mutex_lock(&workers_lock);
+  if (--workers_running == 0) {
+    g_cond_broadcast(&workers_done);
+  }
+  g_mutex_unlock(&workers_lock);
+}
+
+/* g_task_run_in_thread, counted in workers_running */
+static void run_worker(GTask *task, GTaskThreadFunc func) {
+  Worker *worker = g_new(Worker, 1);
+
+  worker->func = func;
+  g_object_set_data_full(G_OBJECT(task), "notes-worker", worker, g_free);
+
+  g_mutex_lock(&workers_lock);
+  workers_running++;
+  g_mutex_unlock(&workers_lock);
+  g_task_run_in_thread(task, worker_thread);
+}
+
+static void list_in_thread(GTask *task, gpointer source, gpointer task_data,
+                           GCancellable *cancellable) {
+  GPtrArray *paths = notes_list_in(task_data);
+
+  (void)source;
+  (void)cancellable;
+
+  if (g_task_return_error_if_cancelled(task)) {
+    g_ptr_array_free(paths, TRUE);
+    return;
+  }
+  g_task_return_pointer(task, paths, (GDestroyNotify)g_ptr_array_unref);
+}
+
+void notes_list_in_async(const gchar *notebook, GCancellable *cancellable,
+                         GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+
+  g_task_set_source_tag(task, notes_list_in_async);
+  g_task_set_task_data(task, g_strdup(notebook ? notebook : ""), g_free);
+  run_worker(task, list_in_thread);
+  g_object_unref(task);
+}
+
+GPtrArray *notes_list_in_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void load_thread(GTask *task, gpointer source, gpointer task_data,
+                        GCancellable *cancellable) {
+  const gchar *path = task_data;
+  gchar *content = NULL;
+  gboolean plain;
+  GError *error = NULL;
+
+  (void)source;
+
+  g_rec_mutex_lock(&storage_lock);
+  plain = !use_sqlite() && !is_cold(path) && !notes_chunked_is(path);
+  if (!plain) {
+    content = load_note(path);
+  }
+  g_rec_mutex_unlock(&storage_lock);
+
+  if (plain) {
+    GFile *file = g_file_new_for_path(path);
+    g_file_load_contents(file, cancellable, &content, NULL, NULL, &error);
+    g_object_unref(file);
+  } else if (!content) {
+    g_set_error(&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Failed to load note '%s'", path);
+  }
+
+  if (error) {
+    g_task_return_error(task, error);
+  } else if (!g_task_return_error_if_cancelled(task)) {
+    g_task_return_pointer(task, content, g_free);
+    return;
+  }
+  g_free(content);
+}
+
+void notes_load_async(const gchar *path, GCancellable *cancellable,
+                      GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+
+  g_task_set_source_tag(task, notes_load_async);
+  g_task_set_task_data(task, g_strdup(path), g_free);
+  run_worker(task, load_thread);
+  g_object_unref(task);
+}
+
+gchar *notes_load_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void delete_thread(GTask *task, gpointer source, gpointer task_data,
+                          GCancellable *cancellable) {
+  (void)source;
+  (void)cancellable;
+
+  if (g_task_return_error_if_cancelled(task)) {
+    return;
+  }
+  if (!delete_storage(task_data)) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Failed to delete note '%s'",
+                            (const gchar *)task_data);
+    return;
+  }
+  g_task_return_boolean(task, TRUE);
+}
+
+/* Back on the caller's thread: finish the bookkeeping, then report */
+static void on_delete_stored(GObject *source, GAsyncResult *result,
+                             gpointer user_data) {
+  GTask *task = user_data;
+  GError *error = NULL;
+
+  (void)source;
+
+  if (g_task_propagate_boolean(G_TASK(result), &error)) {
+    forget_note(g_task_get_task_data(task));
+    g_task_return_boolean(task, TRUE);
+  } else {
+    g_task_return_error(task, error);
+  }
+  g_object_unref(task);
+}
+
+void notes_delete_async(const gchar *path, GCancellable *cancellable,
+                        GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  GTask *removal = g_task_new(NULL, cancellable, on_delete_stored, task);
+
+  g_task_set_source_tag(task, notes_delete_async);
+  g_task_set_task_data(task, g_strdup(path), g_free);
+  g_task_set_task_data(removal, g_strdup(path), g_free);
+  run_worker(removal, delete_thread);
+  g_object_unref(removal);
+}
+
+gboolean notes_delete_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
+
+static void count_thread(GTask *task, gpointer source, gpointer task_data,
+                         GCancellable *cancellable) {
+  gint count = notes_count();
+
+  (void)source;
+  (void)task_data;
+  (void)cancellable;
+
+  if (!g_task_return_error_if_cancelled(task)) {
+    g_task_return_int(task, count);
+  }
+}
+
+void notes_count_async(GCancellable *cancellable, GAsyncReadyCallback callback,
+                       gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+
+  g_task_set_source_tag(task, notes_count_async);
+  run_worker(task, count_thread);
+  g_object_unref(task);
+}
+
+gint notes_count_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), -1);
+  return (gint)g_task_propagate_int(G_TASK(result), error);
+}
+
+static void search_thread(GTask *task, gpointer source, gpointer task_data,
+                          GCancellable *cancellable) {
+  GPtrArray *matches = notes_search(task_data);
+
+  (void)source;
+  (void)cancellable;
+
+  if (g_task_return_error_if_cancelled(task)) {
+    g_ptr_array_free(matches, TRUE);
+    return;
+  }
+  g_task_return_pointer(task, matches, (GDestroyNotify)g_ptr_array_unref);
+}
+
+void notes_search_async(const gchar *query, GCancellable *cancellable,
+                        GAsyncReadyCallback callback, gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+
+  g_task_set_source_tag(task, notes_search_async);
+  g_task_set_task_data(task, g_strdup(query), g_free);
+  run_worker(task, search_thread);
+  g_object_unref(task);
+}
+
+GPtrArray *notes_search_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), NULL);
+  return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+static void archive_cold_thread(GTask *task, gpointer source,
+                                gpointer task_data, GCancellable *cancellable) {
+  gint moved = archive_cold(GPOINTER_TO_INT(task_data), cancellable);
+
+  (void)source;
+
+  if (moved < 0) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Failed to move idle notes to cold storage");
+  } else if (!g_task_return_error_if_cancelled(task)) {
+    g_task_return_int(task, moved);
+  }
+}
+
+void notes_archive_cold_async(gint days, GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data) {
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+
+  g_task_set_source_tag(task, notes_archive_cold_async);
+  g_task_set_task_data(task, GINT_TO_POINTER(days), NULL);
+  run_worker(task, archive_cold_thread);
+  g_object_unref(task);
+}
+
+gint notes_archive_cold_finish(GAsyncResult *result, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(result, NULL), -1);
+  return (gint)g_task_propagate_int(G_TASK(result), error);
+}
@@ -1,19 +1,56 @@
 #ifndef MARKYD_NOTES_H
 #define MARKYD_NOTES_H
 
+#include <gio/gio.h>
 #include <glib.h>
 
+typedef enum _MarkydNotesBackend {
+  MARKYD_NOTES_BACKEND_FILES = 0,  /* One .md file per note */
+  MARKYD_NOTES_BACKEND_SQLITE = 1, /* Single notes.db next to the notes dir */
+} MarkydNotesBackend;
+
+/* Select the storage backend (call before notes_init) */
+void notes_set_backend(MarkydNotesBackend backend);
+MarkydNotesBackend notes_get_backend(void);
+
+/* Keep revision history of saved notes (call before notes_init) */
+void notes_set_history_enabled(gboolean enabled);
+
+/* Store notes of at least bytes in the chunked layout (plain-file backend
+ * only; 0 = never). Once chunked, a note stays chunked. */
+void notes_set_chunk_threshold(gsize bytes);
+
 /* Initialize notes storage directory */
 gboolean notes_init(void);
 
+/* Initialize notes storage rooted at an explicit directory */
+gboolean notes_init_at(const gchar *dir);
+
+/* Release backend resources */
+void notes_cleanup(void);
+
 /* Get storage directory path */
 const gchar *notes_get_dir(void);
 
-/* Get list of all note paths (sorted by mtime, newest first) */
+/* Get list of top-level note paths (sorted by mtime, newest first) */
 GPtrArray *notes_list(void);
 
+/* Notes directly inside a notebook, a subdirectory path relative to the notes
+ * dir ("" is the top level). Sorted by mtime, newest first. */
+GPtrArray *notes_list_in(const gchar *notebook);
+
 /* Create a new note, returns path (caller must free) */
 gchar *notes_create(void);
+gchar *notes_create_in(const gchar *notebook);
+
+/* Create a note named stem.md (stem_N.md if taken) in notebook with content
+ * and mtime (microseconds, 0 = now). Thread-safe with the file backend, but
+ * doesn't refresh notebook counts. Returns the path (caller must free). */
+gchar *notes_create_named(const gchar *notebook, const gchar *stem,
+                          const gchar *content, gint64 mtime);
+
+/* Notebook containing the note at path (caller must free) */
+gchar *notes_notebook_of(const gchar *path);
 
 /* Load note content (caller must free) */
 gchar *notes_load(const gchar *path);
@@ -27,4 +64,46 @@ gboolean notes_delete(const gchar *path);
 /* Get note count */
 gint notes_count(void);
 
+/* Notes directly inside notebook, cold ones included (cheap: cached) */
+gint notes_count_in(const gchar *notebook);
+
+/* Move notes untouched for days into the compressed cold tier (plain-file
+ * backend only), a batch at a time. They keep their paths; returns the
+ * number moved. */
+gint notes_archive_cold(gint days);
+
+/* Paths of notes containing query (FTS5 syntax on the SQLite backend) */
+GPtrArray *notes_search(const gchar *query);
+
+/*
+ * Non-blocking variants of the calls above, run on a worker thread. The
+ * callback fires in the calling thread's main context; after a cancel the
+ * _finish call fails with G_IO_ERROR_CANCELLED. Failures are reported
+ * through error instead of being printed.
+ */
+void notes_list_in_async(const gchar *notebook, GCancellable *cancellable,
+                         GAsyncReadyCallback callback, gpointer user_data);
+GPtrArray *notes_list_in_finish(GAsyncResult *result, GError **error);
+
+void notes_load_async(const gchar *path, GCancellable *cancellable,
+                      GAsyncReadyCallback callback, gpointer user_data);
+gchar *notes_load_finish(GAsyncResult *result, GError **error);
+
+void notes_delete_async(const gchar *path, GCancellable *cancellable,
+                        GAsyncReadyCallback callback, gpointer user_data);
+gboolean notes_delete_finish(GAsyncResult *result, GError **error);
+
+void notes_count_async(GCancellable *cancellable, GAsyncReadyCallback callback,
+                       gpointer user_data);
+gint notes_count_finish(GAsyncResult *result, GError **error);
+
+void notes_search_async(const gchar *query, GCancellable *cancellable,
+                        GAsyncReadyCallback callback, gpointer user_data);
+GPtrArray *notes_search_finish(GAsyncResult *result, GError **error);
+
+void notes_archive_cold_async(gint days, GCancellable *cancellable,
+                              GAsyncReadyCallback callback,
+                              gpointer user_data);
+gint notes_archive_cold_finish(GAsyncResult *result, GError **error);
+
 #endif /* MARKYD_NOTES_H */
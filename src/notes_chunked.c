@@ -0,0 +1,669 @@
+#define _GNU_SOURCE /* RENAME_EXCHANGE */
+#include "notes_chunked.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+#define CHUNK_MANIFEST "manifest"
+#define CHUNK_MAGIC "traymd-chunks 1"
+/* Chunks are at least CHUNK_MIN, then end where the top CHUNK_BITS of the
+ * rolling hash are zero (about every 32 KiB), moved up to the next
+ * paragraph break within CHUNK_SNAP; CHUNK_MAX bounds the rare long ones */
+#define CHUNK_MIN (16 * 1024)
+#define CHUNK_BITS 15
+#define CHUNK_SNAP (8 * 1024)
+#define CHUNK_MAX (256 * 1024)
+
+/* Set once renameat2(RENAME_EXCHANGE) turns out to be unavailable */
+static gboolean exchange_unsupported = FALSE;
+
+typedef struct _Chunk {
+  guint32 id; /* File is <id>.chunk, ids are never reused */
+  gsize length;
+  guint64 sum;
+} Chunk;
+
+typedef struct _Manifest {
+  GArray *chunks; /* Chunk, in content order */
+  guint32 next_id;
+  gsize total;
+} Manifest;
+
+static guint64 chunk_sum(const gchar *p, gsize n) {
+  const guchar *b = (const guchar *)p;
+  guint64 h = 14695981039346656037ULL; /* FNV-1a */
+  for (gsize i = 0; i < n; i++) {
+    h = (h ^ b[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+static gchar *chunk_path(const gchar *dir, guint32 id) {
+  gchar name[32];
+  g_snprintf(name, sizeof(name), "%08x.chunk", id);
+  return g_build_filename(dir, name, NULL);
+}
+
+static void remove_chunk(const gchar *dir, guint32 id) {
+  gchar *path = chunk_path(dir, id);
+  g_remove(path);
+  g_free(path);
+}
+
+static gchar *manifest_path(const gchar *dir) {
+  return g_build_filename(dir, CHUNK_MANIFEST, NULL);
+}
+
+static void manifest_free(Manifest *manifest) {
+  g_array_free(manifest->chunks, TRUE);
+  g_free(manifest);
+}
+
+static Manifest *manifest_new(void) {
+  Manifest *manifest = g_new0(Manifest, 1);
+  manifest->chunks = g_array_new(FALSE, FALSE, sizeof(Chunk));
+  return manifest;
+}
+
+/*
+ * Text format, one chunk per line after the header:
+ *   traymd-chunks 1 <next id, hex>
+ *   <id, hex>\t<length>\t<FNV-1a, hex>
+ */
+static Manifest *manifest_read(const gchar *dir) {
+  gchar *path = manifest_path(dir);
+  gchar *data = NULL;
+  gchar **lines;
+  Manifest *manifest;
+  gboolean ok = TRUE;
+
+  if (!g_file_get_contents(path, &data, NULL, NULL)) {
+    g_free(path);
+    return NULL;
+  }
+  g_free(path);
+
+  lines = g_strsplit(data, "\n", -1);
+  g_free(data);
+  if (!lines[0] || !g_str_has_prefix(lines[0], CHUNK_MAGIC " ")) {
+    g_strfreev(lines);
+    return NULL;
+  }
+
+  manifest = manifest_new();
+  manifest->next_id =
+      (guint32)g_ascii_strtoull(lines[0] + strlen(CHUNK_MAGIC " "), NULL, 16);
+  for (guint i = 1; ok && lines[i]; i++) {
+    Chunk chunk;
+    gchar *end;
+
+    if (!*lines[i]) {
+      continue;
+    }
+    chunk.id = (guint32)g_ascii_strtoull(lines[i], &end, 16);
+    ok = *end == '\t';
+    if (ok) {
+      chunk.length = (gsize)g_ascii_strtoull(end + 1, &end, 10);
+      ok = *end == '\t';
+    }
+    if (ok) {
+      chunk.sum = g_ascii_strtoull(end + 1, &end, 16);
+      ok = *end == '\0' && chunk.id < manifest->next_id;
+    }
+    if (ok) {
+      g_array_append_val(manifest->chunks, chunk);
+      manifest->total += chunk.length;
+    }
+  }
+  g_strfreev(lines);
+
+  if (!ok) {
+    manifest_free(manifest);
+    return NULL;
+  }
+  return manifest;
+}
+
+/* Atomic replace; this is the commit point of a save */
+static gboolean manifest_write(const gchar *dir, const Manifest *manifest) {
+  GString *out = g_string_new(NULL);
+  gchar *path = manifest_path(dir);
+  GError *error = NULL;
+  gboolean ok;
+
+  g_string_append_printf(out, CHUNK_MAGIC " %x\n", manifest->next_id);
+  for (guint i = 0; i < manifest->chunks->len; i++) {
+    const Chunk *chunk = &g_array_index(manifest->chunks, Chunk, i);
+    g_string_append_printf(out, "%x\t%" G_GSIZE_FORMAT "\t%" G_GINT64_MODIFIER
+                                "x\n",
+                           chunk->id, chunk->length, chunk->sum);
+  }
+
+  ok = g_file_set_contents(path, out->str, (gssize)out->len, &error);
+  if (!ok) {
+    g_printerr("Failed to write chunk manifest: %s\n", error->message);
+    g_error_free(error);
+  }
+  g_string_free(out, TRUE);
+  g_free(path);
+  return ok;
+}
+
+static const guint64 *gear_table(void) {
+  static guint64 table[256];
+  static gsize ready = 0;
+
+  if (g_once_init_enter(&ready)) {
+    /* Fixed seed: cut points must not change between runs */
+    guint64 x = 0x747261796d64ULL;
+    for (guint i = 0; i < 256; i++) {
+      guint64 z = (x += 0x9E3779B97F4A7C15ULL); /* splitmix64 */
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      table[i] = z ^ (z >> 31);
+    }
+    g_once_init_leave(&ready, 1);
+  }
+  return table;
+}
+
+/* First paragraph end (else line end, else character boundary) at or after
+ * data[at], looking no further than CHUNK_SNAP ahead */
+static gsize snap_cut(const gchar *data, gsize at, gsize avail) {
+  gsize limit = MIN(avail, at + CHUNK_SNAP);
+  gsize line = 0;
+
+  for (gsize i = at; i < limit; i++) {
+    if (data[i] == '\n') {
+      if (i + 1 < avail && data[i + 1] == '\n') {
+        return i + 2;
+      }
+      if (!line) {
+        line = i + 1;
+      }
+    }
+  }
+  if (line) {
+    return line;
+  }
+
+  while (at < avail && ((guchar)data[at] & 0xC0) == 0x80) {
+    at++;
+  }
+  return at;
+}
+
+/*
+ * Length of the chunk starting at data[0]. Cut points come from a gear
+ * rolling hash of the last 64 bytes, so they depend only on nearby content:
+ * after an insertion or deletion the cuts fall back into step with the old
+ * ones and the chunks past the edit keep their checksums.
+ */
+static gsize next_cut(const gchar *data, gsize avail) {
+  const guint64 *gear = gear_table();
+  const guchar *b = (const guchar *)data;
+  gsize end = MIN(avail, CHUNK_MAX);
+  guint64 h = 0;
+
+  if (avail <= CHUNK_MIN) {
+    return avail;
+  }
+
+  for (gsize i = CHUNK_MIN - 64; i < end; i++) {
+    h = (h << 1) + gear[b[i]];
+    if (i >= CHUNK_MIN && (h >> (64 - CHUNK_BITS)) == 0) {
+      return snap_cut(data, i, avail);
+    }
+  }
+  if (avail <= CHUNK_MAX) {
+    return avail;
+  }
+  return snap_cut(data, CHUNK_MAX - CHUNK_SNAP, avail);
+}
+
+/* Length of the run data and prev share at their starts */
+static gsize common_prefix(const gchar *data, const gchar *prev, gsize n) {
+  gsize i = 0;
+
+  while (i + 4096 <= n && memcmp(data + i, prev + i, 4096) == 0) {
+    i += 4096;
+  }
+  while (i < n && data[i] == prev[i]) {
+    i++;
+  }
+  return i;
+}
+
+/* Length of the run data and prev share at their ends, up to n */
+static gsize common_suffix(const gchar *data, gsize len, const gchar *prev,
+                           gsize prev_len, gsize n) {
+  gsize i = 0;
+
+  while (i < n && data[len - 1 - i] == prev[prev_len - 1 - i]) {
+    i++;
+  }
+  return i;
+}
+
+/*
+ * Split data into chunks, reusing any chunk of old with the same length and
+ * checksum and writing the rest as new files in dir; manifest (empty) gets
+ * the result. On failure the files written so far are removed again.
+ *
+ * With prev, the content old was cut from, only the edited span is cut
+ * again: a cut depends on no more than CHUNK_SNAP bytes past it, so old
+ * chunks that end that far before the first changed byte are kept as they
+ * are, and once a new cut lands on an old one inside the unchanged tail the
+ * rest of old follows unchanged.
+ */
+static gboolean write_chunks(const gchar *dir, const gchar *data, gsize len,
+                             const Manifest *old, const gchar *prev,
+                             gsize prev_len, Manifest *manifest) {
+  GHashTable *known = g_hash_table_new(g_int64_hash, g_int64_equal);
+  gsize pos = 0;
+  gsize tail_from = G_MAXSIZE; /* Where the unchanged tail starts in data */
+  gsize old_pos = 0;           /* Start of old chunk next, in prev */
+  guint next = 0;
+  GError *error = NULL;
+  gboolean ok = TRUE;
+
+  for (guint i = 0; i < old->chunks->len; i++) {
+    Chunk *chunk = &g_array_index(old->chunks, Chunk, i);
+    g_hash_table_insert(known, &chunk->sum, chunk);
+  }
+  manifest->next_id = old->next_id;
+
+  if (prev) {
+    gsize first = common_prefix(data, prev, MIN(len, prev_len));
+    gsize same = common_suffix(data, len, prev, prev_len,
+                               MIN(len, prev_len) - first);
+
+    tail_from = len - same;
+    for (; next < old->chunks->len; next++) {
+      const Chunk *chunk = &g_array_index(old->chunks, Chunk, next);
+
+      if (old_pos + chunk->length + CHUNK_SNAP >= first ||
+          old_pos + chunk->length >= prev_len) {
+        break;
+      }
+      g_array_append_val(manifest->chunks, *chunk);
+      old_pos += chunk->length;
+    }
+    pos = old_pos;
+    manifest->total = pos;
+  }
+
+  while (ok && pos < len) {
+    Chunk chunk;
+    const Chunk *same;
+    gchar *path;
+
+    chunk.length = next_cut(data + pos, len - pos);
+    chunk.sum = chunk_sum(data + pos, chunk.length);
+    same = g_hash_table_lookup(known, &chunk.sum);
+    if (same && same->length == chunk.length) {
+      chunk.id = same->id;
+    } else {
+      chunk.id = manifest->next_id++;
+      path = chunk_path(dir, chunk.id);
+      ok = g_file_set_contents(path, data + pos, (gssize)chunk.length,
+                               &error);
+      if (!ok) {
+        g_printerr("Failed to write note chunk: %s\n", error->message);
+        g_error_free(error);
+      }
+      g_free(path);
+    }
+
+    if (ok) {
+      g_array_append_val(manifest->chunks, chunk);
+      manifest->total += chunk.length;
+      pos += chunk.length;
+    }
+
+    /* Back in step with old: from here on the content, and so the cuts,
+     * are the same */
+    if (ok && pos >= tail_from && pos < len) {
+      gsize at = pos - len + prev_len;
+
+      while (next < old->chunks->len && old_pos < at) {
+        old_pos += g_array_index(old->chunks, Chunk, next).length;
+        next++;
+      }
+      if (old_pos == at) {
+        g_array_append_vals(manifest->chunks,
+                            &g_array_index(old->chunks, Chunk, next),
+                            old->chunks->len - next);
+        manifest->total = len;
+        break;
+      }
+    }
+  }
+  g_hash_table_destroy(known);
+
+  if (!ok) {
+    for (guint32 id = old->next_id; id < manifest->next_id; id++) {
+      remove_chunk(dir, id);
+    }
+  }
+  return ok;
+}
+
+/* Drop chunk files the manifest doesn't reference (left by a save that
+ * died before its manifest was written) */
+static void remove_strays(const gchar *dir, const Manifest *manifest) {
+  GHashTable *live = g_hash_table_new(g_direct_hash, g_direct_equal);
+  GDir *handle = g_dir_open(dir, 0, NULL);
+  const gchar *name;
+
+  if (!handle) {
+    g_hash_table_destroy(live);
+    return;
+  }
+
+  for (guint i = 0; i < manifest->chunks->len; i++) {
+    guint32 id = g_array_index(manifest->chunks, Chunk, i).id;
+    g_hash_table_add(live, GUINT_TO_POINTER(id + 1));
+  }
+
+  while ((name = g_dir_read_name(handle)) != NULL) {
+    gchar *end;
+    guint32 id;
+
+    if (!g_str_has_suffix(name, ".chunk")) {
+      continue;
+    }
+    id = (guint32)g_ascii_strtoull(name, &end, 16);
+    if (strcmp(end, ".chunk") != 0 ||
+        !g_hash_table_contains(live, GUINT_TO_POINTER(id + 1))) {
+      gchar *path = g_build_filename(dir, name, NULL);
+      g_remove(path);
+      g_free(path);
+    }
+  }
+
+  g_dir_close(handle);
+  g_hash_table_destroy(live);
+}
+
+/* The last content saved, so the next save of the same note can find the
+ * edit by comparing rather than cutting and hashing it all again */
+static GMutex saved_lock;
+static gchar *saved_dir = NULL;
+static gchar *saved_content = NULL;
+static gsize saved_len = 0;
+static Manifest *saved_manifest = NULL;
+
+static gboolean manifest_equal(const Manifest *a, const Manifest *b) {
+  return a->next_id == b->next_id && a->total == b->total &&
+         a->chunks->len == b->chunks->len &&
+         memcmp(a->chunks->data, b->chunks->data,
+                sizeof(Chunk) * a->chunks->len) == 0;
+}
+
+/* Caller holds saved_lock. A NULL dir just drops what was kept. */
+static void remember_saved(const gchar *dir, const gchar *content, gsize len,
+                           Manifest *manifest) {
+  g_free(saved_dir);
+  g_free(saved_content);
+  if (saved_manifest) {
+    manifest_free(saved_manifest);
+  }
+  saved_dir = g_strdup(dir);
+  saved_content = dir ? g_memdup2(content, len) : NULL;
+  saved_len = len;
+  saved_manifest = manifest;
+}
+
+/* Chunk the new content and rewrite only chunks the manifest doesn't
+ * already have; with content-defined cuts that is just the ones around each
+ * edit, wherever they are. */
+static gboolean update_chunked(const gchar *dir, const gchar *content,
+                               gsize len) {
+  Manifest *old = manifest_read(dir);
+  Manifest *manifest;
+  const gchar *prev = NULL;
+  gboolean ok;
+
+  if (!old) {
+    g_printerr("Failed to save note: unreadable chunk manifest in '%s'\n",
+               dir);
+    return FALSE;
+  }
+
+  g_mutex_lock(&saved_lock);
+  /* Only if nothing else wrote the note since */
+  if (saved_dir && strcmp(saved_dir, dir) == 0 &&
+      manifest_equal(saved_manifest, old)) {
+    prev = saved_content;
+  }
+
+  manifest = manifest_new();
+  ok = write_chunks(dir, content, len, old, prev, saved_len, manifest);
+  if (ok) {
+    /* Rewritten even when nothing changed, so the note's mtime moves */
+    ok = manifest_write(dir, manifest);
+    remove_strays(dir, ok ? manifest : old);
+  }
+
+  if (ok) {
+    remember_saved(dir, content, len, manifest);
+  } else {
+    remember_saved(NULL, NULL, 0, NULL);
+    manifest_free(manifest);
+  }
+  g_mutex_unlock(&saved_lock);
+
+  manifest_free(old);
+  return ok;
+}
+
+static gboolean exchange_paths(const gchar *a, const gchar *b) {
+#ifdef SYS_renameat2
+  return syscall(SYS_renameat2, AT_FDCWD, a, AT_FDCWD, b, RENAME_EXCHANGE) ==
+         0;
+#else
+  (void)a;
+  (void)b;
+  errno = ENOSYS;
+  return FALSE;
+#endif
+}
+
+static gboolean remove_dir(const gchar *dir) {
+  GDir *handle = g_dir_open(dir, 0, NULL);
+  const gchar *name;
+
+  if (handle) {
+    while ((name = g_dir_read_name(handle)) != NULL) {
+      gchar *path = g_build_filename(dir, name, NULL);
+      g_remove(path);
+      g_free(path);
+    }
+    g_dir_close(handle);
+  }
+  return g_rmdir(dir) == 0;
+}
+
+/* Build the chunked note next to path and swap it in. With an existing
+ * plain file the swap needs renameat2(RENAME_EXCHANGE), so readers see
+ * either the old file or the complete directory, never neither. */
+static gboolean convert_to_chunked(const gchar *path, const gchar *content,
+                                   gsize len) {
+  gboolean exists = g_file_test(path, G_FILE_TEST_EXISTS);
+  gchar *parent;
+  gchar *base;
+  gchar *tmp_name;
+  gchar *tmp;
+  Manifest *manifest;
+  gboolean ok;
+
+  if (exists && exchange_unsupported) {
+    return FALSE;
+  }
+
+  parent = g_path_get_dirname(path);
+  base = g_path_get_basename(path);
+  tmp_name = g_strdup_printf(".%s.chunking", base);
+  tmp = g_build_filename(parent, tmp_name, NULL);
+  manifest = manifest_new();
+
+  if (g_file_test(tmp, G_FILE_TEST_IS_DIR)) {
+    remove_dir(tmp);
+  }
+
+  ok = g_mkdir(tmp, 0700) == 0;
+  if (!ok) {
+    g_printerr("Failed to create '%s': %s\n", tmp, g_strerror(errno));
+  } else {
+    Manifest *none = manifest_new();
+    ok = write_chunks(tmp, content, len, none, NULL, 0, manifest) &&
+         manifest_write(tmp, manifest);
+    manifest_free(none);
+  }
+
+  if (ok && exists) {
+    ok = exchange_paths(tmp, path);
+    if (ok) {
+      g_remove(tmp); /* The old plain file */
+    } else if (errno == EINVAL || errno == ENOSYS) {
+      /* Filesystem or kernel can't swap; keep such notes plain */
+      exchange_unsupported = TRUE;
+    } else {
+      g_printerr("Failed to convert '%s' to chunks: %s\n", path,
+                 g_strerror(errno));
+    }
+  } else if (ok) {
+    ok = g_rename(tmp, path) == 0;
+  }
+
+  if (!ok && g_file_test(tmp, G_FILE_TEST_IS_DIR)) {
+    remove_dir(tmp);
+  }
+
+  manifest_free(manifest);
+  g_free(tmp);
+  g_free(tmp_name);
+  g_free(base);
+  g_free(parent);
+  return ok;
+}
+
+gboolean notes_chunked_is(const gchar *path) {
+  gchar *manifest = manifest_path(path);
+  gboolean is = g_file_test(manifest, G_FILE_TEST_IS_REGULAR);
+  g_free(manifest);
+  return is;
+}
+
+/* Every chunk is read straight into its slot of one buffer sized from the
+ * manifest; nothing is copied or reallocated along the way. */
+gchar *notes_chunked_load(const gchar *path, gsize *length) {
+  Manifest *manifest = manifest_read(path);
+  gchar *content;
+  gsize offset = 0;
+
+  if (!manifest) {
+    g_printerr("Failed to load note: unreadable chunk manifest in '%s'\n",
+               path);
+    return NULL;
+  }
+
+  content = g_malloc(manifest->total + 1);
+  for (guint i = 0; i < manifest->chunks->len && content; i++) {
+    const Chunk *chunk = &g_array_index(manifest->chunks, Chunk, i);
+    gchar *file = chunk_path(path, chunk->id);
+    gint fd = open(file, O_RDONLY | O_CLOEXEC);
+    gsize done = 0;
+
+    while (fd >= 0 && done < chunk->length) {
+      gssize n = pread(fd, content + offset + done, chunk->length - done,
+                       (off_t)done);
+      if (n <= 0 && !(n < 0 && errno == EINTR)) {
+        break;
+      }
+      done += n > 0 ? (gsize)n : 0;
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+
+    if (done != chunk->length) {
+      g_printerr("Failed to load note: chunk '%s' is missing or short\n",
+                 file);
+      g_free(content);
+      content = NULL;
+    }
+    offset += chunk->length;
+    g_free(file);
+  }
+  manifest_free(manifest);
+
+  if (!content) {
+    return NULL;
+  }
+  content[offset] = '\0';
+  if (length) {
+    *length = offset;
+  }
+  return content;
+}
+
+gboolean notes_chunked_save(const gchar *path, const gchar *content) {
+  gsize len = strlen(content);
+
+  if (notes_chunked_is(path)) {
+    return update_chunked(path, content, len);
+  }
+  return convert_to_chunked(path, content, len);
+}
+
+gboolean notes_chunked_delete(const gchar *path) {
+  g_mutex_lock(&saved_lock);
+  if (saved_dir && strcmp(saved_dir, path) == 0) {
+    remember_saved(NULL, NULL, 0, NULL);
+  }
+  g_mutex_unlock(&saved_lock);
+
+  if (!remove_dir(path)) {
+    g_printerr("Failed to delete note '%s': %s\n", path, g_strerror(errno));
+    return FALSE;
+  }
+  return TRUE;
+}
+
+gboolean notes_chunked_export(const gchar *path, const gchar *dest) {
+  gchar *content = NULL;
+  gsize length = 0;
+  GError *error = NULL;
+  gboolean ok;
+
+  if (notes_chunked_is(path)) {
+    content = notes_chunked_load(path, &length);
+    if (!content) {
+      return FALSE;
+    }
+  } else if (!g_file_get_contents(path, &content, &length, &error)) {
+    g_printerr("Failed to read note: %s\n", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  ok = g_file_set_contents(dest, content, (gssize)length, &error);
+  if (!ok) {
+    g_printerr("Failed to export note: %s\n", error->message);
+    g_error_free(error);
+  }
+  g_free(content);
+  return ok;
+}
@@ -0,0 +1,34 @@
+#ifndef MARKYD_NOTES_CHUNKED_H
+#define MARKYD_NOTES_CHUNKED_H
+
+#include <glib.h>
+
+/*
+ * Chunked layout for very large notes (running logs, journals). Instead of a
+ * single file, the note at name.md is a directory holding chunk files of
+ * around 50 KiB, cut at content-defined paragraph breaks, and a manifest
+ * listing them in order with their lengths and checksums. A save writes only
+ * chunks whose checksum the manifest doesn't know, i.e. those around each
+ * edit, and cuts and hashes again only the span between the first and last
+ * changed byte; the manifest is replaced atomically last, so a crash leaves
+ * the old version.
+ */
+
+/* Whether path is a chunked note directory */
+gboolean notes_chunked_is(const gchar *path);
+
+/* Reassemble the note into one buffer (caller must free). length may be
+ * NULL. Thread-safe. */
+gchar *notes_chunked_load(const gchar *path, gsize *length);
+
+/* Save content to the chunked note at path, converting a plain file there
+ * in place. Returns FALSE (leaving path untouched) on failure. */
+gboolean notes_chunked_save(const gchar *path, const gchar *content);
+
+/* Remove the chunked note directory and everything in it */
+gboolean notes_chunked_delete(const gchar *path);
+
+/* Write the note at path (chunked or plain) as a single .md file at dest */
+gboolean notes_chunked_export(const gchar *path, const gchar *dest);
+
+#endif /* MARKYD_NOTES_CHUNKED_H */
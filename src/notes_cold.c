@@ -0,0 +1,435 @@
+#include "notes_cold.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zstd.h>
+
+#define COLD_INDEX_NAME "index.tsv"
+#define COLD_INDEX_HEADER "# traymd cold index v1\n"
+#define COLD_ZSTD_LEVEL 9
+
+typedef struct _ColdEntry {
+  gchar *name;    /* Note file name, e.g. 20240101_120000.md */
+  gint64 mtime;   /* Microseconds */
+  guint64 size;   /* Uncompressed bytes */
+  gchar *archive; /* Archive file name inside cold_dir */
+  guint64 offset; /* Start of the note's zstd frame */
+  guint64 csize;  /* Frame length */
+} ColdEntry;
+
+static gchar *cold_dir = NULL;
+static GHashTable *entries = NULL; /* name -> ColdEntry */
+
+static void cold_entry_free(gpointer data) {
+  ColdEntry *entry = data;
+
+  g_free(entry->name);
+  g_free(entry->archive);
+  g_free(entry);
+}
+
+static gchar *index_path(void) {
+  return g_build_filename(cold_dir, COLD_INDEX_NAME, NULL);
+}
+
+static void load_index(void) {
+  gchar *path = index_path();
+  gchar *data = NULL;
+  gchar **lines;
+
+  if (!g_file_get_contents(path, &data, NULL, NULL)) {
+    g_free(path);
+    return;
+  }
+
+  lines = g_strsplit(data, "\n", -1);
+  for (gchar **line = lines; *line; line++) {
+    gchar **fields;
+    ColdEntry *entry;
+
+    if ((*line)[0] == '\0' || (*line)[0] == '#') {
+      continue;
+    }
+
+    fields = g_strsplit(*line, "\t", -1);
+    if (g_strv_length(fields) != 6) {
+      g_printerr("Skipping malformed cold index line: %s\n", *line);
+      g_strfreev(fields);
+      continue;
+    }
+
+    entry = g_new0(ColdEntry, 1);
+    entry->name = g_strdup(fields[0]);
+    entry->mtime = g_ascii_strtoll(fields[1], NULL, 10);
+    entry->size = g_ascii_strtoull(fields[2], NULL, 10);
+    entry->archive = g_strdup(fields[3]);
+    entry->offset = g_ascii_strtoull(fields[4], NULL, 10);
+    entry->csize = g_ascii_strtoull(fields[5], NULL, 10);
+    g_hash_table_replace(entries, entry->name, entry);
+    g_strfreev(fields);
+  }
+
+  g_strfreev(lines);
+  g_free(data);
+  g_free(path);
+}
+
+/* Delete archives no longer referenced by any entry. */
+static void prune_archives(void) {
+  GHashTable *live = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTableIter iter;
+  gpointer value;
+  GDir *dir;
+  const gchar *filename;
+
+  g_hash_table_iter_init(&iter, entries);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    ColdEntry *entry = value;
+    g_hash_table_add(live, entry->archive);
+  }
+
+  dir = g_dir_open(cold_dir, 0, NULL);
+  if (dir) {
+    while ((filename = g_dir_read_name(dir)) != NULL) {
+      if (g_str_has_suffix(filename, ".zst") &&
+          !g_hash_table_contains(live, filename)) {
+        gchar *path = g_build_filename(cold_dir, filename, NULL);
+        g_remove(path);
+        g_free(path);
+      }
+    }
+    g_dir_close(dir);
+  }
+
+  g_hash_table_destroy(live);
+}
+
+static gboolean save_index(void) {
+  GString *out = g_string_new(COLD_INDEX_HEADER);
+  GHashTableIter iter;
+  gpointer value;
+  gchar *path = index_path();
+  GError *error = NULL;
+  gboolean ok;
+
+  g_hash_table_iter_init(&iter, entries);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    ColdEntry *entry = value;
+    g_string_append_printf(out,
+                           "%s\t%" G_GINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                           "\t%s\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT
+                           "\n",
+                           entry->name, entry->mtime, entry->size,
+                           entry->archive, entry->offset, entry->csize);
+  }
+
+  ok = g_file_set_contents(path, out->str, (gssize)out->len, &error);
+  if (!ok) {
+    g_printerr("Failed to write cold index: %s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_string_free(out, TRUE);
+  g_free(path);
+  return ok;
+}
+
+gboolean notes_cold_open(const gchar *dir) {
+  notes_cold_close();
+
+  cold_dir = g_strdup(dir);
+  entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                  cold_entry_free);
+  load_index();
+  return TRUE;
+}
+
+void notes_cold_close(void) {
+  g_clear_pointer(&entries, g_hash_table_destroy);
+  g_clear_pointer(&cold_dir, g_free);
+}
+
+gboolean notes_cold_contains(const gchar *name) {
+  return entries && name && g_hash_table_contains(entries, name);
+}
+
+gint notes_cold_count(void) {
+  return entries ? (gint)g_hash_table_size(entries) : 0;
+}
+
+void notes_cold_foreach(MarkydColdFunc func, gpointer user_data) {
+  GHashTableIter iter;
+  gpointer value;
+
+  if (!entries) {
+    return;
+  }
+
+  g_hash_table_iter_init(&iter, entries);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    ColdEntry *entry = value;
+    func(entry->name, entry->mtime, user_data);
+  }
+}
+
+gchar *notes_cold_load(const gchar *name) {
+  ColdEntry *entry;
+  gchar *archive_path;
+  FILE *fp;
+  gchar *frame;
+  gchar *content;
+  size_t result;
+
+  if (!entries || !(entry = g_hash_table_lookup(entries, name))) {
+    return NULL;
+  }
+
+  archive_path = g_build_filename(cold_dir, entry->archive, NULL);
+  fp = g_fopen(archive_path, "rb");
+  if (!fp) {
+    g_printerr("Failed to open cold archive '%s': %s\n", archive_path,
+               g_strerror(errno));
+    g_free(archive_path);
+    return NULL;
+  }
+
+  /* Seek straight to the note's frame; nothing else is read. */
+  frame = g_malloc(entry->csize > 0 ? entry->csize : 1);
+  if (fseeko(fp, (off_t)entry->offset, SEEK_SET) != 0 ||
+      fread(frame, 1, entry->csize, fp) != entry->csize) {
+    g_printerr("Truncated cold archive '%s'\n", archive_path);
+    fclose(fp);
+    g_free(frame);
+    g_free(archive_path);
+    return NULL;
+  }
+  fclose(fp);
+
+  content = g_malloc(entry->size + 1);
+  result = ZSTD_decompress(content, entry->size, frame, entry->csize);
+  if (ZSTD_isError(result) || result != entry->size) {
+    g_printerr("Failed to decompress cold note '%s': %s\n", name,
+               ZSTD_isError(result) ? ZSTD_getErrorName(result)
+                                    : "size mismatch");
+    g_free(content);
+    content = NULL;
+  } else {
+    content[entry->size] = '\0';
+  }
+
+  g_free(frame);
+  g_free(archive_path);
+  return content;
+}
+
+gboolean notes_cold_remove(const gchar *name) {
+  if (!notes_cold_contains(name)) {
+    return FALSE;
+  }
+
+  g_hash_table_remove(entries, name);
+  if (!save_index()) {
+    return FALSE;
+  }
+  prune_archives();
+  return TRUE;
+}
+
+/* Compress old notes into archive, up to max_bytes of them; returns the new
+ * entries (not yet indexed) */
+static GPtrArray *collect_cold_notes(const gchar *notes_dir, gint64 cutoff,
+                                     const gchar *archive_name,
+                                     GByteArray *archive, gsize max_bytes,
+                                     gboolean *more) {
+  GPtrArray *frozen = g_ptr_array_new();
+  GDir *dir;
+  const gchar *filename;
+  gsize taken = 0;
+
+  dir = g_dir_open(notes_dir, 0, NULL);
+  if (!dir) {
+    return frozen;
+  }
+
+  while ((filename = g_dir_read_name(dir)) != NULL) {
+    gchar *path;
+    GStatBuf st;
+    gchar *content = NULL;
+    gsize length = 0;
+    size_t bound;
+    size_t csize;
+    guint offset;
+    ColdEntry *entry;
+
+    if (!g_str_has_suffix(filename, ".md") ||
+        g_hash_table_contains(entries, filename)) {
+      continue;
+    }
+
+    path = g_build_filename(notes_dir, filename, NULL);
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (gint64)st.st_mtime * G_USEC_PER_SEC >= cutoff) {
+      g_free(path);
+      continue;
+    }
+    if (max_bytes > 0 && taken >= max_bytes) {
+      *more = TRUE;
+      g_free(path);
+      break;
+    }
+    if (!g_file_get_contents(path, &content, &length, NULL)) {
+      g_free(path);
+      continue;
+    }
+    g_free(path);
+    taken += length;
+
+    /* One independent frame per note so loads can seek straight to it. */
+    offset = archive->len;
+    bound = ZSTD_compressBound(length);
+    g_byte_array_set_size(archive, offset + (guint)bound);
+    csize = ZSTD_compress(archive->data + offset, bound, content, length,
+                          COLD_ZSTD_LEVEL);
+    g_free(content);
+    if (ZSTD_isError(csize)) {
+      g_byte_array_set_size(archive, offset);
+      continue;
+    }
+    g_byte_array_set_size(archive, offset + (guint)csize);
+
+    entry = g_new0(ColdEntry, 1);
+    entry->name = g_strdup(filename);
+    entry->mtime = (gint64)st.st_mtime * G_USEC_PER_SEC;
+    entry->size = length;
+    entry->archive = g_strdup(archive_name);
+    entry->offset = offset;
+    entry->csize = csize;
+    g_ptr_array_add(frozen, entry);
+  }
+
+  g_dir_close(dir);
+  return frozen;
+}
+
+/* Delete the plain copies of notes that went into archive_name, unless they
+ * were edited in the meantime (those stay hot). Returns -1 if a copy could
+ * not be deleted; its note stays hot too. */
+static gint remove_plain_copies(const gchar *notes_dir,
+                                const gchar *archive_name) {
+  GHashTableIter iter;
+  gpointer value;
+  gboolean dropped = FALSE;
+  gboolean failed = FALSE;
+  gint count = 0;
+
+  g_hash_table_iter_init(&iter, entries);
+  while (g_hash_table_iter_next(&iter, NULL, &value)) {
+    ColdEntry *entry = value;
+    gchar *path;
+    GStatBuf st;
+
+    if (g_strcmp0(entry->archive, archive_name) != 0) {
+      continue;
+    }
+
+    path = g_build_filename(notes_dir, entry->name, NULL);
+    if (g_stat(path, &st) != 0 ||
+        (gint64)st.st_mtime * G_USEC_PER_SEC != entry->mtime) {
+      g_hash_table_iter_remove(&iter);
+      dropped = TRUE;
+    } else if (g_remove(path) == 0) {
+      count++;
+    } else {
+      g_printerr("Failed to move '%s' to the cold tier: %s\n", path,
+                 g_strerror(errno));
+      g_hash_table_iter_remove(&iter);
+      dropped = TRUE;
+      failed = TRUE;
+    }
+    g_free(path);
+  }
+
+  if (dropped && save_index()) {
+    prune_archives();
+  }
+
+  return failed ? -1 : count;
+}
+
+/*
+ * Order matters for crash safety: archive first, then the index, then the
+ * plain files. An interruption leaves at worst a note in both tiers, and the
+ * plain file wins when listing and loading.
+ */
+static gint commit_archive(const gchar *notes_dir, const gchar *archive_name,
+                           GByteArray *archive, GPtrArray *frozen) {
+  gchar *archive_path;
+  GError *error = NULL;
+
+  if (g_mkdir_with_parents(cold_dir, 0755) != 0) {
+    g_printerr("Failed to create cold directory: %s\n", g_strerror(errno));
+    return -1;
+  }
+
+  archive_path = g_build_filename(cold_dir, archive_name, NULL);
+  if (!g_file_set_contents(archive_path, (const gchar *)archive->data,
+                           (gssize)archive->len, &error)) {
+    g_printerr("Failed to write cold archive: %s\n", error->message);
+    g_error_free(error);
+    g_free(archive_path);
+    return -1;
+  }
+  g_free(archive_path);
+
+  /* Ownership moves to the index */
+  for (guint i = 0; i < frozen->len; i++) {
+    ColdEntry *entry = g_ptr_array_index(frozen, i);
+    g_hash_table_replace(entries, entry->name, entry);
+  }
+  g_ptr_array_set_size(frozen, 0);
+
+  if (!save_index()) {
+    return -1;
+  }
+
+  return remove_plain_copies(notes_dir, archive_name);
+}
+
+gint notes_cold_freeze(const gchar *notes_dir, gint days, gsize max_bytes,
+                       gboolean *more) {
+  gint64 cutoff;
+  GByteArray *archive;
+  GPtrArray *frozen;
+  gchar *archive_name;
+  gint count = 0;
+
+  *more = FALSE;
+  if (!entries || days <= 0) {
+    return 0;
+  }
+
+  cutoff = g_get_real_time() - (gint64)days * 24 * 3600 * G_USEC_PER_SEC;
+  archive = g_byte_array_new();
+  archive_name =
+      g_strdup_printf("archive-%" G_GINT64_FORMAT ".zst", g_get_real_time());
+
+  frozen = collect_cold_notes(notes_dir, cutoff, archive_name, archive,
+                              max_bytes, more);
+  if (frozen->len > 0) {
+    count = commit_archive(notes_dir, archive_name, archive, frozen);
+  }
+  /* Nothing left the notes dir: another pass would collect the same notes */
+  if (count <= 0) {
+    *more = FALSE;
+  }
+
+  for (guint i = 0; i < frozen->len; i++) {
+    cold_entry_free(g_ptr_array_index(frozen, i));
+  }
+  g_ptr_array_free(frozen, TRUE);
+  g_byte_array_free(archive, TRUE);
+  g_free(archive_name);
+  return count;
+}
@@ -0,0 +1,41 @@
+#ifndef MARKYD_NOTES_COLD_H
+#define MARKYD_NOTES_COLD_H
+
+#include <glib.h>
+
+/*
+ * Cold tier for the plain-file backend. Notes untouched for a while are moved
+ * out of the notes directory into zstd archives (one independent frame per
+ * note) under the cold directory. A metadata index (name, mtime, size and the
+ * frame's archive/offset) keeps them listed without touching the archives;
+ * content is decompressed only when a note is loaded.
+ */
+
+typedef void (*MarkydColdFunc)(const gchar *name, gint64 mtime,
+                               gpointer user_data);
+
+/* Load the index from cold_dir (the directory is created on first freeze) */
+gboolean notes_cold_open(const gchar *cold_dir);
+void notes_cold_close(void);
+
+/* Is a note with this file name stored in the cold tier? */
+gboolean notes_cold_contains(const gchar *name);
+gint notes_cold_count(void);
+
+/* Call func for every cold note (mtime in microseconds), in no order */
+void notes_cold_foreach(MarkydColdFunc func, gpointer user_data);
+
+/* Decompress a cold note (caller must free) */
+gchar *notes_cold_load(const gchar *name);
+
+/* Drop a note from the cold tier (after it was thawed or deleted) */
+gboolean notes_cold_remove(const gchar *name);
+
+/* Move .md files in notes_dir older than days into a new archive, stopping
+ * once about max_bytes of notes went in (0 for no limit); more is set when
+ * some were left for the next call. Returns the number of notes frozen, or
+ * -1 on error, e.g. a plain copy could not be deleted. */
+gint notes_cold_freeze(const gchar *notes_dir, gint days, gsize max_bytes,
+                       gboolean *more);
+
+#endif /* MARKYD_NOTES_COLD_H */
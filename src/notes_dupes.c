@@ -0,0 +1,572 @@
+#include "notes_dupes.h"
+#include "notes.h"
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+/*
+ * Cache file: magic, then one record per note:
+ *   u32 path_len, path, i64 mtime, i64 size, u32 min[DUPES_HASHES]
+ * Integers are little-endian. A torn tail is dropped on load.
+ */
+
+#define DUPES_MAGIC "TMDMINH1"
+#define DUPES_MAGIC_LEN 8
+#define DUPES_HASHES 64
+#define DUPES_ROWS 4 /* Hashes per LSH band */
+#define DUPES_BANDS (DUPES_HASHES / DUPES_ROWS)
+#define DUPES_SHINGLE 3 /* Words per shingle */
+#define DUPES_MIN_SIMILARITY 0.7
+#define DUPES_RECORD_FIXED (4 + 8 + 8 + 4 * DUPES_HASHES)
+/* Stale notes loaded per notes_dupes_refresh call of the background
+ * refresh */
+#define DUPES_REFRESH_BATCH 64
+/* Earlier bucket members a note is confirmed against, newest first; keeps a
+ * bucket of near-identical notes from costing k^2 comparisons */
+#define DUPES_BUCKET_CHECKS 16
+
+typedef struct _DupeSig {
+  gint64 mtime; /* Seconds; 0 when the note isn't a plain file */
+  gint64 size;
+  guint32 min[DUPES_HASHES]; /* All G_MAXUINT32 for a note without words */
+} DupeSig;
+
+typedef struct _DupesUpdate {
+  gchar *path;
+  gchar *content;
+} DupesUpdate;
+
+static gchar *cache_file = NULL;
+static GHashTable *sigs = NULL; /* path -> DupeSig */
+static gboolean cache_dirty = FALSE;
+
+/* Signatures are hashed off the main thread: saved notes on update_pool (one
+ * thread, so a note's saves are applied in order), stale ones by the
+ * background refresh. dupes_lock guards sigs, cache_dirty,
+ * pending_updates and refreshes. */
+static GMutex dupes_lock;
+static GCond updates_done;
+static guint pending_updates = 0;
+static GCond refreshes_done;
+static guint refreshes = 0; /* Refresh tasks still running */
+static GThreadPool *update_pool = NULL;
+
+/* Multiply-shift hash family, one (seed, odd multiplier) pair per slot */
+static guint64 hash_seed[DUPES_HASHES];
+static guint64 hash_mul[DUPES_HASHES];
+
+static guint64 mix64(guint64 x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static void put_u32(GByteArray *out, guint32 v) {
+  guint8 b[4];
+  for (gint i = 0; i < 4; i++) {
+    b[i] = (guint8)(v >> (8 * i));
+  }
+  g_byte_array_append(out, b, 4);
+}
+
+static void put_i64(GByteArray *out, gint64 v) {
+  guint64 u = (guint64)v;
+  guint8 b[8];
+  for (gint i = 0; i < 8; i++) {
+    b[i] = (guint8)(u >> (8 * i));
+  }
+  g_byte_array_append(out, b, 8);
+}
+
+static guint32 get_u32(const gchar *p) {
+  const guint8 *b = (const guint8 *)p;
+  return (guint32)b[0] | ((guint32)b[1] << 8) | ((guint32)b[2] << 16) |
+         ((guint32)b[3] << 24);
+}
+
+static gint64 get_i64(const gchar *p) {
+  const guint8 *b = (const guint8 *)p;
+  guint64 u = 0;
+  for (gint i = 7; i >= 0; i--) {
+    u = (u << 8) | b[i];
+  }
+  return (gint64)u;
+}
+
+static gboolean is_word_byte(guchar c) {
+  /* Any non-ASCII byte counts, so UTF-8 words stay whole */
+  return g_ascii_isalnum(c) || c >= 0x80;
+}
+
+static void add_shingle(const guint64 *words, guint n_words, guint32 *min) {
+  guint64 h = 0;
+
+  for (guint i = 0; i < n_words; i++) {
+    h = mix64(h ^ words[i]);
+  }
+
+  for (guint i = 0; i < DUPES_HASHES; i++) {
+    guint32 v = (guint32)(((h ^ hash_seed[i]) * hash_mul[i]) >> 32);
+    if (v < min[i]) {
+      min[i] = v;
+    }
+  }
+}
+
+static void compute_signature(const gchar *content, guint32 *min) {
+  const guchar *p = (const guchar *)content;
+  guint64 words[DUPES_SHINGLE] = {0};
+  guint n_words = 0;
+
+  for (guint i = 0; i < DUPES_HASHES; i++) {
+    min[i] = G_MAXUINT32;
+  }
+
+  while (*p) {
+    guint64 h = 14695981039346656037ULL; /* FNV-1a */
+
+    while (*p && !is_word_byte(*p)) {
+      p++;
+    }
+    if (!*p) {
+      break;
+    }
+    while (*p && is_word_byte(*p)) {
+      h = (h ^ (guint64)g_ascii_tolower(*p)) * 1099511628211ULL;
+      p++;
+    }
+
+    memmove(words, words + 1, sizeof(words[0]) * (DUPES_SHINGLE - 1));
+    words[DUPES_SHINGLE - 1] = h;
+    n_words++;
+    if (n_words >= DUPES_SHINGLE) {
+      add_shingle(words, DUPES_SHINGLE, min);
+    }
+  }
+
+  /* Very short notes: the whole text is the only shingle */
+  if (n_words > 0 && n_words < DUPES_SHINGLE) {
+    add_shingle(words + DUPES_SHINGLE - n_words, n_words, min);
+  }
+}
+
+static void stat_note(const gchar *path, gint64 *mtime, gint64 *size) {
+  GStatBuf st;
+
+  if (g_stat(path, &st) != 0) {
+    *mtime = 0;
+    *size = 0;
+    return;
+  }
+  *mtime = (gint64)st.st_mtime;
+  *size = (gint64)st.st_size;
+}
+
+/* Hash content unlocked, then store it (unless the cache went away) */
+static void store_signature(const gchar *path, gint64 mtime, gint64 size,
+                            const gchar *content) {
+  guint32 min[DUPES_HASHES];
+  DupeSig *sig;
+
+  compute_signature(content, min);
+
+  g_mutex_lock(&dupes_lock);
+  if (sigs) {
+    sig = g_hash_table_lookup(sigs, path);
+    if (!sig) {
+      sig = g_new0(DupeSig, 1);
+      g_hash_table_insert(sigs, g_strdup(path), sig);
+    }
+    sig->mtime = mtime;
+    sig->size = size;
+    memcpy(sig->min, min, sizeof(min));
+    cache_dirty = TRUE;
+  }
+  g_mutex_unlock(&dupes_lock);
+}
+
+/* Until saved notes queued so far are hashed (dupes_lock held) */
+static void wait_for_updates(void) {
+  while (pending_updates > 0) {
+    g_cond_wait(&updates_done, &dupes_lock);
+  }
+}
+
+static void update_worker(gpointer data, gpointer user_data) {
+  DupesUpdate *update = data;
+  gint64 mtime;
+  gint64 size;
+
+  (void)user_data;
+
+  stat_note(update->path, &mtime, &size);
+  store_signature(update->path, mtime, size, update->content);
+  g_free(update->path);
+  g_free(update->content);
+  g_free(update);
+
+  g_mutex_lock(&dupes_lock);
+  pending_updates--;
+  g_cond_broadcast(&updates_done);
+  g_mutex_unlock(&dupes_lock);
+}
+
+static void load_cache(void) {
+  gchar *data = NULL;
+  gsize length = 0;
+  gsize pos = DUPES_MAGIC_LEN;
+
+  if (!g_file_get_contents(cache_file, &data, &length, NULL)) {
+    return;
+  }
+
+  if (length < DUPES_MAGIC_LEN ||
+      memcmp(data, DUPES_MAGIC, DUPES_MAGIC_LEN) != 0) {
+    g_printerr("Ignoring unrecognized duplicate cache '%s'\n", cache_file);
+    g_free(data);
+    cache_dirty = TRUE;
+    return;
+  }
+
+  while (length - pos >= 4) {
+    guint32 path_len = get_u32(data + pos);
+    const gchar *p;
+    DupeSig *sig;
+
+    if (length - pos < (gsize)DUPES_RECORD_FIXED + path_len) {
+      cache_dirty = TRUE; /* Torn tail */
+      break;
+    }
+
+    p = data + pos + 4 + path_len;
+    sig = g_new0(DupeSig, 1);
+    sig->mtime = get_i64(p);
+    sig->size = get_i64(p + 8);
+    for (guint i = 0; i < DUPES_HASHES; i++) {
+      sig->min[i] = get_u32(p + 16 + 4 * i);
+    }
+    g_hash_table_insert(sigs, g_strndup(data + pos + 4, path_len), sig);
+    pos += DUPES_RECORD_FIXED + path_len;
+  }
+
+  g_free(data);
+}
+
+/* dupes_lock held */
+static void save_cache(void) {
+  GByteArray *out = g_byte_array_new();
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GError *error = NULL;
+
+  g_byte_array_append(out, (const guint8 *)DUPES_MAGIC, DUPES_MAGIC_LEN);
+  g_hash_table_iter_init(&iter, sigs);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    const gchar *path = key;
+    const DupeSig *sig = value;
+    guint32 path_len = (guint32)strlen(path);
+
+    put_u32(out, path_len);
+    g_byte_array_append(out, (const guint8 *)path, path_len);
+    put_i64(out, sig->mtime);
+    put_i64(out, sig->size);
+    for (guint i = 0; i < DUPES_HASHES; i++) {
+      put_u32(out, sig->min[i]);
+    }
+  }
+
+  if (!g_file_set_contents(cache_file, (const gchar *)out->data,
+                           (gssize)out->len, &error)) {
+    g_printerr("Failed to save duplicate cache: %s\n", error->message);
+    g_error_free(error);
+  } else {
+    cache_dirty = FALSE;
+  }
+
+  g_byte_array_free(out, TRUE);
+}
+
+void notes_dupes_init(const gchar *cache_path) {
+  guint64 state = 0x7472617964757065ULL;
+
+  notes_dupes_cleanup();
+
+  for (guint i = 0; i < DUPES_HASHES; i++) {
+    state += 0x9e3779b97f4a7c15ULL;
+    hash_seed[i] = mix64(state);
+    state += 0x9e3779b97f4a7c15ULL;
+    hash_mul[i] = mix64(state) | 1;
+  }
+
+  g_mutex_lock(&dupes_lock);
+  cache_file = g_strdup(cache_path);
+  sigs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  cache_dirty = FALSE;
+  load_cache();
+  g_mutex_unlock(&dupes_lock);
+
+  update_pool = g_thread_pool_new(update_worker, NULL, 1, FALSE, NULL);
+}
+
+void notes_dupes_cleanup(void) {
+  /* A refresh loads notes; the caller cancelled it, wait until it stops */
+  g_mutex_lock(&dupes_lock);
+  while (refreshes > 0) {
+    g_cond_wait(&refreshes_done, &dupes_lock);
+  }
+  g_mutex_unlock(&dupes_lock);
+
+  /* Let queued saves land in the cache before it is written */
+  if (update_pool) {
+    g_thread_pool_free(update_pool, FALSE, TRUE);
+    update_pool = NULL;
+  }
+
+  g_mutex_lock(&dupes_lock);
+  if (sigs && cache_dirty) {
+    save_cache();
+  }
+  g_clear_pointer(&sigs, g_hash_table_destroy);
+  g_clear_pointer(&cache_file, g_free);
+  g_mutex_unlock(&dupes_lock);
+}
+
+void notes_dupes_update(const gchar *path, const gchar *content) {
+  DupesUpdate *update;
+
+  if (!sigs || !update_pool || !path || !content) {
+    return;
+  }
+
+  update = g_new(DupesUpdate, 1);
+  update->path = g_strdup(path);
+  update->content = g_strdup(content);
+
+  g_mutex_lock(&dupes_lock);
+  pending_updates++;
+  g_mutex_unlock(&dupes_lock);
+  g_thread_pool_push(update_pool, update, NULL);
+}
+
+void notes_dupes_forget(const gchar *path) {
+  g_mutex_lock(&dupes_lock);
+  /* A save still queued would bring the note back */
+  wait_for_updates();
+  if (sigs && path && g_hash_table_remove(sigs, path)) {
+    cache_dirty = TRUE;
+  }
+  g_mutex_unlock(&dupes_lock);
+}
+
+gboolean notes_dupes_refresh(GPtrArray *paths, guint *cursor, guint budget,
+                             GCancellable *cancellable) {
+  guint loaded = 0;
+
+  g_mutex_lock(&dupes_lock);
+  if (!sigs) {
+    g_mutex_unlock(&dupes_lock);
+    *cursor = paths->len;
+    return TRUE;
+  }
+  wait_for_updates();
+  g_mutex_unlock(&dupes_lock);
+
+  while (*cursor < paths->len && loaded < budget &&
+         !g_cancellable_is_cancelled(cancellable)) {
+    const gchar *path = g_ptr_array_index(paths, *cursor);
+    DupeSig *sig;
+    gboolean fresh;
+    gint64 mtime;
+    gint64 size;
+    gchar *content;
+
+    (*cursor)++;
+
+    stat_note(path, &mtime, &size);
+    g_mutex_lock(&dupes_lock);
+    sig = sigs ? g_hash_table_lookup(sigs, path) : NULL;
+    fresh = !sigs || (sig && sig->mtime == mtime && sig->size == size);
+    g_mutex_unlock(&dupes_lock);
+    if (fresh) {
+      continue;
+    }
+
+    content = notes_load(path);
+    loaded++;
+    if (content) {
+      store_signature(path, mtime, size, content);
+      g_free(content);
+    }
+  }
+
+  if (*cursor >= paths->len) {
+    g_mutex_lock(&dupes_lock);
+    if (sigs && cache_dirty) {
+      save_cache();
+    }
+    g_mutex_unlock(&dupes_lock);
+  }
+  return *cursor >= paths->len;
+}
+
+static void refresh_thread(GTask *task, gpointer source, gpointer task_data,
+                           GCancellable *cancellable) {
+  guint cursor = 0;
+
+  (void)source;
+
+  while (!g_cancellable_is_cancelled(cancellable)) {
+    if (notes_dupes_refresh(task_data, &cursor, DUPES_REFRESH_BATCH,
+                            cancellable)) {
+      break;
+    }
+  }
+  g_task_return_boolean(task, TRUE);
+
+  g_mutex_lock(&dupes_lock);
+  if (--refreshes == 0) {
+    g_cond_broadcast(&refreshes_done);
+  }
+  g_mutex_unlock(&dupes_lock);
+}
+
+void notes_dupes_refresh_async(GPtrArray *paths, GCancellable *cancellable) {
+  GTask *task = g_task_new(NULL, cancellable, NULL, NULL);
+  GPtrArray *copy = g_ptr_array_new_with_free_func(g_free);
+
+  for (guint i = 0; i < paths->len; i++) {
+    g_ptr_array_add(copy, g_strdup(g_ptr_array_index(paths, i)));
+  }
+
+  g_task_set_source_tag(task, notes_dupes_refresh_async);
+  g_task_set_task_data(task, copy, (GDestroyNotify)g_ptr_array_unref);
+  g_mutex_lock(&dupes_lock);
+  refreshes++;
+  g_mutex_unlock(&dupes_lock);
+  g_task_run_in_thread(task, refresh_thread);
+  g_object_unref(task);
+}
+
+static guint uf_find(guint *parent, guint i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+static gdouble similarity(const DupeSig *a, const DupeSig *b) {
+  guint same = 0;
+
+  for (guint i = 0; i < DUPES_HASHES; i++) {
+    same += a->min[i] == b->min[i];
+  }
+  return (gdouble)same / DUPES_HASHES;
+}
+
+static gint compare_cluster_size(gconstpointer a, gconstpointer b) {
+  const GPtrArray *ca = *(const GPtrArray *const *)a;
+  const GPtrArray *cb = *(const GPtrArray *const *)b;
+  return (gint)cb->len - (gint)ca->len;
+}
+
+GPtrArray *notes_dupes_clusters(GPtrArray *paths) {
+  GPtrArray *result =
+      g_ptr_array_new_with_free_func((GDestroyNotify)g_ptr_array_unref);
+  guint n = paths->len;
+  const DupeSig **table = g_new0(const DupeSig *, n);
+  guint *parent = g_new(guint, n);
+  guint *size = g_new0(guint, n);
+  guint64 *keys = g_new(guint64, n);
+  GPtrArray **groups = g_new0(GPtrArray *, n);
+
+  g_mutex_lock(&dupes_lock);
+  wait_for_updates();
+  for (guint i = 0; i < n; i++) {
+    const DupeSig *sig =
+        sigs ? g_hash_table_lookup(sigs, g_ptr_array_index(paths, i)) : NULL;
+    table[i] = sig && sig->min[0] != G_MAXUINT32 ? sig : NULL;
+    parent[i] = i;
+  }
+
+  /* Notes sharing any band are candidates; each is confirmed against
+   * earlier members of the bucket in other groups, since similarity isn't
+   * transitive, up to DUPES_BUCKET_CHECKS of them */
+  for (guint band = 0; band < DUPES_BANDS; band++) {
+    GHashTable *buckets = g_hash_table_new_full(
+        g_int64_hash, g_int64_equal, NULL, (GDestroyNotify)g_array_unref);
+
+    for (guint i = 0; i < n; i++) {
+      GArray *members;
+      guint64 key = band;
+
+      if (!table[i]) {
+        continue;
+      }
+      for (guint r = 0; r < DUPES_ROWS; r++) {
+        key = mix64(key ^ table[i]->min[band * DUPES_ROWS + r]);
+      }
+      keys[i] = key;
+
+      members = g_hash_table_lookup(buckets, &keys[i]);
+      if (!members) {
+        members = g_array_new(FALSE, FALSE, sizeof(guint));
+        g_hash_table_insert(buckets, &keys[i], members);
+      }
+
+      for (guint m = members->len, checks = 0;
+           m > 0 && checks < DUPES_BUCKET_CHECKS; m--) {
+        guint j = g_array_index(members, guint, m - 1);
+
+        if (uf_find(parent, i) == uf_find(parent, j)) {
+          continue;
+        }
+        checks++;
+        if (similarity(table[i], table[j]) >= DUPES_MIN_SIMILARITY) {
+          parent[uf_find(parent, i)] = uf_find(parent, j);
+        }
+      }
+      g_array_append_val(members, i);
+    }
+
+    g_hash_table_destroy(buckets);
+  }
+  g_mutex_unlock(&dupes_lock);
+
+  for (guint i = 0; i < n; i++) {
+    if (table[i]) {
+      size[uf_find(parent, i)]++;
+    }
+  }
+
+  for (guint i = 0; i < n; i++) {
+    guint root;
+
+    if (!table[i]) {
+      continue;
+    }
+    root = uf_find(parent, i);
+    if (size[root] < 2) {
+      continue;
+    }
+    if (!groups[root]) {
+      groups[root] = g_ptr_array_new_with_free_func(g_free);
+      g_ptr_array_add(result, groups[root]);
+    }
+    g_ptr_array_add(groups[root], g_strdup(g_ptr_array_index(paths, i)));
+  }
+
+  /* Stable, so equal-sized groups keep the order of their newest note */
+  g_ptr_array_sort(result, compare_cluster_size);
+
+  g_free(groups);
+  g_free(keys);
+  g_free(size);
+  g_free(parent);
+  g_free(table);
+  return result;
+}
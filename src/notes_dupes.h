@@ -0,0 +1,40 @@
+#ifndef MARKYD_NOTES_DUPES_H
+#define MARKYD_NOTES_DUPES_H
+
+#include <gio/gio.h>
+
+/*
+ * Near-duplicate detection. Each note gets a MinHash signature over its
+ * three-word shingles; signatures are cached on disk keyed by path, mtime
+ * and size, and are refreshed as notes are saved. Hashing runs on worker
+ * threads. Candidates are found by LSH banding and confirmed by the
+ * estimated Jaccard similarity.
+ */
+
+/* Load the signature cache from cache_path (missing is fine) */
+void notes_dupes_init(const gchar *cache_path);
+
+/* Write the cache back if it changed and release it */
+void notes_dupes_cleanup(void);
+
+/* Recompute the signature of a note that was just saved, on a worker
+ * (content is copied) */
+void notes_dupes_update(const gchar *path, const gchar *content);
+
+/* Drop the signature of a deleted note */
+void notes_dupes_forget(const gchar *path);
+
+/* Bring signatures of paths up to date, starting at *cursor and loading at
+ * most budget stale notes; stops before the next load once cancellable is
+ * cancelled. Returns TRUE once *cursor reached the end. */
+gboolean notes_dupes_refresh(GPtrArray *paths, guint *cursor, guint budget,
+                             GCancellable *cancellable);
+
+/* Bring signatures of paths (copied) up to date on a worker thread */
+void notes_dupes_refresh_async(GPtrArray *paths, GCancellable *cancellable);
+
+/* Groups of likely duplicates among paths (array of path arrays, largest
+ * group first, members in input order). Only cached signatures are used. */
+GPtrArray *notes_dupes_clusters(GPtrArray *paths);
+
+#endif /* MARKYD_NOTES_DUPES_H */
@@ -0,0 +1,162 @@
+#include "notes_folds.h"
+#include "notes.h"
+#include <string.h>
+
+#define FOLDS_GROUP "Folds"
+
+static GKeyFile *folds_file = NULL;
+static gchar *folds_path = NULL;
+
+/* Read on first use */
+static GKeyFile *folds_get(void) {
+  gchar *parent;
+  GError *error = NULL;
+
+  if (folds_file) {
+    return folds_file;
+  }
+
+  parent = g_path_get_dirname(notes_get_dir());
+  folds_path = g_build_filename(parent, "folds.ini", NULL);
+  folds_file = g_key_file_new();
+  if (!g_key_file_load_from_file(folds_file, folds_path, G_KEY_FILE_NONE,
+                                 &error)) {
+    if (!g_error_matches(error, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+      g_printerr("Failed to read fold state: %s\n", error->message);
+    }
+    g_error_free(error);
+  }
+
+  g_free(parent);
+  return folds_file;
+}
+
+/* The note's path below the notes dir, escaped so any name is a valid key.
+ * That is the path the app knows the note by; moving it to the cold tier or
+ * into chunks doesn't change it, so neither needs a new key. */
+static gchar *folds_key(const gchar *path) {
+  const gchar *notes_dir = notes_get_dir();
+  gsize root_len = strlen(notes_dir);
+  const gchar *relative = path;
+
+  if (strncmp(path, notes_dir, root_len) == 0 &&
+      path[root_len] == G_DIR_SEPARATOR) {
+    relative = path + root_len + 1;
+  }
+  return g_uri_escape_string(relative, NULL, FALSE);
+}
+
+GArray *notes_folds_load(const gchar *path) {
+  GArray *lines = g_array_new(FALSE, FALSE, sizeof(gint));
+  gchar *key;
+  gint *values;
+  gsize n_values = 0;
+
+  if (!path || !notes_get_dir()) {
+    return lines;
+  }
+
+  key = folds_key(path);
+  values = g_key_file_get_integer_list(folds_get(), FOLDS_GROUP, key,
+                                       &n_values, NULL);
+  if (values) {
+    g_array_append_vals(lines, values, (guint)n_values);
+  }
+
+  g_free(values);
+  g_free(key);
+  return lines;
+}
+
+void notes_folds_save(const gchar *path, GArray *lines) {
+  GKeyFile *file;
+  gchar *key;
+  gint *old;
+  gsize n_old = 0;
+  gboolean changed = FALSE;
+  GError *error = NULL;
+
+  if (!path || !notes_get_dir()) {
+    return;
+  }
+
+  file = folds_get();
+  key = folds_key(path);
+  old = g_key_file_get_integer_list(file, FOLDS_GROUP, key, &n_old, NULL);
+
+  /* Called on every note save: usually nothing to write */
+  if (lines && lines->len > 0) {
+    if (!old || n_old != lines->len ||
+        memcmp(old, lines->data, n_old * sizeof(gint)) != 0) {
+      g_key_file_set_integer_list(file, FOLDS_GROUP, key, (gint *)lines->data,
+                                  lines->len);
+      changed = TRUE;
+    }
+  } else if (old) {
+    g_key_file_remove_key(file, FOLDS_GROUP, key, NULL);
+    changed = TRUE;
+  }
+
+  if (changed && !g_key_file_save_to_file(file, folds_path, &error)) {
+    g_printerr("Failed to save fold state: %s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(old);
+  g_free(key);
+}
+
+void notes_folds_prune(const gchar *notebook, GPtrArray *paths) {
+  GKeyFile *file;
+  GHashTable *listed;
+  gchar **keys;
+  gboolean changed = FALSE;
+  GError *error = NULL;
+
+  if (!notebook || !notes_get_dir()) {
+    return;
+  }
+
+  file = folds_get();
+  keys = g_key_file_get_keys(file, FOLDS_GROUP, NULL, NULL);
+  if (!keys) {
+    return;
+  }
+
+  listed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (guint i = 0; i < paths->len; i++) {
+    g_hash_table_add(listed, folds_key(g_ptr_array_index(paths, i)));
+  }
+
+  for (guint i = 0; keys[i]; i++) {
+    gchar *relative = g_uri_unescape_string(keys[i], NULL);
+    gchar *dir = relative ? g_path_get_dirname(relative) : NULL;
+    gboolean in_notebook =
+        dir && (strcmp(dir, ".") == 0 ? *notebook == '\0'
+                                      : strcmp(dir, notebook) == 0);
+
+    /* Deleted or moved away from outside the app */
+    if (in_notebook && !g_hash_table_contains(listed, keys[i])) {
+      g_key_file_remove_key(file, FOLDS_GROUP, keys[i], NULL);
+      changed = TRUE;
+    }
+    g_free(dir);
+    g_free(relative);
+  }
+
+  if (changed && !g_key_file_save_to_file(file, folds_path, &error)) {
+    g_printerr("Failed to save fold state: %s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_hash_table_destroy(listed);
+  g_strfreev(keys);
+}
+
+void notes_folds_cleanup(void) {
+  if (folds_file) {
+    g_key_file_free(folds_file);
+    folds_file = NULL;
+  }
+  g_clear_pointer(&folds_path, g_free);
+}
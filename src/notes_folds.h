@@ -0,0 +1,22 @@
+#ifndef MARKYD_NOTES_FOLDS_H
+#define MARKYD_NOTES_FOLDS_H
+
+#include <glib.h>
+
+/*
+ * Which headings and code blocks of each note are folded, by line number,
+ * kept in folds.ini next to the notes dir. Main thread only.
+ */
+
+/* Folded lines of the note at path, ascending (never NULL) */
+GArray *notes_folds_load(const gchar *path);
+
+/* Replace them; NULL or empty forgets the note. Writes only on change. */
+void notes_folds_save(const gchar *path, GArray *lines);
+
+/* Forget notes of notebook that are not among paths, its full listing */
+void notes_folds_prune(const gchar *notebook, GPtrArray *paths);
+
+void notes_folds_cleanup(void);
+
+#endif /* MARKYD_NOTES_FOLDS_H */
@@ -0,0 +1,357 @@
+#define _GNU_SOURCE /* memmem */
+#include "notes_grep.h"
+#include "notes.h"
+#include "notes_chunked.h"
+#include <string.h>
+
+#define GREP_LINE_MAX 200
+
+/* A worker's share of the input: indices [next, end) */
+typedef struct _GrepRange {
+  GMutex lock;
+  guint next;
+  guint end;
+} GrepRange;
+
+typedef struct _GrepHit {
+  guint index;
+  gchar *line;
+} GrepHit;
+
+struct _MarkydGrep {
+  gint ref_count; /* Atomic: caller + each worker + pending idle */
+  gint cancelled; /* Atomic */
+  gint running;   /* Atomic: workers not yet finished */
+
+  GPtrArray *paths;
+  GRegex *regex; /* NULL for a plain case-sensitive search */
+  gchar *needle;
+  gsize needle_len;
+
+  guint n_workers;
+  GrepRange *ranges;
+
+  GMutex lock; /* Guards everything below */
+  GArray *pending; /* GrepHit, waiting for the main loop */
+  guint idle_id;
+  gboolean finished;
+  guint matches;
+
+  MarkydGrepMatchFunc match_func;
+  MarkydGrepDoneFunc done_func;
+  gpointer user_data;
+};
+
+typedef struct _GrepWorker {
+  MarkydGrep *grep;
+  guint id;
+} GrepWorker;
+
+/* One thread per core, shared by every search: a query per keystroke only
+ * queues work, and a cancelled search's workers return at the next file */
+static GThreadPool *pool = NULL;
+
+static MarkydGrep *grep_ref(MarkydGrep *grep) {
+  g_atomic_int_inc(&grep->ref_count);
+  return grep;
+}
+
+static void grep_unref(gpointer data) {
+  MarkydGrep *grep = data;
+
+  if (!g_atomic_int_dec_and_test(&grep->ref_count)) {
+    return;
+  }
+
+  for (guint i = 0; i < grep->pending->len; i++) {
+    g_free(g_array_index(grep->pending, GrepHit, i).line);
+  }
+  g_array_free(grep->pending, TRUE);
+  for (guint i = 0; i < grep->n_workers; i++) {
+    g_mutex_clear(&grep->ranges[i].lock);
+  }
+  g_free(grep->ranges);
+  g_ptr_array_free(grep->paths, TRUE);
+  if (grep->regex) {
+    g_regex_unref(grep->regex);
+  }
+  g_free(grep->needle);
+  g_mutex_clear(&grep->lock);
+  g_free(grep);
+}
+
+static gboolean flush_hits(gpointer data) {
+  MarkydGrep *grep = data;
+  GArray *hits;
+  gboolean finished;
+  guint matches;
+
+  g_mutex_lock(&grep->lock);
+  hits = grep->pending;
+  grep->pending = g_array_new(FALSE, FALSE, sizeof(GrepHit));
+  grep->idle_id = 0;
+  finished = grep->finished;
+  matches = grep->matches;
+  g_mutex_unlock(&grep->lock);
+
+  for (guint i = 0; i < hits->len; i++) {
+    GrepHit *hit = &g_array_index(hits, GrepHit, i);
+    if (!g_atomic_int_get(&grep->cancelled) && grep->match_func) {
+      grep->match_func(hit->index, g_ptr_array_index(grep->paths, hit->index),
+                       hit->line, grep->user_data);
+    }
+    g_free(hit->line);
+  }
+  g_array_free(hits, TRUE);
+
+  if (finished && !g_atomic_int_get(&grep->cancelled) && grep->done_func) {
+    grep->done_func(matches, grep->user_data);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Wake the main loop unless a flush is already queued (lock held). */
+static void schedule_flush_locked(MarkydGrep *grep) {
+  if (grep->idle_id == 0) {
+    grep->idle_id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, flush_hits,
+                                    grep_ref(grep), grep_unref);
+  }
+}
+
+/* Next index for worker id: its own range first, then steal the upper half
+ * of the fullest other range. */
+static gboolean take_index(MarkydGrep *grep, guint id, guint *index) {
+  GrepRange *own = &grep->ranges[id];
+  guint victim = id;
+  guint most = 0;
+
+  g_mutex_lock(&own->lock);
+  if (own->next < own->end) {
+    *index = own->next++;
+    g_mutex_unlock(&own->lock);
+    return TRUE;
+  }
+  g_mutex_unlock(&own->lock);
+
+  /* Unlocked peek to pick a victim; re-checked under its lock below */
+  for (guint i = 0; i < grep->n_workers; i++) {
+    GrepRange *range = &grep->ranges[i];
+    guint left;
+
+    if (i == id) {
+      continue;
+    }
+    g_mutex_lock(&range->lock);
+    left = range->end > range->next ? range->end - range->next : 0;
+    g_mutex_unlock(&range->lock);
+    if (left > most) {
+      most = left;
+      victim = i;
+    }
+  }
+
+  if (victim == id) {
+    return FALSE;
+  }
+
+  {
+    GrepRange *range = &grep->ranges[victim];
+    guint start;
+    guint end;
+
+    g_mutex_lock(&range->lock);
+    if (range->next >= range->end) {
+      g_mutex_unlock(&range->lock);
+      return take_index(grep, id, index);
+    }
+    end = range->end;
+    start = range->next + (range->end - range->next) / 2;
+    range->end = start;
+    g_mutex_unlock(&range->lock);
+
+    /* A single item left: start == next, so we took it outright */
+    g_mutex_lock(&own->lock);
+    own->next = start + 1;
+    own->end = end;
+    g_mutex_unlock(&own->lock);
+    *index = start;
+    return TRUE;
+  }
+}
+
+static gchar *extract_line(const gchar *data, gsize length, gsize at) {
+  gsize start = at;
+  gsize end = at;
+  gchar *line;
+  gchar *valid;
+
+  while (start > 0 && data[start - 1] != '\n' && at - start < GREP_LINE_MAX) {
+    start--;
+  }
+  while (end < length && data[end] != '\n' && end - start < GREP_LINE_MAX) {
+    end++;
+  }
+
+  line = g_strndup(data + start, end - start);
+  valid = g_utf8_make_valid(line, -1);
+  g_free(line);
+  return g_strstrip(valid);
+}
+
+static void scan_file(MarkydGrep *grep, guint index) {
+  const gchar *path = g_ptr_array_index(grep->paths, index);
+  GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+  gchar *loaded = NULL;
+  const gchar *data;
+  gsize length = 0;
+  gssize at = -1;
+
+  if (mapped) {
+    data = g_mapped_file_get_contents(mapped);
+    length = g_mapped_file_get_length(mapped);
+  } else if (notes_chunked_is(path)) {
+    data = loaded = notes_chunked_load(path, &length);
+  } else if ((loaded = notes_load(path)) != NULL) {
+    /* Cold tier or SQLite */
+    data = loaded;
+    length = strlen(loaded);
+  } else {
+    return;
+  }
+
+  if (data && length > 0) {
+    if (grep->regex) {
+      GMatchInfo *match_info = NULL;
+      if (g_regex_match_full(grep->regex, data, (gssize)length, 0, 0,
+                             &match_info, NULL)) {
+        gint start_pos = 0;
+        gint end_pos = 0;
+        g_match_info_fetch_pos(match_info, 0, &start_pos, &end_pos);
+        at = start_pos;
+      }
+      g_match_info_free(match_info);
+    } else {
+      const gchar *hit = memmem(data, length, grep->needle, grep->needle_len);
+      if (hit) {
+        at = hit - data;
+      }
+    }
+  }
+
+  if (at >= 0) {
+    GrepHit hit;
+    hit.index = index;
+    hit.line = extract_line(data, length, (gsize)at);
+
+    g_mutex_lock(&grep->lock);
+    g_array_append_val(grep->pending, hit);
+    grep->matches++;
+    schedule_flush_locked(grep);
+    g_mutex_unlock(&grep->lock);
+  }
+
+  if (mapped) {
+    g_mapped_file_unref(mapped);
+  }
+  g_free(loaded);
+}
+
+static void grep_worker(gpointer data, gpointer user_data) {
+  GrepWorker *worker = data;
+  MarkydGrep *grep = worker->grep;
+  guint index;
+
+  (void)user_data;
+
+  while (!g_atomic_int_get(&grep->cancelled) &&
+         take_index(grep, worker->id, &index)) {
+    scan_file(grep, index);
+  }
+
+  if (g_atomic_int_dec_and_test(&grep->running)) {
+    g_mutex_lock(&grep->lock);
+    grep->finished = TRUE;
+    schedule_flush_locked(grep);
+    g_mutex_unlock(&grep->lock);
+  }
+
+  grep_unref(grep);
+  g_free(worker);
+}
+
+MarkydGrep *notes_grep_start(GPtrArray *paths, const gchar *pattern,
+                             gboolean use_regex, gboolean case_sensitive,
+                             MarkydGrepMatchFunc match_func,
+                             MarkydGrepDoneFunc done_func, gpointer user_data,
+                             GError **error) {
+  MarkydGrep *grep;
+  GRegex *regex = NULL;
+  guint n_paths = paths ? paths->len : 0;
+  guint per_worker;
+
+  g_return_val_if_fail(pattern != NULL, NULL);
+
+  if (use_regex || !case_sensitive) {
+    GRegexCompileFlags flags = G_REGEX_OPTIMIZE | G_REGEX_MULTILINE;
+    gchar *source = use_regex ? g_strdup(pattern)
+                              : g_regex_escape_string(pattern, -1);
+
+    if (!case_sensitive) {
+      flags |= G_REGEX_CASELESS;
+    }
+    regex = g_regex_new(source, flags, 0, error);
+    g_free(source);
+    if (!regex) {
+      return NULL;
+    }
+  }
+
+  grep = g_new0(MarkydGrep, 1);
+  grep->ref_count = 1;
+  grep->regex = regex;
+  grep->needle = g_strdup(pattern);
+  grep->needle_len = strlen(pattern);
+  grep->paths = g_ptr_array_new_with_free_func(g_free);
+  for (guint i = 0; i < n_paths; i++) {
+    g_ptr_array_add(grep->paths, g_strdup(g_ptr_array_index(paths, i)));
+  }
+  g_mutex_init(&grep->lock);
+  grep->pending = g_array_new(FALSE, FALSE, sizeof(GrepHit));
+  grep->match_func = match_func;
+  grep->done_func = done_func;
+  grep->user_data = user_data;
+
+  grep->n_workers = CLAMP(g_get_num_processors(), 1, MAX(n_paths, 1));
+  grep->ranges = g_new0(GrepRange, grep->n_workers);
+  per_worker = (n_paths + grep->n_workers - 1) / grep->n_workers;
+  for (guint i = 0; i < grep->n_workers; i++) {
+    g_mutex_init(&grep->ranges[i].lock);
+    grep->ranges[i].next = MIN(i * per_worker, n_paths);
+    grep->ranges[i].end = MIN((i + 1) * per_worker, n_paths);
+  }
+
+  if (!pool) {
+    pool = g_thread_pool_new(grep_worker, NULL, (gint)g_get_num_processors(),
+                             FALSE, NULL);
+  }
+
+  grep->running = (gint)grep->n_workers;
+  for (guint i = 0; i < grep->n_workers; i++) {
+    GrepWorker *worker = g_new0(GrepWorker, 1);
+    worker->grep = grep_ref(grep);
+    worker->id = i;
+    g_thread_pool_push(pool, worker, NULL);
+  }
+
+  return grep;
+}
+
+void notes_grep_cancel(MarkydGrep *grep) {
+  if (!grep) {
+    return;
+  }
+
+  g_atomic_int_set(&grep->cancelled, 1);
+  grep_unref(grep);
+}
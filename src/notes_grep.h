@@ -0,0 +1,37 @@
+#ifndef MARKYD_NOTES_GREP_H
+#define MARKYD_NOTES_GREP_H
+
+#include <glib.h>
+
+/*
+ * Brute-force search over note files for queries an index can't answer
+ * (regexes, case-sensitive phrases). Files are memory-mapped and scanned on
+ * a shared pool of one thread per core; idle workers steal half of a busy
+ * worker's remaining range. Hits are delivered on the main loop in batches,
+ * tagged with their position in the input list so callers can keep them in
+ * mtime order. Notes that can't be mapped (chunked, cold-tier or SQLite)
+ * are loaded whole instead.
+ */
+
+typedef struct _MarkydGrep MarkydGrep;
+
+/* First matching line of a note (main thread) */
+typedef void (*MarkydGrepMatchFunc)(guint index, const gchar *path,
+                                    const gchar *line, gpointer user_data);
+
+/* All files scanned (main thread; never called after cancel) */
+typedef void (*MarkydGrepDoneFunc)(guint matches, gpointer user_data);
+
+/* Start scanning paths (copied). Returns NULL and sets error for an invalid
+ * regex. */
+MarkydGrep *notes_grep_start(GPtrArray *paths, const gchar *pattern,
+                             gboolean use_regex, gboolean case_sensitive,
+                             MarkydGrepMatchFunc match_func,
+                             MarkydGrepDoneFunc done_func, gpointer user_data,
+                             GError **error);
+
+/* Stop the search and release it. No callbacks run after this returns;
+ * workers wind down on their own. */
+void notes_grep_cancel(MarkydGrep *grep);
+
+#endif /* MARKYD_NOTES_GREP_H */
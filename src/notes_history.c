@@ -0,0 +1,683 @@
+#include "notes_history.h"
+#include <errno.h>
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Pack layout (little endian), after an 8-byte magic:
+ *
+ *   full:  u8 kind=0, i64 timestamp, u32 length, u32 data_len, data
+ *   delta: u8 kind=1, i64 timestamp, u32 length, u32 prefix, u32 suffix,
+ *          u32 data_len, data
+ *
+ * A delta rebuilds a revision as prev[0..prefix) + data + the last suffix
+ * bytes of prev. Autosave runs every few hundred ms of typing, so almost every
+ * delta is one small edited region. A full snapshot every KEYFRAME_INTERVAL
+ * records bounds reconstruction to a handful of memcpy passes.
+ */
+#define PACK_MAGIC "TMDHIST1"
+#define PACK_MAGIC_LEN 8
+#define KEYFRAME_INTERVAL 16
+
+/* Thin once a pack is this long, then again every THIN_EVERY appends. */
+#define THIN_MIN_RECORDS 128
+#define THIN_EVERY 32
+/* Revisions kept from the last hour; autosave may record one every 500ms */
+#define RECENT_INTERVAL_USEC ((gint64)30 * G_USEC_PER_SEC)
+
+#define MINUTE_USEC ((gint64)60 * G_USEC_PER_SEC)
+#define HOUR_USEC (60 * MINUTE_USEC)
+#define DAY_USEC (24 * HOUR_USEC)
+#define WEEK_USEC (7 * DAY_USEC)
+
+typedef enum _RecordKind {
+  RECORD_FULL = 0,
+  RECORD_DELTA = 1,
+} RecordKind;
+
+typedef struct _PackRecord {
+  guint8 kind;
+  gint64 timestamp;
+  guint32 length;
+  guint32 prefix;
+  guint32 suffix;
+  guint32 data_len;
+  const gchar *data; /* Points into Pack.buffer */
+} PackRecord;
+
+typedef struct _Pack {
+  gchar *buffer;
+  gsize size;
+  gsize valid_size; /* Bytes up to the last complete record */
+  GArray *records;  /* PackRecord */
+} Pack;
+
+/* Newest revision of the most recently saved note, so autosave can delta
+ * against it without re-reading the pack. */
+typedef struct _HistoryCache {
+  gchar *path;
+  gchar *content;
+  gsize length;
+  guint records;
+  guint since_keyframe;
+} HistoryCache;
+
+static gchar *history_dir = NULL;
+static gchar *history_notes_dir = NULL;
+static HistoryCache cache = {0};
+
+/* Guards the cache and the pack files against the thinning worker */
+static GMutex history_lock;
+static gboolean thinning = FALSE; /* A worker is rewriting a pack */
+static GCond thin_done;
+static GCancellable *thin_cancellable = NULL; /* Cancelled on cleanup */
+
+static void put_u32(GByteArray *out, guint32 v) {
+  guint8 b[4];
+  for (gint i = 0; i < 4; i++) {
+    b[i] = (guint8)(v >> (8 * i));
+  }
+  g_byte_array_append(out, b, 4);
+}
+
+static void put_i64(GByteArray *out, gint64 v) {
+  guint64 u = (guint64)v;
+  guint8 b[8];
+  for (gint i = 0; i < 8; i++) {
+    b[i] = (guint8)(u >> (8 * i));
+  }
+  g_byte_array_append(out, b, 8);
+}
+
+static guint32 get_u32(const gchar *p) {
+  const guint8 *b = (const guint8 *)p;
+  return (guint32)b[0] | ((guint32)b[1] << 8) | ((guint32)b[2] << 16) |
+         ((guint32)b[3] << 24);
+}
+
+static gint64 get_i64(const gchar *p) {
+  const guint8 *b = (const guint8 *)p;
+  guint64 u = 0;
+  for (gint i = 7; i >= 0; i--) {
+    u = (u << 8) | b[i];
+  }
+  return (gint64)u;
+}
+
+static void encode_full(GByteArray *out, gint64 timestamp, const gchar *content,
+                        gsize length) {
+  guint8 kind = RECORD_FULL;
+
+  g_byte_array_append(out, &kind, 1);
+  put_i64(out, timestamp);
+  put_u32(out, (guint32)length);
+  put_u32(out, (guint32)length);
+  g_byte_array_append(out, (const guint8 *)content, (guint)length);
+}
+
+static void encode_delta(GByteArray *out, gint64 timestamp, const gchar *prev,
+                         gsize prev_len, const gchar *cur, gsize cur_len) {
+  guint8 kind = RECORD_DELTA;
+  gsize max = MIN(prev_len, cur_len);
+  gsize prefix = 0;
+  gsize suffix = 0;
+
+  while (prefix < max && prev[prefix] == cur[prefix]) {
+    prefix++;
+  }
+  while (suffix < max - prefix &&
+         prev[prev_len - 1 - suffix] == cur[cur_len - 1 - suffix]) {
+    suffix++;
+  }
+
+  g_byte_array_append(out, &kind, 1);
+  put_i64(out, timestamp);
+  put_u32(out, (guint32)cur_len);
+  put_u32(out, (guint32)prefix);
+  put_u32(out, (guint32)suffix);
+  put_u32(out, (guint32)(cur_len - prefix - suffix));
+  g_byte_array_append(out, (const guint8 *)cur + prefix,
+                      (guint)(cur_len - prefix - suffix));
+}
+
+/* Packs are named after the note's path below the notes dir, with
+ * separators escaped so notes in different notebooks never share one. */
+static gchar *pack_path_for(const gchar *path) {
+  gsize root_len = strlen(history_notes_dir);
+  const gchar *relative = path;
+  gchar *name;
+  gchar *filename;
+  gchar *pack_path;
+
+  if (g_str_has_prefix(path, history_notes_dir) &&
+      path[root_len] == G_DIR_SEPARATOR) {
+    relative = path + root_len + 1;
+  }
+
+  name = g_uri_escape_string(relative, NULL, FALSE);
+  filename = g_strdup_printf("%s.pack", name);
+  pack_path = g_build_filename(history_dir, filename, NULL);
+
+  g_free(filename);
+  g_free(name);
+  return pack_path;
+}
+
+static void pack_free(Pack *pack) {
+  if (!pack) {
+    return;
+  }
+  g_free(pack->buffer);
+  g_array_free(pack->records, TRUE);
+  g_free(pack);
+}
+
+static Pack *pack_load(const gchar *pack_path) {
+  Pack *pack = g_new0(Pack, 1);
+  gsize pos;
+
+  pack->records = g_array_new(FALSE, FALSE, sizeof(PackRecord));
+
+  if (!g_file_get_contents(pack_path, &pack->buffer, &pack->size, NULL) ||
+      pack->size < PACK_MAGIC_LEN ||
+      memcmp(pack->buffer, PACK_MAGIC, PACK_MAGIC_LEN) != 0) {
+    pack->valid_size = 0;
+    return pack;
+  }
+
+  pos = PACK_MAGIC_LEN;
+  while (pos < pack->size) {
+    const gchar *p = pack->buffer + pos;
+    gsize avail = pack->size - pos;
+    PackRecord rec = {0};
+    gsize header;
+
+    rec.kind = (guint8)p[0];
+    if (rec.kind == RECORD_FULL) {
+      header = 1 + 8 + 4 + 4;
+      if (avail < header) {
+        break;
+      }
+      rec.data_len = get_u32(p + 13);
+    } else if (rec.kind == RECORD_DELTA) {
+      header = 1 + 8 + 4 + 4 + 4 + 4;
+      if (avail < header) {
+        break;
+      }
+      rec.prefix = get_u32(p + 13);
+      rec.suffix = get_u32(p + 17);
+      rec.data_len = get_u32(p + 21);
+    } else {
+      break;
+    }
+
+    rec.timestamp = get_i64(p + 1);
+    rec.length = get_u32(p + 9);
+    if (avail - header < rec.data_len) {
+      break; /* Torn write at the tail */
+    }
+    rec.data = p + header;
+
+    g_array_append_val(pack->records, rec);
+    pos += header + rec.data_len;
+  }
+
+  pack->valid_size = pos;
+  return pack;
+}
+
+/* Rebuild revision index starting from the nearest preceding snapshot. */
+static GString *pack_reconstruct(Pack *pack, guint index) {
+  guint key = index;
+  GString *cur;
+  GString *next;
+
+  if (index >= pack->records->len) {
+    return NULL;
+  }
+
+  while (key > 0 &&
+         g_array_index(pack->records, PackRecord, key).kind != RECORD_FULL) {
+    key--;
+  }
+
+  const PackRecord *base = &g_array_index(pack->records, PackRecord, key);
+  if (base->kind != RECORD_FULL) {
+    return NULL;
+  }
+
+  cur = g_string_sized_new(base->length + 1);
+  g_string_append_len(cur, base->data, base->data_len);
+  next = g_string_sized_new(base->length + 1);
+
+  for (guint i = key + 1; i <= index; i++) {
+    const PackRecord *rec = &g_array_index(pack->records, PackRecord, i);
+    GString *tmp;
+
+    if ((gsize)rec->prefix + rec->suffix > cur->len) {
+      g_string_free(cur, TRUE);
+      g_string_free(next, TRUE);
+      return NULL;
+    }
+
+    g_string_truncate(next, 0);
+    g_string_append_len(next, cur->str, rec->prefix);
+    g_string_append_len(next, rec->data, rec->data_len);
+    g_string_append_len(next, cur->str + cur->len - rec->suffix, rec->suffix);
+
+    tmp = cur;
+    cur = next;
+    next = tmp;
+  }
+
+  g_string_free(next, TRUE);
+  return cur;
+}
+
+static void cache_reset(void) {
+  g_clear_pointer(&cache.path, g_free);
+  g_clear_pointer(&cache.content, g_free);
+  cache.length = 0;
+  cache.records = 0;
+  cache.since_keyframe = 0;
+}
+
+static void cache_load(const gchar *path, const gchar *pack_path) {
+  Pack *pack = pack_load(pack_path);
+  guint n = pack->records->len;
+
+  cache_reset();
+  cache.path = g_strdup(path);
+
+  /* Drop a torn tail so the next append lands on a record boundary. */
+  if (pack->valid_size < pack->size) {
+    if (n > 0) {
+      g_file_set_contents(pack_path, pack->buffer, (gssize)pack->valid_size,
+                          NULL);
+    } else {
+      g_remove(pack_path);
+    }
+  }
+
+  if (n > 0) {
+    GString *last = pack_reconstruct(pack, n - 1);
+    if (last) {
+      cache.length = last->len;
+      cache.content = g_string_free(last, FALSE);
+      cache.records = n;
+      while (cache.since_keyframe < n &&
+             g_array_index(pack->records, PackRecord,
+                           n - 1 - cache.since_keyframe)
+                     .kind != RECORD_FULL) {
+        cache.since_keyframe++;
+      }
+    } else {
+      /* Unreadable pack: start over rather than append garbage deltas. */
+      g_printerr("Discarding corrupt note history '%s'\n", pack_path);
+      g_remove(pack_path);
+    }
+  }
+
+  pack_free(pack);
+}
+
+static gint64 thin_bucket_width(gint64 age) {
+  if (age < HOUR_USEC) {
+    return RECENT_INTERVAL_USEC;
+  }
+  if (age < DAY_USEC) {
+    return 10 * MINUTE_USEC;
+  }
+  if (age < WEEK_USEC) {
+    return HOUR_USEC;
+  }
+  return DAY_USEC;
+}
+
+/*
+ * Time-based thinning: one revision per 30 seconds from the last hour, then
+ * one per 10 minutes for a day, one per hour for a week, one per day beyond.
+ * The newest revision is always kept. Runs on a worker: the pack is read and
+ * re-encoded unlocked, then records appended meanwhile are carried over and
+ * the pack is replaced atomically under the lock. They still apply, as they
+ * delta against the newest revision.
+ */
+static void thin_pack(const gchar *pack_path, GCancellable *cancellable) {
+  Pack *pack;
+  guint n;
+  gboolean *keep;
+  gint64 now = g_get_real_time();
+  gint64 last_width = -1;
+  gint64 last_bucket = -1;
+  guint kept = 0;
+  guint encoded = 0;
+  GByteArray *out;
+  GString *cur = NULL;
+  GString *prev_kept = NULL;
+  guint since_keyframe = 0;
+  gchar *current = NULL;
+  gsize current_size = 0;
+
+  g_mutex_lock(&history_lock);
+  pack = pack_load(pack_path);
+  g_mutex_unlock(&history_lock);
+
+  n = pack->records->len;
+  if (n == 0 || pack->valid_size < pack->size) {
+    pack_free(pack);
+    return;
+  }
+
+  keep = g_new0(gboolean, n);
+  for (gint i = (gint)n - 1; i >= 0; i--) {
+    const PackRecord *rec = &g_array_index(pack->records, PackRecord, i);
+    gint64 width = thin_bucket_width(now - rec->timestamp);
+    gint64 bucket;
+
+    if (i == (gint)n - 1) {
+      keep[i] = TRUE;
+      continue;
+    }
+
+    bucket = rec->timestamp / width;
+    if (width != last_width || bucket != last_bucket) {
+      keep[i] = TRUE;
+      last_width = width;
+      last_bucket = bucket;
+    }
+  }
+
+  for (guint i = 0; i < n; i++) {
+    kept += keep[i] ? 1 : 0;
+  }
+  if (kept == n) {
+    g_free(keep);
+    pack_free(pack);
+    return;
+  }
+
+  out = g_byte_array_new();
+  g_byte_array_append(out, (const guint8 *)PACK_MAGIC, PACK_MAGIC_LEN);
+
+  /* Walk revisions in order, re-encoding only the kept ones. A cancel
+   * leaves encoded short of kept, so the pack is left alone. */
+  for (guint i = 0; i < n && !g_cancellable_is_cancelled(cancellable); i++) {
+    const PackRecord *rec = &g_array_index(pack->records, PackRecord, i);
+
+    if (rec->kind == RECORD_FULL) {
+      if (!cur) {
+        cur = g_string_new(NULL);
+      }
+      g_string_truncate(cur, 0);
+      g_string_append_len(cur, rec->data, rec->data_len);
+    } else {
+      GString *next;
+
+      if (!cur || (gsize)rec->prefix + rec->suffix > cur->len) {
+        break; /* Corrupt chain: keep what we have */
+      }
+      next = g_string_sized_new(rec->length + 1);
+      g_string_append_len(next, cur->str, rec->prefix);
+      g_string_append_len(next, rec->data, rec->data_len);
+      g_string_append_len(next, cur->str + cur->len - rec->suffix, rec->suffix);
+      g_string_free(cur, TRUE);
+      cur = next;
+    }
+
+    if (!keep[i]) {
+      continue;
+    }
+
+    if (!prev_kept || since_keyframe + 1 >= KEYFRAME_INTERVAL) {
+      encode_full(out, rec->timestamp, cur->str, cur->len);
+      since_keyframe = 0;
+      prev_kept = prev_kept ? prev_kept : g_string_new(NULL);
+    } else {
+      encode_delta(out, rec->timestamp, prev_kept->str, prev_kept->len,
+                   cur->str, cur->len);
+      since_keyframe++;
+    }
+    g_string_truncate(prev_kept, 0);
+    g_string_append_len(prev_kept, cur->str, cur->len);
+    encoded++;
+  }
+
+  g_mutex_lock(&history_lock);
+
+  /* Appends since the read follow the newest revision; anything else (a
+   * forgotten note, a torn chain) leaves the pack alone */
+  if (encoded == kept &&
+      g_file_get_contents(pack_path, &current, &current_size, NULL) &&
+      current_size >= pack->size &&
+      memcmp(current, pack->buffer, pack->size) == 0) {
+    g_byte_array_append(out, (const guint8 *)current + pack->size,
+                        (guint)(current_size - pack->size));
+    if (!g_file_set_contents(pack_path, (const gchar *)out->data,
+                             (gssize)out->len, NULL)) {
+      g_printerr("Failed to rewrite note history '%s'\n", pack_path);
+      cache_reset();
+    } else if (cache.path) {
+      gchar *cached_pack = pack_path_for(cache.path);
+
+      if (g_strcmp0(cached_pack, pack_path) == 0) {
+        guint appended = cache.records - MIN(cache.records, n);
+
+        /* Deltas since the last keyframe: the rewritten tail's, plus the
+         * appends unless one of those was a keyframe itself */
+        if (cache.since_keyframe >= appended) {
+          cache.since_keyframe = since_keyframe + appended;
+        }
+        cache.records -= MIN(cache.records, n - kept);
+      }
+      g_free(cached_pack);
+    }
+  }
+  g_mutex_unlock(&history_lock);
+
+  g_free(current);
+  if (cur) {
+    g_string_free(cur, TRUE);
+  }
+  if (prev_kept) {
+    g_string_free(prev_kept, TRUE);
+  }
+  g_byte_array_free(out, TRUE);
+  g_free(keep);
+  pack_free(pack);
+}
+
+static void thin_thread(GTask *task, gpointer source, gpointer task_data,
+                        GCancellable *cancellable) {
+  (void)task;
+  (void)source;
+
+  thin_pack(task_data, cancellable);
+
+  g_mutex_lock(&history_lock);
+  thinning = FALSE;
+  g_cond_broadcast(&thin_done);
+  g_mutex_unlock(&history_lock);
+}
+
+/* Thin the pack off the save path; one pack at a time (history_lock held) */
+static void thin_pack_async(const gchar *pack_path) {
+  GTask *task;
+
+  if (thinning || !thin_cancellable) {
+    return;
+  }
+
+  thinning = TRUE;
+  task = g_task_new(NULL, thin_cancellable, NULL, NULL);
+  g_task_set_task_data(task, g_strdup(pack_path), g_free);
+  g_task_run_in_thread(task, thin_thread);
+  g_object_unref(task);
+}
+
+gboolean notes_history_init(const gchar *dir, const gchar *notes_dir) {
+  if (g_mkdir_with_parents(dir, 0755) != 0) {
+    g_printerr("Failed to create history directory: %s\n", g_strerror(errno));
+    return FALSE;
+  }
+
+  g_free(history_dir);
+  history_dir = g_strdup(dir);
+  g_free(history_notes_dir);
+  history_notes_dir = g_strdup(notes_dir);
+  g_mutex_lock(&history_lock);
+  cache_reset();
+  if (!thin_cancellable) {
+    thin_cancellable = g_cancellable_new();
+  }
+  g_mutex_unlock(&history_lock);
+  return TRUE;
+}
+
+/* Stops a running thin and waits for it before the dirs go */
+void notes_history_cleanup(void) {
+  g_mutex_lock(&history_lock);
+  if (thin_cancellable) {
+    g_cancellable_cancel(thin_cancellable);
+  }
+  while (thinning) {
+    g_cond_wait(&thin_done, &history_lock);
+  }
+  g_clear_object(&thin_cancellable);
+  cache_reset();
+  g_mutex_unlock(&history_lock);
+  g_clear_pointer(&history_dir, g_free);
+  g_clear_pointer(&history_notes_dir, g_free);
+}
+
+gboolean notes_history_enabled(void) { return history_dir != NULL; }
+
+void notes_history_record(const gchar *path, const gchar *content) {
+  gchar *pack_path;
+  gsize length;
+  GByteArray *out;
+  gint64 now;
+  FILE *fp;
+
+  if (!history_dir || !path || !content) {
+    return;
+  }
+
+  pack_path = pack_path_for(path);
+  g_mutex_lock(&history_lock);
+  if (g_strcmp0(cache.path, path) != 0) {
+    cache_load(path, pack_path);
+  }
+
+  length = strlen(content);
+  if (cache.content && cache.length == length &&
+      memcmp(cache.content, content, length) == 0) {
+    g_mutex_unlock(&history_lock);
+    g_free(pack_path);
+    return;
+  }
+
+  now = g_get_real_time();
+  out = g_byte_array_new();
+  if (cache.records == 0) {
+    g_byte_array_append(out, (const guint8 *)PACK_MAGIC, PACK_MAGIC_LEN);
+  }
+
+  if (!cache.content || cache.since_keyframe + 1 >= KEYFRAME_INTERVAL) {
+    encode_full(out, now, content, length);
+    cache.since_keyframe = 0;
+  } else {
+    encode_delta(out, now, cache.content, cache.length, content, length);
+    cache.since_keyframe++;
+  }
+
+  fp = g_fopen(pack_path, cache.records == 0 ? "wb" : "ab");
+  if (!fp || fwrite(out->data, 1, out->len, fp) != out->len) {
+    g_printerr("Failed to record note history: %s\n", g_strerror(errno));
+    if (fp) {
+      fclose(fp);
+    }
+    cache_reset();
+    g_mutex_unlock(&history_lock);
+    g_byte_array_free(out, TRUE);
+    g_free(pack_path);
+    return;
+  }
+  fclose(fp);
+  g_byte_array_free(out, TRUE);
+
+  g_free(cache.content);
+  cache.content = g_strndup(content, length);
+  cache.length = length;
+  cache.records++;
+
+  if (cache.records >= THIN_MIN_RECORDS &&
+      cache.records % THIN_EVERY == 0) {
+    thin_pack_async(pack_path);
+  }
+  g_mutex_unlock(&history_lock);
+
+  g_free(pack_path);
+}
+
+GArray *notes_history_list(const gchar *path) {
+  GArray *revisions = g_array_new(FALSE, FALSE, sizeof(MarkydRevision));
+  gchar *pack_path;
+  Pack *pack;
+
+  if (!history_dir || !path) {
+    return revisions;
+  }
+
+  pack_path = pack_path_for(path);
+  g_mutex_lock(&history_lock);
+  pack = pack_load(pack_path);
+  g_mutex_unlock(&history_lock);
+  for (guint i = 0; i < pack->records->len; i++) {
+    const PackRecord *rec = &g_array_index(pack->records, PackRecord, i);
+    MarkydRevision rev = {rec->timestamp, rec->length};
+    g_array_append_val(revisions, rev);
+  }
+
+  pack_free(pack);
+  g_free(pack_path);
+  return revisions;
+}
+
+gchar *notes_history_get(const gchar *path, guint index) {
+  gchar *pack_path;
+  Pack *pack;
+  GString *content;
+
+  if (!history_dir || !path) {
+    return NULL;
+  }
+
+  pack_path = pack_path_for(path);
+  g_mutex_lock(&history_lock);
+  pack = pack_load(pack_path);
+  g_mutex_unlock(&history_lock);
+  content = pack_reconstruct(pack, index);
+  pack_free(pack);
+  g_free(pack_path);
+
+  return content ? g_string_free(content, FALSE) : NULL;
+}
+
+void notes_history_forget(const gchar *path) {
+  gchar *pack_path;
+
+  if (!history_dir || !path) {
+    return;
+  }
+
+  pack_path = pack_path_for(path);
+  g_mutex_lock(&history_lock);
+  if (g_strcmp0(cache.path, path) == 0) {
+    cache_reset();
+  }
+  g_remove(pack_path);
+  g_mutex_unlock(&history_lock);
+  g_free(pack_path);
+}
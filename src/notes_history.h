@@ -0,0 +1,35 @@
+#ifndef MARKYD_NOTES_HISTORY_H
+#define MARKYD_NOTES_HISTORY_H
+
+#include <glib.h>
+
+/*
+ * Per-note revision history. Each note gets an append-only pack in the
+ * history directory holding periodic full snapshots and small deltas
+ * (common prefix/suffix + replaced middle) against the previous revision.
+ */
+
+typedef struct _MarkydRevision {
+  gint64 timestamp; /* Wall clock, microseconds */
+  gsize length;     /* Size of the reconstructed content in bytes */
+} MarkydRevision;
+
+/* Enable history for notes below notes_dir, storing packs under dir (created
+ * if missing) */
+gboolean notes_history_init(const gchar *dir, const gchar *notes_dir);
+void notes_history_cleanup(void);
+gboolean notes_history_enabled(void);
+
+/* Record content as the newest revision of the note at path */
+void notes_history_record(const gchar *path, const gchar *content);
+
+/* Revisions of the note, oldest first (array of MarkydRevision) */
+GArray *notes_history_list(const gchar *path);
+
+/* Reconstruct revision index of the note (caller must free) */
+gchar *notes_history_get(const gchar *path, guint index);
+
+/* Drop the note's history pack */
+void notes_history_forget(const gchar *path);
+
+#endif /* MARKYD_NOTES_HISTORY_H */
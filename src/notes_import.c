@@ -0,0 +1,448 @@
+#include "notes_import.h"
+#include "notes.h"
+#include "notes_chunked.h"
+#include "notes_cold.h"
+#include "notes_dupes.h"
+#include "notes_sqlite.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define PROGRESS_INTERVAL_USEC (250 * 1000)
+#define QUEUE_POLL_USEC (50 * 1000)
+#define SQLITE_BATCH 500
+
+typedef struct _ImportFile {
+  gchar *path;     /* Source file */
+  gchar *notebook; /* Directory relative to the source root */
+  gboolean stored; /* A chunked or cold note: read through notes_load */
+} ImportFile;
+
+/* A prepared note waiting for the (single-threaded) SQLite writer */
+typedef struct _ImportNote {
+  gchar *notebook;
+  gchar *stem;
+  gchar *content;
+  gint64 mtime;
+} ImportNote;
+
+typedef struct _ImportJob {
+  GMutex lock;
+  GHashTable *seen; /* SHA-256 of every note's content, guarded by lock */
+  MarkydImportStats stats; /* Guarded by lock */
+  guint done;              /* Files finished by workers, guarded by lock */
+  GCond progressed;        /* Signalled as done grows */
+  GAsyncQueue *queue;      /* ImportNote, SQLite backend only */
+  gboolean seeding;        /* Only hashing the existing notes */
+} ImportJob;
+
+static void import_file_free(gpointer data) {
+  ImportFile *file = data;
+
+  g_free(file->path);
+  g_free(file->notebook);
+  g_free(file);
+}
+
+static void import_note_free(ImportNote *note) {
+  g_free(note->notebook);
+  g_free(note->stem);
+  g_free(note->content);
+  g_free(note);
+}
+
+static gboolean is_importable(const gchar *filename, gboolean notes_only) {
+  if (notes_only) {
+    return g_str_has_suffix(filename, ".md");
+  }
+  return g_str_has_suffix(filename, ".md") ||
+         g_str_has_suffix(filename, ".markdown") ||
+         g_str_has_suffix(filename, ".txt");
+}
+
+static void add_file(GPtrArray *files, gchar *path, const gchar *notebook,
+                     gboolean stored) {
+  ImportFile *file = g_new0(ImportFile, 1);
+
+  file->path = path;
+  file->notebook = g_strdup(notebook);
+  file->stored = stored;
+  g_ptr_array_add(files, file);
+}
+
+/* Recursively gather files below root/notebook, skipping hidden entries.
+ * With notes_only, root is the notes dir and chunked notes (directories)
+ * are taken as notes too. */
+static void collect_files(const gchar *root, const gchar *notebook,
+                          gboolean notes_only, GPtrArray *files) {
+  gchar *dir_path = g_build_filename(root, notebook, NULL);
+  GDir *dir = g_dir_open(dir_path, 0, NULL);
+  const gchar *filename;
+
+  if (!dir) {
+    g_free(dir_path);
+    return;
+  }
+
+  while ((filename = g_dir_read_name(dir)) != NULL) {
+    gchar *path;
+
+    if (filename[0] == '.') {
+      continue;
+    }
+
+    path = g_build_filename(dir_path, filename, NULL);
+    if (is_importable(filename, notes_only) &&
+        g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+      add_file(files, path, notebook, FALSE);
+      continue;
+    }
+    if (notes_only && is_importable(filename, TRUE) &&
+        notes_chunked_is(path)) {
+      add_file(files, path, notebook, TRUE);
+      continue;
+    }
+
+    if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+      gchar *child = notebook[0] ? g_build_filename(notebook, filename, NULL)
+                                 : g_strdup(filename);
+      collect_files(root, child, notes_only, files);
+      g_free(child);
+    }
+    g_free(path);
+  }
+
+  g_dir_close(dir);
+  g_free(dir_path);
+}
+
+/*
+ * Decode to UTF-8 (honouring UTF-8/UTF-16 BOMs, falling back to Windows-1252
+ * and then Latin-1, which always succeeds) and turn CRLF / CR into LF.
+ */
+static gchar *normalize_text(const gchar *raw, gsize len) {
+  const guchar *bytes = (const guchar *)raw;
+  gchar *utf8 = NULL;
+  gchar *r;
+  gchar *w;
+
+  if (len >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+    raw += 3;
+    len -= 3;
+  } else if (len >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+    utf8 = g_convert(raw + 2, (gssize)len - 2, "UTF-8", "UTF-16LE", NULL, NULL,
+                     NULL);
+  } else if (len >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+    utf8 = g_convert(raw + 2, (gssize)len - 2, "UTF-8", "UTF-16BE", NULL, NULL,
+                     NULL);
+  }
+
+  if (!utf8) {
+    if (g_utf8_validate(raw, (gssize)len, NULL)) {
+      utf8 = g_strndup(raw, len);
+    } else {
+      utf8 = g_convert(raw, (gssize)len, "UTF-8", "WINDOWS-1252", NULL, NULL,
+                       NULL);
+      if (!utf8) {
+        utf8 = g_convert(raw, (gssize)len, "UTF-8", "ISO-8859-1", NULL, NULL,
+                         NULL);
+      }
+    }
+  }
+  if (!utf8) {
+    return NULL;
+  }
+
+  for (r = w = utf8; *r; r++) {
+    if (*r == '\r') {
+      *w++ = '\n';
+      if (r[1] == '\n') {
+        r++;
+      }
+    } else {
+      *w++ = *r;
+    }
+  }
+  *w = '\0';
+
+  return utf8;
+}
+
+/* File name without its extension, used as the note name */
+static gchar *note_stem(const gchar *path) {
+  gchar *name = g_path_get_basename(path);
+  gchar *dot = strrchr(name, '.');
+
+  if (dot && dot != name) {
+    *dot = '\0';
+  }
+  if (name[0] == '\0') {
+    g_free(name);
+    name = g_strdup("note");
+  }
+  return name;
+}
+
+static void import_worker(gpointer data, gpointer user_data) {
+  ImportFile *file = data;
+  ImportJob *job = user_data;
+  gchar *raw = NULL;
+  gsize raw_len = 0;
+  gchar *text = NULL;
+  gchar *hash = NULL;
+  gchar *path = NULL;
+  GStatBuf st;
+  gboolean fresh = FALSE;
+  gboolean ok = FALSE;
+
+  if (file->stored) {
+    raw = notes_load(file->path);
+  } else if (!g_file_get_contents(file->path, &raw, &raw_len, NULL) ||
+             g_stat(file->path, &st) != 0) {
+    g_clear_pointer(&raw, g_free);
+  }
+  if (!raw) {
+    g_printerr("Skipping unreadable file '%s'\n", file->path);
+    g_mutex_lock(&job->lock);
+    job->stats.failed++;
+    job->done++;
+    g_cond_signal(&job->progressed);
+    g_mutex_unlock(&job->lock);
+    return;
+  }
+
+  /* Existing notes were written by us: hash them as they are */
+  text = job->seeding ? raw : normalize_text(raw, raw_len);
+  if (text) {
+    hash = g_compute_checksum_for_string(G_CHECKSUM_SHA256, text, -1);
+    g_mutex_lock(&job->lock);
+    fresh = !g_hash_table_contains(job->seen, hash);
+    if (fresh) {
+      g_hash_table_add(job->seen, hash);
+      hash = NULL;
+    }
+    g_mutex_unlock(&job->lock);
+  }
+
+  if (!job->seeding && text && fresh) {
+    gchar *stem = note_stem(file->path);
+    gint64 mtime = (gint64)st.st_mtime * G_USEC_PER_SEC;
+
+    if (job->queue) {
+      ImportNote *note = g_new0(ImportNote, 1);
+      note->notebook = g_strdup(file->notebook);
+      note->stem = stem;
+      note->content = text;
+      note->mtime = mtime;
+      g_async_queue_push(job->queue, note);
+      text = NULL;
+      stem = NULL;
+      ok = TRUE;
+    } else {
+      path = notes_create_named(file->notebook, stem, text, mtime);
+      ok = path != NULL;
+      if (ok) {
+        notes_dupes_update(path, text);
+      }
+    }
+    g_free(stem);
+  }
+
+  g_mutex_lock(&job->lock);
+  if (!job->seeding) {
+    if (!text && !ok) {
+      job->stats.failed++;
+    } else if (!fresh) {
+      job->stats.duplicates++;
+    } else if (!job->queue) {
+      if (ok) {
+        job->stats.imported++;
+        job->stats.bytes += strlen(text);
+      } else {
+        job->stats.failed++;
+      }
+    }
+  }
+  job->done++;
+  g_cond_signal(&job->progressed);
+  g_mutex_unlock(&job->lock);
+
+  if (text != raw) {
+    g_free(text);
+  }
+  g_free(raw);
+  g_free(hash);
+  g_free(path);
+}
+
+static void add_cold_file(const gchar *name, gint64 mtime, gpointer user_data) {
+  (void)mtime;
+  add_file(user_data, g_build_filename(notes_get_dir(), name, NULL), "",
+           TRUE);
+}
+
+/* Hash what's already stored so re-running an import adds nothing. */
+static void seed_existing(ImportJob *job, gboolean use_db, gint threads) {
+  GPtrArray *files;
+  GThreadPool *pool;
+
+  if (use_db) {
+    GPtrArray *paths = notes_list();
+    for (guint i = 0; i < paths->len; i++) {
+      gchar *content = notes_load(g_ptr_array_index(paths, i));
+      if (content) {
+        g_hash_table_add(job->seen, g_compute_checksum_for_string(
+                                        G_CHECKSUM_SHA256, content, -1));
+      }
+      g_free(content);
+    }
+    g_ptr_array_free(paths, TRUE);
+    return;
+  }
+
+  files = g_ptr_array_new_with_free_func(import_file_free);
+  collect_files(notes_get_dir(), "", TRUE, files);
+  notes_cold_foreach(add_cold_file, files);
+
+  job->seeding = TRUE;
+  pool = g_thread_pool_new(import_worker, job, threads, FALSE, NULL);
+  for (guint i = 0; i < files->len; i++) {
+    g_thread_pool_push(pool, g_ptr_array_index(files, i), NULL);
+  }
+  g_thread_pool_free(pool, FALSE, TRUE);
+  job->seeding = FALSE;
+  job->done = 0;
+
+  g_ptr_array_free(files, TRUE);
+}
+
+/* SQLite connections aren't shared across threads: rows go in from here, in
+ * batched transactions. Returns FALSE once the queue stayed empty. */
+static gboolean write_queued_note(ImportJob *job, guint *pending) {
+  ImportNote *note = g_async_queue_timeout_pop(job->queue, QUEUE_POLL_USEC);
+  gchar *path;
+
+  if (!note) {
+    return FALSE;
+  }
+
+  /* The database is flat, so keep the source folder in the name */
+  if (note->notebook[0]) {
+    gchar *flat = g_strdup_printf("%s_%s", note->notebook, note->stem);
+    g_strdelimit(flat, G_DIR_SEPARATOR_S, '_');
+    g_free(note->stem);
+    note->stem = flat;
+  }
+
+  /* Triggers keep the FTS index in step with the insert */
+  path = notes_sqlite_insert(note->stem, note->mtime, note->content);
+  if (path) {
+    notes_dupes_update(path, note->content);
+  }
+  g_mutex_lock(&job->lock);
+  if (path) {
+    job->stats.imported++;
+    job->stats.bytes += strlen(note->content);
+  } else {
+    job->stats.failed++;
+  }
+  g_mutex_unlock(&job->lock);
+  g_free(path);
+  import_note_free(note);
+
+  if (++(*pending) >= SQLITE_BATCH) {
+    notes_sqlite_commit();
+    notes_sqlite_begin();
+    *pending = 0;
+  }
+  return TRUE;
+}
+
+gboolean notes_import_dir(const gchar *source, MarkydImportStats *stats,
+                          MarkydImportProgress progress, gpointer user_data) {
+  ImportJob job = {0};
+  GPtrArray *files;
+  GThreadPool *pool;
+  gboolean use_db = notes_get_backend() == MARKYD_NOTES_BACKEND_SQLITE;
+  gint threads = MAX(1, (gint)g_get_num_processors());
+  gint64 start;
+  gint64 last_report = 0;
+  guint pending = 0;
+  MarkydImportStats snapshot;
+
+  if (!g_file_test(source, G_FILE_TEST_IS_DIR)) {
+    g_printerr("Import source '%s' is not a directory\n", source);
+    return FALSE;
+  }
+
+  g_mutex_init(&job.lock);
+  g_cond_init(&job.progressed);
+  job.seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  seed_existing(&job, use_db, threads);
+
+  files = g_ptr_array_new_with_free_func(import_file_free);
+  collect_files(source, "", FALSE, files);
+  job.stats.total = files->len;
+  if (use_db) {
+    job.queue = g_async_queue_new();
+    notes_sqlite_begin();
+  }
+
+  start = g_get_monotonic_time();
+  pool = g_thread_pool_new(import_worker, &job, threads, FALSE, NULL);
+  for (guint i = 0; i < files->len; i++) {
+    g_thread_pool_push(pool, g_ptr_array_index(files, i), NULL);
+  }
+
+  for (;;) {
+    gboolean wrote = FALSE;
+    gboolean finished;
+    gint64 now;
+
+    if (use_db) {
+      wrote = write_queued_note(&job, &pending);
+    }
+
+    g_mutex_lock(&job.lock);
+    /* Plain files are written by the workers: sleep until they are all
+     * done or progress is due */
+    while (!use_db && job.done < job.stats.total &&
+           g_cond_wait_until(&job.progressed, &job.lock,
+                             last_report + PROGRESS_INTERVAL_USEC)) {
+    }
+    finished = job.done == job.stats.total;
+    snapshot = job.stats;
+    g_mutex_unlock(&job.lock);
+
+    now = g_get_monotonic_time();
+    if (progress && now - last_report >= PROGRESS_INTERVAL_USEC) {
+      progress(&snapshot, (gdouble)(now - start) / G_USEC_PER_SEC, user_data);
+      last_report = now;
+    }
+
+    if (finished && !wrote &&
+        (!use_db || g_async_queue_length(job.queue) == 0)) {
+      break;
+    }
+  }
+
+  g_thread_pool_free(pool, FALSE, TRUE);
+  if (use_db) {
+    notes_sqlite_commit();
+    g_async_queue_unref(job.queue);
+  }
+
+  if (progress) {
+    progress(&job.stats,
+             (gdouble)(g_get_monotonic_time() - start) / G_USEC_PER_SEC,
+             user_data);
+  }
+  if (stats) {
+    *stats = job.stats;
+  }
+
+  g_ptr_array_free(files, TRUE);
+  g_hash_table_destroy(job.seen);
+  g_cond_clear(&job.progressed);
+  g_mutex_clear(&job.lock);
+  return job.stats.failed == 0;
+}
@@ -0,0 +1,30 @@
+#ifndef MARKYD_NOTES_IMPORT_H
+#define MARKYD_NOTES_IMPORT_H
+
+#include <glib.h>
+
+/*
+ * Bulk import of an external markdown tree. Files are read, converted to
+ * UTF-8 with LF line endings and hashed on a worker pool; content already
+ * present (in the notes or earlier in the import) is skipped. Source
+ * subdirectories become notebooks.
+ */
+
+typedef struct _MarkydImportStats {
+  guint total;      /* Files found under the source dir */
+  guint imported;   /* Notes written */
+  guint duplicates; /* Skipped, same content as an existing note */
+  guint failed;     /* Unreadable or unwritable */
+  guint64 bytes;    /* Normalized bytes written */
+} MarkydImportStats;
+
+typedef void (*MarkydImportProgress)(const MarkydImportStats *stats,
+                                     gdouble elapsed_sec, gpointer user_data);
+
+/* Import every .md/.markdown/.txt file under source into the notes storage
+ * (notes_init must have run). progress is called from the calling thread a
+ * few times per second and once at the end. */
+gboolean notes_import_dir(const gchar *source, MarkydImportStats *stats,
+                          MarkydImportProgress progress, gpointer user_data);
+
+#endif /* MARKYD_NOTES_IMPORT_H */
@@ -0,0 +1,890 @@
+#include "notes_mirror.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+
+/*
+ * State lives in <target>/.traymd-mirror/:
+ *   manifest  "path \t size \t src_mtime \t dst_mtime \t hash \t blocks",
+ *             blocks being 8 hex digits of weak and 16 of strong checksum
+ *             per MIRROR_BLOCK of the target copy
+ *   journal   undo record of the in-place patch in progress, if any:
+ *             magic, u32 path_len, path, i64 old_size, i64 old_mtime, then
+ *             (i64 offset, u32 length, old bytes)...
+ */
+
+#define MIRROR_STATE_DIR ".traymd-mirror"
+#define MIRROR_MANIFEST_HEADER "# traymd mirror manifest v1"
+#define MIRROR_JOURNAL_MAGIC "TMDMJRN1"
+#define MIRROR_MAGIC_LEN 8
+#define MIRROR_BLOCK 2048
+#define MIRROR_BLOCK_HEX 24
+/* Smaller files are rewritten whole and renamed into place */
+#define MIRROR_INPLACE_MIN (2 * MIRROR_BLOCK)
+/* Changed files between manifest checkpoints */
+#define MIRROR_CHECKPOINT 256
+
+typedef struct _MirrorBlock {
+  guint32 weak;
+  guint64 strong;
+} MirrorBlock;
+
+typedef struct _MirrorEntry {
+  gint64 size;
+  gint64 src_mtime; /* Microseconds */
+  gint64 dst_mtime; /* Target copy, as its filesystem reports it */
+  guint64 hash;     /* Whole content, to recognise renames */
+  GArray *blocks;   /* MirrorBlock */
+} MirrorEntry;
+
+typedef struct _MirrorRange {
+  gsize offset;
+  gsize length;
+} MirrorRange;
+
+typedef struct _Mirror {
+  gchar *source;
+  gchar *target;
+  gchar *manifest_path;
+  gchar *journal_path;
+  GHashTable *manifest; /* relative path -> MirrorEntry */
+  GHashTable *gone;     /* Manifest paths no longer in the source (set) */
+  guint pending;        /* Changes since the manifest was last saved */
+  MarkydMirrorStats *stats;
+} Mirror;
+
+static void put_u32(GByteArray *out, guint32 v) {
+  guint8 b[4];
+  for (gint i = 0; i < 4; i++) {
+    b[i] = (guint8)(v >> (8 * i));
+  }
+  g_byte_array_append(out, b, 4);
+}
+
+static void put_i64(GByteArray *out, gint64 v) {
+  guint64 u = (guint64)v;
+  guint8 b[8];
+  for (gint i = 0; i < 8; i++) {
+    b[i] = (guint8)(u >> (8 * i));
+  }
+  g_byte_array_append(out, b, 8);
+}
+
+static guint32 get_u32(const gchar *p) {
+  const guint8 *b = (const guint8 *)p;
+  return (guint32)b[0] | ((guint32)b[1] << 8) | ((guint32)b[2] << 16) |
+         ((guint32)b[3] << 24);
+}
+
+static gint64 get_i64(const gchar *p) {
+  const guint8 *b = (const guint8 *)p;
+  guint64 u = 0;
+  for (gint i = 7; i >= 0; i--) {
+    u = (u << 8) | b[i];
+  }
+  return (gint64)u;
+}
+
+static guint64 strong_sum(const guchar *p, gsize n) {
+  guint64 h = 14695981039346656037ULL; /* FNV-1a */
+  for (gsize i = 0; i < n; i++) {
+    h = (h ^ p[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+/* rsync's weak checksum: a = sum of bytes, b = sum of running a */
+static void weak_init(const guchar *p, gsize n, guint32 *a, guint32 *b) {
+  *a = 0;
+  *b = 0;
+  for (gsize i = 0; i < n; i++) {
+    *a += p[i];
+    *b += (guint32)(n - i) * p[i];
+  }
+}
+
+static guint32 weak_value(guint32 a, guint32 b) {
+  return (a & 0xffff) | (b << 16);
+}
+
+static void mirror_entry_free(gpointer data) {
+  MirrorEntry *entry = data;
+
+  if (entry->blocks) {
+    g_array_free(entry->blocks, TRUE);
+  }
+  g_free(entry);
+}
+
+static MirrorEntry *mirror_entry_new(const guchar *data, gsize len) {
+  MirrorEntry *entry = g_new0(MirrorEntry, 1);
+
+  entry->size = (gint64)len;
+  entry->hash = strong_sum(data, len);
+  entry->blocks = g_array_new(FALSE, FALSE, sizeof(MirrorBlock));
+  for (gsize off = 0; off < len; off += MIRROR_BLOCK) {
+    gsize n = MIN((gsize)MIRROR_BLOCK, len - off);
+    MirrorBlock block;
+    guint32 a;
+    guint32 b;
+
+    weak_init(data + off, n, &a, &b);
+    block.weak = weak_value(a, b);
+    block.strong = strong_sum(data + off, n);
+    g_array_append_val(entry->blocks, block);
+  }
+  return entry;
+}
+
+static void add_range(GArray *ranges, gsize offset, gsize length) {
+  MirrorRange range;
+
+  if (length == 0) {
+    return;
+  }
+  if (ranges->len > 0) {
+    MirrorRange *last = &g_array_index(ranges, MirrorRange, ranges->len - 1);
+    if (last->offset + last->length == offset) {
+      last->length += length;
+      return;
+    }
+  }
+  range.offset = offset;
+  range.length = length;
+  g_array_append_val(ranges, range);
+}
+
+/*
+ * Match data against the blocks of the old copy with a rolling checksum and
+ * collect the ranges that must be written: literal data, and matched blocks
+ * that moved. Both ends are local, so a moved block costs the same as a
+ * literal; only blocks found at their old offset are left alone.
+ */
+static GArray *plan_writes(const MirrorEntry *old, const guchar *data,
+                           gsize len, guint64 *matched) {
+  GArray *writes = g_array_new(FALSE, FALSE, sizeof(MirrorRange));
+  const MirrorBlock *blocks = (const MirrorBlock *)old->blocks->data;
+  guint n_full = (guint)(old->size / MIRROR_BLOCK);
+  GHashTable *by_weak = g_hash_table_new(NULL, NULL);
+  gsize o = 0;
+  gsize literal = 0;
+  guint32 a = 0;
+  guint32 b = 0;
+  gboolean fresh = TRUE;
+
+  /* Lowest index wins for repeated blocks */
+  for (guint j = n_full; j > 0; j--) {
+    g_hash_table_insert(by_weak, GUINT_TO_POINTER(blocks[j - 1].weak),
+                        GUINT_TO_POINTER(j));
+  }
+
+  while (n_full > 0 && o + MIRROR_BLOCK <= len) {
+    guint32 weak;
+    guint j;
+
+    if (fresh) {
+      weak_init(data + o, MIRROR_BLOCK, &a, &b);
+      fresh = FALSE;
+    }
+    weak = weak_value(a, b);
+
+    /* Prefer the block that already sits at this offset */
+    if (o % MIRROR_BLOCK == 0 && o / MIRROR_BLOCK < n_full &&
+        blocks[o / MIRROR_BLOCK].weak == weak) {
+      j = (guint)(o / MIRROR_BLOCK) + 1;
+    } else {
+      j = GPOINTER_TO_UINT(
+          g_hash_table_lookup(by_weak, GUINT_TO_POINTER(weak)));
+    }
+
+    if (j > 0 && strong_sum(data + o, MIRROR_BLOCK) == blocks[j - 1].strong) {
+      add_range(writes, literal, o - literal);
+      if ((gsize)(j - 1) * MIRROR_BLOCK != o) {
+        add_range(writes, o, MIRROR_BLOCK);
+      } else {
+        *matched += MIRROR_BLOCK;
+      }
+      o += MIRROR_BLOCK;
+      literal = o;
+      fresh = TRUE;
+      continue;
+    }
+
+    if (o + MIRROR_BLOCK < len) {
+      guint32 out = data[o];
+      guint32 in = data[o + MIRROR_BLOCK];
+      a = a - out + in;
+      b = b - MIRROR_BLOCK * out + a;
+    }
+    o++;
+  }
+
+  /* The tail is in place only if it is the old copy's identical last block */
+  if (literal < len) {
+    gsize tail = len - literal;
+    guint k = (guint)(literal / MIRROR_BLOCK);
+    gboolean same = FALSE;
+
+    if (literal % MIRROR_BLOCK == 0 && k < old->blocks->len &&
+        (gsize)MIN((gint64)MIRROR_BLOCK,
+                   old->size - (gint64)k * MIRROR_BLOCK) == tail) {
+      guint32 ta;
+      guint32 tb;
+      weak_init(data + literal, tail, &ta, &tb);
+      same = blocks[k].weak == weak_value(ta, tb) &&
+             blocks[k].strong == strong_sum(data + literal, tail);
+    }
+
+    if (same) {
+      *matched += tail;
+    } else {
+      add_range(writes, literal, tail);
+    }
+  }
+
+  g_hash_table_destroy(by_weak);
+  return writes;
+}
+
+static gboolean parse_blocks(const gchar *hex, GArray *blocks) {
+  gsize len = strlen(hex);
+
+  if (len % MIRROR_BLOCK_HEX != 0) {
+    return FALSE;
+  }
+
+  for (gsize i = 0; i < len; i += MIRROR_BLOCK_HEX) {
+    gchar weak[9];
+    gchar strong[17];
+    MirrorBlock block;
+
+    memcpy(weak, hex + i, 8);
+    weak[8] = '\0';
+    memcpy(strong, hex + i + 8, 16);
+    strong[16] = '\0';
+    block.weak = (guint32)g_ascii_strtoull(weak, NULL, 16);
+    block.strong = g_ascii_strtoull(strong, NULL, 16);
+    g_array_append_val(blocks, block);
+  }
+  return TRUE;
+}
+
+static void load_manifest(Mirror *m) {
+  gchar *contents = NULL;
+  gchar **lines;
+
+  if (!g_file_get_contents(m->manifest_path, &contents, NULL, NULL)) {
+    return;
+  }
+
+  lines = g_strsplit(contents, "\n", -1);
+  for (gint i = 0; lines[i]; i++) {
+    gchar **fields;
+    MirrorEntry *entry;
+
+    if (lines[i][0] == '\0' || lines[i][0] == '#') {
+      continue;
+    }
+
+    fields = g_strsplit(lines[i], "\t", -1);
+    if (g_strv_length(fields) != 6) {
+      g_strfreev(fields);
+      continue;
+    }
+
+    entry = g_new0(MirrorEntry, 1);
+    entry->size = g_ascii_strtoll(fields[1], NULL, 10);
+    entry->src_mtime = g_ascii_strtoll(fields[2], NULL, 10);
+    entry->dst_mtime = g_ascii_strtoll(fields[3], NULL, 10);
+    entry->hash = g_ascii_strtoull(fields[4], NULL, 16);
+    entry->blocks = g_array_new(FALSE, FALSE, sizeof(MirrorBlock));
+    if (parse_blocks(fields[5], entry->blocks)) {
+      g_hash_table_insert(m->manifest, g_strcompress(fields[0]), entry);
+    } else {
+      mirror_entry_free(entry);
+    }
+    g_strfreev(fields);
+  }
+
+  g_strfreev(lines);
+  g_free(contents);
+}
+
+static gboolean save_manifest(Mirror *m) {
+  GString *out = g_string_new(MIRROR_MANIFEST_HEADER "\n");
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GError *error = NULL;
+  gboolean ok;
+
+  g_hash_table_iter_init(&iter, m->manifest);
+  while (g_hash_table_iter_next(&iter, &key, &value)) {
+    const MirrorEntry *entry = value;
+    gchar *escaped = g_strescape(key, NULL);
+
+    g_string_append_printf(out,
+                           "%s\t%" G_GINT64_FORMAT "\t%" G_GINT64_FORMAT
+                           "\t%" G_GINT64_FORMAT "\t%016" G_GINT64_MODIFIER
+                           "x\t",
+                           escaped, entry->size, entry->src_mtime,
+                           entry->dst_mtime, entry->hash);
+    for (guint i = 0; i < entry->blocks->len; i++) {
+      const MirrorBlock *block = &g_array_index(entry->blocks, MirrorBlock, i);
+      g_string_append_printf(out, "%08x%016" G_GINT64_MODIFIER "x",
+                             block->weak, block->strong);
+    }
+    g_string_append_c(out, '\n');
+    g_free(escaped);
+  }
+
+  ok = g_file_set_contents(m->manifest_path, out->str, (gssize)out->len,
+                           &error);
+  if (!ok) {
+    g_printerr("Failed to save mirror manifest: %s\n", error->message);
+    g_error_free(error);
+  } else {
+    m->pending = 0;
+  }
+  g_string_free(out, TRUE);
+  return ok;
+}
+
+static gboolean pwrite_all(gint fd, const gchar *data, gsize len,
+                           gint64 offset) {
+  while (len > 0) {
+    gssize n = pwrite(fd, data, len, (off_t)offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return FALSE;
+    }
+    data += n;
+    len -= (gsize)n;
+    offset += n;
+  }
+  return TRUE;
+}
+
+static void set_mtime(const gchar *path, gint64 mtime) {
+  struct utimbuf times;
+
+  times.actime = (time_t)(mtime / G_USEC_PER_SEC);
+  times.modtime = (time_t)(mtime / G_USEC_PER_SEC);
+  g_utime(path, &times);
+}
+
+/* Undo an in-place patch that a previous run didn't finish. */
+static gboolean journal_recover(Mirror *m) {
+  gchar *data = NULL;
+  gsize length = 0;
+  gsize pos;
+  guint32 path_len;
+  gchar *rel;
+  gchar *path;
+  gint64 old_size;
+  gint64 old_mtime;
+  gint fd;
+  gboolean ok = TRUE;
+
+  if (!g_file_get_contents(m->journal_path, &data, &length, NULL)) {
+    return TRUE;
+  }
+
+  path_len = length >= MIRROR_MAGIC_LEN + 4
+                 ? get_u32(data + MIRROR_MAGIC_LEN)
+                 : G_MAXUINT32;
+  if (memcmp(data, MIRROR_JOURNAL_MAGIC, MIN(length, MIRROR_MAGIC_LEN)) != 0 ||
+      length < MIRROR_MAGIC_LEN + 4 + 16 ||
+      path_len > length - MIRROR_MAGIC_LEN - 4 - 16) {
+    g_printerr("Discarding unreadable mirror journal '%s'\n", m->journal_path);
+    g_free(data);
+    g_remove(m->journal_path);
+    return TRUE;
+  }
+
+  pos = MIRROR_MAGIC_LEN + 4;
+  rel = g_strndup(data + pos, path_len);
+  pos += path_len;
+  old_size = get_i64(data + pos);
+  old_mtime = get_i64(data + pos + 8);
+  pos += 16;
+
+  path = g_build_filename(m->target, rel, NULL);
+  fd = g_open(path, O_WRONLY, 0);
+  if (fd >= 0) {
+    while (ok && length - pos >= 12) {
+      gint64 offset = get_i64(data + pos);
+      guint32 n = get_u32(data + pos + 8);
+
+      pos += 12;
+      if (n > length - pos) {
+        break;
+      }
+      ok = pwrite_all(fd, data + pos, n, offset);
+      pos += n;
+    }
+    ok = ok && ftruncate(fd, (off_t)old_size) == 0 && fsync(fd) == 0;
+    close(fd);
+    set_mtime(path, old_mtime);
+  }
+
+  if (ok) {
+    g_printerr("Rolled back interrupted mirror update of '%s'\n", rel);
+    g_remove(m->journal_path);
+  } else {
+    g_printerr("Failed to roll back '%s': %s\n", path, g_strerror(errno));
+  }
+
+  g_free(path);
+  g_free(rel);
+  g_free(data);
+  return ok;
+}
+
+/* fsync the directory holding path, so a rename into it is durable */
+static gboolean sync_dir_of(const gchar *path) {
+  gchar *dir = g_path_get_dirname(path);
+  gint fd = g_open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
+  gboolean ok = fd >= 0 && fsync(fd) == 0;
+
+  if (!ok) {
+    g_printerr("Failed to sync '%s': %s\n", dir, g_strerror(errno));
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  g_free(dir);
+  return ok;
+}
+
+/* Save the bytes about to be overwritten so an interruption can be undone */
+static gboolean journal_write(Mirror *m, const gchar *rel, gint fd,
+                              gint64 old_size, gint64 old_mtime,
+                              GArray *writes) {
+  GByteArray *out = g_byte_array_new();
+  GError *error = NULL;
+  gboolean ok = TRUE;
+
+  g_byte_array_append(out, (const guint8 *)MIRROR_JOURNAL_MAGIC,
+                      MIRROR_MAGIC_LEN);
+  put_u32(out, (guint32)strlen(rel));
+  g_byte_array_append(out, (const guint8 *)rel, (guint)strlen(rel));
+  put_i64(out, old_size);
+  put_i64(out, old_mtime);
+
+  for (guint i = 0; ok && i < writes->len; i++) {
+    const MirrorRange *range = &g_array_index(writes, MirrorRange, i);
+    gsize n;
+    guint old_len;
+
+    if ((gint64)range->offset >= old_size) {
+      continue;
+    }
+    n = MIN(range->length, (gsize)(old_size - (gint64)range->offset));
+    put_i64(out, (gint64)range->offset);
+    put_u32(out, (guint32)n);
+    old_len = out->len;
+    g_byte_array_set_size(out, old_len + (guint)n);
+    ok = pread(fd, out->data + old_len, n, (off_t)range->offset) == (gssize)n;
+  }
+
+  /* The journal and its name must be on disk before the first pwrite, or a
+   * crash could leave a half-patched file with nothing to roll it back */
+  if (ok && !g_file_set_contents_full(m->journal_path, (const gchar *)out->data,
+                                      (gssize)out->len,
+                                      G_FILE_SET_CONTENTS_DURABLE, 0666,
+                                      &error)) {
+    g_printerr("Failed to write mirror journal: %s\n", error->message);
+    g_error_free(error);
+    ok = FALSE;
+  }
+  ok = ok && sync_dir_of(m->journal_path);
+
+  g_byte_array_free(out, TRUE);
+  return ok;
+}
+
+static gboolean patch_in_place(Mirror *m, const gchar *rel, const gchar *path,
+                               const GStatBuf *st, const guchar *data,
+                               gsize len, GArray *writes) {
+  gint fd = g_open(path, O_RDWR, 0);
+  gboolean ok;
+
+  if (fd < 0) {
+    return FALSE;
+  }
+
+  ok = journal_write(m, rel, fd, (gint64)st->st_size,
+                     (gint64)st->st_mtime * G_USEC_PER_SEC, writes);
+  for (guint i = 0; ok && i < writes->len; i++) {
+    const MirrorRange *range = &g_array_index(writes, MirrorRange, i);
+    ok = pwrite_all(fd, (const gchar *)data + range->offset, range->length,
+                    (gint64)range->offset);
+  }
+  ok = ok && ftruncate(fd, (off_t)len) == 0 && fsync(fd) == 0;
+  close(fd);
+
+  /* Past this point the new version is durable; the undo is not needed */
+  if (ok) {
+    g_remove(m->journal_path);
+  }
+  return ok;
+}
+
+static gboolean replace_whole(const gchar *path, const guchar *data,
+                              gsize len) {
+  GError *error = NULL;
+  gchar *dir = g_path_get_dirname(path);
+  gboolean ok;
+
+  g_mkdir_with_parents(dir, 0755);
+  g_free(dir);
+
+  ok = g_file_set_contents(path, (const gchar *)data, (gssize)len, &error);
+  if (!ok) {
+    g_printerr("Failed to write '%s': %s\n", path, error->message);
+    g_error_free(error);
+  }
+  return ok;
+}
+
+/* A vanished manifest path whose target copy has exactly this content */
+static gchar *find_renamed(Mirror *m, const MirrorEntry *entry) {
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init(&iter, m->gone);
+  while (g_hash_table_iter_next(&iter, &key, NULL)) {
+    const MirrorEntry *old = g_hash_table_lookup(m->manifest, key);
+    gchar *path;
+    GStatBuf st;
+    gboolean intact;
+
+    if (!old || old->hash != entry->hash || old->size != entry->size) {
+      continue;
+    }
+
+    path = g_build_filename(m->target, (const gchar *)key, NULL);
+    intact = g_stat(path, &st) == 0 && (gint64)st.st_size == old->size &&
+             (gint64)st.st_mtime * G_USEC_PER_SEC == old->dst_mtime;
+    g_free(path);
+    if (intact) {
+      return g_strdup(key);
+    }
+  }
+  return NULL;
+}
+
+static gboolean try_rename(Mirror *m, const gchar *dst,
+                           const MirrorEntry *entry) {
+  gchar *from_rel = find_renamed(m, entry);
+  gchar *from;
+  gchar *dir;
+  gboolean ok;
+
+  if (!from_rel) {
+    return FALSE;
+  }
+
+  from = g_build_filename(m->target, from_rel, NULL);
+  dir = g_path_get_dirname(dst);
+  g_mkdir_with_parents(dir, 0755);
+  ok = g_rename(from, dst) == 0;
+  if (ok) {
+    g_hash_table_remove(m->gone, from_rel);
+    g_hash_table_remove(m->manifest, from_rel);
+  }
+
+  g_free(dir);
+  g_free(from);
+  g_free(from_rel);
+  return ok;
+}
+
+static void mirror_file(Mirror *m, const gchar *rel) {
+  MarkydMirrorStats *stats = m->stats;
+  gchar *src = g_build_filename(m->source, rel, NULL);
+  gchar *dst = g_build_filename(m->target, rel, NULL);
+  MirrorEntry *entry = g_hash_table_lookup(m->manifest, rel);
+  MirrorEntry *fresh;
+  GStatBuf src_st;
+  GStatBuf dst_st;
+  gboolean has_dst;
+  gint64 src_mtime;
+  gchar *data = NULL;
+  gsize len = 0;
+  gboolean ok = TRUE;
+
+  stats->files++;
+
+  if (g_stat(src, &src_st) != 0) {
+    stats->failed++;
+    g_free(dst);
+    g_free(src);
+    return;
+  }
+  src_mtime = (gint64)src_st.st_mtime * G_USEC_PER_SEC;
+  has_dst = g_stat(dst, &dst_st) == 0;
+
+  /* Quick check: both sides still as the manifest left them */
+  if (entry && has_dst && entry->size == (gint64)src_st.st_size &&
+      entry->src_mtime == src_mtime && (gint64)dst_st.st_size == entry->size &&
+      (gint64)dst_st.st_mtime * G_USEC_PER_SEC == entry->dst_mtime) {
+    stats->unchanged++;
+    g_free(dst);
+    g_free(src);
+    return;
+  }
+
+  if (!g_file_get_contents(src, &data, &len, NULL)) {
+    g_printerr("Failed to read '%s'\n", src);
+    stats->failed++;
+    g_free(dst);
+    g_free(src);
+    return;
+  }
+  fresh = mirror_entry_new((const guchar *)data, len);
+  fresh->src_mtime = src_mtime;
+
+  if (!has_dst) {
+    if (try_rename(m, dst, fresh)) {
+      stats->renamed++;
+    } else if ((ok = replace_whole(dst, (const guchar *)data, len))) {
+      stats->created++;
+      stats->bytes_written += len;
+    }
+  } else {
+    MirrorEntry *basis = NULL;
+    MirrorEntry *scanned = NULL;
+    GArray *writes;
+    guint64 written = 0;
+    guint64 matched = 0;
+
+    /* Trust the manifest's checksums only if the copy is untouched */
+    if (entry && (gint64)dst_st.st_size == entry->size &&
+        (gint64)dst_st.st_mtime * G_USEC_PER_SEC == entry->dst_mtime) {
+      basis = entry;
+    } else {
+      gchar *old = NULL;
+      gsize old_len = 0;
+      if (g_file_get_contents(dst, &old, &old_len, NULL)) {
+        basis = scanned = mirror_entry_new((const guchar *)old, old_len);
+        g_free(old);
+      }
+    }
+
+    if (basis) {
+      writes = plan_writes(basis, (const guchar *)data, len, &matched);
+    } else {
+      writes = g_array_new(FALSE, FALSE, sizeof(MirrorRange));
+      add_range(writes, 0, len);
+    }
+    for (guint i = 0; i < writes->len; i++) {
+      written += g_array_index(writes, MirrorRange, i).length;
+    }
+
+    if (basis && writes->len == 0 && basis->size == (gint64)len) {
+      /* Same bytes, only the timestamp differs */
+    } else if (!basis || len < MIRROR_INPLACE_MIN ||
+               basis->size < MIRROR_INPLACE_MIN) {
+      ok = replace_whole(dst, (const guchar *)data, len);
+      written = len;
+      matched = 0;
+    } else {
+      ok = patch_in_place(m, rel, dst, &dst_st, (const guchar *)data, len,
+                          writes);
+      if (!ok) {
+        g_printerr("Failed to update '%s': %s\n", dst, g_strerror(errno));
+      }
+    }
+
+    if (ok) {
+      stats->updated++;
+      stats->bytes_written += written;
+      stats->bytes_matched += matched;
+    }
+    g_array_free(writes, TRUE);
+    if (scanned) {
+      mirror_entry_free(scanned);
+    }
+  }
+
+  if (ok) {
+    set_mtime(dst, src_mtime);
+    fresh->dst_mtime = g_stat(dst, &dst_st) == 0
+                           ? (gint64)dst_st.st_mtime * G_USEC_PER_SEC
+                           : src_mtime;
+    g_hash_table_insert(m->manifest, g_strdup(rel), fresh);
+    if (++m->pending >= MIRROR_CHECKPOINT) {
+      save_manifest(m);
+    }
+  } else {
+    stats->failed++;
+    mirror_entry_free(fresh);
+  }
+
+  g_free(data);
+  g_free(dst);
+  g_free(src);
+}
+
+static void collect_files(const gchar *root, const gchar *rel,
+                          GPtrArray *out) {
+  gchar *dir_path = g_build_filename(root, rel, NULL);
+  GDir *dir = g_dir_open(dir_path, 0, NULL);
+  const gchar *name;
+
+  if (!dir) {
+    g_free(dir_path);
+    return;
+  }
+
+  while ((name = g_dir_read_name(dir)) != NULL) {
+    gchar *child_rel;
+    gchar *child_path;
+
+    /* Hidden files include our own state and editors' temp files */
+    if (name[0] == '.') {
+      continue;
+    }
+
+    child_rel = rel[0] ? g_build_filename(rel, name, NULL) : g_strdup(name);
+    child_path = g_build_filename(root, child_rel, NULL);
+    if (g_file_test(child_path, G_FILE_TEST_IS_DIR)) {
+      collect_files(root, child_rel, out);
+      g_free(child_rel);
+    } else if (g_file_test(child_path, G_FILE_TEST_IS_REGULAR)) {
+      g_ptr_array_add(out, child_rel);
+    } else {
+      g_free(child_rel);
+    }
+    g_free(child_path);
+  }
+
+  g_dir_close(dir);
+  g_free(dir_path);
+}
+
+/* Remove directories emptied by deletes, up to the target root */
+static void prune_empty_dirs(const gchar *target, const gchar *path) {
+  gchar *dir = g_path_get_dirname(path);
+
+  while (g_strcmp0(dir, target) != 0 && g_str_has_prefix(dir, target) &&
+         g_rmdir(dir) == 0) {
+    gchar *parent = g_path_get_dirname(dir);
+    g_free(dir);
+    dir = parent;
+  }
+  g_free(dir);
+}
+
+static void delete_gone(Mirror *m) {
+  GHashTableIter iter;
+  gpointer key;
+
+  g_hash_table_iter_init(&iter, m->gone);
+  while (g_hash_table_iter_next(&iter, &key, NULL)) {
+    gchar *path = g_build_filename(m->target, (const gchar *)key, NULL);
+
+    if (g_remove(path) == 0 || errno == ENOENT) {
+      g_hash_table_remove(m->manifest, key);
+      prune_empty_dirs(m->target, path);
+      m->stats->deleted++;
+      m->pending++;
+    } else {
+      g_printerr("Failed to delete '%s': %s\n", path, g_strerror(errno));
+      m->stats->failed++;
+    }
+    g_free(path);
+  }
+}
+
+gboolean notes_mirror_run(const gchar *source, const gchar *target,
+                          MarkydMirrorStats *stats) {
+  Mirror m = {0};
+  GPtrArray *files;
+  GHashTable *present;
+  GHashTableIter iter;
+  gpointer key;
+  gchar *state_dir;
+  gchar *source_slash;
+  gboolean ok = TRUE;
+
+  memset(stats, 0, sizeof(*stats));
+
+  if (!g_file_test(source, G_FILE_TEST_IS_DIR)) {
+    g_printerr("Nothing to mirror: '%s' is not a directory\n", source);
+    return FALSE;
+  }
+
+  m.source = g_canonicalize_filename(source, NULL);
+  m.target = g_canonicalize_filename(target, NULL);
+  source_slash = g_strconcat(m.source, G_DIR_SEPARATOR_S, NULL);
+  if (g_strcmp0(m.source, m.target) == 0 ||
+      g_str_has_prefix(m.target, source_slash)) {
+    g_printerr("Mirror target must be outside '%s'\n", m.source);
+    g_free(source_slash);
+    g_free(m.target);
+    g_free(m.source);
+    return FALSE;
+  }
+  g_free(source_slash);
+
+  state_dir = g_build_filename(m.target, MIRROR_STATE_DIR, NULL);
+  if (g_mkdir_with_parents(state_dir, 0755) != 0) {
+    g_printerr("Failed to create '%s': %s\n", state_dir, g_strerror(errno));
+    g_free(state_dir);
+    g_free(m.target);
+    g_free(m.source);
+    return FALSE;
+  }
+  m.manifest_path = g_build_filename(state_dir, "manifest", NULL);
+  m.journal_path = g_build_filename(state_dir, "journal", NULL);
+  g_free(state_dir);
+  m.stats = stats;
+  m.manifest = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                     mirror_entry_free);
+  m.gone = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  if (!journal_recover(&m)) {
+    ok = FALSE;
+  } else {
+    load_manifest(&m);
+
+    files = g_ptr_array_new_with_free_func(g_free);
+    collect_files(m.source, "", files);
+    present = g_hash_table_new(g_str_hash, g_str_equal);
+    for (guint i = 0; i < files->len; i++) {
+      g_hash_table_add(present, g_ptr_array_index(files, i));
+    }
+    g_hash_table_iter_init(&iter, m.manifest);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+      if (!g_hash_table_contains(present, key)) {
+        g_hash_table_add(m.gone, g_strdup(key));
+      }
+    }
+    g_hash_table_destroy(present);
+
+    /* Renames are taken out of gone as their new paths are reached */
+    for (guint i = 0; i < files->len; i++) {
+      mirror_file(&m, g_ptr_array_index(files, i));
+    }
+    delete_gone(&m);
+    g_ptr_array_free(files, TRUE);
+
+    ok = save_manifest(&m) && stats->failed == 0;
+  }
+
+  g_hash_table_destroy(m.gone);
+  g_hash_table_destroy(m.manifest);
+  g_free(m.journal_path);
+  g_free(m.manifest_path);
+  g_free(m.target);
+  g_free(m.source);
+  return ok;
+}
@@ -0,0 +1,36 @@
+#ifndef MARKYD_NOTES_MIRROR_H
+#define MARKYD_NOTES_MIRROR_H
+
+#include <glib.h>
+
+/*
+ * One-way mirror of a directory tree to a second local path (a USB drive,
+ * another disk). A manifest in the target remembers size, mtime and block
+ * checksums of every mirrored file, so unchanged files are skipped on stat
+ * alone and changed ones are diffed against the manifest with an rsync-style
+ * rolling checksum. Only blocks whose content at that offset changed are
+ * written; renames and deletes are replayed.
+ *
+ * Small files are replaced atomically. Larger ones are patched in place
+ * behind an undo journal; if a run is interrupted, the next one first rolls
+ * the half-patched file back to its old version.
+ */
+
+typedef struct _MarkydMirrorStats {
+  guint files;     /* Files in the source */
+  guint unchanged; /* Skipped on size and mtime */
+  guint created;
+  guint updated;
+  guint renamed;
+  guint deleted;
+  guint failed;
+  guint64 bytes_written; /* Bytes written to target files */
+  guint64 bytes_matched; /* Bytes of changed files already in place */
+} MarkydMirrorStats;
+
+/* Bring target up to date with source. Returns FALSE if any file failed or
+ * the paths are unusable. */
+gboolean notes_mirror_run(const gchar *source, const gchar *target,
+                          MarkydMirrorStats *stats);
+
+#endif /* MARKYD_NOTES_MIRROR_H */
@@ -0,0 +1,281 @@
+#define _GNU_SOURCE /* statx */
+#include "notes_scan.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define MARKYD_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+/* Below this a plain loop beats setting anything up */
+#define SCAN_BATCH_MIN 64
+/* Requests in flight on the ring */
+#define SCAN_RING_ENTRIES 256
+/* Fallback threads; more than cores, since they mostly wait on the disk */
+#define SCAN_THREADS 16
+
+/* mtimes[i] is -1 until filled */
+#define SCAN_PENDING (-1)
+
+static gint64 mtime_of(gint dirfd, const gchar *name) {
+  struct stat st;
+
+  if (fstatat(dirfd, name, &st, 0) != 0) {
+    return 0;
+  }
+  return (gint64)st.st_mtime * G_USEC_PER_SEC;
+}
+
+#ifdef MARKYD_HAVE_IO_URING
+
+typedef struct _ScanRing {
+  gint fd;
+  guint entries;
+  void *sq_ring;
+  gsize sq_ring_len;
+  void *cq_ring;
+  gsize cq_ring_len;
+  struct io_uring_sqe *sqes;
+  gsize sqes_len;
+  guint *sq_tail;
+  guint *sq_mask;
+  guint *sq_array;
+  guint *cq_head;
+  guint *cq_tail;
+  guint *cq_mask;
+  struct io_uring_cqe *cqes;
+} ScanRing;
+
+static void ring_close(ScanRing *ring) {
+  if (ring->sqes) {
+    munmap(ring->sqes, ring->sqes_len);
+  }
+  if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+    munmap(ring->cq_ring, ring->cq_ring_len);
+  }
+  if (ring->sq_ring) {
+    munmap(ring->sq_ring, ring->sq_ring_len);
+  }
+  if (ring->fd >= 0) {
+    close(ring->fd);
+  }
+}
+
+static void *ring_map(gint fd, gsize len, off_t offset) {
+  void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+  return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/* Set up a ring by hand; liburing isn't worth a dependency for one opcode.
+ * Fails (seccomp, old kernel, io_uring disabled) leave ring->fd < 0. */
+static gboolean ring_open(ScanRing *ring) {
+  struct io_uring_params params;
+  guint8 *sq;
+  guint8 *cq;
+
+  memset(ring, 0, sizeof(*ring));
+  memset(&params, 0, sizeof(params));
+  ring->fd = (gint)syscall(__NR_io_uring_setup, SCAN_RING_ENTRIES, &params);
+  if (ring->fd < 0) {
+    return FALSE;
+  }
+
+  ring->entries = params.sq_entries;
+  ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(guint);
+  ring->cq_ring_len = params.cq_off.cqes +
+                      params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->sq_ring_len = ring->cq_ring_len =
+        MAX(ring->sq_ring_len, ring->cq_ring_len);
+  }
+
+  ring->sq_ring = ring_map(ring->fd, ring->sq_ring_len, IORING_OFF_SQ_RING);
+  ring->cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP)
+                      ? ring->sq_ring
+                      : ring_map(ring->fd, ring->cq_ring_len,
+                                 IORING_OFF_CQ_RING);
+  ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = ring_map(ring->fd, ring->sqes_len, IORING_OFF_SQES);
+  if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) {
+    ring_close(ring);
+    ring->fd = -1;
+    return FALSE;
+  }
+
+  sq = ring->sq_ring;
+  cq = ring->cq_ring;
+  ring->sq_tail = (guint *)(sq + params.sq_off.tail);
+  ring->sq_mask = (guint *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (guint *)(sq + params.sq_off.array);
+  ring->cq_head = (guint *)(cq + params.cq_off.head);
+  ring->cq_tail = (guint *)(cq + params.cq_off.tail);
+  ring->cq_mask = (guint *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  return TRUE;
+}
+
+/*
+ * Keep up to the ring size of statx requests in flight, each with its own
+ * result slot. Entries the kernel rejects stay SCAN_PENDING for the
+ * fallback; returns FALSE if the ring itself fails.
+ */
+static gboolean scan_with_ring(gint dirfd, GPtrArray *names, gint64 *mtimes) {
+  ScanRing ring;
+  struct statx *slots;
+  guint *free_slots;
+  guint n_free;
+  guint next = 0;
+  guint inflight = 0;
+  guint unsubmitted = 0;
+  gboolean ok = TRUE;
+
+  if (!ring_open(&ring)) {
+    return FALSE;
+  }
+
+  slots = g_new(struct statx, ring.entries);
+  free_slots = g_new(guint, ring.entries);
+  for (n_free = 0; n_free < ring.entries; n_free++) {
+    free_slots[n_free] = n_free;
+  }
+
+  while (ok && (next < names->len || inflight > 0)) {
+    guint tail = *ring.sq_tail;
+    guint head;
+    gint ret;
+
+    while (next < names->len && n_free > 0) {
+      guint index = tail & *ring.sq_mask;
+      struct io_uring_sqe *sqe = &ring.sqes[index];
+      guint slot = free_slots[--n_free];
+
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = dirfd;
+      sqe->addr = (guint64)(guintptr)g_ptr_array_index(names, next);
+      sqe->len = STATX_MTIME;
+      sqe->off = (guint64)(guintptr)&slots[slot];
+      sqe->user_data = ((guint64)slot << 32) | next;
+      ring.sq_array[index] = index;
+      tail++;
+      next++;
+      inflight++;
+      unsubmitted++;
+    }
+    __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+    ret = (gint)syscall(__NR_io_uring_enter, ring.fd, unsubmitted, 1,
+                        IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0) {
+      ok = errno == EINTR || errno == EAGAIN;
+      continue;
+    }
+    unsubmitted -= (guint)ret;
+
+    head = *ring.cq_head;
+    while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+      guint slot = (guint)(cqe->user_data >> 32);
+      guint i = (guint)(cqe->user_data & G_MAXUINT32);
+
+      if (cqe->res == 0) {
+        mtimes[i] = (gint64)slots[slot].stx_mtime.tv_sec * G_USEC_PER_SEC;
+      } else if (cqe->res != -EINVAL && cqe->res != -EOPNOTSUPP) {
+        mtimes[i] = 0; /* Vanished or unreadable, as with stat() */
+      }
+      free_slots[n_free++] = slot;
+      inflight--;
+      head++;
+    }
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  g_free(free_slots);
+  ring_close(&ring);
+  /* After a failed enter the kernel may still own some slots; leak them */
+  if (inflight == 0) {
+    g_free(slots);
+  }
+  return ok;
+}
+
+#endif /* MARKYD_HAVE_IO_URING */
+
+typedef struct _ScanJob {
+  gint dirfd;
+  GPtrArray *names;
+  gint64 *mtimes;
+  gint next; /* Atomic */
+} ScanJob;
+
+static gpointer scan_worker(gpointer data) {
+  ScanJob *job = data;
+  gint i;
+
+  while ((i = g_atomic_int_add(&job->next, 1)) < (gint)job->names->len) {
+    if (job->mtimes[i] == SCAN_PENDING) {
+      job->mtimes[i] = mtime_of(job->dirfd, g_ptr_array_index(job->names, i));
+    }
+  }
+  return NULL;
+}
+
+static void scan_with_threads(gint dirfd, GPtrArray *names, gint64 *mtimes) {
+  ScanJob job = {dirfd, names, mtimes, 0};
+  guint n_threads = MIN(SCAN_THREADS, names->len / SCAN_BATCH_MIN + 1);
+  GThread *threads[SCAN_THREADS];
+
+  for (guint t = 1; t < n_threads; t++) {
+    threads[t] = g_thread_new("traymd-scan", scan_worker, &job);
+  }
+  scan_worker(&job);
+  for (guint t = 1; t < n_threads; t++) {
+    g_thread_join(threads[t]);
+  }
+}
+
+void notes_scan_mtimes(const gchar *dir, GPtrArray *names, gint64 *mtimes) {
+  gint dirfd;
+  guint pending = 0;
+
+  for (guint i = 0; i < names->len; i++) {
+    mtimes[i] = SCAN_PENDING;
+  }
+
+  dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd < 0) {
+    memset(mtimes, 0, sizeof(gint64) * names->len);
+    return;
+  }
+
+#ifdef MARKYD_HAVE_IO_URING
+  if (names->len >= SCAN_BATCH_MIN) {
+    scan_with_ring(dirfd, names, mtimes);
+  }
+#endif
+
+  /* Whatever the ring didn't cover (or everything, without one) */
+  for (guint i = 0; i < names->len; i++) {
+    pending += mtimes[i] == SCAN_PENDING;
+  }
+  if (pending >= SCAN_BATCH_MIN) {
+    scan_with_threads(dirfd, names, mtimes);
+  } else if (pending > 0) {
+    for (guint i = 0; i < names->len; i++) {
+      if (mtimes[i] == SCAN_PENDING) {
+        mtimes[i] = mtime_of(dirfd, g_ptr_array_index(names, i));
+      }
+    }
+  }
+
+  close(dirfd);
+}
@@ -0,0 +1,17 @@
+#ifndef MARKYD_NOTES_SCAN_H
+#define MARKYD_NOTES_SCAN_H
+
+#include <glib.h>
+
+/*
+ * Batched stat of many files in one directory. On a cold cache one blocking
+ * stat() at a time leaves a spinning disk seeking back and forth; here all
+ * requests are in flight together so the I/O scheduler can order them. Uses
+ * io_uring statx where the kernel allows it, otherwise a pool of threads.
+ */
+
+/* Fill mtimes[i] (microseconds, 0 if the file can't be stat'ed) for each
+ * names[i] inside dir. */
+void notes_scan_mtimes(const gchar *dir, GPtrArray *names, gint64 *mtimes);
+
+#endif /* MARKYD_NOTES_SCAN_H */
@@ -0,0 +1,449 @@
+#include "notes_sqlite.h"
+#include "notes_chunked.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <utime.h>
+
+static sqlite3 *db = NULL;
+static gchar *db_notes_dir = NULL;
+static gboolean fts_enabled = FALSE;
+
+static const gchar *SCHEMA_SQL =
+    "PRAGMA journal_mode=WAL;"
+    "PRAGMA synchronous=NORMAL;"
+    "CREATE TABLE IF NOT EXISTS notes("
+    "  id INTEGER PRIMARY KEY,"
+    "  name TEXT NOT NULL UNIQUE,"
+    "  mtime INTEGER NOT NULL,"
+    "  content TEXT NOT NULL DEFAULT ''"
+    ");"
+    "CREATE INDEX IF NOT EXISTS notes_mtime ON notes(mtime DESC);";
+
+/* Kept separate so a SQLite built without FTS5 still works (minus search). */
+static const gchar *FTS_SCHEMA_SQL =
+    "CREATE VIRTUAL TABLE IF NOT EXISTS notes_fts USING fts5("
+    "  content, content='notes', content_rowid='id');"
+    "CREATE TRIGGER IF NOT EXISTS notes_ai AFTER INSERT ON notes BEGIN"
+    "  INSERT INTO notes_fts(rowid, content) VALUES (new.id, new.content);"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS notes_ad AFTER DELETE ON notes BEGIN"
+    "  INSERT INTO notes_fts(notes_fts, rowid, content)"
+    "  VALUES ('delete', old.id, old.content);"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS notes_au AFTER UPDATE OF content ON notes "
+    "BEGIN"
+    "  INSERT INTO notes_fts(notes_fts, rowid, content)"
+    "  VALUES ('delete', old.id, old.content);"
+    "  INSERT INTO notes_fts(rowid, content) VALUES (new.id, new.content);"
+    "END;";
+
+typedef enum _NotesStmt {
+  STMT_LIST = 0,
+  STMT_COUNT,
+  STMT_LOAD,
+  STMT_UPSERT,
+  STMT_INSERT_NEW,
+  STMT_DELETE,
+  STMT_SEARCH,
+  STMT_EXPORT,
+  STMT_LAST
+} NotesStmt;
+
+static const gchar *const STMT_SQL[STMT_LAST] = {
+    [STMT_LIST] = "SELECT name FROM notes ORDER BY mtime DESC",
+    [STMT_COUNT] = "SELECT COUNT(*) FROM notes",
+    [STMT_LOAD] = "SELECT content FROM notes WHERE name = ?1",
+    [STMT_UPSERT] = "INSERT INTO notes(name, mtime, content) VALUES (?1, ?2, ?3) "
+                    "ON CONFLICT(name) DO UPDATE SET "
+                    "mtime = excluded.mtime, content = excluded.content",
+    [STMT_INSERT_NEW] =
+        "INSERT OR IGNORE INTO notes(name, mtime, content) VALUES (?1, ?2, ?3)",
+    [STMT_DELETE] = "DELETE FROM notes WHERE name = ?1",
+    [STMT_SEARCH] = "SELECT n.name FROM notes_fts JOIN notes n "
+                    "ON n.id = notes_fts.rowid WHERE notes_fts MATCH ?1 "
+                    "ORDER BY n.mtime DESC",
+    [STMT_EXPORT] = "SELECT name, mtime, content FROM notes",
+};
+
+static sqlite3_stmt *stmts[STMT_LAST];
+
+static gboolean exec_sql(const gchar *sql) {
+  char *errmsg = NULL;
+
+  if (sqlite3_exec(db, sql, NULL, NULL, &errmsg) != SQLITE_OK) {
+    g_printerr("SQLite error: %s\n", errmsg ? errmsg : sqlite3_errmsg(db));
+    sqlite3_free(errmsg);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* Prepared statements are compiled once and reset on every reuse. */
+static sqlite3_stmt *get_stmt(NotesStmt id) {
+  if (!db) {
+    return NULL;
+  }
+
+  if (!stmts[id]) {
+    if (sqlite3_prepare_v2(db, STMT_SQL[id], -1, &stmts[id], NULL) !=
+        SQLITE_OK) {
+      g_printerr("Failed to prepare statement: %s\n", sqlite3_errmsg(db));
+      stmts[id] = NULL;
+      return NULL;
+    }
+  } else {
+    sqlite3_reset(stmts[id]);
+    sqlite3_clear_bindings(stmts[id]);
+  }
+
+  return stmts[id];
+}
+
+static gchar *name_to_path(const unsigned char *name) {
+  return g_build_filename(db_notes_dir, (const gchar *)name, NULL);
+}
+
+static GPtrArray *collect_paths(sqlite3_stmt *stmt) {
+  GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+  gint rc;
+
+  if (!stmt) {
+    return paths;
+  }
+
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    g_ptr_array_add(paths, name_to_path(sqlite3_column_text(stmt, 0)));
+  }
+  if (rc != SQLITE_DONE) {
+    g_printerr("Failed to list notes: %s\n", sqlite3_errmsg(db));
+  }
+  sqlite3_reset(stmt);
+
+  return paths;
+}
+
+static gboolean upsert_note(const gchar *name, gint64 mtime,
+                            const gchar *content) {
+  sqlite3_stmt *stmt = get_stmt(STMT_UPSERT);
+  gboolean ok;
+
+  if (!stmt) {
+    return FALSE;
+  }
+
+  sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, mtime);
+  sqlite3_bind_text(stmt, 3, content ? content : "", -1, SQLITE_STATIC);
+  ok = (sqlite3_step(stmt) == SQLITE_DONE);
+  if (!ok) {
+    g_printerr("Failed to save note: %s\n", sqlite3_errmsg(db));
+  }
+  sqlite3_reset(stmt);
+
+  return ok;
+}
+
+gboolean notes_sqlite_open(const gchar *db_path, const gchar *notes_dir) {
+  if (db) {
+    notes_sqlite_close();
+  }
+
+  if (sqlite3_open(db_path, &db) != SQLITE_OK) {
+    g_printerr("Failed to open notes database '%s': %s\n", db_path,
+               db ? sqlite3_errmsg(db) : "out of memory");
+    sqlite3_close(db);
+    db = NULL;
+    return FALSE;
+  }
+
+  sqlite3_busy_timeout(db, 2000);
+
+  if (!exec_sql(SCHEMA_SQL)) {
+    notes_sqlite_close();
+    return FALSE;
+  }
+
+  fts_enabled = exec_sql(FTS_SCHEMA_SQL);
+  if (!fts_enabled) {
+    g_printerr("SQLite FTS5 unavailable; note search is disabled\n");
+  }
+
+  db_notes_dir = g_strdup(notes_dir);
+  return TRUE;
+}
+
+void notes_sqlite_close(void) {
+  for (guint i = 0; i < STMT_LAST; i++) {
+    if (stmts[i]) {
+      sqlite3_finalize(stmts[i]);
+      stmts[i] = NULL;
+    }
+  }
+
+  if (db) {
+    sqlite3_close(db);
+    db = NULL;
+  }
+
+  g_clear_pointer(&db_notes_dir, g_free);
+  fts_enabled = FALSE;
+}
+
+GPtrArray *notes_sqlite_list(void) { return collect_paths(get_stmt(STMT_LIST)); }
+
+gchar *notes_sqlite_create(void) {
+  time_t now;
+  struct tm *tm_info;
+  gchar timestamp[32];
+
+  now = time(NULL);
+  tm_info = localtime(&now);
+  strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S", tm_info);
+
+  return notes_sqlite_insert(timestamp, g_get_real_time(), "");
+}
+
+gchar *notes_sqlite_insert(const gchar *stem, gint64 mtime,
+                           const gchar *content) {
+  /* Same naming as the file backend, with a suffix on clashes. */
+  for (gint attempt = 0; attempt < 1000; attempt++) {
+    sqlite3_stmt *stmt = get_stmt(STMT_INSERT_NEW);
+    gchar *filename;
+    gint rc;
+
+    if (!stmt) {
+      return NULL;
+    }
+
+    filename = attempt == 0 ? g_strdup_printf("%s.md", stem)
+                            : g_strdup_printf("%s_%d.md", stem, attempt);
+    sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, mtime > 0 ? mtime : g_get_real_time());
+    sqlite3_bind_text(stmt, 3, content ? content : "", -1, SQLITE_STATIC);
+    rc = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+
+    if (rc != SQLITE_DONE) {
+      g_printerr("Failed to create note: %s\n", sqlite3_errmsg(db));
+      g_free(filename);
+      return NULL;
+    }
+
+    if (sqlite3_changes(db) == 1) {
+      gchar *path = g_build_filename(db_notes_dir, filename, NULL);
+      g_free(filename);
+      return path;
+    }
+    g_free(filename);
+  }
+
+  g_printerr("Failed to create note: no free name for %s\n", stem);
+  return NULL;
+}
+
+gboolean notes_sqlite_begin(void) { return db && exec_sql("BEGIN"); }
+
+gboolean notes_sqlite_commit(void) {
+  if (!db) {
+    return FALSE;
+  }
+  if (!exec_sql("COMMIT")) {
+    exec_sql("ROLLBACK");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+gchar *notes_sqlite_load(const gchar *path) {
+  sqlite3_stmt *stmt = get_stmt(STMT_LOAD);
+  gchar *name;
+  gchar *content = NULL;
+
+  if (!stmt || !path) {
+    return NULL;
+  }
+
+  name = g_path_get_basename(path);
+  sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    const unsigned char *text = sqlite3_column_text(stmt, 0);
+    gint len = sqlite3_column_bytes(stmt, 0);
+    content = text ? g_strndup((const gchar *)text, (gsize)len) : g_strdup("");
+  } else {
+    g_printerr("Failed to load note: '%s' not found\n", name);
+  }
+  sqlite3_reset(stmt);
+  g_free(name);
+
+  return content;
+}
+
+gboolean notes_sqlite_save(const gchar *path, const gchar *content) {
+  gchar *name;
+  gboolean ok;
+
+  if (!path) {
+    return FALSE;
+  }
+
+  name = g_path_get_basename(path);
+  ok = upsert_note(name, g_get_real_time(), content);
+  g_free(name);
+  return ok;
+}
+
+gboolean notes_sqlite_delete(const gchar *path) {
+  sqlite3_stmt *stmt = get_stmt(STMT_DELETE);
+  gchar *name;
+  gboolean ok;
+
+  if (!stmt || !path) {
+    return FALSE;
+  }
+
+  name = g_path_get_basename(path);
+  sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+  ok = (sqlite3_step(stmt) == SQLITE_DONE && sqlite3_changes(db) > 0);
+  if (!ok) {
+    g_printerr("Failed to delete note '%s': %s\n", name, sqlite3_errmsg(db));
+  }
+  sqlite3_reset(stmt);
+  g_free(name);
+
+  return ok;
+}
+
+gint notes_sqlite_count(void) {
+  sqlite3_stmt *stmt = get_stmt(STMT_COUNT);
+  gint count = 0;
+
+  if (!stmt) {
+    return 0;
+  }
+
+  if (sqlite3_step(stmt) == SQLITE_ROW) {
+    count = sqlite3_column_int(stmt, 0);
+  }
+  sqlite3_reset(stmt);
+
+  return count;
+}
+
+GPtrArray *notes_sqlite_search(const gchar *query) {
+  sqlite3_stmt *stmt;
+
+  if (!fts_enabled || !query || !*query) {
+    return g_ptr_array_new_with_free_func(g_free);
+  }
+
+  stmt = get_stmt(STMT_SEARCH);
+  if (stmt) {
+    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_STATIC);
+  }
+  return collect_paths(stmt);
+}
+
+gint notes_sqlite_import_dir(const gchar *dir) {
+  GDir *gdir;
+  const gchar *filename;
+  GError *error = NULL;
+  gint imported = 0;
+
+  if (!db) {
+    return -1;
+  }
+
+  gdir = g_dir_open(dir, 0, &error);
+  if (!gdir) {
+    g_printerr("Failed to open import directory: %s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  /* One transaction: per-row commits would fsync the WAL for every note. */
+  if (!exec_sql("BEGIN")) {
+    g_dir_close(gdir);
+    return -1;
+  }
+
+  while ((filename = g_dir_read_name(gdir)) != NULL) {
+    gchar *path;
+    gchar *content = NULL;
+    GStatBuf st;
+
+    if (!g_str_has_suffix(filename, ".md")) {
+      continue;
+    }
+
+    path = g_build_filename(dir, filename, NULL);
+    if (notes_chunked_is(path)) {
+      content = notes_chunked_load(path, NULL);
+    }
+    if (g_stat(path, &st) == 0 &&
+        (content || g_file_get_contents(path, &content, NULL, NULL))) {
+      if (upsert_note(filename, (gint64)st.st_mtime * G_USEC_PER_SEC,
+                      content)) {
+        imported++;
+      }
+    } else {
+      g_printerr("Skipping unreadable note '%s'\n", path);
+    }
+    g_free(content);
+    g_free(path);
+  }
+
+  g_dir_close(gdir);
+
+  if (!exec_sql("COMMIT")) {
+    exec_sql("ROLLBACK");
+    return -1;
+  }
+
+  return imported;
+}
+
+gint notes_sqlite_export_dir(const gchar *dir) {
+  sqlite3_stmt *stmt = get_stmt(STMT_EXPORT);
+  gint exported = 0;
+  gint rc;
+
+  if (!stmt) {
+    return -1;
+  }
+
+  if (g_mkdir_with_parents(dir, 0755) != 0) {
+    g_printerr("Failed to create export directory: %s\n", g_strerror(errno));
+    return -1;
+  }
+
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const gchar *name = (const gchar *)sqlite3_column_text(stmt, 0);
+    gint64 mtime = sqlite3_column_int64(stmt, 1);
+    const gchar *content = (const gchar *)sqlite3_column_text(stmt, 2);
+    gint len = sqlite3_column_bytes(stmt, 2);
+    gchar *path = g_build_filename(dir, name, NULL);
+    GError *error = NULL;
+
+    if (g_file_set_contents(path, content ? content : "", len, &error)) {
+      struct utimbuf times;
+      times.actime = (time_t)(mtime / G_USEC_PER_SEC);
+      times.modtime = times.actime;
+      g_utime(path, &times);
+      exported++;
+    } else {
+      g_printerr("Failed to export note: %s\n", error->message);
+      g_error_free(error);
+    }
+    g_free(path);
+  }
+  if (rc != SQLITE_DONE) {
+    g_printerr("Failed to export notes: %s\n", sqlite3_errmsg(db));
+  }
+  sqlite3_reset(stmt);
+
+  return exported;
+}
@@ -0,0 +1,40 @@
+#ifndef MARKYD_NOTES_SQLITE_H
+#define MARKYD_NOTES_SQLITE_H
+
+#include <glib.h>
+
+/*
+ * SQLite-backed note store. Notes keep their "<notes_dir>/<name>.md" paths so
+ * callers of notes.h never see the difference; the path basename is the key.
+ */
+
+/* Open (or create) the database at db_path; note paths are built under
+ * notes_dir. */
+gboolean notes_sqlite_open(const gchar *db_path, const gchar *notes_dir);
+void notes_sqlite_close(void);
+
+GPtrArray *notes_sqlite_list(void);
+gchar *notes_sqlite_create(void);
+
+/* Insert a note named stem.md (stem_N.md on clashes); returns its path */
+gchar *notes_sqlite_insert(const gchar *stem, gint64 mtime,
+                           const gchar *content);
+
+/* Group many writes into one transaction */
+gboolean notes_sqlite_begin(void);
+gboolean notes_sqlite_commit(void);
+gchar *notes_sqlite_load(const gchar *path);
+gboolean notes_sqlite_save(const gchar *path, const gchar *content);
+gboolean notes_sqlite_delete(const gchar *path);
+gint notes_sqlite_count(void);
+
+/* Full-text search (FTS5 query syntax), newest first */
+GPtrArray *notes_sqlite_search(const gchar *query);
+
+/* Copy every .md file in dir into the database, keeping file mtimes */
+gint notes_sqlite_import_dir(const gchar *dir);
+
+/* Write every note to dir as <name>.md, restoring mtimes */
+gint notes_sqlite_export_dir(const gchar *dir);
+
+#endif /* MARKYD_NOTES_SQLITE_H */
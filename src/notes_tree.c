@@ -0,0 +1,171 @@
+#include "notes_tree.h"
+#include <string.h>
+
+typedef struct _TreeNode {
+  gint count;          /* Notes directly inside, -1 if not counted yet */
+  GPtrArray *children; /* Child notebook paths, NULL until enumerated */
+} TreeNode;
+
+static gchar *tree_root = NULL;
+static GHashTable *nodes = NULL; /* notebook -> TreeNode */
+static GMutex tree_lock;          /* Guards nodes */
+
+static void tree_node_free(gpointer data) {
+  TreeNode *node = data;
+
+  if (node->children) {
+    g_ptr_array_free(node->children, TRUE);
+  }
+  g_free(node);
+}
+
+static gint compare_names(gconstpointer a, gconstpointer b) {
+  return g_utf8_collate(*(const gchar **)a, *(const gchar **)b);
+}
+
+/* Cached node for notebook (tree_lock held) */
+static TreeNode *lookup_node(const gchar *notebook) {
+  TreeNode *node = g_hash_table_lookup(nodes, notebook);
+
+  if (!node) {
+    node = g_new0(TreeNode, 1);
+    node->count = -1;
+    g_hash_table_insert(nodes, g_strdup(notebook), node);
+  }
+
+  return node;
+}
+
+/*
+ * One pass over the folder. Counting only looks at names; finding child
+ * notebooks needs a stat per non-note entry, so it's skipped unless wanted.
+ */
+static void scan_folder(const gchar *notebook, const gchar *dir,
+                        TreeNode *node, gboolean want_children) {
+  GDir *handle;
+  const gchar *filename;
+  gint count = 0;
+  GPtrArray *children =
+      want_children ? g_ptr_array_new_with_free_func(g_free) : NULL;
+
+  handle = g_dir_open(dir, 0, NULL);
+  if (handle) {
+    while ((filename = g_dir_read_name(handle)) != NULL) {
+      if (g_str_has_suffix(filename, ".md")) {
+        count++;
+      } else if (children && filename[0] != '.') {
+        gchar *path = g_build_filename(dir, filename, NULL);
+        if (g_file_test(path, G_FILE_TEST_IS_DIR)) {
+          g_ptr_array_add(children,
+                          notebook[0] ? g_build_filename(notebook, filename,
+                                                         NULL)
+                                      : g_strdup(filename));
+        }
+        g_free(path);
+      }
+    }
+    g_dir_close(handle);
+  }
+
+  node->count = count;
+  if (children) {
+    g_ptr_array_sort(children, compare_names);
+    node->children = children;
+  }
+}
+
+void notes_tree_init(const gchar *root) {
+  notes_tree_cleanup();
+
+  g_mutex_lock(&tree_lock);
+  tree_root = g_strdup(root);
+  nodes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                tree_node_free);
+  g_mutex_unlock(&tree_lock);
+}
+
+void notes_tree_cleanup(void) {
+  g_mutex_lock(&tree_lock);
+  g_clear_pointer(&nodes, g_hash_table_destroy);
+  g_clear_pointer(&tree_root, g_free);
+  g_mutex_unlock(&tree_lock);
+}
+
+GPtrArray *notes_tree_children(const gchar *notebook) {
+  GPtrArray *result = g_ptr_array_new_with_free_func(g_free);
+  gchar *dir;
+  TreeNode *node;
+
+  g_mutex_lock(&tree_lock);
+  if (!nodes) {
+    g_mutex_unlock(&tree_lock);
+    return result;
+  }
+
+  notebook = notebook ? notebook : "";
+  node = lookup_node(notebook);
+  if (!node->children) {
+    dir = g_build_filename(tree_root, notebook, NULL);
+    scan_folder(notebook, dir, node, TRUE);
+    g_free(dir);
+  }
+
+  for (guint i = 0; i < node->children->len; i++) {
+    g_ptr_array_add(result, g_strdup(g_ptr_array_index(node->children, i)));
+  }
+  g_mutex_unlock(&tree_lock);
+  return result;
+}
+
+gint notes_tree_count(const gchar *notebook) {
+  gchar *dir;
+  TreeNode *node;
+  gint count;
+
+  g_mutex_lock(&tree_lock);
+  if (!nodes) {
+    g_mutex_unlock(&tree_lock);
+    return 0;
+  }
+
+  notebook = notebook ? notebook : "";
+  node = lookup_node(notebook);
+  if (node->count < 0) {
+    dir = g_build_filename(tree_root, notebook, NULL);
+    scan_folder(notebook, dir, node, FALSE);
+    g_free(dir);
+  }
+  count = node->count;
+  g_mutex_unlock(&tree_lock);
+
+  return count;
+}
+
+void notes_tree_invalidate(const gchar *notebook) {
+  g_mutex_lock(&tree_lock);
+  if (nodes) {
+    g_hash_table_remove(nodes, notebook ? notebook : "");
+  }
+  g_mutex_unlock(&tree_lock);
+}
+
+void notes_tree_invalidate_path(const gchar *notebook) {
+  gchar *path = g_strdup(notebook ? notebook : "");
+
+  g_mutex_lock(&tree_lock);
+  while (nodes) {
+    gchar *slash = strrchr(path, G_DIR_SEPARATOR);
+
+    g_hash_table_remove(nodes, path);
+    if (!path[0]) {
+      break;
+    }
+    if (slash) {
+      *slash = '\0';
+    } else {
+      path[0] = '\0';
+    }
+  }
+  g_mutex_unlock(&tree_lock);
+  g_free(path);
+}
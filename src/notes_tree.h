@@ -0,0 +1,30 @@
+#ifndef MARKYD_NOTES_TREE_H
+#define MARKYD_NOTES_TREE_H
+
+#include <glib.h>
+
+/*
+ * Notebook tree index. Notebooks are subdirectories of the notes dir, named by
+ * their path relative to it ("" is the top level). A folder is only read when
+ * its count or children are first asked for, and the result is cached until
+ * it is invalidated. Saves rewrite notes in place (an atomic rename bumps the
+ * folder's mtime), so only creating and deleting notes or notebooks
+ * invalidates. Thread-safe.
+ */
+
+void notes_tree_init(const gchar *root);
+void notes_tree_cleanup(void);
+
+/* Child notebooks of notebook, sorted by name (caller must free) */
+GPtrArray *notes_tree_children(const gchar *notebook);
+
+/* Number of notes directly inside notebook */
+gint notes_tree_count(const gchar *notebook);
+
+/* Drop cached data for notebook (after creating/deleting notes in it) */
+void notes_tree_invalidate(const gchar *notebook);
+
+/* Drop notebook and every notebook above it (after creating folders) */
+void notes_tree_invalidate_path(const gchar *notebook);
+
+#endif /* MARKYD_NOTES_TREE_H */
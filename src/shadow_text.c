@@ -0,0 +1,132 @@
+#include "shadow_text.h"
+#include <string.h>
+
+/* Room left at the gap after growing, so typing doesn't reallocate */
+#define SHADOW_MIN_GAP 4096
+
+struct _MarkydShadowText {
+  gchar *data;
+  gsize size;      /* Bytes allocated */
+  gsize gap_start; /* The text is [0, gap_start) then [gap_end, size) */
+  gsize gap_end;
+  gint gap_chars;  /* Characters before the gap */
+};
+
+MarkydShadowText *markyd_shadow_text_new(void) {
+  MarkydShadowText *shadow = g_new0(MarkydShadowText, 1);
+
+  shadow->size = SHADOW_MIN_GAP;
+  shadow->data = g_malloc(shadow->size);
+  shadow->gap_end = shadow->size;
+  return shadow;
+}
+
+void markyd_shadow_text_free(MarkydShadowText *shadow) {
+  if (!shadow) {
+    return;
+  }
+  g_free(shadow->data);
+  g_free(shadow);
+}
+
+void markyd_shadow_text_set(MarkydShadowText *shadow, const gchar *text) {
+  gsize length = text ? strlen(text) : 0;
+
+  g_free(shadow->data);
+  shadow->size = length + SHADOW_MIN_GAP;
+  shadow->data = g_malloc(shadow->size);
+  if (length > 0) {
+    memcpy(shadow->data, text, length);
+  }
+  shadow->gap_start = length;
+  shadow->gap_end = shadow->size;
+  shadow->gap_chars = text ? (gint)g_utf8_strlen(text, (gssize)length) : 0;
+}
+
+/* Put the gap at character offset (clamped to the text) */
+static void move_gap(MarkydShadowText *shadow, gint offset) {
+  gsize moved;
+
+  if (offset > shadow->gap_chars) {
+    const gchar *p = shadow->data + shadow->gap_end;
+    const gchar *end = shadow->data + shadow->size;
+
+    while (shadow->gap_chars < offset && p < end) {
+      p = g_utf8_next_char(p);
+      shadow->gap_chars++;
+    }
+    moved = (gsize)(p - (shadow->data + shadow->gap_end));
+    memmove(shadow->data + shadow->gap_start, shadow->data + shadow->gap_end,
+            moved);
+    shadow->gap_start += moved;
+    shadow->gap_end += moved;
+  } else if (offset < shadow->gap_chars) {
+    const gchar *p = shadow->data + shadow->gap_start;
+
+    while (shadow->gap_chars > offset && p > shadow->data) {
+      p = g_utf8_prev_char(p);
+      shadow->gap_chars--;
+    }
+    moved = (gsize)(shadow->data + shadow->gap_start - p);
+    memmove(shadow->data + shadow->gap_end - moved, p, moved);
+    shadow->gap_start -= moved;
+    shadow->gap_end -= moved;
+  }
+}
+
+/* At least need bytes in the gap, plus one for peek's NUL */
+static void ensure_gap(MarkydShadowText *shadow, gsize need) {
+  gsize tail = shadow->size - shadow->gap_end;
+  gsize size;
+
+  if (shadow->gap_end - shadow->gap_start > need) {
+    return;
+  }
+
+  size = MAX(shadow->size * 2, shadow->size + need + SHADOW_MIN_GAP);
+  shadow->data = g_realloc(shadow->data, size);
+  memmove(shadow->data + size - tail, shadow->data + shadow->gap_end, tail);
+  shadow->gap_end = size - tail;
+  shadow->size = size;
+}
+
+void markyd_shadow_text_insert(MarkydShadowText *shadow, gint offset,
+                               const gchar *text, gssize len) {
+  gsize n_bytes = len < 0 ? strlen(text) : (gsize)len;
+
+  if (n_bytes == 0) {
+    return;
+  }
+
+  move_gap(shadow, offset);
+  ensure_gap(shadow, n_bytes);
+  memcpy(shadow->data + shadow->gap_start, text, n_bytes);
+  shadow->gap_start += n_bytes;
+  shadow->gap_chars += (gint)g_utf8_strlen(text, (gssize)n_bytes);
+}
+
+void markyd_shadow_text_delete(MarkydShadowText *shadow, gint offset,
+                               gsize n_bytes) {
+  move_gap(shadow, offset);
+  shadow->gap_end = MIN(shadow->gap_end + n_bytes, shadow->size);
+}
+
+const gchar *markyd_shadow_text_peek(MarkydShadowText *shadow, gsize *length) {
+  gsize tail = shadow->size - shadow->gap_end;
+
+  if (tail > 0) {
+    shadow->gap_chars += (gint)g_utf8_strlen(shadow->data + shadow->gap_end,
+                                             (gssize)tail);
+    memmove(shadow->data + shadow->gap_start, shadow->data + shadow->gap_end,
+            tail);
+    shadow->gap_start += tail;
+    shadow->gap_end = shadow->size;
+  }
+
+  /* ensure_gap always leaves a byte free */
+  shadow->data[shadow->gap_start] = '\0';
+  if (length) {
+    *length = shadow->gap_start;
+  }
+  return shadow->data;
+}
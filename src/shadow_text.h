@@ -0,0 +1,34 @@
+#ifndef MARKYD_SHADOW_TEXT_H
+#define MARKYD_SHADOW_TEXT_H
+
+#include <glib.h>
+
+/*
+ * A copy of the note's markdown kept in step with the editor's buffer, so
+ * saving doesn't have to read the text back out of the GtkTextBuffer. It is
+ * a gap buffer: edits land at the gap, which follows the cursor, so typing
+ * moves only the bytes between one edit and the next. Offsets are in
+ * characters, like the buffer's.
+ */
+
+typedef struct _MarkydShadowText MarkydShadowText;
+
+MarkydShadowText *markyd_shadow_text_new(void);
+void markyd_shadow_text_free(MarkydShadowText *shadow);
+
+/* Replace everything with text (NULL is empty) */
+void markyd_shadow_text_set(MarkydShadowText *shadow, const gchar *text);
+
+/* Insert len bytes of text (-1 if NUL-terminated) at offset */
+void markyd_shadow_text_insert(MarkydShadowText *shadow, gint offset,
+                               const gchar *text, gssize len);
+
+/* Remove n_bytes of text starting at offset */
+void markyd_shadow_text_delete(MarkydShadowText *shadow, gint offset,
+                               gsize n_bytes);
+
+/* The whole text, NUL-terminated, with its length in bytes if length isn't
+ * NULL. Valid until the next change; closes the gap, so no copy is made. */
+const gchar *markyd_shadow_text_peek(MarkydShadowText *shadow, gsize *length);
+
+#endif /* MARKYD_SHADOW_TEXT_H */
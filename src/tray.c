@@ -15,6 +15,7 @@ static MarkydApp *tray_app = NULL;
 
 static void on_show_activate(GtkMenuItem *item, gpointer user_data);
 static void on_new_activate(GtkMenuItem *item, gpointer user_data);
+static void on_duplicates_activate(GtkMenuItem *item, gpointer user_data);
 static void on_settings_activate(GtkMenuItem *item, gpointer user_data);
 static void on_quit_activate(GtkMenuItem *item, gpointer user_data);
 static void on_status_icon_activate(GtkStatusIcon *icon, gpointer user_data);
@@ -32,6 +33,7 @@ static void set_autostart_enabled(gboolean enabled);
 
 void tray_init(MarkydApp *app) {
   GtkWidget *item_new;
+  GtkWidget *item_duplicates;
   GtkWidget *item_settings;
   GtkWidget *item_separator;
   GtkWidget *item_quit;
@@ -51,6 +53,12 @@ void tray_init(MarkydApp *app) {
   g_signal_connect(item_new, "activate", G_CALLBACK(on_new_activate), app);
   gtk_menu_shell_append(GTK_MENU_SHELL(menu), item_new);
 
+  /* Near-duplicate review */
+  item_duplicates = gtk_menu_item_new_with_label("Find Similar Notes...");
+  g_signal_connect(item_duplicates, "activate",
+                   G_CALLBACK(on_duplicates_activate), app);
+  gtk_menu_shell_append(GTK_MENU_SHELL(menu), item_duplicates);
+
   /* Separator */
   item_separator = gtk_separator_menu_item_new();
   gtk_menu_shell_append(GTK_MENU_SHELL(menu), item_separator);
@@ -151,6 +159,15 @@ static void on_new_activate(GtkMenuItem *item, gpointer user_data) {
   markyd_window_show(app->window);
 }
 
+static void on_duplicates_activate(GtkMenuItem *item, gpointer user_data) {
+  MarkydApp *app = (MarkydApp *)user_data;
+
+  (void)item;
+
+  markyd_window_show(app->window);
+  markyd_window_show_duplicates(app->window);
+}
+
 static void on_settings_activate(GtkMenuItem *item, gpointer user_data) {
   MarkydApp *app = (MarkydApp *)user_data;
   GtkWidget *dialog;
@@ -0,0 +1,320 @@
+#include "undo.h"
+#include <string.h>
+
+typedef struct _UndoOp {
+  MarkydUndoKind kind;
+  gint offset; /* Characters */
+  gint n_chars;
+  gchar *text; /* NULL for an insert of a compact step */
+} UndoOp;
+
+typedef struct _UndoStep {
+  GArray *ops; /* UndoOp, in the order they happened */
+  gsize bytes;
+  gboolean compact; /* Inserts too big to keep: undoable, not redoable */
+} UndoStep;
+
+struct _MarkydUndo {
+  GQueue undo;    /* UndoStep, oldest first */
+  GQueue redo;    /* UndoStep, most recently undone last */
+  UndoStep *open; /* Step the current action records into */
+  gint depth;     /* begin_action nesting */
+  gboolean dropping;  /* The current action's step was evicted */
+  gboolean replaying; /* Inside undo/redo: don't record */
+  gboolean typing;    /* The newest step is a word being typed or erased */
+  gsize bytes;
+  gsize max_bytes;
+};
+
+static gsize op_bytes(const UndoOp *op) {
+  return sizeof(UndoOp) + (op->text ? strlen(op->text) + 1 : 0);
+}
+
+static void step_free(gpointer data) {
+  UndoStep *step = data;
+
+  for (guint i = 0; i < step->ops->len; i++) {
+    g_free(g_array_index(step->ops, UndoOp, i).text);
+  }
+  g_array_free(step->ops, TRUE);
+  g_free(step);
+}
+
+static void drop_step(MarkydUndo *undo, UndoStep *step) {
+  undo->bytes -= step->bytes;
+  if (step == undo->open) {
+    undo->open = NULL;
+    undo->dropping = TRUE;
+  }
+  step_free(step);
+}
+
+static void clear_redo(MarkydUndo *undo) {
+  UndoStep *step;
+
+  while ((step = g_queue_pop_tail(&undo->redo)) != NULL) {
+    drop_step(undo, step);
+  }
+}
+
+/* Let the step's inserts go by their ranges alone; undoing one is deleting
+ * that range, redoing it would need the text */
+static void compact_step(MarkydUndo *undo, UndoStep *step) {
+  step->compact = TRUE;
+  for (guint i = 0; i < step->ops->len; i++) {
+    UndoOp *op = &g_array_index(step->ops, UndoOp, i);
+
+    if (op->kind == MARKYD_UNDO_INSERT && op->text) {
+      step->bytes -= op_bytes(op);
+      undo->bytes -= op_bytes(op);
+      g_clear_pointer(&op->text, g_free);
+      step->bytes += op_bytes(op);
+      undo->bytes += op_bytes(op);
+    }
+  }
+}
+
+/* Oldest first, until the log fits its budget again */
+static void evict(MarkydUndo *undo) {
+  while (undo->bytes > undo->max_bytes && !g_queue_is_empty(&undo->undo)) {
+    drop_step(undo, g_queue_pop_head(&undo->undo));
+  }
+}
+
+/* A new word starts after whitespace; a line break always ends one */
+static gboolean is_word_break(const gchar *before, const gchar *after) {
+  gunichar b = g_utf8_get_char(before);
+  gunichar a = g_utf8_get_char(after);
+
+  if (b == '\n' || a == '\n') {
+    return TRUE;
+  }
+  return g_unichar_isspace(b) && !g_unichar_isspace(a);
+}
+
+/*
+ * Fold a finished single-character step into the word before it, if it
+ * continues that word right where it left off: typing after it, Backspace
+ * before it, or Delete at the same spot.
+ */
+static gboolean merge_into(UndoStep *prev, const UndoOp *op) {
+  UndoOp *last = &g_array_index(prev->ops, UndoOp, prev->ops->len - 1);
+  gchar *text;
+
+  if (prev->ops->len != 1 || last->kind != op->kind) {
+    return FALSE;
+  }
+
+  if (op->kind == MARKYD_UNDO_INSERT &&
+      op->offset == last->offset + last->n_chars &&
+      !is_word_break(g_utf8_prev_char(last->text + strlen(last->text)),
+                     op->text)) {
+    text = g_strconcat(last->text, op->text, NULL);
+  } else if (op->kind == MARKYD_UNDO_DELETE &&
+             op->offset + op->n_chars == last->offset &&
+             !is_word_break(op->text, last->text)) {
+    text = g_strconcat(op->text, last->text, NULL);
+    last->offset = op->offset;
+  } else if (op->kind == MARKYD_UNDO_DELETE && op->offset == last->offset &&
+             !is_word_break(g_utf8_prev_char(last->text + strlen(last->text)),
+                            op->text)) {
+    text = g_strconcat(last->text, op->text, NULL);
+  } else {
+    return FALSE;
+  }
+
+  prev->bytes -= op_bytes(last);
+  g_free(last->text);
+  last->text = text;
+  last->n_chars += op->n_chars;
+  prev->bytes += op_bytes(last);
+  return TRUE;
+}
+
+static void close_step(MarkydUndo *undo) {
+  UndoStep *step = undo->open;
+  GList *prev_link;
+  const UndoOp *op;
+  gboolean single;
+
+  undo->open = NULL;
+  if (!step) {
+    return;
+  }
+
+  op = &g_array_index(step->ops, UndoOp, 0);
+  single = step->ops->len == 1 && op->n_chars == 1 && op->text;
+  prev_link = g_queue_peek_tail_link(&undo->undo)->prev;
+
+  if (single && undo->typing && prev_link) {
+    UndoStep *prev = prev_link->data;
+    gsize before = prev->bytes;
+
+    if (merge_into(prev, op)) {
+      g_queue_pop_tail(&undo->undo);
+      undo->bytes += prev->bytes - before;
+      undo->bytes -= step->bytes;
+      step_free(step);
+    }
+  }
+  undo->typing = single;
+}
+
+MarkydUndo *markyd_undo_new(gsize max_bytes) {
+  MarkydUndo *undo = g_new0(MarkydUndo, 1);
+
+  g_queue_init(&undo->undo);
+  g_queue_init(&undo->redo);
+  undo->max_bytes = max_bytes;
+  return undo;
+}
+
+void markyd_undo_free(MarkydUndo *undo) {
+  if (!undo) {
+    return;
+  }
+  markyd_undo_clear(undo);
+  g_free(undo);
+}
+
+void markyd_undo_clear(MarkydUndo *undo) {
+  g_queue_clear_full(&undo->undo, step_free);
+  g_queue_clear_full(&undo->redo, step_free);
+  undo->open = NULL;
+  undo->dropping = undo->depth > 0;
+  undo->typing = FALSE;
+  undo->bytes = 0;
+}
+
+void markyd_undo_begin_action(MarkydUndo *undo) { undo->depth++; }
+
+void markyd_undo_end_action(MarkydUndo *undo) {
+  if (undo->depth == 0) {
+    return;
+  }
+  if (--undo->depth == 0) {
+    close_step(undo);
+    undo->dropping = FALSE;
+  }
+}
+
+void markyd_undo_record(MarkydUndo *undo, MarkydUndoKind kind, gint offset,
+                        const gchar *text, gssize len) {
+  UndoOp op;
+
+  if (undo->replaying) {
+    return;
+  }
+  if (len < 0) {
+    len = (gssize)strlen(text);
+  }
+  if (len == 0) {
+    return;
+  }
+
+  markyd_undo_begin_action(undo);
+  if (!undo->dropping) {
+    clear_redo(undo);
+    if (!undo->open) {
+      undo->open = g_new0(UndoStep, 1);
+      undo->open->ops = g_array_new(FALSE, FALSE, sizeof(UndoOp));
+      undo->open->bytes = sizeof(UndoStep);
+      undo->bytes += undo->open->bytes;
+      g_queue_push_tail(&undo->undo, undo->open);
+    }
+
+    op.kind = kind;
+    op.offset = offset;
+    op.n_chars = (gint)g_utf8_strlen(text, len);
+    op.text = NULL;
+
+    /* A paste bigger than the whole budget would otherwise push out all
+     * history and then itself; keep it as ranges instead */
+    if (kind == MARKYD_UNDO_INSERT && !undo->open->compact &&
+        undo->open->bytes + sizeof(UndoOp) + (gsize)len + 1 >
+            undo->max_bytes) {
+      compact_step(undo, undo->open);
+    }
+
+    if (kind == MARKYD_UNDO_INSERT && undo->open->compact) {
+      UndoOp *last = undo->open->ops->len > 0
+                         ? &g_array_index(undo->open->ops, UndoOp,
+                                          undo->open->ops->len - 1)
+                         : NULL;
+
+      /* Streamed chunks follow on from each other: one range */
+      if (last && last->kind == MARKYD_UNDO_INSERT &&
+          offset == last->offset + last->n_chars) {
+        last->n_chars += op.n_chars;
+      } else {
+        g_array_append_val(undo->open->ops, op);
+        undo->open->bytes += op_bytes(&op);
+        undo->bytes += op_bytes(&op);
+      }
+    } else {
+      op.text = g_strndup(text, (gsize)len);
+      g_array_append_val(undo->open->ops, op);
+      undo->open->bytes += op_bytes(&op);
+      undo->bytes += op_bytes(&op);
+    }
+    evict(undo);
+  }
+  markyd_undo_end_action(undo);
+}
+
+gboolean markyd_undo_can_undo(MarkydUndo *undo) {
+  return undo->depth == 0 && !g_queue_is_empty(&undo->undo);
+}
+
+gboolean markyd_undo_can_redo(MarkydUndo *undo) {
+  return undo->depth == 0 && !g_queue_is_empty(&undo->redo);
+}
+
+gboolean markyd_undo_undo(MarkydUndo *undo, MarkydUndoApplyFunc apply,
+                          gpointer user_data) {
+  UndoStep *step;
+
+  if (!markyd_undo_can_undo(undo)) {
+    return FALSE;
+  }
+
+  step = g_queue_pop_tail(&undo->undo);
+  undo->replaying = TRUE;
+  for (guint i = step->ops->len; i-- > 0;) {
+    const UndoOp *op = &g_array_index(step->ops, UndoOp, i);
+    apply(op->kind == MARKYD_UNDO_INSERT ? MARKYD_UNDO_DELETE
+                                         : MARKYD_UNDO_INSERT,
+          op->offset, op->text, op->n_chars, user_data);
+  }
+  undo->replaying = FALSE;
+  undo->typing = FALSE;
+
+  /* Nothing to redo it from, nor anything undone before it */
+  if (step->compact) {
+    clear_redo(undo);
+    drop_step(undo, step);
+    return TRUE;
+  }
+  g_queue_push_tail(&undo->redo, step);
+  return TRUE;
+}
+
+gboolean markyd_undo_redo(MarkydUndo *undo, MarkydUndoApplyFunc apply,
+                          gpointer user_data) {
+  UndoStep *step;
+
+  if (!markyd_undo_can_redo(undo)) {
+    return FALSE;
+  }
+
+  step = g_queue_pop_tail(&undo->redo);
+  undo->replaying = TRUE;
+  for (guint i = 0; i < step->ops->len; i++) {
+    const UndoOp *op = &g_array_index(step->ops, UndoOp, i);
+    apply(op->kind, op->offset, op->text, op->n_chars, user_data);
+  }
+  undo->replaying = FALSE;
+  undo->typing = FALSE;
+  g_queue_push_tail(&undo->undo, step);
+  return TRUE;
+}
@@ -0,0 +1,55 @@
+#ifndef MARKYD_UNDO_H
+#define MARKYD_UNDO_H
+
+#include <glib.h>
+
+/*
+ * Undo/redo log for the open note. Edits are kept as inserts and deletes of
+ * text at a character offset. Everything between begin/end_action (one
+ * keystroke, one paste) is one step, and single typed or erased characters
+ * coalesce into one step per word. Once the log holds more than its byte
+ * budget the oldest steps are dropped. A step whose inserted text alone
+ * would not fit keeps just where it went, so it can be undone but not
+ * redone.
+ */
+
+typedef enum {
+  MARKYD_UNDO_INSERT,
+  MARKYD_UNDO_DELETE,
+} MarkydUndoKind;
+
+typedef struct _MarkydUndo MarkydUndo;
+
+/* Carries out one edit while undoing or redoing: insert text at offset, or
+ * delete the n_chars characters (text, or NULL if not kept) starting at
+ * offset. */
+typedef void (*MarkydUndoApplyFunc)(MarkydUndoKind kind, gint offset,
+                                    const gchar *text, gint n_chars,
+                                    gpointer user_data);
+
+MarkydUndo *markyd_undo_new(gsize max_bytes);
+void markyd_undo_free(MarkydUndo *undo);
+
+/* Forget all history (e.g., another note was loaded) */
+void markyd_undo_clear(MarkydUndo *undo);
+
+/* Group the edits recorded in between into one step; may nest */
+void markyd_undo_begin_action(MarkydUndo *undo);
+void markyd_undo_end_action(MarkydUndo *undo);
+
+/* Record an edit that is about to happen. len is in bytes, -1 if
+ * NUL-terminated. Ignored while undoing or redoing. */
+void markyd_undo_record(MarkydUndo *undo, MarkydUndoKind kind, gint offset,
+                        const gchar *text, gssize len);
+
+gboolean markyd_undo_can_undo(MarkydUndo *undo);
+gboolean markyd_undo_can_redo(MarkydUndo *undo);
+
+/* Revert the newest step / replay the last reverted one through apply.
+ * Returns FALSE if there was nothing to do. */
+gboolean markyd_undo_undo(MarkydUndo *undo, MarkydUndoApplyFunc apply,
+                          gpointer user_data);
+gboolean markyd_undo_redo(MarkydUndo *undo, MarkydUndoApplyFunc apply,
+                          gpointer user_data);
+
+#endif /* MARKYD_UNDO_H */
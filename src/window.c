@@ -1,11 +1,22 @@
 #include "window.h"
 #include "app.h"
 #include "config.h"
+#include "doc_stats.h"
 #include "editor.h"
+#include "heading_index.h"
+#include "latency.h"
+#include "notes.h"
+#include "notes_dupes.h"
+#include "notes_grep.h"
+#include "notes_history.h"
+#include "notes_tree.h"
+#include <string.h>
 
 static void on_new_clicked(GtkButton *button, gpointer user_data);
 static void on_copy_clicked(GtkButton *button, gpointer user_data);
 static void on_delete_clicked(GtkButton *button, gpointer user_data);
+static void on_history_clicked(GtkButton *button, gpointer user_data);
+static void on_notebook_clicked(GtkButton *button, gpointer user_data);
 static void on_prev_clicked(GtkButton *button, gpointer user_data);
 static void on_next_clicked(GtkButton *button, gpointer user_data);
 static gboolean on_delete_event(GtkWidget *widget, GdkEvent *event,
@@ -18,6 +29,26 @@ static gboolean on_window_state_event(GtkWidget *widget,
                                       GdkEventWindowState *event,
                                       gpointer user_data);
 
+static GtkWidget *grep_bar_new(MarkydWindow *self);
+static GtkWidget *find_bar_new(MarkydWindow *self);
+static void find_toggle(MarkydWindow *self);
+static void grep_stop(MarkydWindow *self);
+static void grep_toggle(MarkydWindow *self);
+static GtkWidget *loading_placeholder_new(MarkydWindow *self);
+static void latency_overlay_toggle(MarkydWindow *self);
+static GtkWidget *outline_new(MarkydWindow *self);
+static void on_outline_toggled(GtkToggleButton *button, gpointer user_data);
+
+/* Rows kept in the grep results list (the newest notes win) */
+#define GREP_MAX_ROWS 500
+
+/* Loads faster than this never show the placeholder, so switching between
+ * small notes doesn't flicker */
+#define LOADING_PLACEHOLDER_DELAY_MS 150
+
+/* How often the latency overlay re-reads the histograms */
+#define LATENCY_OVERLAY_REFRESH_MS 1000
+
 static gboolean geometry_debug_enabled(void) {
   const gchar *v = g_getenv("TRAYMD_DEBUG_GEOMETRY");
   return v && v[0] != '\0' && g_strcmp0(v, "0") != 0;
@@ -26,6 +57,10 @@ static gboolean geometry_debug_enabled(void) {
 MarkydWindow *markyd_window_new(MarkydApp *app) {
   MarkydWindow *self = g_new0(MarkydWindow, 1);
   GtkWidget *nav_box;
+  GtkWidget *title_box;
+  GtkWidget *vbox;
+  GtkWidget *hbox;
+  GtkWidget *overlay;
 
   self->app = app;
 
@@ -76,11 +111,20 @@ MarkydWindow *markyd_window_new(MarkydApp *app) {
   gtk_header_bar_set_show_close_button(GTK_HEADER_BAR(self->header_bar), TRUE);
   gtk_window_set_titlebar(GTK_WINDOW(self->window), self->header_bar);
 
-  /* Note counter label (center) */
+  /* Note counter label (center), with the note's counts below it */
+  title_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+  gtk_widget_set_valign(title_box, GTK_ALIGN_CENTER);
   self->lbl_counter = gtk_label_new("0 / 0");
   gtk_widget_set_halign(self->lbl_counter, GTK_ALIGN_CENTER);
-  gtk_header_bar_set_custom_title(GTK_HEADER_BAR(self->header_bar),
-                                  self->lbl_counter);
+  gtk_box_pack_start(GTK_BOX(title_box), self->lbl_counter, FALSE, FALSE, 0);
+  self->lbl_stats = gtk_label_new(NULL);
+  gtk_widget_set_halign(self->lbl_stats, GTK_ALIGN_CENTER);
+  gtk_style_context_add_class(gtk_widget_get_style_context(self->lbl_stats),
+                              "subtitle");
+  gtk_style_context_add_class(gtk_widget_get_style_context(self->lbl_stats),
+                              "dim-label");
+  gtk_box_pack_start(GTK_BOX(title_box), self->lbl_stats, FALSE, FALSE, 0);
+  gtk_header_bar_set_custom_title(GTK_HEADER_BAR(self->header_bar), title_box);
 
   /* New note button */
   self->btn_new = gtk_button_new_from_icon_name("document-new-symbolic",
@@ -125,11 +169,78 @@ MarkydWindow *markyd_window_new(MarkydApp *app) {
 
   gtk_header_bar_pack_start(GTK_HEADER_BAR(self->header_bar), nav_box);
 
+  /* Notebook picker (right side) */
+  self->btn_notebook =
+      gtk_button_new_from_icon_name("folder-symbolic", GTK_ICON_SIZE_BUTTON);
+  gtk_widget_set_tooltip_text(self->btn_notebook, "Notebooks");
+  g_signal_connect(self->btn_notebook, "clicked",
+                   G_CALLBACK(on_notebook_clicked), self);
+  gtk_header_bar_pack_end(GTK_HEADER_BAR(self->header_bar),
+                          self->btn_notebook);
+
+  /* Revision history button (right side) */
+  self->btn_history = gtk_button_new_from_icon_name(
+      "document-open-recent-symbolic", GTK_ICON_SIZE_BUTTON);
+  gtk_widget_set_tooltip_text(self->btn_history, "Note History");
+  gtk_widget_set_sensitive(self->btn_history, notes_history_enabled());
+  g_signal_connect(self->btn_history, "clicked",
+                   G_CALLBACK(on_history_clicked), self);
+  gtk_header_bar_pack_end(GTK_HEADER_BAR(self->header_bar), self->btn_history);
+
+  /* Outline toggle (right side) */
+  self->btn_outline = gtk_toggle_button_new();
+  gtk_button_set_image(GTK_BUTTON(self->btn_outline),
+                       gtk_image_new_from_icon_name("view-list-symbolic",
+                                                    GTK_ICON_SIZE_BUTTON));
+  gtk_widget_set_tooltip_text(self->btn_outline, "Outline");
+  gtk_header_bar_pack_end(GTK_HEADER_BAR(self->header_bar), self->btn_outline);
+
+  vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
+  gtk_container_add(GTK_CONTAINER(self->window), vbox);
+
+  /* Grep bar and its results, above the editor */
+  gtk_box_pack_start(GTK_BOX(vbox), grep_bar_new(self), FALSE, FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), self->grep_results, FALSE, FALSE, 0);
+
+  /* Find in the open note */
+  gtk_box_pack_start(GTK_BOX(vbox), find_bar_new(self), FALSE, FALSE, 0);
+
+  /* Outline on the left of the editor */
+  hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
+  gtk_box_pack_start(GTK_BOX(vbox), hbox, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(hbox), outline_new(self), FALSE, FALSE, 0);
+
+  /* Latency percentiles (Ctrl+Shift+L) float over the editor's corner */
+  overlay = gtk_overlay_new();
+  gtk_box_pack_start(GTK_BOX(hbox), overlay, TRUE, TRUE, 0);
+  self->editor_stack = gtk_stack_new();
+  gtk_container_add(GTK_CONTAINER(overlay), self->editor_stack);
+
+  self->latency_label = gtk_label_new(NULL);
+  gtk_widget_set_halign(self->latency_label, GTK_ALIGN_END);
+  gtk_widget_set_valign(self->latency_label, GTK_ALIGN_START);
+  gtk_widget_set_margin_top(self->latency_label, 8);
+  gtk_widget_set_margin_end(self->latency_label, 8);
+  gtk_style_context_add_class(gtk_widget_get_style_context(self->latency_label),
+                              "osd");
+  gtk_style_context_add_class(gtk_widget_get_style_context(self->latency_label),
+                              "monospace");
+  gtk_widget_set_no_show_all(self->latency_label, TRUE);
+  gtk_overlay_add_overlay(GTK_OVERLAY(overlay), self->latency_label);
+  gtk_overlay_set_overlay_pass_through(GTK_OVERLAY(overlay),
+                                       self->latency_label, TRUE);
+
   /* Scrolled window for editor - no extra margins */
   self->scroll = gtk_scrolled_window_new(NULL, NULL);
   gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(self->scroll),
                                  GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-  gtk_container_add(GTK_CONTAINER(self->window), self->scroll);
+  gtk_stack_add_named(GTK_STACK(self->editor_stack), self->scroll, "editor");
+  gtk_stack_add_named(GTK_STACK(self->editor_stack),
+                      loading_placeholder_new(self), "loading");
+
+  self->insert_progress = gtk_progress_bar_new();
+  gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(self->insert_progress), TRUE);
+  gtk_box_pack_start(GTK_BOX(vbox), self->insert_progress, FALSE, FALSE, 0);
 
   /* Create editor */
   self->editor = markyd_editor_new(app);
@@ -145,7 +256,20 @@ MarkydWindow *markyd_window_new(MarkydApp *app) {
    * configure events which can overwrite the restored position.
    */
   gtk_widget_show_all(self->header_bar);
-  gtk_widget_show_all(self->scroll);
+  gtk_widget_show(vbox);
+  gtk_widget_show(hbox);
+  gtk_widget_show(overlay);
+  gtk_widget_show_all(self->outline);
+  gtk_widget_set_visible(self->outline, config->outline);
+  /* Connected last so restoring the state doesn't save it again */
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(self->btn_outline),
+                               config->outline);
+  g_signal_connect(self->btn_outline, "toggled",
+                   G_CALLBACK(on_outline_toggled), self);
+  gtk_widget_show_all(self->grep_bar);
+  gtk_widget_show_all(self->find_bar);
+  gtk_widget_show_all(self->editor_stack);
+  gtk_stack_set_visible_child_name(GTK_STACK(self->editor_stack), "editor");
 
   return self;
 }
@@ -221,6 +345,16 @@ void markyd_window_free(MarkydWindow *self) {
   if (!self)
     return;
 
+  grep_stop(self);
+
+  if (self->loading_timeout_id > 0) {
+    g_source_remove(self->loading_timeout_id);
+  }
+
+  if (self->latency_timeout_id > 0) {
+    g_source_remove(self->latency_timeout_id);
+  }
+
   if (self->editor) {
     markyd_editor_free(self->editor);
   }
@@ -229,6 +363,8 @@ void markyd_window_free(MarkydWindow *self) {
     gtk_widget_destroy(self->window);
   }
 
+  g_array_free(self->outline_headings, TRUE);
+
   g_free(self);
 }
 
@@ -276,11 +412,34 @@ void markyd_window_update_counter(MarkydWindow *self) {
   gint count = markyd_app_get_note_count(self->app);
   gint current = self->app->current_index + 1;
 
-  text = g_strdup_printf("%d / %d", current, count);
+  if (self->app->notebook && self->app->notebook[0]) {
+    text = g_strdup_printf("%s  %d / %d", self->app->notebook, current, count);
+  } else {
+    text = g_strdup_printf("%d / %d", current, count);
+  }
   gtk_label_set_text(GTK_LABEL(self->lbl_counter), text);
   g_free(text);
 }
 
+void markyd_window_update_stats(MarkydWindow *self,
+                                const MarkydDocStats *stats) {
+  gchar *text;
+
+  if (!stats) {
+    gtk_label_set_text(GTK_LABEL(self->lbl_stats), "Counting\u2026");
+    return;
+  }
+
+  text = g_strdup_printf(
+      "%" G_GINT64_FORMAT " %s \u00b7 %" G_GINT64_FORMAT
+      " chars \u00b7 %" G_GINT64_FORMAT " lines \u00b7 %" G_GINT64_FORMAT
+      " min read",
+      stats->words, stats->words == 1 ? "word" : "words", stats->chars,
+      stats->newlines + 1, markyd_doc_stats_reading_minutes(stats));
+  gtk_label_set_text(GTK_LABEL(self->lbl_stats), text);
+  g_free(text);
+}
+
 void markyd_window_update_nav_sensitivity(MarkydWindow *self) {
   gint count = markyd_app_get_note_count(self->app);
   gint current = self->app->current_index;
@@ -289,6 +448,194 @@ void markyd_window_update_nav_sensitivity(MarkydWindow *self) {
   gtk_widget_set_sensitive(self->btn_next, current < count - 1);
 }
 
+static GtkWidget *loading_placeholder_new(MarkydWindow *self) {
+  GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+  GtkWidget *label = gtk_label_new("Loading note\u2026");
+
+  gtk_widget_set_halign(box, GTK_ALIGN_CENTER);
+  gtk_widget_set_valign(box, GTK_ALIGN_CENTER);
+  self->loading_spinner = gtk_spinner_new();
+  gtk_box_pack_start(GTK_BOX(box), self->loading_spinner, FALSE, FALSE, 0);
+  gtk_style_context_add_class(gtk_widget_get_style_context(label),
+                              "dim-label");
+  gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+  return box;
+}
+
+static gboolean on_loading_timeout(gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+
+  self->loading_timeout_id = 0;
+  gtk_spinner_start(GTK_SPINNER(self->loading_spinner));
+  gtk_stack_set_visible_child_name(GTK_STACK(self->editor_stack), "loading");
+  return G_SOURCE_REMOVE;
+}
+
+void markyd_window_set_loading(MarkydWindow *self, gboolean loading) {
+  GtkWidget *view = markyd_editor_get_widget(self->editor);
+
+  /* Keystrokes would otherwise land in the previous note's text */
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(view), !loading);
+
+  if (loading) {
+    if (self->loading_timeout_id == 0) {
+      self->loading_timeout_id = g_timeout_add(LOADING_PLACEHOLDER_DELAY_MS,
+                                               on_loading_timeout, self);
+    }
+    return;
+  }
+
+  if (self->loading_timeout_id > 0) {
+    g_source_remove(self->loading_timeout_id);
+    self->loading_timeout_id = 0;
+  }
+  gtk_spinner_stop(GTK_SPINNER(self->loading_spinner));
+  gtk_stack_set_visible_child_name(GTK_STACK(self->editor_stack), "editor");
+}
+
+void markyd_window_set_insert_progress(MarkydWindow *self, gdouble fraction) {
+  gchar *text;
+
+  if (fraction < 0) {
+    gtk_widget_hide(self->insert_progress);
+    return;
+  }
+
+  text = g_strdup_printf("Inserting\u2026 %d%%", (gint)(fraction * 100));
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(self->insert_progress),
+                                fraction);
+  gtk_progress_bar_set_text(GTK_PROGRESS_BAR(self->insert_progress), text);
+  gtk_widget_show(self->insert_progress);
+  g_free(text);
+}
+
+static gboolean latency_overlay_refresh(gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  GtkTextBuffer *buffer = self->editor->buffer;
+  gchar *text;
+
+  text = markyd_latency_format(gtk_text_buffer_get_char_count(buffer),
+                               gtk_text_buffer_get_line_count(buffer));
+  gtk_label_set_text(GTK_LABEL(self->latency_label), g_strchomp(text));
+  g_free(text);
+  return G_SOURCE_CONTINUE;
+}
+
+static void latency_overlay_toggle(MarkydWindow *self) {
+  if (self->latency_timeout_id > 0) {
+    g_source_remove(self->latency_timeout_id);
+    self->latency_timeout_id = 0;
+    gtk_widget_hide(self->latency_label);
+    return;
+  }
+
+  latency_overlay_refresh(self);
+  gtk_widget_show(self->latency_label);
+  self->latency_timeout_id = g_timeout_add(LATENCY_OVERLAY_REFRESH_MS,
+                                           latency_overlay_refresh, self);
+}
+
+static void on_outline_row_activated(GtkListBox *list, GtkListBoxRow *row,
+                                     gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  gint index = gtk_list_box_row_get_index(row);
+  (void)list;
+
+  if (index >= 0 && (guint)index < self->outline_headings->len) {
+    markyd_editor_goto_line(
+        self->editor,
+        g_array_index(self->outline_headings, MarkydHeading, index).line);
+  }
+}
+
+static void on_outline_toggled(GtkToggleButton *button, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+
+  config->outline = gtk_toggle_button_get_active(button);
+  gtk_widget_set_visible(self->outline, config->outline);
+  config_save(config);
+}
+
+static GtkWidget *outline_new(MarkydWindow *self) {
+  self->outline_headings = markyd_headings_new();
+
+  self->outline_list = gtk_list_box_new();
+  gtk_list_box_set_activate_on_single_click(GTK_LIST_BOX(self->outline_list),
+                                            TRUE);
+  g_signal_connect(self->outline_list, "row-activated",
+                   G_CALLBACK(on_outline_row_activated), self);
+
+  self->outline = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(self->outline),
+                                 GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_widget_set_size_request(self->outline, 200, -1);
+  gtk_widget_set_no_show_all(self->outline, TRUE);
+  gtk_container_add(GTK_CONTAINER(self->outline), self->outline_list);
+
+  return self->outline;
+}
+
+static GtkWidget *outline_row_new(const MarkydHeading *heading) {
+  GtkWidget *label = gtk_label_new(heading->title);
+  GtkWidget *row = gtk_list_box_row_new();
+
+  gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+  gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+  gtk_widget_set_margin_start(label, 8 + (heading->level - 1) * 12);
+  gtk_widget_set_margin_end(label, 6);
+  gtk_widget_set_margin_top(label, 2);
+  gtk_widget_set_margin_bottom(label, 2);
+  gtk_container_add(GTK_CONTAINER(row), label);
+  gtk_widget_show_all(row);
+  return row;
+}
+
+static gboolean same_heading(const MarkydHeading *a, const MarkydHeading *b) {
+  return a->level == b->level &&
+         (a->title == b->title || strcmp(a->title, b->title) == 0);
+}
+
+void markyd_window_update_outline(MarkydWindow *self, GArray *headings) {
+  GArray *old = self->outline_headings;
+  guint prefix = 0;
+  guint suffix = 0;
+
+  /* Typing touches one section, so keep the rows around it. Lines are read
+   * from outline_headings on activation, so a row only changes with its
+   * level or title. */
+  while (prefix < old->len && prefix < headings->len &&
+         same_heading(&g_array_index(old, MarkydHeading, prefix),
+                      &g_array_index(headings, MarkydHeading, prefix))) {
+    prefix++;
+  }
+  while (suffix < old->len - prefix && suffix < headings->len - prefix &&
+         same_heading(
+             &g_array_index(old, MarkydHeading, old->len - 1 - suffix),
+             &g_array_index(headings, MarkydHeading,
+                            headings->len - 1 - suffix))) {
+    suffix++;
+  }
+
+  for (guint i = prefix; i < old->len - suffix; i++) {
+    GtkListBoxRow *row = gtk_list_box_get_row_at_index(
+        GTK_LIST_BOX(self->outline_list), (gint)prefix);
+    gtk_widget_destroy(GTK_WIDGET(row));
+  }
+  for (guint i = prefix; i < headings->len - suffix; i++) {
+    gtk_list_box_insert(
+        GTK_LIST_BOX(self->outline_list),
+        outline_row_new(&g_array_index(headings, MarkydHeading, i)), (gint)i);
+  }
+
+  /* Titles are shared with the editor's index, not copied */
+  g_array_set_size(old, 0);
+  for (guint i = 0; i < headings->len; i++) {
+    MarkydHeading heading = g_array_index(headings, MarkydHeading, i);
+    heading.title = g_ref_string_acquire(heading.title);
+    g_array_append_val(old, heading);
+  }
+}
+
 static void on_new_clicked(GtkButton *button, gpointer user_data) {
   MarkydWindow *self = (MarkydWindow *)user_data;
   (void)button;
@@ -297,7 +644,7 @@ static void on_new_clicked(GtkButton *button, gpointer user_data) {
 
 static void on_copy_clicked(GtkButton *button, gpointer user_data) {
   MarkydWindow *self = (MarkydWindow *)user_data;
-  gchar *content;
+  const gchar *content;
   GtkClipboard *clipboard;
 
   (void)button;
@@ -306,14 +653,9 @@ static void on_copy_clicked(GtkButton *button, gpointer user_data) {
     return;
   }
 
-  content = markyd_editor_get_content(self->editor);
-  if (!content) {
-    return;
-  }
-
+  content = markyd_editor_peek_content(self->editor);
   clipboard = gtk_clipboard_get(GDK_SELECTION_CLIPBOARD);
   gtk_clipboard_set_text(clipboard, content, -1);
-  g_free(content);
 }
 
 static void on_delete_clicked(GtkButton *button, gpointer user_data) {
@@ -359,6 +701,840 @@ static void on_delete_clicked(GtkButton *button, gpointer user_data) {
   }
 }
 
+typedef struct _HistoryDialog {
+  GtkWidget *preview;
+  GtkWidget *btn_restore;
+  gchar *path;
+  gchar *selected; /* Reconstructed content of the selected revision */
+} HistoryDialog;
+
+static void on_history_row_selected(GtkListBox *box, GtkListBoxRow *row,
+                                    gpointer user_data) {
+  HistoryDialog *hd = (HistoryDialog *)user_data;
+  GtkTextBuffer *buffer =
+      gtk_text_view_get_buffer(GTK_TEXT_VIEW(hd->preview));
+  guint index;
+
+  (void)box;
+
+  g_clear_pointer(&hd->selected, g_free);
+  if (row) {
+    index = GPOINTER_TO_UINT(
+        g_object_get_data(G_OBJECT(row), "revision-index"));
+    hd->selected = notes_history_get(hd->path, index);
+  }
+
+  gtk_text_buffer_set_text(buffer, hd->selected ? hd->selected : "", -1);
+  gtk_widget_set_sensitive(hd->btn_restore, hd->selected != NULL);
+}
+
+static GtkWidget *history_row_new(const MarkydRevision *rev, guint index) {
+  GDateTime *dt = g_date_time_new_from_unix_local(rev->timestamp /
+                                                  G_USEC_PER_SEC);
+  gchar *when = dt ? g_date_time_format(dt, "%Y-%m-%d %H:%M:%S") : NULL;
+  gchar *size = g_format_size(rev->length);
+  gchar *text = g_strdup_printf("%s  (%s)", when ? when : "?", size);
+  GtkWidget *row = gtk_list_box_row_new();
+  GtkWidget *label = gtk_label_new(text);
+
+  gtk_widget_set_halign(label, GTK_ALIGN_START);
+  gtk_widget_set_margin_start(label, 6);
+  gtk_widget_set_margin_end(label, 6);
+  gtk_widget_set_margin_top(label, 4);
+  gtk_widget_set_margin_bottom(label, 4);
+  gtk_container_add(GTK_CONTAINER(row), label);
+  g_object_set_data(G_OBJECT(row), "revision-index", GUINT_TO_POINTER(index));
+
+  g_free(text);
+  g_free(size);
+  g_free(when);
+  if (dt) {
+    g_date_time_unref(dt);
+  }
+  return row;
+}
+
+static void on_history_clicked(GtkButton *button, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  const gchar *path = markyd_app_get_current_path(self->app);
+  HistoryDialog hd = {0};
+  GtkWidget *dialog;
+  GtkWidget *content_area;
+  GtkWidget *paned;
+  GtkWidget *list_scroll;
+  GtkWidget *list;
+  GtkWidget *preview_scroll;
+  GArray *revisions;
+  gint response;
+
+  (void)button;
+
+  if (!path) {
+    return;
+  }
+
+  /* Flush pending edits so the newest revision matches the editor. */
+  markyd_app_save_current(self->app);
+
+  revisions = notes_history_list(path);
+  hd.path = g_strdup(path);
+
+  dialog = gtk_dialog_new_with_buttons(
+      "Note History", GTK_WINDOW(self->window),
+      GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, "_Cancel",
+      GTK_RESPONSE_CANCEL, "_Restore", GTK_RESPONSE_OK, NULL);
+  gtk_window_set_default_size(GTK_WINDOW(dialog), 720, 460);
+  hd.btn_restore =
+      gtk_dialog_get_widget_for_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
+  gtk_widget_set_sensitive(hd.btn_restore, FALSE);
+
+  content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+  paned = gtk_paned_new(GTK_ORIENTATION_HORIZONTAL);
+  gtk_widget_set_vexpand(paned, TRUE);
+  gtk_box_pack_start(GTK_BOX(content_area), paned, TRUE, TRUE, 0);
+
+  list_scroll = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(list_scroll),
+                                 GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_widget_set_size_request(list_scroll, 240, -1);
+  list = gtk_list_box_new();
+  gtk_container_add(GTK_CONTAINER(list_scroll), list);
+  gtk_paned_pack1(GTK_PANED(paned), list_scroll, FALSE, FALSE);
+
+  preview_scroll = gtk_scrolled_window_new(NULL, NULL);
+  hd.preview = gtk_text_view_new();
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(hd.preview), FALSE);
+  gtk_text_view_set_monospace(GTK_TEXT_VIEW(hd.preview), TRUE);
+  gtk_text_view_set_wrap_mode(GTK_TEXT_VIEW(hd.preview), GTK_WRAP_WORD_CHAR);
+  gtk_container_add(GTK_CONTAINER(preview_scroll), hd.preview);
+  gtk_paned_pack2(GTK_PANED(paned), preview_scroll, TRUE, FALSE);
+
+  /* Newest first */
+  for (guint i = revisions->len; i > 0; i--) {
+    const MarkydRevision *rev =
+        &g_array_index(revisions, MarkydRevision, i - 1);
+    gtk_container_add(GTK_CONTAINER(list), history_row_new(rev, i - 1));
+  }
+  g_array_free(revisions, TRUE);
+
+  g_signal_connect(list, "row-selected", G_CALLBACK(on_history_row_selected),
+                   &hd);
+
+  gtk_widget_show_all(dialog);
+  response = gtk_dialog_run(GTK_DIALOG(dialog));
+
+  if (response == GTK_RESPONSE_OK && hd.selected &&
+      g_strcmp0(hd.path, markyd_app_get_current_path(self->app)) == 0) {
+    markyd_editor_set_content(self->editor, hd.selected);
+    markyd_app_schedule_save(self->app);
+  }
+
+  gtk_widget_destroy(dialog);
+  g_free(hd.selected);
+  g_free(hd.path);
+}
+
+enum {
+  NOTEBOOK_COL_LABEL,
+  NOTEBOOK_COL_PATH,
+  NOTEBOOK_COL_LOADED,
+  NOTEBOOK_N_COLS
+};
+
+static gchar *notebook_display_name(const gchar *notebook) {
+  return notebook[0] ? g_path_get_basename(notebook) : g_strdup("Notes");
+}
+
+/* Add a notebook row with a placeholder child so it can be expanded; its
+ * folder is only read, and its notes counted, when that happens. */
+static void notebook_row_add(GtkTreeStore *store, GtkTreeIter *parent,
+                             const gchar *notebook) {
+  GtkTreeIter iter;
+  GtkTreeIter placeholder;
+  gchar *name = notebook_display_name(notebook);
+
+  gtk_tree_store_append(store, &iter, parent);
+  gtk_tree_store_set(store, &iter, NOTEBOOK_COL_LABEL, name,
+                     NOTEBOOK_COL_PATH, notebook, NOTEBOOK_COL_LOADED, FALSE,
+                     -1);
+  gtk_tree_store_append(store, &placeholder, &iter);
+
+  g_free(name);
+}
+
+static gboolean on_notebook_test_expand(GtkTreeView *view, GtkTreeIter *iter,
+                                        GtkTreePath *path,
+                                        gpointer user_data) {
+  GtkTreeStore *store = GTK_TREE_STORE(gtk_tree_view_get_model(view));
+  GtkTreeIter child;
+  gchar *notebook = NULL;
+  gboolean loaded = FALSE;
+  GPtrArray *children;
+  gchar *name;
+  gchar *label;
+
+  (void)path;
+  (void)user_data;
+
+  gtk_tree_model_get(GTK_TREE_MODEL(store), iter, NOTEBOOK_COL_PATH, &notebook,
+                     NOTEBOOK_COL_LOADED, &loaded, -1);
+  if (loaded) {
+    g_free(notebook);
+    return FALSE;
+  }
+
+  /* Replace the placeholder with the real child notebooks */
+  while (gtk_tree_model_iter_children(GTK_TREE_MODEL(store), &child, iter)) {
+    gtk_tree_store_remove(store, &child);
+  }
+
+  children = notes_tree_children(notebook);
+  for (guint i = 0; i < children->len; i++) {
+    notebook_row_add(store, iter, g_ptr_array_index(children, i));
+  }
+  g_ptr_array_free(children, TRUE);
+
+  /* Listing the children counted the notes in the same pass */
+  name = notebook_display_name(notebook);
+  label = g_strdup_printf("%s (%d)", name, notes_count_in(notebook));
+  gtk_tree_store_set(store, iter, NOTEBOOK_COL_LABEL, label,
+                     NOTEBOOK_COL_LOADED, TRUE, -1);
+  g_free(label);
+  g_free(name);
+  g_free(notebook);
+  return FALSE; /* Allow the expansion */
+}
+
+static void on_notebook_row_activated(GtkTreeView *view, GtkTreePath *path,
+                                      GtkTreeViewColumn *column,
+                                      gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  GtkTreeModel *model = gtk_tree_view_get_model(view);
+  GtkTreeIter iter;
+  gchar *notebook = NULL;
+
+  (void)column;
+
+  if (!gtk_tree_model_get_iter(model, &iter, path)) {
+    return;
+  }
+
+  gtk_tree_model_get(model, &iter, NOTEBOOK_COL_PATH, &notebook, -1);
+  markyd_app_set_notebook(self->app, notebook);
+  g_free(notebook);
+
+  gtk_popover_popdown(
+      GTK_POPOVER(gtk_widget_get_ancestor(GTK_WIDGET(view), GTK_TYPE_POPOVER)));
+}
+
+static void on_notebook_clicked(GtkButton *button, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  GtkTreeStore *store;
+  GtkWidget *popover;
+  GtkWidget *scroll;
+  GtkWidget *view;
+  GtkTreePath *root_path;
+
+  store = gtk_tree_store_new(NOTEBOOK_N_COLS, G_TYPE_STRING, G_TYPE_STRING,
+                             G_TYPE_BOOLEAN);
+  view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+  g_object_unref(store);
+  gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(view), FALSE);
+  gtk_tree_view_set_activate_on_single_click(GTK_TREE_VIEW(view), TRUE);
+  gtk_tree_view_insert_column_with_attributes(
+      GTK_TREE_VIEW(view), -1, NULL, gtk_cell_renderer_text_new(), "text",
+      NOTEBOOK_COL_LABEL, NULL);
+  g_signal_connect(view, "test-expand-row",
+                   G_CALLBACK(on_notebook_test_expand), NULL);
+  g_signal_connect(view, "row-activated",
+                   G_CALLBACK(on_notebook_row_activated), self);
+
+  /* Only the top level is read up front */
+  notebook_row_add(store, NULL, "");
+  root_path = gtk_tree_path_new_first();
+  gtk_tree_view_expand_row(GTK_TREE_VIEW(view), root_path, FALSE);
+  gtk_tree_path_free(root_path);
+
+  scroll = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scroll),
+                                 GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_scrolled_window_set_propagate_natural_height(GTK_SCROLLED_WINDOW(scroll),
+                                                   TRUE);
+  gtk_scrolled_window_set_max_content_height(GTK_SCROLLED_WINDOW(scroll), 360);
+  gtk_widget_set_size_request(scroll, 220, -1);
+  gtk_container_add(GTK_CONTAINER(scroll), view);
+
+  popover = gtk_popover_new(GTK_WIDGET(button));
+  gtk_container_add(GTK_CONTAINER(popover), scroll);
+  g_signal_connect(popover, "closed", G_CALLBACK(gtk_widget_destroy), NULL);
+  gtk_widget_show_all(scroll);
+  gtk_popover_popup(GTK_POPOVER(popover));
+}
+
+enum { DUPES_COL_LABEL, DUPES_COL_PATH, DUPES_N_COLS };
+
+/* Groups shown in the duplicates dialog */
+#define DUPES_MAX_GROUPS 200
+
+/* "name — first line" for a note in the duplicates dialog */
+static gchar *dupes_note_label(const gchar *path) {
+  gchar *name = g_path_get_basename(path);
+  gchar *content = notes_load(path);
+  gchar *line = NULL;
+  gchar *label;
+
+  if (content) {
+    gchar *end = strchr(content, '\n');
+    if (end) {
+      *end = '\0';
+    }
+    line = g_utf8_make_valid(content, MIN(strlen(content), 120));
+  }
+
+  label = line && *line ? g_strdup_printf("%s — %s", name, line)
+                        : g_strdup(name);
+  g_free(line);
+  g_free(content);
+  g_free(name);
+  return label;
+}
+
+static void on_dupes_selection_changed(GtkTreeSelection *selection,
+                                       gpointer user_data) {
+  GtkWidget *btn_open = GTK_WIDGET(user_data);
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  gchar *path = NULL;
+
+  if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+    gtk_tree_model_get(model, &iter, DUPES_COL_PATH, &path, -1);
+  }
+  gtk_widget_set_sensitive(btn_open, path != NULL);
+  g_free(path);
+}
+
+static void on_dupes_row_activated(GtkTreeView *view, GtkTreePath *path,
+                                   GtkTreeViewColumn *column,
+                                   gpointer user_data) {
+  GtkDialog *dialog = GTK_DIALOG(user_data);
+
+  (void)view;
+  (void)path;
+  (void)column;
+
+  gtk_dialog_response(dialog, GTK_RESPONSE_OK);
+}
+
+void markyd_window_show_duplicates(MarkydWindow *self) {
+  GtkWidget *dialog;
+  GtkWidget *content_area;
+  GtkWidget *scroll;
+  GtkWidget *view;
+  GtkWidget *btn_open;
+  GtkTreeStore *store;
+  GtkTreeSelection *selection;
+  GtkTreeModel *model;
+  GtkTreeIter iter;
+  GPtrArray *groups;
+  guint cursor = 0;
+  gchar *selected = NULL;
+
+  /* Pick up the latest edits and anything the background scan hasn't
+   * reached yet; unchanged notes come straight from the cache. */
+  markyd_app_save_current(self->app);
+  notes_dupes_refresh(self->app->note_paths, &cursor, G_MAXUINT, NULL);
+  groups = notes_dupes_clusters(self->app->note_paths);
+
+  store = gtk_tree_store_new(DUPES_N_COLS, G_TYPE_STRING, G_TYPE_STRING);
+  for (guint i = 0; i < groups->len && i < DUPES_MAX_GROUPS; i++) {
+    GPtrArray *group = g_ptr_array_index(groups, i);
+    gchar *label = g_strdup_printf("%u similar notes", group->len);
+
+    gtk_tree_store_append(store, &iter, NULL);
+    gtk_tree_store_set(store, &iter, DUPES_COL_LABEL, label, -1);
+    for (guint j = 0; j < group->len; j++) {
+      GtkTreeIter child;
+      const gchar *path = g_ptr_array_index(group, j);
+      gchar *note_label = dupes_note_label(path);
+
+      gtk_tree_store_append(store, &child, &iter);
+      gtk_tree_store_set(store, &child, DUPES_COL_LABEL, note_label,
+                         DUPES_COL_PATH, path, -1);
+      g_free(note_label);
+    }
+    g_free(label);
+  }
+
+  dialog = gtk_dialog_new_with_buttons(
+      groups->len > 0 ? "Similar Notes" : "No Similar Notes",
+      GTK_WINDOW(self->window),
+      GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT, "_Close",
+      GTK_RESPONSE_CANCEL, "_Open", GTK_RESPONSE_OK, NULL);
+  gtk_window_set_default_size(GTK_WINDOW(dialog), 560, 420);
+  btn_open =
+      gtk_dialog_get_widget_for_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
+  gtk_widget_set_sensitive(btn_open, FALSE);
+
+  view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+  g_object_unref(store);
+  gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(view), FALSE);
+  gtk_tree_view_insert_column_with_attributes(
+      GTK_TREE_VIEW(view), -1, NULL, gtk_cell_renderer_text_new(), "text",
+      DUPES_COL_LABEL, NULL);
+  gtk_tree_view_expand_all(GTK_TREE_VIEW(view));
+  selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(view));
+  g_signal_connect(selection, "changed",
+                   G_CALLBACK(on_dupes_selection_changed), btn_open);
+  g_signal_connect(view, "row-activated", G_CALLBACK(on_dupes_row_activated),
+                   dialog);
+
+  scroll = gtk_scrolled_window_new(NULL, NULL);
+  gtk_widget_set_vexpand(scroll, TRUE);
+  gtk_container_add(GTK_CONTAINER(scroll), view);
+  content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+  gtk_box_pack_start(GTK_BOX(content_area), scroll, TRUE, TRUE, 0);
+
+  gtk_widget_show_all(dialog);
+  if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_OK &&
+      gtk_tree_selection_get_selected(selection, &model, &iter)) {
+    gtk_tree_model_get(model, &iter, DUPES_COL_PATH, &selected, -1);
+  }
+  gtk_widget_destroy(dialog);
+
+  for (guint i = 0; selected && i < self->app->note_paths->len; i++) {
+    if (g_strcmp0(g_ptr_array_index(self->app->note_paths, i), selected) ==
+        0) {
+      markyd_app_goto_note(self->app, (gint)i);
+      break;
+    }
+  }
+
+  g_free(selected);
+  g_ptr_array_free(groups, TRUE);
+}
+
+static gint grep_row_index(GtkListBoxRow *row) {
+  return GPOINTER_TO_INT(g_object_get_data(G_OBJECT(row), "grep-index"));
+}
+
+/* Keep results in note-list (mtime) order however they arrive */
+static gint grep_row_sort(GtkListBoxRow *a, GtkListBoxRow *b,
+                          gpointer user_data) {
+  (void)user_data;
+  return grep_row_index(a) - grep_row_index(b);
+}
+
+static void grep_set_status(MarkydWindow *self, const gchar *text) {
+  gtk_label_set_text(GTK_LABEL(self->grep_status), text);
+}
+
+static void on_grep_match(guint index, const gchar *path, const gchar *line,
+                          gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  GtkWidget *row;
+  GtkWidget *label;
+  gchar *name;
+  gchar *markup;
+  gchar *status;
+
+  if (self->grep_rows >= GREP_MAX_ROWS) {
+    GtkListBoxRow *last = gtk_list_box_get_row_at_index(
+        GTK_LIST_BOX(self->grep_list), (gint)self->grep_rows - 1);
+    if (!last || (gint)index > grep_row_index(last)) {
+      return;
+    }
+    gtk_widget_destroy(GTK_WIDGET(last));
+    self->grep_rows--;
+  }
+
+  name = g_path_get_basename(path);
+  markup = g_markup_printf_escaped("<b>%s</b>  %s", name, line);
+  label = gtk_label_new(NULL);
+  gtk_label_set_markup(GTK_LABEL(label), markup);
+  gtk_label_set_ellipsize(GTK_LABEL(label), PANGO_ELLIPSIZE_END);
+  gtk_widget_set_halign(label, GTK_ALIGN_START);
+  gtk_widget_set_margin_start(label, 6);
+  gtk_widget_set_margin_end(label, 6);
+  gtk_widget_set_margin_top(label, 2);
+  gtk_widget_set_margin_bottom(label, 2);
+
+  row = gtk_list_box_row_new();
+  gtk_container_add(GTK_CONTAINER(row), label);
+  g_object_set_data(G_OBJECT(row), "grep-index", GUINT_TO_POINTER(index));
+  g_object_set_data_full(G_OBJECT(row), "grep-path", g_strdup(path), g_free);
+  gtk_widget_show_all(row);
+  gtk_list_box_insert(GTK_LIST_BOX(self->grep_list), row, -1);
+  self->grep_rows++;
+
+  status = g_strdup_printf("%u…", self->grep_rows);
+  grep_set_status(self, status);
+
+  g_free(status);
+  g_free(markup);
+  g_free(name);
+}
+
+static void on_grep_done(guint matches, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  gchar *status = g_strdup_printf("%u %s", matches,
+                                  matches == 1 ? "note" : "notes");
+  grep_set_status(self, status);
+  g_free(status);
+}
+
+static void grep_stop(MarkydWindow *self) {
+  GList *rows;
+
+  if (self->grep) {
+    notes_grep_cancel(self->grep);
+    self->grep = NULL;
+  }
+  if (self->grep_search_cancellable) {
+    g_cancellable_cancel(self->grep_search_cancellable);
+    g_clear_object(&self->grep_search_cancellable);
+  }
+
+  if (self->grep_list) {
+    rows = gtk_container_get_children(GTK_CONTAINER(self->grep_list));
+    for (GList *l = rows; l; l = l->next) {
+      gtk_widget_destroy(GTK_WIDGET(l->data));
+    }
+    g_list_free(rows);
+  }
+  self->grep_rows = 0;
+}
+
+static void on_grep_searched(GObject *source, GAsyncResult *result,
+                             gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  GError *error = NULL;
+  GPtrArray *found = notes_search_finish(result, &error);
+  GHashTable *hits;
+  guint matches = 0;
+
+  (void)source;
+
+  if (!found) {
+    /* A cancel comes from grep_stop, maybe in markyd_window_free */
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      grep_set_status(self, error->message);
+      g_clear_object(&self->grep_search_cancellable);
+    }
+    g_error_free(error);
+    return;
+  }
+  g_clear_object(&self->grep_search_cancellable);
+
+  hits = g_hash_table_new(g_str_hash, g_str_equal);
+  for (guint i = 0; i < found->len; i++) {
+    g_hash_table_add(hits, g_ptr_array_index(found, i));
+  }
+  for (guint i = 0; i < self->app->note_paths->len; i++) {
+    const gchar *path = g_ptr_array_index(self->app->note_paths, i);
+    if (g_hash_table_contains(hits, path)) {
+      on_grep_match(i, path, "", self);
+      matches++;
+    }
+  }
+  on_grep_done(matches, self);
+  gtk_widget_show_all(self->grep_results);
+
+  g_hash_table_destroy(hits);
+  g_ptr_array_free(found, TRUE);
+}
+
+static void grep_search_index(MarkydWindow *self, const gchar *query) {
+  self->grep_search_cancellable = g_cancellable_new();
+  notes_search_async(query, self->grep_search_cancellable, on_grep_searched,
+                     self);
+  grep_set_status(self, "…");
+}
+
+/* Restart the search whenever the query or its options change. */
+static void on_grep_query_changed(GtkWidget *widget, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  const gchar *query = gtk_entry_get_text(GTK_ENTRY(self->grep_entry));
+  gboolean use_regex =
+      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self->grep_regex));
+  gboolean case_sensitive =
+      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self->grep_case));
+  GError *error = NULL;
+
+  (void)widget;
+
+  grep_stop(self);
+
+  if (!query || !*query) {
+    gtk_widget_hide(self->grep_results);
+    grep_set_status(self, "");
+    return;
+  }
+
+  /* Notes in a database can't be mapped; the FTS index answers plain
+   * queries, the scan (loading each note) the rest */
+  if (notes_get_backend() == MARKYD_NOTES_BACKEND_SQLITE && !use_regex &&
+      !case_sensitive) {
+    grep_search_index(self, query);
+    return;
+  }
+
+  self->grep = notes_grep_start(self->app->note_paths, query, use_regex,
+                                case_sensitive, on_grep_match, on_grep_done,
+                                self, &error);
+  if (!self->grep) {
+    grep_set_status(self, error ? error->message : "Invalid pattern");
+    g_clear_error(&error);
+    gtk_widget_hide(self->grep_results);
+    return;
+  }
+
+  grep_set_status(self, "…");
+  gtk_widget_show_all(self->grep_results);
+}
+
+static void on_grep_row_activated(GtkListBox *box, GtkListBoxRow *row,
+                                  gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  const gchar *path = g_object_get_data(G_OBJECT(row), "grep-path");
+
+  (void)box;
+
+  for (guint i = 0; i < self->app->note_paths->len; i++) {
+    if (g_strcmp0(g_ptr_array_index(self->app->note_paths, i), path) == 0) {
+      markyd_app_goto_note(self->app, (gint)i);
+      return;
+    }
+  }
+}
+
+static void on_grep_search_mode(GObject *object, GParamSpec *pspec,
+                                gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+
+  (void)pspec;
+
+  if (!gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(object))) {
+    grep_stop(self);
+    gtk_widget_hide(self->grep_results);
+    markyd_editor_focus(self->editor);
+  }
+}
+
+static void grep_toggle(MarkydWindow *self) {
+  GtkSearchBar *bar = GTK_SEARCH_BAR(self->grep_bar);
+  gboolean active = !gtk_search_bar_get_search_mode(bar);
+
+  gtk_search_bar_set_search_mode(bar, active);
+  if (active) {
+    gtk_widget_grab_focus(self->grep_entry);
+  }
+}
+
+static GtkWidget *grep_bar_new(MarkydWindow *self) {
+  GtkWidget *box;
+
+  box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+
+  self->grep_entry = gtk_search_entry_new();
+  gtk_entry_set_placeholder_text(GTK_ENTRY(self->grep_entry),
+                                 "Search all notes");
+  gtk_widget_set_hexpand(self->grep_entry, TRUE);
+  gtk_widget_set_size_request(self->grep_entry, 280, -1);
+  g_signal_connect(self->grep_entry, "search-changed",
+                   G_CALLBACK(on_grep_query_changed), self);
+  gtk_box_pack_start(GTK_BOX(box), self->grep_entry, TRUE, TRUE, 0);
+
+  self->grep_regex = gtk_toggle_button_new_with_label(".*");
+  gtk_widget_set_tooltip_text(self->grep_regex, "Regular Expression");
+  g_signal_connect(self->grep_regex, "toggled",
+                   G_CALLBACK(on_grep_query_changed), self);
+  gtk_box_pack_start(GTK_BOX(box), self->grep_regex, FALSE, FALSE, 0);
+
+  self->grep_case = gtk_toggle_button_new_with_label("Aa");
+  gtk_widget_set_tooltip_text(self->grep_case, "Match Case");
+  g_signal_connect(self->grep_case, "toggled",
+                   G_CALLBACK(on_grep_query_changed), self);
+  gtk_box_pack_start(GTK_BOX(box), self->grep_case, FALSE, FALSE, 0);
+
+  self->grep_status = gtk_label_new("");
+  gtk_box_pack_start(GTK_BOX(box), self->grep_status, FALSE, FALSE, 0);
+
+  self->grep_bar = gtk_search_bar_new();
+  gtk_search_bar_connect_entry(GTK_SEARCH_BAR(self->grep_bar),
+                               GTK_ENTRY(self->grep_entry));
+  gtk_search_bar_set_show_close_button(GTK_SEARCH_BAR(self->grep_bar), TRUE);
+  gtk_container_add(GTK_CONTAINER(self->grep_bar), box);
+  g_signal_connect(self->grep_bar, "notify::search-mode-enabled",
+                   G_CALLBACK(on_grep_search_mode), self);
+
+  /* Results list, shown only while a query is active */
+  self->grep_list = gtk_list_box_new();
+  gtk_list_box_set_sort_func(GTK_LIST_BOX(self->grep_list), grep_row_sort,
+                             NULL, NULL);
+  gtk_list_box_set_activate_on_single_click(GTK_LIST_BOX(self->grep_list),
+                                            TRUE);
+  g_signal_connect(self->grep_list, "row-activated",
+                   G_CALLBACK(on_grep_row_activated), self);
+
+  self->grep_results = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(self->grep_results),
+                                 GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+  gtk_widget_set_size_request(self->grep_results, -1, 180);
+  gtk_container_add(GTK_CONTAINER(self->grep_results), self->grep_list);
+
+  return self->grep_bar;
+}
+
+void markyd_window_set_find_status(MarkydWindow *self, guint matches,
+                                   gboolean done) {
+  gchar *text;
+
+  if (done) {
+    text = g_strdup_printf(matches == 1 ? "%u match" : "%u matches", matches);
+  } else {
+    text = g_strdup_printf("%u…", matches);
+  }
+  gtk_label_set_text(GTK_LABEL(self->find_status), text);
+  g_free(text);
+}
+
+static void on_find_query_changed(GtkWidget *widget, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  const gchar *query = gtk_entry_get_text(GTK_ENTRY(self->find_entry));
+  GError *error = NULL;
+
+  (void)widget;
+
+  if (!markyd_editor_find(
+          self->editor, query,
+          gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self->find_regex)),
+          gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self->find_case)),
+          &error)) {
+    gtk_label_set_text(GTK_LABEL(self->find_status),
+                       error ? error->message : "Invalid pattern");
+    g_clear_error(&error);
+    return;
+  }
+  if (!query || !*query) {
+    gtk_label_set_text(GTK_LABEL(self->find_status), "");
+  }
+}
+
+static void on_find_next(GtkWidget *widget, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  (void)widget;
+  markyd_editor_find_next(self->editor, FALSE);
+}
+
+static void on_find_previous(GtkWidget *widget, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  (void)widget;
+  markyd_editor_find_next(self->editor, TRUE);
+}
+
+static void on_replace_all_clicked(GtkButton *button, gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+  GError *error = NULL;
+  gint replaced;
+  gchar *text;
+
+  (void)button;
+
+  replaced = markyd_editor_replace_all(
+      self->editor, gtk_entry_get_text(GTK_ENTRY(self->find_replace)), &error);
+  if (replaced < 0) {
+    gtk_label_set_text(GTK_LABEL(self->find_status),
+                       error ? error->message : "Invalid replacement");
+    g_clear_error(&error);
+    return;
+  }
+  text = g_strdup_printf("%d replaced", replaced);
+  gtk_label_set_text(GTK_LABEL(self->find_status), text);
+  g_free(text);
+}
+
+static void on_find_search_mode(GObject *object, GParamSpec *pspec,
+                                gpointer user_data) {
+  MarkydWindow *self = (MarkydWindow *)user_data;
+
+  (void)pspec;
+
+  if (!gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(object))) {
+    markyd_editor_find(self->editor, NULL, FALSE, FALSE, NULL);
+    markyd_editor_focus(self->editor);
+  } else {
+    on_find_query_changed(NULL, self);
+  }
+}
+
+static void find_toggle(MarkydWindow *self) {
+  GtkSearchBar *bar = GTK_SEARCH_BAR(self->find_bar);
+  gboolean active = !gtk_search_bar_get_search_mode(bar);
+
+  gtk_search_bar_set_search_mode(bar, active);
+  if (active) {
+    gtk_widget_grab_focus(self->find_entry);
+  }
+}
+
+static GtkWidget *find_bar_new(MarkydWindow *self) {
+  GtkWidget *box;
+  GtkWidget *button;
+
+  box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+
+  /* Enter and Ctrl+G go to the next match, Ctrl+Shift+G to the previous */
+  self->find_entry = gtk_search_entry_new();
+  gtk_entry_set_placeholder_text(GTK_ENTRY(self->find_entry),
+                                 "Find in note");
+  gtk_widget_set_hexpand(self->find_entry, TRUE);
+  gtk_widget_set_size_request(self->find_entry, 200, -1);
+  g_signal_connect(self->find_entry, "search-changed",
+                   G_CALLBACK(on_find_query_changed), self);
+  g_signal_connect(self->find_entry, "activate", G_CALLBACK(on_find_next),
+                   self);
+  g_signal_connect(self->find_entry, "next-match", G_CALLBACK(on_find_next),
+                   self);
+  g_signal_connect(self->find_entry, "previous-match",
+                   G_CALLBACK(on_find_previous), self);
+  gtk_box_pack_start(GTK_BOX(box), self->find_entry, TRUE, TRUE, 0);
+
+  self->find_regex = gtk_toggle_button_new_with_label(".*");
+  gtk_widget_set_tooltip_text(self->find_regex, "Regular Expression");
+  g_signal_connect(self->find_regex, "toggled",
+                   G_CALLBACK(on_find_query_changed), self);
+  gtk_box_pack_start(GTK_BOX(box), self->find_regex, FALSE, FALSE, 0);
+
+  self->find_case = gtk_toggle_button_new_with_label("Aa");
+  gtk_widget_set_tooltip_text(self->find_case, "Match Case");
+  g_signal_connect(self->find_case, "toggled",
+                   G_CALLBACK(on_find_query_changed), self);
+  gtk_box_pack_start(GTK_BOX(box), self->find_case, FALSE, FALSE, 0);
+
+  self->find_replace = gtk_entry_new();
+  gtk_entry_set_placeholder_text(GTK_ENTRY(self->find_replace), "Replace with");
+  gtk_widget_set_size_request(self->find_replace, 160, -1);
+  gtk_box_pack_start(GTK_BOX(box), self->find_replace, TRUE, TRUE, 0);
+
+  button = gtk_button_new_with_label("Replace All");
+  g_signal_connect(button, "clicked", G_CALLBACK(on_replace_all_clicked),
+                   self);
+  gtk_box_pack_start(GTK_BOX(box), button, FALSE, FALSE, 0);
+
+  self->find_status = gtk_label_new("");
+  gtk_box_pack_start(GTK_BOX(box), self->find_status, FALSE, FALSE, 0);
+
+  self->find_bar = gtk_search_bar_new();
+  gtk_search_bar_connect_entry(GTK_SEARCH_BAR(self->find_bar),
+                               GTK_ENTRY(self->find_entry));
+  gtk_search_bar_set_show_close_button(GTK_SEARCH_BAR(self->find_bar), TRUE);
+  gtk_container_add(GTK_CONTAINER(self->find_bar), box);
+  g_signal_connect(self->find_bar, "notify::search-mode-enabled",
+                   G_CALLBACK(on_find_search_mode), self);
+
+  return self->find_bar;
+}
+
 static void on_prev_clicked(GtkButton *button, gpointer user_data) {
   MarkydWindow *self = (MarkydWindow *)user_data;
   (void)button;
@@ -387,7 +1563,52 @@ static gboolean on_key_press_event(GtkWidget *widget, GdkEventKey *event,
   MarkydWindow *self = (MarkydWindow *)user_data;
   (void)widget;
 
+  if (event && (event->state & GDK_CONTROL_MASK) &&
+      (event->state & GDK_SHIFT_MASK) &&
+      (event->keyval == GDK_KEY_F || event->keyval == GDK_KEY_f)) {
+    grep_toggle(self);
+    return TRUE;
+  }
+
+  if (event && (event->state & GDK_CONTROL_MASK) &&
+      !(event->state & GDK_SHIFT_MASK) &&
+      (event->keyval == GDK_KEY_F || event->keyval == GDK_KEY_f)) {
+    find_toggle(self);
+    return TRUE;
+  }
+
+  if (event && (event->state & GDK_CONTROL_MASK) &&
+      (event->state & GDK_SHIFT_MASK) &&
+      (event->keyval == GDK_KEY_D || event->keyval == GDK_KEY_d)) {
+    markyd_window_show_duplicates(self);
+    return TRUE;
+  }
+
+  if (event && (event->state & GDK_CONTROL_MASK) &&
+      (event->state & GDK_SHIFT_MASK) &&
+      (event->keyval == GDK_KEY_L || event->keyval == GDK_KEY_l)) {
+    latency_overlay_toggle(self);
+    return TRUE;
+  }
+
+  if (event && (event->state & GDK_CONTROL_MASK) &&
+      (event->state & GDK_SHIFT_MASK) &&
+      (event->keyval == GDK_KEY_O || event->keyval == GDK_KEY_o)) {
+    gtk_toggle_button_set_active(
+        GTK_TOGGLE_BUTTON(self->btn_outline),
+        !gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(self->btn_outline)));
+    return TRUE;
+  }
+
   if (event && event->keyval == GDK_KEY_Escape) {
+    if (gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(self->grep_bar))) {
+      gtk_search_bar_set_search_mode(GTK_SEARCH_BAR(self->grep_bar), FALSE);
+      return TRUE;
+    }
+    if (gtk_search_bar_get_search_mode(GTK_SEARCH_BAR(self->find_bar))) {
+      gtk_search_bar_set_search_mode(GTK_SEARCH_BAR(self->find_bar), FALSE);
+      return TRUE;
+    }
     markyd_window_close_to_tray(self);
     return TRUE;
   }
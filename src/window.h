@@ -5,6 +5,8 @@
 
 typedef struct _MarkydApp MarkydApp;
 typedef struct _MarkydEditor MarkydEditor;
+typedef struct _MarkydGrep MarkydGrep;
+typedef struct _MarkydDocStats MarkydDocStats;
 
 typedef struct _MarkydWindow {
   GtkWidget *window;
@@ -12,10 +14,52 @@ typedef struct _MarkydWindow {
   GtkWidget *btn_new;
   GtkWidget *btn_copy;
   GtkWidget *btn_delete;
+  GtkWidget *btn_history;
+  GtkWidget *btn_notebook;
   GtkWidget *btn_prev;
   GtkWidget *btn_next;
+  GtkWidget *btn_outline;
   GtkWidget *lbl_counter;
+  GtkWidget *lbl_stats; /* Words, characters, lines and reading time */
   GtkWidget *scroll;
+
+  /* Stack showing the editor scroll, or a placeholder while a note loads */
+  GtkWidget *editor_stack;
+  GtkWidget *loading_spinner;
+  guint loading_timeout_id;
+
+  /* Shown below the editor while a large paste or drop is inserted */
+  GtkWidget *insert_progress;
+
+  /* Editor latency percentiles over the editor (Ctrl+Shift+L) */
+  GtkWidget *latency_label;
+  guint latency_timeout_id; /* Refresh while shown, 0 when hidden */
+
+  /* Headings of the open note beside the editor (Ctrl+Shift+O) */
+  GtkWidget *outline;      /* Scrolled window around outline_list */
+  GtkWidget *outline_list;
+  GArray *outline_headings; /* MarkydHeading, one per row */
+
+  /* Find and replace in the open note (Ctrl+F) */
+  GtkWidget *find_bar;
+  GtkWidget *find_entry;
+  GtkWidget *find_replace;
+  GtkWidget *find_regex;
+  GtkWidget *find_case;
+  GtkWidget *find_status;
+
+  /* Grep all notes (Ctrl+Shift+F) */
+  GtkWidget *grep_bar;
+  GtkWidget *grep_entry;
+  GtkWidget *grep_regex;
+  GtkWidget *grep_case;
+  GtkWidget *grep_status;
+  GtkWidget *grep_results; /* Scrolled window around grep_list */
+  GtkWidget *grep_list;
+  MarkydGrep *grep;
+  GCancellable *grep_search_cancellable; /* FTS lookup in flight, or NULL */
+  guint grep_rows;
+
   MarkydEditor *editor;
   MarkydApp *app;
 } MarkydWindow;
@@ -35,7 +79,28 @@ void markyd_window_close_to_tray(MarkydWindow *win);
 void markyd_window_update_counter(MarkydWindow *win);
 void markyd_window_update_nav_sensitivity(MarkydWindow *win);
 
+/* Counts of the open note under the counter; NULL while they are taken */
+void markyd_window_update_stats(MarkydWindow *win, const MarkydDocStats *stats);
+
+/* Lock the editor while the current note loads; a placeholder replaces it
+ * if loading takes noticeably long */
+void markyd_window_set_loading(MarkydWindow *win, gboolean loading);
+
+/* Progress of a large paste or drop going into the editor; < 0 hides it */
+void markyd_window_set_insert_progress(MarkydWindow *win, gdouble fraction);
+
+/* Rebuild the outline from the headings of the last render; only rows that
+ * changed are touched */
+void markyd_window_update_outline(MarkydWindow *win, GArray *headings);
+
+/* Match count of the in-note search; done FALSE while it still runs */
+void markyd_window_set_find_status(MarkydWindow *win, guint matches,
+                                   gboolean done);
+
 /* Styling */
 void markyd_window_apply_css(MarkydWindow *win);
 
+/* Review groups of near-identical notes in the current notebook */
+void markyd_window_show_duplicates(MarkydWindow *win);
+
 #endif /* MARKYD_WINDOW_H */